@@ -0,0 +1,374 @@
+#ifndef ACCRUAL_OPS_H
+#define ACCRUAL_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// ./server --accrue [annual rate %] [fee] [minimum balance]
+// Nightly interest and fee run. Each shard's account file is streamed in chunks of
+// ACCRUAL_CHUNK records. The balances of a chunk are gathered into contiguous arrays
+// and run through a SIMD kernel. The chunk is then written back with one pwrite under
+// one byte range lock, and its log entries (one summary per changed account) go out
+// with one append. A running server's sessions just wait on the range lock for a few
+// milliseconds. Its lock free readers see the seqlock bumps.
+// Resuming: the checkpoint file records the next chunk of today's run. Before a chunk
+// is written, the journal records the chunk's balances before and after, plus where the
+// log ended (segment and size, see segment_ops.h). A run interrupted mid chunk redoes
+// only what is missing: balances still at their before value get the new one, and log
+// entries are written only for accounts that don't have today's entry yet. An account a
+// session changed in between is left alone. Running again once today's run finished
+// does nothing.
+
+#define ACCRUAL_CHECKPOINT_DB "accrual_checkpoint.dat"
+#define ACCRUAL_JOURNAL_DB "accrual_journal.dat"
+#define ACCRUAL_CHUNK 16384 // records per chunk, multiple of ACCRUAL_LANES
+#define ACCRUAL_LANES 4
+#define ACCRUAL_RATE 3.0f // percent a year
+#define ACCRUAL_FEE 1.0f // charged per day below the minimum balance
+#define ACCRUAL_MIN_BALANCE 100.0f
+
+typedef float AccrualVector __attribute__((vector_size(ACCRUAL_LANES * sizeof(float))));
+typedef int AccrualMask __attribute__((vector_size(ACCRUAL_LANES * sizeof(int))));
+
+struct AccrualCheckpoint {
+    int runDay; // yyyymmdd
+    int shard;
+    long long nextRecord;
+    int finished;
+};
+
+// followed by before, after, interest and fee arrays of count floats each
+struct AccrualJournal {
+    int runDay;
+    int shard;
+    long long startRecord;
+    int count;
+    int logSeqBefore;
+    long long logSizeBefore;
+};
+
+struct AccrualBatch {
+    struct AccountHolder records[ACCRUAL_CHUNK];
+    float before[ACCRUAL_CHUNK], after[ACCRUAL_CHUNK], interest[ACCRUAL_CHUNK], fees[ACCRUAL_CHUNK];
+    float active[ACCRUAL_CHUNK]; // 1 or 0, inactive accounts accrue nothing
+    char apply[ACCRUAL_CHUNK];   // recovery: record still needs the new balance
+    char logged[ACCRUAL_CHUNK];  // recovery: today's log entry already written
+    struct TransactionLog logs[ACCRUAL_CHUNK];
+};
+
+struct AccrualTotals {
+    long long accounts, changed, recovered, skipped;
+    double interest, fees;
+};
+
+void accrueBalances(const float *balances, const float *active, float *interest, float *fees, float *after,
+                    int count, float dailyRate, float fee, float minBalance);
+int accrueChunk(int dbFile, int checkpointFile, int journalFile, struct AccrualCheckpoint *checkpoint,
+                long long startRecord, int count, struct AccrualBatch *batch, struct AccrualTotals *totals,
+                float dailyRate, float fee, float minBalance);
+int runAccrual(int argc, char *argv[]);
+
+// interest rounded down to the cent, the fee capped so no balance goes below zero.
+// branch free, one vector of ACCRUAL_LANES accounts at a time
+void accrueBalances(const float *balances, const float *active, float *interest, float *fees, float *after,
+                    int count, float dailyRate, float fee, float minBalance)
+{
+    int i = 0;
+    for (; i + ACCRUAL_LANES <= count; i += ACCRUAL_LANES) {
+        AccrualVector balance, isActive;
+        memcpy(&balance, balances + i, sizeof(balance));
+        memcpy(&isActive, active + i, sizeof(isActive));
+
+        AccrualVector gained = __builtin_convertvector(__builtin_convertvector(balance * dailyRate * 100 * isActive, AccrualMask), AccrualVector) / 100;
+        AccrualMask below = balance < minBalance;
+        AccrualVector charged = (AccrualVector)((AccrualMask)(isActive * fee) & below);
+        AccrualVector available = balance + gained;
+        AccrualMask overdrawn = charged > available;
+        charged = (AccrualVector)(((AccrualMask)charged & ~overdrawn) | ((AccrualMask)available & overdrawn));
+
+        AccrualVector result = available - charged;
+        memcpy(interest + i, &gained, sizeof(gained));
+        memcpy(fees + i, &charged, sizeof(charged));
+        memcpy(after + i, &result, sizeof(result));
+    }
+    for (; i < count; i++) { // tail, same arithmetic
+        float gained = (int)(balances[i] * dailyRate * 100 * active[i]) / 100.0f;
+        float charged = balances[i] < minBalance ? fee * active[i] : 0;
+        if (charged > balances[i] + gained) charged = balances[i] + gained;
+        interest[i] = gained;
+        fees[i] = charged;
+        after[i] = balances[i] + gained - charged;
+    }
+}
+
+static int writeAccrualCheckpoint(int checkpointFile, struct AccrualCheckpoint *checkpoint)
+{
+    if (pwrite(checkpointFile, checkpoint, sizeof(*checkpoint), 0) != sizeof(*checkpoint) || fdatasync(checkpointFile) == -1) {
+        perror("Accrual: checkpoint write failed");
+        return 0;
+    }
+    return 1;
+}
+
+static int writeAccrualJournal(int journalFile, struct AccrualJournal *journal, struct AccrualBatch *batch)
+{
+    size_t arraySize = journal->count * sizeof(float);
+    off_t at = sizeof(*journal);
+    if (pwrite(journalFile, journal, sizeof(*journal), 0) != sizeof(*journal) ||
+        pwrite(journalFile, batch->before, arraySize, at) != (ssize_t)arraySize ||
+        pwrite(journalFile, batch->after, arraySize, at + arraySize) != (ssize_t)arraySize ||
+        pwrite(journalFile, batch->interest, arraySize, at + 2 * arraySize) != (ssize_t)arraySize ||
+        pwrite(journalFile, batch->fees, arraySize, at + 3 * arraySize) != (ssize_t)arraySize ||
+        fdatasync(journalFile) == -1) {
+        perror("Accrual: journal write failed");
+        return 0;
+    }
+    return 1;
+}
+
+// the journal of the chunk starting at startRecord, if the last run died in the middle of it
+static int readAccrualJournal(int journalFile, struct AccrualJournal *journal, struct AccrualBatch *batch,
+                              int runDay, int shard, long long startRecord, int count)
+{
+    size_t arraySize = count * sizeof(float);
+    off_t at = sizeof(*journal);
+    return pread(journalFile, journal, sizeof(*journal), 0) == sizeof(*journal) &&
+           journal->runDay == runDay && journal->shard == shard && journal->startRecord == startRecord &&
+           journal->count == count &&
+           pread(journalFile, batch->before, arraySize, at) == (ssize_t)arraySize &&
+           pread(journalFile, batch->after, arraySize, at + arraySize) == (ssize_t)arraySize &&
+           pread(journalFile, batch->interest, arraySize, at + 2 * arraySize) == (ssize_t)arraySize &&
+           pread(journalFile, batch->fees, arraySize, at + 3 * arraySize) == (ssize_t)arraySize;
+}
+
+// which accounts of the chunk already have today's entry in the log written since the
+// journal's log position, which may have been sealed since
+static void markAccrualLogged(struct AccrualJournal *journal, int runDay, int count, struct AccrualBatch *batch)
+{
+    struct TransactionLog entry;
+    struct LogSegmentSet segments;
+    int day, next = 0;
+    for (int i = 0; i < count; i++) batch->logged[i] = batch->after[i] == batch->before[i];
+    if (!loadLogSegments(journal->shard, &segments)) return;
+
+    // the run appends a chunk's entries in record order, sessions' entries in between don't match
+    for (int index = 0; index < segments.count && next < count; index++) {
+        if (segments.segments[index].seq < journal->logSeqBefore) continue;
+        int logFile = openLogSegment(&segments, index);
+        if (logFile == -1) continue;
+        off_t end = segments.segments[index].records * sizeof(entry);
+        off_t at = segments.segments[index].seq == journal->logSeqBefore ? journal->logSizeBefore : 0;
+        for (; next < count && at < end && pread(logFile, &entry, sizeof(entry), at) == sizeof(entry); at += sizeof(entry)) {
+            if (sscanf(entry.logEntry, "Accrual %d:", &day) != 1 || day != runDay) continue;
+            while (next < count && batch->records[next].accountID != entry.accountID) next++;
+            if (next < count) batch->logged[next++] = 1;
+        }
+        close(logFile);
+    }
+    freeLogSegments(&segments);
+}
+
+// one chunk: compute (or recover), write back, log, checkpoint. 0 on an I/O failure
+int accrueChunk(int dbFile, int checkpointFile, int journalFile, struct AccrualCheckpoint *checkpoint,
+                long long startRecord, int count, struct AccrualBatch *batch, struct AccrualTotals *totals,
+                float dailyRate, float fee, float minBalance)
+{
+    struct AccrualJournal journal;
+    off_t offset = startRecord * sizeof(struct AccountHolder);
+    size_t chunkSize = count * sizeof(struct AccountHolder);
+    int shard = checkpoint->shard, written = 0, done = 0;
+
+    struct flock lock = {F_WRLCK, SEEK_SET, offset, chunkSize, getpid()};
+    if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
+        perror("Accrual: Failed to lock chunk");
+        return 0;
+    }
+    if (pread(dbFile, batch->records, chunkSize, offset) != (ssize_t)chunkSize) {
+        perror("Accrual: chunk read failed");
+        goto accrual_unlock;
+    }
+
+    int recovering = readAccrualJournal(journalFile, &journal, batch, checkpoint->runDay, shard, startRecord, count);
+    if (recovering) {
+        markAccrualLogged(&journal, checkpoint->runDay, count, batch);
+        for (int i = 0; i < count; i++) {
+            float balance = batch->records[i].currentBalance;
+            batch->apply[i] = balance == batch->before[i] && batch->after[i] != batch->before[i];
+            // neither value: a session changed it since, the accrual may or may not be in it
+            if (balance != batch->before[i] && balance != batch->after[i]) {
+                batch->apply[i] = 0;
+                batch->logged[i] = 1;
+                totals->skipped++;
+            }
+            if (batch->apply[i]) totals->recovered++;
+        }
+    } else {
+        // a hot account's pending credits go into its record first, so the interest and
+        // the minimum balance check see the whole balance. the range lock keeps the flusher out
+        if (getHotRegion() != NULL) {
+            for (int i = 0; i < count; i++) {
+                if (findHotAccount(batch->records[i].accountID) == NULL) continue;
+                applyHotCredits(dbFile, offset + i * sizeof(struct AccountHolder), &batch->records[i]);
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            batch->before[i] = batch->records[i].currentBalance;
+            batch->active[i] = batch->records[i].isActive == 1;
+        }
+        accrueBalances(batch->before, batch->active, batch->interest, batch->fees, batch->after, count, dailyRate, fee, minBalance);
+        for (int i = 0; i < count; i++) {
+            batch->apply[i] = batch->after[i] != batch->before[i];
+            batch->logged[i] = !batch->apply[i]; // nothing to log for an untouched account
+        }
+
+        journal.runDay = checkpoint->runDay;
+        journal.shard = shard;
+        journal.startRecord = startRecord;
+        journal.count = count;
+        int logFile = lockHistory(shard);
+        if (logFile == -1) {
+            perror("Accrual: log unavailable");
+            goto accrual_unlock;
+        }
+        journal.logSeqBefore = activeLogSeq(shard);
+        journal.logSizeBefore = lseek(logFile, 0, SEEK_END);
+        unlockHistory(logFile);
+        if (!writeAccrualJournal(journalFile, &journal, batch)) goto accrual_unlock;
+    }
+
+    // balances
+    for (int i = 0; i < count; i++) {
+        if (!batch->apply[i]) continue;
+        batch->records[i].currentBalance = batch->after[i];
+        beginAccountWrite(shard, offset + i * sizeof(struct AccountHolder));
+    }
+    written = pwrite(dbFile, batch->records, chunkSize, offset) == (ssize_t)chunkSize;
+    for (int i = 0; i < count; i++) {
+        if (batch->apply[i]) endAccountWrite(shard, offset + i * sizeof(struct AccountHolder));
+    }
+    if (!written) {
+        perror("Accrual: chunk write failed");
+        goto accrual_unlock;
+    }
+    shipRecord(REPL_FILE_ACCOUNT, shard, offset, batch->records, chunkSize); // the range lock covers the whole chunk
+
+    // one summary entry per changed account
+    int logCount = 0;
+    time_t now = time(NULL);
+    struct tm *localTime = localtime(&now);
+    for (int i = 0; i < count; i++) {
+        if (batch->logged[i]) continue;
+        struct TransactionLog *log = &batch->logs[logCount++];
+        log->accountID = batch->records[i].accountID;
+        memset(log->logEntry, 0, sizeof(log->logEntry));
+        snprintf(log->logEntry, sizeof(log->logEntry), "Accrual %d: interest %.2f, fee %.2f, balance %.2f at %02d:%02d:%02d %d-%d-%d\n",
+                 checkpoint->runDay, batch->interest[i], batch->fees[i], batch->after[i], localTime->tm_hour,
+                 localTime->tm_min, localTime->tm_sec, localTime->tm_year + 1900, localTime->tm_mon + 1, localTime->tm_mday);
+        totals->interest += batch->interest[i];
+        totals->fees += batch->fees[i];
+    }
+    int logFile = -1;
+    if (logCount > 0) {
+        logFile = lockHistory(shard);
+        int logged = logFile != -1 && appendTransactionLogs(logFile, batch->logs, logCount);
+        if (logFile != -1) unlockHistory(logFile);
+        if (!logged) goto accrual_unlock;
+    }
+    if (fdatasync(dbFile) == -1 || (logFile != -1 && fdatasync(logFile) == -1)) {
+        perror("Accrual: sync failed");
+        goto accrual_unlock;
+    }
+
+    totals->accounts += count;
+    totals->changed += logCount;
+    checkpoint->nextRecord = startRecord + count;
+    done = writeAccrualCheckpoint(checkpointFile, checkpoint);
+
+accrual_unlock:
+    lock.l_type = F_UNLCK;
+    fcntl(dbFile, F_SETLK, &lock);
+    return done;
+}
+
+int runAccrual(int argc, char *argv[])
+{
+    struct AccrualCheckpoint checkpoint;
+    struct AccrualTotals totals;
+    struct timespec started, finished;
+    struct stat st;
+
+    float rate = argc > 2 ? atof(argv[2]) : ACCRUAL_RATE;
+    float fee = argc > 3 ? atof(argv[3]) : ACCRUAL_FEE;
+    float minBalance = argc > 4 ? atof(argv[4]) : ACCRUAL_MIN_BALANCE;
+    float dailyRate = rate / 100 / 365;
+
+    time_t now = time(NULL);
+    struct tm *localTime = localtime(&now);
+    int today = (localTime->tm_year + 1900) * 10000 + (localTime->tm_mon + 1) * 100 + localTime->tm_mday;
+
+    int checkpointFile = open(ACCRUAL_CHECKPOINT_DB, O_RDWR | O_CREAT, 0644);
+    int journalFile = open(ACCRUAL_JOURNAL_DB, O_RDWR | O_CREAT, 0644);
+    struct AccrualBatch *batch = malloc(sizeof(struct AccrualBatch));
+    if (checkpointFile == -1 || journalFile == -1 || batch == NULL) {
+        perror("Accrual: setup failed");
+        return EXIT_FAILURE;
+    }
+
+    if (pread(checkpointFile, &checkpoint, sizeof(checkpoint), 0) != sizeof(checkpoint) || checkpoint.runDay != today) {
+        memset(&checkpoint, 0, sizeof(checkpoint));
+        checkpoint.runDay = today;
+    } else if (checkpoint.finished) {
+        printf("Accrual: already ran for %d\n", today);
+        return EXIT_SUCCESS;
+    } else {
+        printf("Accrual: resuming %d at shard %d, record %lld\n", today, checkpoint.shard, checkpoint.nextRecord);
+    }
+
+    attachServerHotAccounts();
+    printf("Accrual: %d at %.2f%% a year, fee %.2f below %.2f\n", today, rate, fee, minBalance);
+    memset(&totals, 0, sizeof(totals));
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    for (; checkpoint.shard < ACCOUNT_SHARDS; checkpoint.shard++, checkpoint.nextRecord = 0) {
+        int dbFile = openShardFile(ACCOUNT_DB, checkpoint.shard, O_RDWR);
+        if (dbFile == -1) continue; // shard without accounts
+        if (fstat(dbFile, &st) == -1) {
+            perror("Accrual: Failed to open shard");
+            return EXIT_FAILURE;
+        }
+
+        long long records = st.st_size / sizeof(struct AccountHolder);
+        while (checkpoint.nextRecord < records) {
+            long long left = records - checkpoint.nextRecord;
+            int count = left < ACCRUAL_CHUNK ? left : ACCRUAL_CHUNK;
+            if (!accrueChunk(dbFile, checkpointFile, journalFile, &checkpoint, checkpoint.nextRecord, count,
+                             batch, &totals, dailyRate, fee, minBalance)) {
+                printf("Accrual: stopped at shard %d, record %lld. Run again to resume.\n", checkpoint.shard, checkpoint.nextRecord);
+                return EXIT_FAILURE;
+            }
+        }
+        close(dbFile);
+    }
+
+    checkpoint.finished = 1;
+    writeAccrualCheckpoint(checkpointFile, &checkpoint);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    printf("Accrual: %lld accounts in %.2f s, %lld changed, interest %.2f, fees %.2f\n",
+           totals.accounts, seconds, totals.changed, totals.interest, totals.fees);
+    if (totals.recovered > 0 || totals.skipped > 0) {
+        printf("Accrual: %lld balances finished from the interrupted run, %lld changed since and left alone\n",
+               totals.recovered, totals.skipped);
+    }
+    free(batch);
+    return EXIT_SUCCESS;
+}
+
+#endif
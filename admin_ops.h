@@ -21,68 +21,49 @@ void handleAdminSession(int clientSocket);
 
 // --- Function Definitions ---
 
+// caller holds the employee file lock, or is only checking early
+static int employeeIDTaken(int dbFile, int employeeID)
+{
+    struct Employee tempEmployee;
+    lseek(dbFile, 0, SEEK_SET); // Go to start
+    while(read(dbFile, &tempEmployee, sizeof(tempEmployee)) == sizeof(tempEmployee)) { 
+        if (tempEmployee.employeeID == employeeID) return 1;
+    }
+    return 0;
+}
+
 int createNewEmployee(int clientSocket)
 {
-    struct Employee employee, tempEmployee; 
+    struct Employee employee; 
     
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "Enter Employee ID: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
         printf("Client disconnected during employee ID entry.\n"); return 0;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; // Sanitize
     employee.employeeID = atoi(inBuffer);
 
     // -duplicate employee check 
-    int dbFile = open(EMPLOYEE_DB, O_RDWR | O_CREAT, 0644);
+    int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0);
     if(dbFile == -1) {
         perror("CreateEmployee: Error opening Employee DB");
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return 0; 
     }
+    // unlocked, so the admin hears about it before typing the rest; checked again under the lock
+    if (employeeIDTaken(dbFile, employee.employeeID)) goto createemployee_duplicate;
 
-    // xclusive lock file 
-    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
-    if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
-        perror("CreateEmployee: Failed to lock Employee DB");
-        close(dbFile);
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        return 0; // Indicate failure
-    }
-
-    int duplicateFound = 0;
-    lseek(dbFile, 0, SEEK_SET); // Go to start
-    while(read(dbFile, &tempEmployee, sizeof(tempEmployee)) == sizeof(tempEmployee)) { 
-        if (tempEmployee.employeeID == employee.employeeID) {
-            duplicateFound = 1;
-            break;
-        }
-    }
-
-    if (duplicateFound) {
-        //release lock
-        lock.l_type = F_UNLCK;
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
-
-        bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "Employee ID already exists. Please try again.^");
-        write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
-        return 0;
-    }
-    // duplicate check end
-
+    // all the prompts first, the file lock is only held for the re-check and the append
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "Enter FirstName: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected during first name entry.\n"); goto createemployee_unlock_fail;
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Client disconnected during first name entry.\n"); return 0;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     strncpy(employee.firstName, inBuffer, sizeof(employee.firstName) - 1);
@@ -92,8 +73,8 @@ int createNewEmployee(int clientSocket)
     strcpy(outBuffer, "Enter LastName: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected during last name entry.\n"); goto createemployee_unlock_fail;
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Client disconnected during last name entry.\n"); return 0;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     strncpy(employee.lastName, inBuffer, sizeof(employee.lastName) - 1);
@@ -103,28 +84,45 @@ int createNewEmployee(int clientSocket)
     strcpy(outBuffer, "Enter Password: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected during password entry.\n"); goto createemployee_unlock_fail;
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Client disconnected during password entry.\n"); return 0;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-    strncpy(employee.password, inBuffer, sizeof(employee.password) - 1);
-    employee.password[sizeof(employee.password) - 1] = '\0';
+    inBuffer[sizeof(employee.password) - 1] = '\0';
+    hashPassword(inBuffer, employee.password); // before the lock, it is the slow part
     employee.roleType = 1; // default 1 -> employee
 
-    lseek(dbFile, 0, SEEK_END);
-    write(dbFile, &employee, sizeof(employee));
+    // xclusive lock file 
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
+        perror("CreateEmployee: Failed to lock Employee DB");
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return 0; // Indicate failure
+    }
+
+    if (employeeIDTaken(dbFile, employee.employeeID)) { // added while we were asking
+        lock.l_type = F_UNLCK;
+        fcntl(dbFile, F_SETLK, &lock);
+        goto createemployee_duplicate;
+    }
+
+    off_t employeeOffset = lseek(dbFile, 0, SEEK_END);
+    if (write(dbFile, &employee, sizeof(employee)) == sizeof(employee))
+        shipRecord(REPL_FILE_EMPLOYEE, 0, employeeOffset, &employee, sizeof(employee));
     // release lock
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
 
+    setLoanOfficer(employee.employeeID, 1);
     printf("Admin added employee ID: %d\n", employee.employeeID);
     return 1; 
 
-createemployee_unlock_fail: // unlock file if client disconnects midway
-    lock.l_type = F_UNLCK;
-    fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+createemployee_duplicate:
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Employee ID already exists. Please try again.^");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    readClient(clientSocket, inBuffer, 3); // ack
     return 0;
 }
 
@@ -132,66 +130,56 @@ void modifyUser(int clientSocket, int modifyType)
 {
     if(modifyType == 1) // customer
     {
-        int dbFile = open(ACCOUNT_DB, O_RDWR);
-        if(dbFile == -1) {
-             perror("Modify customer: error opening DB");
-              bzero(outBuffer, sizeof(outBuffer));
-             strcpy(outBuffer, "DB error.^");
-             write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-             return;
-         }
-
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Enter Account Number: ");
         write(clientSocket, outBuffer, strlen(outBuffer));
 
         int accountID;
         bzero(inBuffer, sizeof(inBuffer));
-        if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(dbFile); return; }
+        if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
         inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
         accountID = atoi(inBuffer);
 
+        int dbFile = accountHandle(accountID);
+        if(dbFile == -1) {
+             perror("Modify customer: error opening DB");
+              bzero(outBuffer, sizeof(outBuffer));
+             strcpy(outBuffer, "DB error.^");
+             write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+             return;
+         }
+
         struct AccountHolder account;
-        int offset = -1;
-        off_t currentPos = 0;
-        lseek(dbFile, 0, SEEK_SET);
-        while (read(dbFile, &account, sizeof(account)) > 0)
-        {
-            currentPos = lseek(dbFile, 0, SEEK_CUR) - sizeof(account);
-            if(account.accountID == accountID) {
-                offset = currentPos;// where account info is in file
-                break;
-            }
-        }
+        off_t offset = findAccountOffset(dbFile, accountID); // where account info is in file
 
         if(offset == -1) {
             bzero(outBuffer, sizeof(outBuffer));
             strcpy(outBuffer, "Account not found.^");
-            write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-            close(dbFile);
-             return;
-        }
-
-        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
-        if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
-             perror("cust modifu: Lock failed"); close(dbFile);
-             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-             write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
              return;
         }
 
+        // ask first, the lock is only held for the re-read and write
         char newName[50];
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Enter New Name: ");
         write(clientSocket, outBuffer, strlen(outBuffer));
         bzero(inBuffer, sizeof(inBuffer));
-        if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-             printf("Client disconnected during name entry.\n"); goto modifycust_unlock_fail;
+        if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+             printf("Client disconnected during name entry.\n"); return;
         }
         inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
         strncpy(newName, inBuffer, sizeof(newName) - 1);
         newName[sizeof(newName)-1] = '\0';
 
+        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+        if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
+             perror("cust modifu: Lock failed");
+             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
+             write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+             return;
+        }
+
         // Re-read before write
         lseek(dbFile, offset, SEEK_SET);
          if (read(dbFile, &account, sizeof(account)) != sizeof(account)) {
@@ -202,33 +190,30 @@ void modifyUser(int clientSocket, int modifyType)
         account.holderName[sizeof(account.holderName) -1] = '\0';
 
 
-        lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &account, sizeof(account));
+        writeAccountRecord(dbFile, offset, &account);
 
         lock.l_type = F_UNLCK;
         fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
 
         printf("Admin/employee modified name for account %d\n", accountID);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Customer name updated.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return; 
 
     modifycust_unlock_fail: // cleanup on error
         lock.l_type = F_UNLCK;
         fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
         return; 
     }
     else if(modifyType == 2) // emp
     {
         struct Employee employee;
-        int dbFile = open(EMPLOYEE_DB, O_RDWR);
+        int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0);
         if(dbFile == -1) {
             perror("Modify employee: Error opening DB");
             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-            write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
              return;
         }
 
@@ -238,7 +223,7 @@ void modifyUser(int clientSocket, int modifyType)
 
         int employeeID;
         bzero(inBuffer, sizeof(inBuffer));
-         if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(dbFile); return; }
+         if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
         inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
         employeeID = atoi(inBuffer);
 
@@ -256,31 +241,31 @@ void modifyUser(int clientSocket, int modifyType)
 
         if(offset == -1) {
              bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "employee ID not found.^");
-             write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-             close(dbFile);
+             write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
              return;
          }
 
-        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct Employee), getpid()};
-        if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
-            perror("Modify employee: locking failed"); close(dbFile);
-             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-            write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-            return;
-        }
-
+        // ask first, the lock is only held for the re-read and write
         char newFirstName[50];
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Enter New First Name: ");
         write(clientSocket, outBuffer, strlen(outBuffer));
         bzero(inBuffer, sizeof(inBuffer));
-         if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-             printf("Client disconnected during employee name entry.\n"); goto modifyemployee_unlock_fail;
+         if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+             printf("Client disconnected during employee name entry.\n"); return;
          }
         inBuffer[strcspn(inBuffer, "\r\n")] = 0; // Sanitize
         strncpy(newFirstName, inBuffer, sizeof(newFirstName) - 1);
         newFirstName[sizeof(newFirstName)-1] = '\0';
 
+        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct Employee), getpid()};
+        if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
+            perror("Modify employee: locking failed");
+             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+            return;
+        }
+
         lseek(dbFile, offset, SEEK_SET);
          if (read(dbFile, &employee, sizeof(employee)) != sizeof(employee)) {
              perror("Modify employee: Re-read failed"); goto modifyemployee_unlock_fail;
@@ -291,37 +276,36 @@ void modifyUser(int clientSocket, int modifyType)
 
 
         lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &employee, sizeof(employee));
+        if (write(dbFile, &employee, sizeof(employee)) == sizeof(employee))
+            shipRecord(REPL_FILE_EMPLOYEE, 0, offset, &employee, sizeof(employee));
 
         lock.l_type = F_UNLCK;
         fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
 
         printf("Admin modified name for employee %d\n", employeeID);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "employee name updated.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return; 
 
     modifyemployee_unlock_fail: // cleanup error
         lock.l_type = F_UNLCK;
         fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
         return;
     } else {
         // invalid option
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid modification type.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
     }
 }
 
 void updateEmployeeRole(int clientSocket)
 {
-    int dbFile = open(EMPLOYEE_DB, O_RDWR); 
+    int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0);
     if(dbFile == -1) {
         perror("UpdateRole: Error opening employee DB");
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
@@ -331,7 +315,7 @@ void updateEmployeeRole(int clientSocket)
 
     int employeeID;
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(dbFile); return; }
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     employeeID = atoi(inBuffer);
 
@@ -352,17 +336,30 @@ void updateEmployeeRole(int clientSocket)
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Invalid employee ID^");
         write(clientSocket, outBuffer, strlen(outBuffer)); 
-        read(clientSocket, inBuffer, 3);
-        close(dbFile);
+        readClient(clientSocket, inBuffer, 3);
         return;
     }
 
+    // show the current role from the scan, ask, then lock only to apply
+    int choice;
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "employee %d is currently %s.\n[0] Make Manager\n[1] Make Employee\nChoice: ",
+            employeeID, (employee.roleType == 0) ? "Manager" : "Employee");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Cleint disconnected during role choice.\n"); return;
+    }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
+    choice = atoi(inBuffer);
+
     // locking
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct Employee), getpid()};
     if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
-         perror("UpdateRole: Lock failed"); close(dbFile);
+         perror("UpdateRole: Lock failed");
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
          return;
     }
 
@@ -372,19 +369,6 @@ void updateEmployeeRole(int clientSocket)
         perror("UpdateRole: Re-read failed"); goto updaterole_unlock_fail;
     }
 
-    int choice;
-    bzero(outBuffer, sizeof(outBuffer));
-    sprintf(outBuffer, "employee %d is currently %s.\n[0] Make Manager\n[1] Make Employee\nChoice: ",
-            employeeID, (employee.roleType == 0) ? "Manager" : "Employee");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-
-    bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Cleint disconnected during role choice.\n"); goto updaterole_unlock_fail;
-    }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
-    choice = atoi(inBuffer);
-
     int roleChanged = 0;
     if(choice == 0 && employee.roleType != 0) {
         employee.roleType = 0; // manager
@@ -396,7 +380,8 @@ void updateEmployeeRole(int clientSocket)
 
     if (roleChanged) { //success
         lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &employee, sizeof(employee));
+        if (write(dbFile, &employee, sizeof(employee)) == sizeof(employee))
+            shipRecord(REPL_FILE_EMPLOYEE, 0, offset, &employee, sizeof(employee));
         printf("Admin changed role for employee %d to %s\n", employeeID, (employee.roleType == 0 ? "Manager" : "Employee"));
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Role updated.^");
@@ -408,15 +393,18 @@ void updateEmployeeRole(int clientSocket)
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+    if (roleChanged) {
+        setLoanOfficer(employeeID, employee.roleType == 1); // a new manager's loans go to other officers
+        revokeSessionsFor(SESSION_EMPLOYEE, employeeID); // the old role's sessions can't be resumed
+        revokeSessionsFor(SESSION_MANAGER, employeeID);
+    }
 
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
     return; 
 
 updaterole_unlock_fail: // cleanup on error
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
     return; 
 }
 
@@ -428,18 +416,18 @@ void changeAdminPassword(int clientSocket)
     write(clientSocket, outBuffer, strlen(outBuffer));
 
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
         printf("Client disconnected during admin password entry.\n"); return;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-    strncpy(newPassword, inBuffer, sizeof(newPassword) - 1);
-    newPassword[sizeof(newPassword) - 1] = '\0';
+    inBuffer[sizeof(newPassword) - 1] = '\0';
+    hashPassword(inBuffer, newPassword);
 
     int passFile = open(ADMIN_PASS_DB, O_WRONLY | O_TRUNC | O_CREAT, 0644);
     if (passFile == -1) {
         perror("Admin change pass: File write error");
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error changing password (file write).^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
@@ -448,13 +436,14 @@ void changeAdminPassword(int clientSocket)
         perror("Admin change pass: Lock error");
         close(passFile);
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error changing password (lock fail).^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
     size_t len_to_write = strlen(newPassword);
     if (len_to_write > sizeof(newPassword) - 1) len_to_write = sizeof(newPassword) -1; // bug fix - don't write anything more 
-    write(passFile, newPassword, len_to_write + 1); // +1 for '\0'
+    if (write(passFile, newPassword, len_to_write + 1) == (ssize_t)(len_to_write + 1)) // +1 for '\0'
+        shipRecord(REPL_FILE_ADMIN_PASS, 0, 0, newPassword, len_to_write + 1);
 
     lock.l_type = F_UNLCK;
     fcntl(passFile, F_SETLK, &lock);
@@ -463,20 +452,22 @@ void changeAdminPassword(int clientSocket)
     printf("Admin password changed.\n");
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "Admin password changed successfully.^");
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
 }
 
 // admin menu handler
 void handleAdminSession(int clientSocket)
 {
     char password_input[51];
+    int resumedAdmin;
 label_admin_login:
+    if (takeResumedSession(SESSION_ADMIN, &resumedAdmin)) goto admin_logged_in;
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "Enter admin password: "); 
     write(clientSocket, outBuffer, strlen(outBuffer));
 
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
         printf("Client disconnected during admin login.\n"); return;
     }
     // sanitize
@@ -518,8 +509,9 @@ label_admin_login:
                  if (passFile != -1) {
                      struct flock writeLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
                      if (fcntl(passFile, F_SETLKW, &writeLock) != -1) {
-                         strcpy(storedPassword, DEFAULT_ADMIN_PASS);
-                         write(passFile, storedPassword, strlen(storedPassword) + 1);
+                         hashPassword(DEFAULT_ADMIN_PASS, storedPassword);
+                         if (write(passFile, storedPassword, strlen(storedPassword) + 1) == (ssize_t)(strlen(storedPassword) + 1))
+                             shipRecord(REPL_FILE_ADMIN_PASS, 0, 0, storedPassword, strlen(storedPassword) + 1);
                          writeLock.l_type = F_UNLCK;
                          fcntl(passFile, F_SETLK, &writeLock);
                          printf("Admin password file initialized.\n");
@@ -534,7 +526,7 @@ label_admin_login:
                  }
             }
              // check password 
-            if(strcmp(ADMIN_USER, "admin") == 0 && strcmp(storedPassword, password_input) == 0) {
+            if(strcmp(ADMIN_USER, "admin") == 0 && checkCredentials(LOGIN_ADMIN, 0, password_input, storedPassword)) {
                 loggedIn = 1;
             }
         }
@@ -543,18 +535,20 @@ label_admin_login:
 
 
     if(loggedIn) {
+        enterClientState(CLIENT_STATE_SESSION);
         bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "\nAdmin Login Successfully^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+        if (issueSessionToken(SESSION_ADMIN, 0)) sprintf(outBuffer, "\nAdmin Login Successfully\nSession token: %s^", sessionToken);
+        else strcpy(outBuffer, "\nAdmin Login Successfully^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
     }
     else{
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "\nInvalid credential^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
         goto label_admin_login;
     }
 
-    //logged in -> admin menu loop
+admin_logged_in: //logged in -> admin menu loop
     while(1)
     {
         int modifyType, choice;
@@ -564,7 +558,7 @@ label_admin_login:
         write(clientSocket, outBuffer, strlen(outBuffer));
 
         bzero(inBuffer, sizeof(inBuffer));
-        if (read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
             printf("Admin client disconnected.\n"); return; // if client disconnects
         }
         inBuffer[strcspn(inBuffer, "\r\n")] = 0;
@@ -578,7 +572,7 @@ label_admin_login:
                 } else {
                     strcpy(outBuffer, "^"); // empty ack
                 }
-                write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+                write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
                 break;
             case 2: // modify emp
                 bzero(outBuffer, sizeof(outBuffer));
@@ -586,7 +580,7 @@ label_admin_login:
                 write(clientSocket, outBuffer, strlen(outBuffer));
 
                 bzero(inBuffer, sizeof(inBuffer));
-                 if (read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+                 if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
                      printf("Admin client disconnected.\n"); return;
                  }
                  inBuffer[strcspn(inBuffer, "\r\n")] = 0;
@@ -602,14 +596,15 @@ label_admin_login:
                 break;
             case 5: 
                 printf("Admin logged out.\n");
+                revokeSessionToken();
                 bzero(outBuffer, sizeof(outBuffer));
                 strcpy(outBuffer, "Logging out...^");
-                write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+                write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
                 return; // return to server loop
             default:
                 bzero(outBuffer, sizeof(outBuffer));
                 strcpy(outBuffer, "Invalid choice!^");
-                write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); 
+                write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); 
         }
     }
 }
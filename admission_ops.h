@@ -0,0 +1,257 @@
+#ifndef ADMISSION_OPS_H
+#define ADMISSION_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+// Admission control. Every connection takes a slot in a shared table before it gets the
+// login menu. Past maxSessions a connection waits in a bounded queue for a slot to free
+// up; once the queue is full it is told the server is busy and hung up on straight away.
+// The fork server turns those away before forking. After the login menu choice the
+// connection also needs room in its role's quota. Customer logins can then fill up
+// to their own quota, but they can't lock employees and managers out. Slots belong to a
+// pid, so a session process that dies without releasing its slot is reclaimed the next
+// time a limit is hit.
+//
+// ./server [--max-sessions n] [--queue n] [--backlog n] [--quota customer employee manager admin]
+
+#define ADMISSION_REGION "admission"
+#define ADMISSION_SLOTS 1024 // max sessions plus queue never go past this
+#define ADMISSION_MAX_SESSIONS 256
+#define ADMISSION_QUEUE 32
+#define ADMISSION_QUEUE_WAIT_MS 5000 // a queued connection gives up after this
+#define ADMISSION_POLL_MS 20
+#define LISTEN_BACKLOG 128
+
+#define ADMISSION_FREE 0
+#define ADMISSION_WAITING 1
+#define ADMISSION_ACTIVE 2
+
+#define ADMISSION_BUSY_MESSAGE "Server busy, try again later.\n"
+
+struct AdmissionSlot {
+    int pid;
+    int state;
+    int role; // login menu choice, 0 = not logged in yet
+};
+
+struct AdmissionRegion {
+    int lockOwner; // pid, 0 = free
+    int active, waiting;
+    int roleActive[5];
+    int nextSlot;
+    struct AdmissionSlot slots[ADMISSION_SLOTS];
+};
+
+struct AdmissionRegion *admissionRegion = NULL;
+int maxSessions = ADMISSION_MAX_SESSIONS;
+int admissionQueue = ADMISSION_QUEUE;
+int listenBacklog = LISTEN_BACKLOG;
+int roleQuota[5] = {0, 224, 64, 16, 4}; // by login choice: customer, employee, manager, admin
+int admissionSlot = -1; // this connection's slot
+
+const char *roleNames[5] = {"", "customer", "employee", "manager", "admin"};
+
+void parseAdmissionOptions(int argc, char *argv[]);
+struct AdmissionRegion *getAdmissionRegion();
+void resetAdmission();
+int admissionBusy();
+int admitConnection(int clientSocket);
+void releaseConnection();
+int admitRole(int clientSocket, int role);
+void releaseRole();
+
+void parseAdmissionOptions(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) maxSessions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) admissionQueue = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--backlog") == 0 && i + 1 < argc) listenBacklog = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--quota") == 0) {
+            for (int role = 1; role <= 4 && i + 1 < argc; role++) roleQuota[role] = atoi(argv[++i]);
+        }
+    }
+
+    if (maxSessions <= 0 || maxSessions > ADMISSION_SLOTS) maxSessions = ADMISSION_MAX_SESSIONS;
+    if (admissionQueue < 0) admissionQueue = 0;
+    if (maxSessions + admissionQueue > ADMISSION_SLOTS) admissionQueue = ADMISSION_SLOTS - maxSessions;
+    if (listenBacklog <= 0) listenBacklog = LISTEN_BACKLOG;
+    for (int role = 1; role <= 4; role++) {
+        if (roleQuota[role] <= 0 || roleQuota[role] > maxSessions) roleQuota[role] = maxSessions;
+    }
+}
+
+// NULL means shared memory is unavailable and every connection is let in
+struct AdmissionRegion *getAdmissionRegion()
+{
+    if (admissionRegion == NULL) {
+        admissionRegion = attachSharedRegion(ADMISSION_REGION, sizeof(struct AdmissionRegion), NULL);
+    }
+    return admissionRegion;
+}
+
+void resetAdmission()
+{
+    resetSharedRegion(ADMISSION_REGION);
+    admissionRegion = NULL;
+    if (getAdmissionRegion() != NULL) {
+        printf("Admission: %d sessions, %d queued, quotas %d/%d/%d/%d, backlog %d\n", maxSessions, admissionQueue,
+               roleQuota[1], roleQuota[2], roleQuota[3], roleQuota[4], listenBacklog);
+    }
+}
+
+static void freeAdmissionSlot(struct AdmissionRegion *admission, struct AdmissionSlot *slot)
+{
+    if (slot->state == ADMISSION_ACTIVE) admission->active--;
+    if (slot->state == ADMISSION_WAITING) admission->waiting--;
+    if (slot->role > 0) admission->roleActive[slot->role]--;
+    memset(slot, 0, sizeof(*slot));
+}
+
+// give back slots whose process died without releasing them, caller holds the lock
+static void reclaimAdmissionSlots(struct AdmissionRegion *admission)
+{
+    for (int i = 0; i < ADMISSION_SLOTS; i++) {
+        struct AdmissionSlot *slot = &admission->slots[i];
+        if (slot->state != ADMISSION_FREE && kill(slot->pid, 0) == -1 && errno == ESRCH) {
+            printf("Admission: reclaimed slot of dead process %d\n", slot->pid);
+            freeAdmissionSlot(admission, slot);
+        }
+    }
+}
+
+// caller holds the lock, -1 if the table is full
+static int claimAdmissionSlot(struct AdmissionRegion *admission, int state)
+{
+    for (int probe = 0; probe < ADMISSION_SLOTS; probe++) {
+        int candidate = (admission->nextSlot + probe) % ADMISSION_SLOTS;
+        struct AdmissionSlot *slot = &admission->slots[candidate];
+        if (slot->state != ADMISSION_FREE) continue;
+        slot->pid = getpid();
+        slot->state = state;
+        slot->role = 0;
+        if (state == ADMISSION_ACTIVE) admission->active++;
+        else admission->waiting++;
+        admission->nextSlot = (candidate + 1) % ADMISSION_SLOTS;
+        return candidate;
+    }
+    return -1;
+}
+
+// unlocked look for the fork server: both the sessions and the queue are full, so a new
+// connection can be turned away without forking for it. a stale count only lets one in
+// that admitConnection then turns away itself
+int admissionBusy()
+{
+    struct AdmissionRegion *admission = getAdmissionRegion();
+    if (admission == NULL) return 0;
+    return __atomic_load_n(&admission->active, __ATOMIC_RELAXED) >= maxSessions &&
+           __atomic_load_n(&admission->waiting, __ATOMIC_RELAXED) >= admissionQueue;
+}
+
+// 1 once the connection has a slot, 0 after telling the client the server is busy
+int admitConnection(int clientSocket)
+{
+    struct AdmissionRegion *admission = getAdmissionRegion();
+    if (admission == NULL) return 1;
+
+    lockSharedRegion(&admission->lockOwner);
+    if (admission->active >= maxSessions || admission->waiting >= admissionQueue) reclaimAdmissionSlots(admission);
+    // a new connection goes behind anyone already queued
+    if (admission->active < maxSessions && admission->waiting == 0) admissionSlot = claimAdmissionSlot(admission, ADMISSION_ACTIVE);
+    else if (admission->waiting < admissionQueue) admissionSlot = claimAdmissionSlot(admission, ADMISSION_WAITING);
+    int state = admissionSlot == -1 ? ADMISSION_FREE : admission->slots[admissionSlot].state;
+    unlockSharedRegion(&admission->lockOwner);
+
+    char peek;
+    int waited = 0;
+    while (state == ADMISSION_WAITING) {
+        // the client gave up on us, no point holding its place
+        if (recv(clientSocket, &peek, 1, MSG_PEEK | MSG_DONTWAIT) == 0 || waited >= ADMISSION_QUEUE_WAIT_MS) {
+            lockSharedRegion(&admission->lockOwner);
+            freeAdmissionSlot(admission, &admission->slots[admissionSlot]);
+            unlockSharedRegion(&admission->lockOwner);
+            admissionSlot = -1;
+            break;
+        }
+        usleep(ADMISSION_POLL_MS * 1000);
+        waited += ADMISSION_POLL_MS;
+
+        lockSharedRegion(&admission->lockOwner);
+        if (admission->active >= maxSessions && waited % 1000 < ADMISSION_POLL_MS) reclaimAdmissionSlots(admission);
+        if (admission->active < maxSessions) {
+            admission->slots[admissionSlot].state = state = ADMISSION_ACTIVE;
+            admission->waiting--;
+            admission->active++;
+        }
+        unlockSharedRegion(&admission->lockOwner);
+    }
+
+    if (admissionSlot == -1) {
+        printf("Admission: turned away connection, server busy\n");
+        write(clientSocket, ADMISSION_BUSY_MESSAGE, strlen(ADMISSION_BUSY_MESSAGE));
+        return 0;
+    }
+    if (waited > 0) printf("Admission: connection admitted after %d ms in the queue\n", waited);
+    return 1;
+}
+
+void releaseConnection()
+{
+    struct AdmissionRegion *admission = getAdmissionRegion();
+    if (admission != NULL && admissionSlot != -1) {
+        lockSharedRegion(&admission->lockOwner);
+        if (admission->slots[admissionSlot].pid == getpid()) freeAdmissionSlot(admission, &admission->slots[admissionSlot]);
+        unlockSharedRegion(&admission->lockOwner);
+    }
+    admissionSlot = -1;
+}
+
+// after the login menu choice: 1 if the role has room, 0 after telling the client it hasn't
+int admitRole(int clientSocket, int role)
+{
+    struct AdmissionRegion *admission = getAdmissionRegion();
+    if (admission == NULL || admissionSlot == -1) return 1;
+
+    lockSharedRegion(&admission->lockOwner);
+    if (admission->roleActive[role] >= roleQuota[role]) reclaimAdmissionSlots(admission);
+    int admitted = admission->roleActive[role] < roleQuota[role];
+    if (admitted) {
+        admission->slots[admissionSlot].role = role;
+        admission->roleActive[role]++;
+    }
+    unlockSharedRegion(&admission->lockOwner);
+    if (admitted) return 1;
+
+    printf("Admission: %s quota of %d reached\n", roleNames[role], roleQuota[role]);
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Too many %s sessions right now, try again later.^", roleNames[role]);
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    readClient(clientSocket, inBuffer, 3); // ack
+    return 0;
+}
+
+// back at the login menu
+void releaseRole()
+{
+    struct AdmissionRegion *admission = getAdmissionRegion();
+    if (admission == NULL || admissionSlot == -1) return;
+
+    lockSharedRegion(&admission->lockOwner);
+    struct AdmissionSlot *slot = &admission->slots[admissionSlot];
+    if (slot->pid == getpid() && slot->role > 0) {
+        admission->roleActive[slot->role]--;
+        slot->role = 0;
+    }
+    unlockSharedRegion(&admission->lockOwner);
+}
+
+#endif
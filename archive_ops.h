@@ -0,0 +1,425 @@
+#ifndef ARCHIVE_OPS_H
+#define ARCHIVE_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Cold storage for archived log segments (see segment_ops.h). An archive is a run of
+// blocks of up to ARCHIVE_BLOCK_RECORDS records, each compressed on its own, then an
+// index of the blocks and a header pointing at it. In a block every record is its account
+// ID, the length of its entry and the entry's bytes without the padding. The block is
+// then compressed with a small LZ77 coder in the shape of LZ4, or stored as is when that
+// doesn't make it smaller. An index entry has the block's place, its first record number
+// in the segment, its first and last day and a summary of the accounts in it: the lowest
+// and highest ID and a bitmap of IDs modulo ARCHIVE_SUMMARY_BITS. A reader looking for
+// one account or one range of days only decompresses the blocks that can hold it.
+// History pages, audits, statements and the reconciliation run read archives through
+// here.
+
+#define ARCHIVE_MAGIC 0x5a534d42 // "BMSZ"
+#define ARCHIVE_BLOCK_RECORDS 256
+#define ARCHIVE_SUMMARY_BITS 256
+#define ARCHIVE_COPY_BATCH 64 // records per pread while archiving
+#define ARCHIVE_HASH_BITS 13
+#define ARCHIVE_MIN_MATCH 4
+#define ARCHIVE_MAX_OFFSET 65535
+
+// packed record: accountID, entry length, entry bytes
+#define ARCHIVE_RECORD_PREFIX (sizeof(int) + sizeof(unsigned short))
+#define ARCHIVE_BLOCK_BYTES (ARCHIVE_BLOCK_RECORDS * (ARCHIVE_RECORD_PREFIX + sizeof(((struct TransactionLog *)0)->logEntry)))
+
+struct ArchiveHeader {
+    int magic;
+    int seq;
+    long long records;
+    off_t indexOffset; // blocks entries of struct ArchiveBlock
+    int blocks;
+};
+
+struct ArchiveBlock {
+    off_t offset;
+    long long firstRecord;     // in the segment
+    int records;
+    int rawBytes, storedBytes; // equal for a block stored uncompressed
+    int firstDay, lastDay;     // yyyymmdd, 0 if unreadable
+    int minAccount, maxAccount;
+    unsigned char accounts[ARCHIVE_SUMMARY_BITS / 8];
+};
+
+// an open archive. sequential reads (readSegmentArchive) go a block at a time
+struct SegmentArchive {
+    int fd;
+    struct ArchiveHeader header;
+    struct ArchiveBlock *blocks;
+    char *stored, *raw; // one block, as read and decompressed
+    struct TransactionLog *pending; // sequential reads: the block being handed out
+    int nextBlock, pendingCount, pendingUsed;
+};
+
+struct ArchiveWriter {
+    int fd;
+    struct ArchiveHeader header;
+    struct ArchiveBlock *blocks; // the index so far
+    int capacity;
+    struct ArchiveBlock block;   // being filled
+    char *raw, *stored;
+    int failed;
+};
+
+int logEntryDay(const char *text, size_t length); // audit_ops.h
+
+int archiveCompress(const char *source, int length, char *dest);
+int archiveDecompress(const char *source, int length, char *dest, int capacity);
+int openArchiveWriter(struct ArchiveWriter *writer, int fd, int seq);
+void appendArchiveRecord(struct ArchiveWriter *writer, struct TransactionLog *log);
+int closeArchiveWriter(struct ArchiveWriter *writer);
+int writeSegmentArchive(int shard, struct LogSegment *segment, const char *path);
+int openSegmentArchive(int shard, int seq, struct SegmentArchive *archive);
+void closeSegmentArchive(struct SegmentArchive *archive);
+int archiveBlockHasAccount(struct ArchiveBlock *block, int accountID);
+int findArchiveBlock(struct SegmentArchive *archive, long long record);
+int readArchiveBlock(struct SegmentArchive *archive, int index, struct TransactionLog *logs);
+int readSegmentArchive(struct SegmentArchive *archive, struct TransactionLog *logs, int max);
+
+static unsigned int archiveHash(const unsigned char *at)
+{
+    unsigned int word;
+    memcpy(&word, at, sizeof(word));
+    return (word * 2654435761u) >> (32 - ARCHIVE_HASH_BITS);
+}
+
+// a length past the 15 a token holds: 255 while there is more, then the rest
+static unsigned char *archiveLength(unsigned char *out, int length)
+{
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = length;
+    return out;
+}
+
+static int archiveReadLength(const unsigned char **in, const unsigned char *end, int *length)
+{
+    int more;
+    do {
+        if (*in >= end) return 0;
+        more = *(*in)++;
+        *length += more;
+    } while (more == 255);
+    return 1;
+}
+
+// each sequence is a token (literal count << 4 | match length - ARCHIVE_MIN_MATCH), the
+// literals, and a two byte offset back to the match; the last one is only literals.
+// returns the compressed size, dest has room for length bytes. 0 if it wouldn't be smaller
+int archiveCompress(const char *source, int length, char *dest)
+{
+    static int table[1 << ARCHIVE_HASH_BITS];
+    const unsigned char *src = (const unsigned char *)source;
+    unsigned char *out = (unsigned char *)dest, *outEnd = out + length;
+    int anchor = 0, at = 0;
+
+    for (int h = 0; h < (1 << ARCHIVE_HASH_BITS); h++) table[h] = -1;
+    while (at + ARCHIVE_MIN_MATCH <= length) {
+        unsigned int h = archiveHash(src + at);
+        int ref = table[h];
+        table[h] = at;
+        if (ref < 0 || at - ref > ARCHIVE_MAX_OFFSET || memcmp(src + ref, src + at, ARCHIVE_MIN_MATCH) != 0) {
+            at++;
+            continue;
+        }
+        int match = ARCHIVE_MIN_MATCH, literals = at - anchor;
+        while (at + match < length && src[ref + match] == src[at + match]) match++;
+        if (out + 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1 > outEnd) return 0;
+
+        unsigned char *token = out++;
+        *token = (literals < 15 ? literals : 15) << 4 | (match - ARCHIVE_MIN_MATCH < 15 ? match - ARCHIVE_MIN_MATCH : 15);
+        if (literals >= 15) out = archiveLength(out, literals - 15);
+        memcpy(out, src + anchor, literals);
+        out += literals;
+        *out++ = (at - ref) & 0xff;
+        *out++ = (at - ref) >> 8;
+        if (match - ARCHIVE_MIN_MATCH >= 15) out = archiveLength(out, match - ARCHIVE_MIN_MATCH - 15);
+        at += match;
+        anchor = at;
+    }
+
+    int literals = length - anchor;
+    if (out + 1 + literals / 255 + 1 + literals > outEnd) return 0;
+    *out++ = (literals < 15 ? literals : 15) << 4;
+    if (literals >= 15) out = archiveLength(out, literals - 15);
+    memcpy(out, src + anchor, literals);
+    out += literals;
+    return out < outEnd ? (int)(out - (unsigned char *)dest) : 0;
+}
+
+// returns the decompressed size, -1 if the input is damaged or doesn't fit capacity
+int archiveDecompress(const char *source, int length, char *dest, int capacity)
+{
+    const unsigned char *in = (const unsigned char *)source, *inEnd = in + length;
+    unsigned char *out = (unsigned char *)dest, *outEnd = out + capacity;
+
+    while (in < inEnd) {
+        int token = *in++, literals = token >> 4, match = token & 15;
+        if (literals == 15 && !archiveReadLength(&in, inEnd, &literals)) return -1;
+        if (literals > inEnd - in || literals > outEnd - out) return -1;
+        memcpy(out, in, literals);
+        out += literals;
+        in += literals;
+        if (in == inEnd) break;
+
+        if (inEnd - in < 2) return -1;
+        int offset = in[0] | in[1] << 8;
+        in += 2;
+        if (match == 15 && !archiveReadLength(&in, inEnd, &match)) return -1;
+        match += ARCHIVE_MIN_MATCH;
+        if (offset == 0 || offset > out - (unsigned char *)dest || match > outEnd - out) return -1;
+        for (int i = 0; i < match; i++) out[i] = out[i - offset]; // may overlap itself
+        out += match;
+    }
+    return out - (unsigned char *)dest;
+}
+
+int openArchiveWriter(struct ArchiveWriter *writer, int fd, int seq)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    writer->header.magic = ARCHIVE_MAGIC;
+    writer->header.seq = seq;
+    writer->header.indexOffset = sizeof(writer->header);
+    writer->raw = malloc(ARCHIVE_BLOCK_BYTES);
+    writer->stored = malloc(ARCHIVE_BLOCK_BYTES);
+    // the header is written last, a torn archive has no magic
+    writer->failed = writer->raw == NULL || writer->stored == NULL ||
+                     pwrite(fd, &writer->header, sizeof(writer->header), 0) != sizeof(writer->header) ||
+                     ftruncate(fd, sizeof(writer->header)) == -1;
+    if (writer->failed) {
+        free(writer->raw);
+        free(writer->stored);
+        writer->raw = writer->stored = NULL;
+    }
+    return !writer->failed;
+}
+
+static void flushArchiveBlock(struct ArchiveWriter *writer)
+{
+    struct ArchiveBlock *block = &writer->block;
+    if (block->records == 0 || writer->failed) return;
+
+    if (writer->header.blocks == writer->capacity) {
+        int capacity = writer->capacity == 0 ? 64 : writer->capacity * 2;
+        struct ArchiveBlock *grown = realloc(writer->blocks, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            writer->failed = 1;
+            return;
+        }
+        writer->blocks = grown;
+        writer->capacity = capacity;
+    }
+
+    block->storedBytes = archiveCompress(writer->raw, block->rawBytes, writer->stored);
+    const char *bytes = block->storedBytes > 0 ? writer->stored : writer->raw;
+    if (block->storedBytes == 0) block->storedBytes = block->rawBytes;
+    block->offset = writer->header.indexOffset;
+    if (pwrite(writer->fd, bytes, block->storedBytes, block->offset) != block->storedBytes) {
+        writer->failed = 1;
+        return;
+    }
+    writer->header.indexOffset += block->storedBytes;
+    writer->blocks[writer->header.blocks++] = *block;
+
+    long long next = block->firstRecord + block->records;
+    memset(block, 0, sizeof(*block));
+    block->firstRecord = next;
+}
+
+void appendArchiveRecord(struct ArchiveWriter *writer, struct TransactionLog *log)
+{
+    struct ArchiveBlock *block = &writer->block;
+    unsigned short length = strnlen(log->logEntry, sizeof(log->logEntry));
+    int day = logEntryDay(log->logEntry, length);
+    if (writer->failed) return;
+
+    char *at = writer->raw + block->rawBytes;
+    memcpy(at, &log->accountID, sizeof(int));
+    memcpy(at + sizeof(int), &length, sizeof(length));
+    memcpy(at + ARCHIVE_RECORD_PREFIX, log->logEntry, length);
+    block->rawBytes += ARCHIVE_RECORD_PREFIX + length;
+
+    if (block->records == 0 || log->accountID < block->minAccount) block->minAccount = log->accountID;
+    if (block->records == 0 || log->accountID > block->maxAccount) block->maxAccount = log->accountID;
+    unsigned int bit = (unsigned int)log->accountID % ARCHIVE_SUMMARY_BITS;
+    block->accounts[bit / 8] |= 1 << (bit % 8);
+    // the earliest and latest day in the block, wherever they are in it
+    if (day != 0 && (block->firstDay == 0 || day < block->firstDay)) block->firstDay = day;
+    if (day > block->lastDay) block->lastDay = day;
+    block->records++;
+    writer->header.records++;
+    if (block->records == ARCHIVE_BLOCK_RECORDS) flushArchiveBlock(writer);
+}
+
+// writes the last block, the index and the header. 1 if all of it made it to the file,
+// which the caller still has to sync
+int closeArchiveWriter(struct ArchiveWriter *writer)
+{
+    flushArchiveBlock(writer);
+    size_t indexBytes = writer->header.blocks * sizeof(struct ArchiveBlock);
+    int ok = !writer->failed &&
+             pwrite(writer->fd, writer->blocks, indexBytes, writer->header.indexOffset) == (ssize_t)indexBytes &&
+             pwrite(writer->fd, &writer->header, sizeof(writer->header), 0) == sizeof(writer->header);
+    free(writer->blocks);
+    free(writer->raw);
+    free(writer->stored);
+    memset(writer, 0, sizeof(*writer));
+    return ok;
+}
+
+// compresses a sealed segment into path, synced. 1 if it is complete
+int writeSegmentArchive(int shard, struct LogSegment *segment, const char *path)
+{
+    static struct TransactionLog batch[ARCHIVE_COPY_BATCH];
+    char sealedPath[SHARD_PATH_SIZE];
+    struct ArchiveWriter writer;
+    long long archived = 0;
+
+    segmentFilePath(shard, segment->seq, SEGMENT_FILE_FORMAT, sealedPath);
+    int sealedFile = open(sealedPath, O_RDONLY);
+    int archiveFile = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (sealedFile == -1 || archiveFile == -1) {
+        perror("Archive: Error opening segment to archive");
+        if (sealedFile != -1) close(sealedFile);
+        if (archiveFile != -1) close(archiveFile);
+        return 0;
+    }
+
+    int ok = openArchiveWriter(&writer, archiveFile, segment->seq);
+    while (ok && archived < segment->records) {
+        long long count = segment->records - archived < ARCHIVE_COPY_BATCH ? segment->records - archived : ARCHIVE_COPY_BATCH;
+        if (pread(sealedFile, batch, count * sizeof(struct TransactionLog), archived * sizeof(struct TransactionLog)) !=
+            (ssize_t)(count * sizeof(struct TransactionLog))) {
+            ok = 0;
+            break;
+        }
+        for (int i = 0; i < count; i++) appendArchiveRecord(&writer, &batch[i]);
+        archived += count;
+    }
+    if (writer.raw != NULL) ok = closeArchiveWriter(&writer) && ok;
+    ok = ok && fsync(archiveFile) == 0;
+    close(archiveFile);
+    close(sealedFile);
+    return ok;
+}
+
+int openSegmentArchive(int shard, int seq, struct SegmentArchive *archive)
+{
+    char path[SHARD_PATH_SIZE];
+    memset(archive, 0, sizeof(*archive));
+    segmentFilePath(shard, seq, SEGMENT_ARCHIVE_FORMAT, path);
+    archive->fd = open(path, O_RDONLY);
+    if (archive->fd == -1) return 0;
+
+    size_t indexBytes = 0;
+    int ok = pread(archive->fd, &archive->header, sizeof(archive->header), 0) == sizeof(archive->header) &&
+             archive->header.magic == ARCHIVE_MAGIC && archive->header.blocks >= 0;
+    if (ok) {
+        indexBytes = archive->header.blocks * sizeof(struct ArchiveBlock);
+        archive->blocks = malloc(indexBytes + 1);
+        archive->stored = malloc(ARCHIVE_BLOCK_BYTES);
+        archive->raw = malloc(ARCHIVE_BLOCK_BYTES);
+    }
+    ok = ok && archive->blocks != NULL && archive->stored != NULL && archive->raw != NULL &&
+         pread(archive->fd, archive->blocks, indexBytes, archive->header.indexOffset) == (ssize_t)indexBytes;
+    if (!ok) {
+        printf("Archive: segment %d of shard %d unreadable\n", seq, shard);
+        closeSegmentArchive(archive);
+    }
+    return ok;
+}
+
+void closeSegmentArchive(struct SegmentArchive *archive)
+{
+    if (archive->fd > 0) close(archive->fd);
+    free(archive->blocks);
+    free(archive->stored);
+    free(archive->raw);
+    free(archive->pending);
+    memset(archive, 0, sizeof(*archive));
+    archive->fd = -1;
+}
+
+// 0 if the block surely has nothing of the account
+int archiveBlockHasAccount(struct ArchiveBlock *block, int accountID)
+{
+    unsigned int bit = (unsigned int)accountID % ARCHIVE_SUMMARY_BITS;
+    return accountID >= block->minAccount && accountID <= block->maxAccount && (block->accounts[bit / 8] & (1 << (bit % 8)));
+}
+
+// the block holding record (in the segment), by binary search on the index
+int findArchiveBlock(struct SegmentArchive *archive, long long record)
+{
+    int low = 0, high = archive->header.blocks - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (archive->blocks[middle].firstRecord <= record) low = middle;
+        else high = middle - 1;
+    }
+    return low;
+}
+
+// decompresses one block into logs, which has room for ARCHIVE_BLOCK_RECORDS. returns its
+// record count, -1 if it is damaged
+int readArchiveBlock(struct SegmentArchive *archive, int index, struct TransactionLog *logs)
+{
+    struct ArchiveBlock *block = &archive->blocks[index];
+    if (block->records > ARCHIVE_BLOCK_RECORDS || block->rawBytes > (int)ARCHIVE_BLOCK_BYTES || block->storedBytes > block->rawBytes ||
+        pread(archive->fd, archive->stored, block->storedBytes, block->offset) != block->storedBytes) {
+        goto damaged;
+    }
+    const char *raw = archive->stored;
+    if (block->storedBytes < block->rawBytes) {
+        if (archiveDecompress(archive->stored, block->storedBytes, archive->raw, block->rawBytes) != block->rawBytes) goto damaged;
+        raw = archive->raw;
+    }
+
+    int used = 0;
+    for (int i = 0; i < block->records; i++) {
+        unsigned short length;
+        if (block->rawBytes - used < (int)ARCHIVE_RECORD_PREFIX) goto damaged;
+        memcpy(&logs[i].accountID, raw + used, sizeof(int));
+        memcpy(&length, raw + used + sizeof(int), sizeof(length));
+        if (length > sizeof(logs[i].logEntry) || block->rawBytes - used - (int)ARCHIVE_RECORD_PREFIX < length) goto damaged;
+        memcpy(logs[i].logEntry, raw + used + ARCHIVE_RECORD_PREFIX, length);
+        memset(logs[i].logEntry + length, 0, sizeof(logs[i].logEntry) - length);
+        used += ARCHIVE_RECORD_PREFIX + length;
+    }
+    return block->records;
+
+damaged:
+    printf("Archive: block %d of segment %d is damaged\n", index, archive->header.seq);
+    return -1;
+}
+
+// the archive front to back, up to max records at a time. 0 at the end, -1 if damaged
+int readSegmentArchive(struct SegmentArchive *archive, struct TransactionLog *logs, int max)
+{
+    int count = 0;
+    if (archive->pending == NULL && (archive->pending = malloc(ARCHIVE_BLOCK_RECORDS * sizeof(struct TransactionLog))) == NULL) return -1;
+    while (count < max) {
+        if (archive->pendingUsed == archive->pendingCount) {
+            if (archive->nextBlock == archive->header.blocks) break;
+            archive->pendingCount = readArchiveBlock(archive, archive->nextBlock++, archive->pending);
+            archive->pendingUsed = 0;
+            if (archive->pendingCount == -1) return -1;
+        }
+        int take = archive->pendingCount - archive->pendingUsed < max - count ? archive->pendingCount - archive->pendingUsed : max - count;
+        memcpy(logs + count, archive->pending + archive->pendingUsed, take * sizeof(struct TransactionLog));
+        archive->pendingUsed += take;
+        count += take;
+    }
+    return count;
+}
+
+#endif
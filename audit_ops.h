@@ -0,0 +1,404 @@
+#ifndef AUDIT_OPS_H
+#define AUDIT_OPS_H
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+// Audit queries over the transaction logs: account, date range, minimum amount, entry
+// type and a text match, any of them optional. Each log segment is mapped read only up
+// to its committed size. A date range skips the segments the manifest puts outside it
+// and is narrowed down by binary search in the rest, since entries are appended in time
+// order (stamped at commit, see stampLogEntry). The rest is scanned a window at a time.
+// A window is cut into chunks that a pool of threads takes one by one. Matching
+// compares the account ID first, then searches the text with memmem, then parses what
+// is left. Each chunk's matches are kept apart, so the window's results come out in log
+// order. Shards are scanned one after another, so an account query only touches its own
+// shard. Archived segments are decompressed up to AUDIT_ARCHIVE_RECORDS at a time and
+// scanned the same way, leaving out the blocks whose day range or account summary rules
+// them out (see archive_ops.h).
+// Employees and managers page through the results like any other cursor. The CLI prints
+// them all.
+//
+// ./server --audit [--account id] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--min amount]
+//                  [--type deposit|withdrawal|transfer|loan|opening|accrual] [--text s] [--threads n]
+
+#define AUDIT_THREADS_MAX 8
+#define AUDIT_CHUNK_RECORDS 1024 // one task for a thread
+#define AUDIT_WINDOW_CHUNKS 4    // per thread, scanned before results are handed out
+#define AUDIT_TEXT_MAX 64
+#define AUDIT_ARCHIVE_RECORDS (AUDIT_CHUNK_RECORDS * 4) // archived records decompressed at a time
+
+struct AuditFilter {
+    int accountID;         // 0 = any
+    int fromDay, toDay;    // yyyymmdd, 0 = open ended
+    long long minCents;    // size of the amount, either sign
+    int types;             // bit per LOG_ENTRY_* type, 0 = any
+    char text[AUDIT_TEXT_MAX]; // "" = any
+};
+
+struct AuditQuery {
+    struct AuditFilter filter;
+    int threads;
+    int shard, lastShard;     // shard being scanned, last one to scan
+    struct LogSegmentSet segments; // its log
+    int segment;              // next segment to map
+    char *map;                // the segment being scanned, mapped, or decompressed blocks of an archived one
+    size_t mapSize;
+    struct SegmentArchive archive; // the archived segment being scanned
+    int block;                // its next block
+    struct TransactionLog *decompressed; // AUDIT_ARCHIVE_RECORDS
+    off_t position, limit;    // next record to scan and where to stop, byte offsets
+    off_t *matches;           // the last window's matches, in log order
+    int matchCount, matchNext;
+    int windowChunks;
+    int *chunkMatches;        // window scratch: AUDIT_CHUNK_RECORDS indexes per chunk
+    int *chunkCounts;
+    long long scanned, matched;
+};
+
+struct AuditWindow {
+    struct AuditQuery *query;
+    int chunks, nextChunk;
+};
+
+const char *auditTypeNames[] = {"", "deposit", "withdrawal", "transfer", "transfer", "loan", "opening", "accrual"};
+
+int parseAuditDay(const char *text);
+int parseAuditTypes(const char *name);
+int logEntryDay(const char *text, size_t length);
+void openAuditQuery(struct AuditQuery *query, struct AuditFilter *filter, int threads);
+void closeAuditQuery(struct AuditQuery *query);
+int auditQueryHasMore(struct AuditQuery *query);
+int scanAuditWindow(struct AuditQuery *query);
+struct TransactionLog *nextAuditMatch(struct AuditQuery *query);
+int fillAuditPage(struct AuditQuery *query, char *page, size_t pageCapacity, int pageSize);
+int runAudit(int argc, char *argv[]);
+
+// yyyymmdd from YYYY-MM-DD, 0 if it isn't one
+int parseAuditDay(const char *text)
+{
+    int year, month, day;
+    if (sscanf(text, "%d-%d-%d", &year, &month, &day) != 3) return 0;
+    return year * 10000 + month * 100 + day;
+}
+
+// LOG_ENTRY_* bits for a type name, 0 for "-" or an unknown name (any type)
+int parseAuditTypes(const char *name)
+{
+    int types = 0;
+    for (int type = 1; type <= LOG_ENTRY_ACCRUAL; type++) {
+        if (strcasecmp(name, auditTypeNames[type]) == 0) types |= 1 << type;
+    }
+    return types;
+}
+
+// yyyymmdd from the "... at hh:mm:ss y-m-d" tail, like logRecordDay. 0 if unreadable
+int logEntryDay(const char *text, size_t length)
+{
+    int hour, minute, second, year, month, day;
+    const char *at = NULL;
+    for (const char *next = text; (next = memmem(next, length - (next - text), " at ", 4)) != NULL; next++) at = next;
+    if (at == NULL || sscanf(at, " at %d:%d:%d %d-%d-%d", &hour, &minute, &second, &year, &month, &day) != 6) return 0;
+    return year * 10000 + month * 100 + day;
+}
+
+static int auditEntryMatches(struct AuditFilter *filter, struct TransactionLog *log)
+{
+    if (filter->accountID != 0 && log->accountID != filter->accountID) return 0;
+
+    size_t length = strnlen(log->logEntry, sizeof(log->logEntry));
+    if (filter->text[0] != '\0' && memmem(log->logEntry, length, filter->text, strlen(filter->text)) == NULL) return 0;
+    if (filter->fromDay != 0 || filter->toDay != 0) {
+        int day = logEntryDay(log->logEntry, length);
+        if (day == 0 || (filter->fromDay != 0 && day < filter->fromDay) || (filter->toDay != 0 && day > filter->toDay)) return 0;
+    }
+    if (filter->types != 0 || filter->minCents != 0) {
+        struct TransactionLog entry; // logEntryAmount terminates the text, the map is read only
+        long long cents;
+        entry.accountID = log->accountID;
+        memcpy(entry.logEntry, log->logEntry, length < sizeof(entry.logEntry) ? length + 1 : sizeof(entry.logEntry));
+        int type = logEntryAmount(&entry, &cents);
+        if (filter->types != 0 && !(filter->types & (1 << type))) return 0;
+        if ((cents < 0 ? -cents : cents) < filter->minCents) return 0;
+    }
+    return 1;
+}
+
+// first record of the mapped log on or after day, the map version of firstRecordOnOrAfter
+static off_t auditFirstOnOrAfter(struct AuditQuery *query, off_t recordCount, int day)
+{
+    off_t low = 0, high = recordCount;
+    while (low < high) {
+        off_t middle = low + (high - low) / 2;
+        struct TransactionLog *log = (struct TransactionLog *)(query->map + middle * sizeof(struct TransactionLog));
+        if (logEntryDay(log->logEntry, strnlen(log->logEntry, sizeof(log->logEntry))) < day) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// decompress the archive's next blocks that can hold a match into query->decompressed.
+// 0 if none of them can
+static int decompressAuditBlocks(struct AuditQuery *query)
+{
+    struct AuditFilter *filter = &query->filter;
+    int count = 0;
+    if (query->decompressed == NULL &&
+        (query->decompressed = malloc(AUDIT_ARCHIVE_RECORDS * sizeof(struct TransactionLog))) == NULL) return 0;
+
+    while (query->block < query->archive.header.blocks) {
+        struct ArchiveBlock *block = &query->archive.blocks[query->block];
+        if (count + block->records > AUDIT_ARCHIVE_RECORDS) break;
+        int index = query->block++;
+        if ((filter->accountID != 0 && !archiveBlockHasAccount(block, filter->accountID)) ||
+            (filter->fromDay != 0 && block->lastDay != 0 && block->lastDay < filter->fromDay) ||
+            (filter->toDay != 0 && block->firstDay != 0 && block->firstDay > filter->toDay)) continue;
+        int got = readArchiveBlock(&query->archive, index, query->decompressed + count);
+        if (got > 0) count += got;
+    }
+    query->map = (char *)query->decompressed;
+    query->position = 0;
+    query->limit = count * sizeof(struct TransactionLog);
+    return count > 0;
+}
+
+// map the next segment that has anything in range, shard after shard. 0 once every
+// shard is done
+static int openAuditSegment(struct AuditQuery *query)
+{
+    if (query->map != NULL && query->map != (char *)query->decompressed) munmap(query->map, query->mapSize);
+    query->map = NULL;
+
+    while (query->shard <= query->lastShard) {
+        if (query->archive.blocks != NULL) {
+            while (query->block < query->archive.header.blocks) {
+                if (decompressAuditBlocks(query)) return 1;
+            }
+            closeSegmentArchive(&query->archive);
+            query->map = NULL;
+        }
+        if (query->segments.segments == NULL && !loadLogSegments(query->shard, &query->segments)) {
+            query->shard++;
+            continue;
+        }
+        if (query->segment >= query->segments.count) {
+            freeLogSegments(&query->segments);
+            query->segment = 0;
+            query->shard++;
+            continue;
+        }
+        int index = query->segment++;
+        struct LogSegment *segment = &query->segments.segments[index];
+        if (segment->records == 0 || (query->filter.fromDay != 0 && segment->lastDay != 0 && segment->lastDay < query->filter.fromDay) ||
+            (query->filter.toDay != 0 && segment->firstDay != 0 && segment->firstDay > query->filter.toDay)) continue;
+        int logFile = openLogSegment(&query->segments, index);
+        if (logFile == -1) {
+            // archived, maybe since the segments were loaded
+            if (segment->state != SEGMENT_ACTIVE && openSegmentArchive(query->shard, segment->seq, &query->archive)) query->block = 0;
+            continue;
+        }
+
+        off_t size = segment->records * sizeof(struct TransactionLog);
+        query->map = mmap(NULL, size, PROT_READ, MAP_SHARED, logFile, 0);
+        close(logFile);
+        if (query->map == MAP_FAILED) {
+            perror("Audit: mmap failed");
+            query->map = NULL;
+            continue;
+        }
+        madvise(query->map, size, MADV_SEQUENTIAL);
+        query->mapSize = size;
+
+        off_t records = segment->records;
+        off_t first = query->filter.fromDay != 0 ? auditFirstOnOrAfter(query, records, query->filter.fromDay) : 0;
+        off_t last = query->filter.toDay != 0 ? auditFirstOnOrAfter(query, records, query->filter.toDay + 1) : records;
+        query->position = first * sizeof(struct TransactionLog);
+        query->limit = last * sizeof(struct TransactionLog);
+        if (query->position < query->limit) return 1;
+        munmap(query->map, query->mapSize);
+        query->map = NULL;
+    }
+    return 0;
+}
+
+void openAuditQuery(struct AuditQuery *query, struct AuditFilter *filter, int threads)
+{
+    memset(query, 0, sizeof(*query));
+    query->filter = *filter;
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    query->threads = threads > AUDIT_THREADS_MAX ? AUDIT_THREADS_MAX : threads;
+    query->windowChunks = query->threads * AUDIT_WINDOW_CHUNKS;
+
+    query->matches = malloc(query->windowChunks * AUDIT_CHUNK_RECORDS * sizeof(off_t));
+    query->chunkMatches = malloc(query->windowChunks * AUDIT_CHUNK_RECORDS * sizeof(int));
+    query->chunkCounts = malloc(query->windowChunks * sizeof(int));
+    if (query->matches == NULL || query->chunkMatches == NULL || query->chunkCounts == NULL) {
+        perror("Audit: out of memory");
+        return; // no map, nothing to scan
+    }
+
+    // an account's entries are all in its own shard
+    query->shard = filter->accountID != 0 ? accountShard(filter->accountID) : 0;
+    query->lastShard = filter->accountID != 0 ? query->shard : ACCOUNT_SHARDS - 1;
+    openAuditSegment(query);
+}
+
+void closeAuditQuery(struct AuditQuery *query)
+{
+    if (query->map != NULL && query->map != (char *)query->decompressed) munmap(query->map, query->mapSize);
+    closeSegmentArchive(&query->archive);
+    free(query->decompressed);
+    freeLogSegments(&query->segments);
+    free(query->matches);
+    free(query->chunkMatches);
+    free(query->chunkCounts);
+    memset(query, 0, sizeof(*query));
+}
+
+int auditQueryHasMore(struct AuditQuery *query)
+{
+    return query->matchNext < query->matchCount ||
+           (query->map != NULL && (query->position < query->limit || query->block < query->archive.header.blocks ||
+                                   query->segment < query->segments.count || query->shard < query->lastShard));
+}
+
+static void *auditWorker(void *arg)
+{
+    struct AuditWindow *window = (struct AuditWindow *)arg;
+    struct AuditQuery *query = window->query;
+    int chunk;
+    while ((chunk = __atomic_fetch_add(&window->nextChunk, 1, __ATOMIC_RELAXED)) < window->chunks) {
+        off_t start = query->position + (off_t)chunk * AUDIT_CHUNK_RECORDS * sizeof(struct TransactionLog);
+        off_t count = (query->limit - start) / sizeof(struct TransactionLog);
+        if (count > AUDIT_CHUNK_RECORDS) count = AUDIT_CHUNK_RECORDS;
+        struct TransactionLog *logs = (struct TransactionLog *)(query->map + start);
+        int *found = query->chunkMatches + chunk * AUDIT_CHUNK_RECORDS, matched = 0;
+        for (int i = 0; i < count; i++) {
+            if (auditEntryMatches(&query->filter, &logs[i])) found[matched++] = i;
+        }
+        query->chunkCounts[chunk] = matched;
+    }
+    return NULL;
+}
+
+// scan the next window into matches, moving on to the next segment at the end of this one.
+// returns the number of matches, which can be 0 with more left to scan
+int scanAuditWindow(struct AuditQuery *query)
+{
+    pthread_t workers[AUDIT_THREADS_MAX];
+    int started[AUDIT_THREADS_MAX] = {0};
+    struct AuditWindow window = {query, 0, 0};
+
+    query->matchCount = query->matchNext = 0;
+    if (query->map == NULL) return 0;
+
+    off_t records = (query->limit - query->position) / sizeof(struct TransactionLog);
+    off_t chunks = (records + AUDIT_CHUNK_RECORDS - 1) / AUDIT_CHUNK_RECORDS;
+    window.chunks = chunks < query->windowChunks ? chunks : query->windowChunks;
+
+    // a small window isn't worth a thread
+    int threads = window.chunks < query->threads ? window.chunks : query->threads;
+    for (int t = 1; t < threads; t++) started[t] = pthread_create(&workers[t], NULL, auditWorker, &window) == 0;
+    auditWorker(&window); // this thread is one of them
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(workers[t], NULL);
+    }
+
+    // chunk order is log order
+    for (int chunk = 0; chunk < window.chunks; chunk++) {
+        off_t chunkStart = query->position + (off_t)chunk * AUDIT_CHUNK_RECORDS * sizeof(struct TransactionLog);
+        for (int i = 0; i < query->chunkCounts[chunk]; i++) {
+            query->matches[query->matchCount++] = chunkStart + query->chunkMatches[chunk * AUDIT_CHUNK_RECORDS + i] * sizeof(struct TransactionLog);
+        }
+    }
+
+    off_t scannedTo = query->position + (off_t)window.chunks * AUDIT_CHUNK_RECORDS * sizeof(struct TransactionLog);
+    query->scanned += ((scannedTo < query->limit ? scannedTo : query->limit) - query->position) / sizeof(struct TransactionLog);
+    query->matched += query->matchCount;
+    query->position = scannedTo;
+    if (query->position >= query->limit) {
+        // the matches point into this map, keep it until they are handed out
+        query->position = query->limit = 0;
+    }
+    return query->matchCount;
+}
+
+// the next match in log order, NULL when there are none left
+struct TransactionLog *nextAuditMatch(struct AuditQuery *query)
+{
+    while (query->matchNext >= query->matchCount) {
+        if (query->map == NULL) return NULL;
+        if (query->position >= query->limit && !openAuditSegment(query)) return NULL;
+        scanAuditWindow(query);
+    }
+    return (struct TransactionLog *)(query->map + query->matches[query->matchNext++]);
+}
+
+// cursor page of up to pageSize matches. one that doesn't fit waits for the next page
+int fillAuditPage(struct AuditQuery *query, char *page, size_t pageCapacity, int pageSize)
+{
+    char line[sizeof(((struct TransactionLog *)0)->logEntry) + 32];
+    int added = 0;
+
+    while (added < pageSize) {
+        struct TransactionLog *log = nextAuditMatch(query);
+        if (log == NULL) break;
+        size_t length = strnlen(log->logEntry, sizeof(log->logEntry));
+        snprintf(line, sizeof(line), "acc %d: %.*s", log->accountID, (int)length, log->logEntry);
+        if (length == 0 || log->logEntry[length - 1] != '\n') strcat(line, "\n");
+        if (strlen(page) + strlen(line) + 1 > pageCapacity) {
+            query->matchNext--;
+            break;
+        }
+        strcat(page, line);
+        added++;
+    }
+    return added;
+}
+
+int runAudit(int argc, char *argv[])
+{
+    struct AuditFilter filter;
+    struct AuditQuery query;
+    struct timespec started, finished;
+    struct TransactionLog *log;
+    int threads = 0;
+
+    memset(&filter, 0, sizeof(filter));
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--account") == 0) filter.accountID = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--from") == 0) filter.fromDay = parseAuditDay(argv[i + 1]);
+        else if (strcmp(argv[i], "--to") == 0) filter.toDay = parseAuditDay(argv[i + 1]);
+        else if (strcmp(argv[i], "--min") == 0) filter.minCents = (long long)(atof(argv[i + 1]) * 100 + 0.5);
+        else if (strcmp(argv[i], "--type") == 0) filter.types = parseAuditTypes(argv[i + 1]);
+        else if (strcmp(argv[i], "--text") == 0) snprintf(filter.text, sizeof(filter.text), "%s", argv[i + 1]);
+        else if (strcmp(argv[i], "--threads") == 0) threads = atoi(argv[i + 1]);
+        else printf("Audit: ignoring unknown option %s\n", argv[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    openAuditQuery(&query, &filter, threads);
+    while ((log = nextAuditMatch(&query)) != NULL) {
+        size_t length = strnlen(log->logEntry, sizeof(log->logEntry));
+        printf("acc %d: %.*s", log->accountID, (int)length, log->logEntry);
+        if (length == 0 || log->logEntry[length - 1] != '\n') printf("\n");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    fprintf(stderr, "Audit: %lld matches in %lld entries scanned, %d threads, %.2f s\n",
+            query.matched, query.scanned, query.threads, seconds);
+    closeAuditQuery(&query);
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // memmem, see audit_ops.h
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
@@ -13,6 +14,7 @@
 #include<sys/wait.h>
 #include<errno.h>
 #include<signal.h>
+#include<poll.h>
 
 // Database file paths
 #define EMPLOYEE_DB "employee_records.dat"
@@ -20,15 +22,19 @@
 #define LOAN_DB "loan_records.dat"
 #define LOAN_COUNTER_DB "loan_id_counter.dat"
 #define HISTORY_DB "transaction_logs.dat"
-#define FEEDBACK_DB "feedback_logs.dat"
+#define FEEDBACK_DB "feedback_logs.dat" // fixed size records from before the feedback store
+#define FEEDBACK_MESSAGES_DB "feedback_messages.dat"
+#define FEEDBACK_ENTRIES_DB "feedback_entries.dat"
+#define FEEDBACK_INDEX_DB "feedback_index.dat"
 #define ADMIN_PASS_DB "admin_pass.dat"
 
 // promptss
 #define MAIN_PROMPT "\n===== Login As =====\n1. Customer\n2. Employee\n3. Manager\n4. Admin\n5. Exit\nEnter your choice: "
 #define ADMIN_PROMPT "\n===== Admin =====\n1. Add New Bank Employee\n2. Modify Customer/Employee Details\n3. Manage User Roles\n4. Change Password\n5. Logout\nEnter your choice: "
 #define CUSTOMER_PROMPT "\n===== Customer =====\n1. Deposit\n2. Withdraw\n3. View Balance\n4. Apply for a loan\n5. Money Transfer\n6. Change Password\n7. View Transaction\n8. Add Feedback\n9. Logout\n10. Exit\nEnter your choice: "
-#define EMPLOYEE_PROMPT "\n===== Employee =====\n1. Add New Customer\n2. Modify Customer Details\n3. Approve/Reject Loans\n4. View Assigned Loan Applications\n5. View Customer Transactions\n6. Change Password\n7. Logout\n8. Exit\nEnter your choice: "
-#define MANAGER_PROMPT "\n===== Manager =====\n1. Activate/Deactivate Customer Accounts\n2. Assign Loan Application Processes to Employees\n3. Review Customer Feedback\n4. Change Password\n5. Logout\n6. Exit\nEnter your choice: "
+#define EMPLOYEE_PROMPT "\n===== Employee =====\n1. Add New Customer\n2. Modify Customer Details\n3. Approve/Reject Loans\n4. Bulk Approve/Reject Loans\n5. View Assigned Loan Applications\n6. View Customer Transactions\n7. Change Password\n8. Audit Transaction Logs\n9. Logout\n10. Exit\nEnter your choice: "
+#define MANAGER_PROMPT "\n===== Manager =====\n1. Activate/Deactivate Customer Accounts\n2. Assign or Reassign Loan Applications\n3. Review Customer Feedback\n4. Change Password\n5. Export Account Statement\n6. Export Transactions for a Day\n7. View Rate Limit Stats\n8. Audit Transaction Logs\n9. Logout\n10. Exit\nEnter your choice: "
+#define REPLICA_PROMPT "\n===== Read-Only Replica =====\n1. View Balance\n2. View Transactions\n3. Replication Status\n4. Exit\nEnter your choice: "
 
 // Global buffers and file descriptors
 int writeBytes, readBytes;
@@ -39,6 +45,7 @@ void handleManagerSession(int clientSocket);
 void handleAdminSession(int clientSocket);
 void handleCustomerSession(int clientSocket);
 void clientConnectionLoop(int clientSocketFD);
+void restartExitedHelpers(int serverSocketFD);
 void terminateClientSession(int clientSocket, int sessionID);
 
 // Session management (semaphore) prototypes and globals
@@ -50,12 +57,70 @@ sem_t *sessionSemaphore;
 char sessionSemName[50]; 
 
 #include "bank_records.h" 
+#include "shm_ops.h"
+#include "shard_ops.h"
+#include "handle_ops.h"
+#include "timeout_ops.h"
+#include "credential_ops.h"
+#include "session_ops.h"
+#include "admission_ops.h"
+#include "ratelimit_ops.h"
+#include "replica_ops.h"
+#include "uring_ops.h"
+#include "record_ops.h"
+#include "segment_ops.h"
+#include "archive_ops.h"
+#include "hot_ops.h"
+#include "accrual_ops.h"
+#include "reconcile_ops.h"
+#include "audit_ops.h"
+#include "loan_id_ops.h"
+#include "loan_sched_ops.h"
+#include "feedback_ops.h"
+#include "cursor_ops.h"
+#include "export_ops.h"
 #include "customer_ops.h" 
 #include "admin_ops.h"
 #include "employee_ops.h"
 #include "manager_ops.h"
+#include "bench_ops.h"
+#include "prefork_ops.h"
+
+// ./server             -> primary
+// ./server --prefork [workers] [sessions per worker] -> primary with a pool of long lived workers
+// ./server --replica   -> hot standby fed by log shipping, read-only sessions on REPLICA_PORT
+// ./server --promote   -> ask the running replica to take over
+// ./server --bench-io [iterations] -> compare the posix and io_uring commit paths
+// ./server --bench [sizes, iterations, json] -> storage micro-benchmarks, see bench_ops.h
+// ./server --accrue [rate %] [fee] [min balance] -> the nightly interest and fee run, see accrual_ops.h
+// ./server --reconcile [threads] -> check every balance against its log entries, see reconcile_ops.h
+// ./server --audit [filters] -> search the transaction logs, see audit_ops.h
+// admission limits, client timeouts, rate limits, hot accounts and log segments go after the
+// mode, see admission_ops.h, timeout_ops.h, ratelimit_ops.h, hot_ops.h and segment_ops.h
+int main(int argc, char *argv[])
+{
+    parseTimeoutOptions(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--replica") == 0) return runReplicaServer();
+    if (argc > 1 && strcmp(argv[1], "--promote") == 0) return sendPromoteCommand();
+    if (argc > 1 && strcmp(argv[1], "--bench-io") == 0) return runStorageBenchmark(argc > 2 ? atoi(argv[2]) : STORAGE_BENCH_ITERATIONS);
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return runBenchmarks(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--accrue") == 0) return runAccrual(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--reconcile") == 0) return runReconciliation(argc > 2 ? atoi(argv[2]) : 0);
+    if (argc > 1 && strcmp(argv[1], "--audit") == 0) return runAudit(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--prefork") == 0) {
+        preforkWorkers = argc > 2 ? atoi(argv[2]) : PREFORK_WORKERS;
+        if (argc > 3) preforkSessionsPerWorker = atoi(argv[3]);
+        if (preforkWorkers <= 0) preforkWorkers = PREFORK_WORKERS;
+        if (preforkSessionsPerWorker <= 0) preforkSessionsPerWorker = PREFORK_SESSIONS_PER_WORKER;
+    }
+    parseAdmissionOptions(argc, argv);
+    parseRateLimitOptions(argc, argv);
+    parseHotAccountOptions(argc, argv);
+    parseSegmentOptions(argc, argv);
+    return runPrimaryServer();
+}
 
-int main()
+int runPrimaryServer()
 {
     int serverSocketFD, clientSocketFD;
     int bindStatus, listenStatus;
@@ -76,6 +141,10 @@ int main()
     if (setsockopt(serverSocketFD, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
         perror("setsockopt(SO_REUSEADDR) failed");
     }
+    // prefork pools can overlap during a restart: the new pool binds while the old one drains
+    if (preforkWorkers > 0 && setsockopt(serverSocketFD, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt(SO_REUSEPORT) failed");
+    }
 
     serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
     serverAddress.sin_family = AF_INET;
@@ -90,7 +159,7 @@ int main()
     }
     printf("Binding to socket successful!\n");
 
-    listenStatus = listen(serverSocketFD, 10); // 10 is the backlog
+    listenStatus = listen(serverSocketFD, listenBacklog);
     if (listenStatus == -1)
     {
         perror("Server listen failed");
@@ -102,8 +171,51 @@ int main()
     // cleanup function
     setupSignalHandlers();
 
+    if (!migrateToShards()) {
+        printf("Server: account shard migration failed\n");
+        close(serverSocketFD);
+        exit(EXIT_FAILURE);
+    }
+    if (!migrateCredentials()) {
+        printf("Server: password migration failed\n");
+        close(serverSocketFD);
+        exit(EXIT_FAILURE);
+    }
+    if (!migrateFeedbackStore()) {
+        printf("Server: feedback migration failed\n");
+        close(serverSocketFD);
+        exit(EXIT_FAILURE);
+    }
+
+    // fresh shared state for this run
+    resetAccountIndex();
+    resetReadPathRegion();
+    recoverLogSegments();
+    probeStorageBackend();
+    resetLoginCache();
+    resetSessionTable();
+    resetAdmission();
+    resetRateLimits();
+    resetHotAccounts();
+    resetLoanIDAllocator();
+    resetLoanScheduler();
+    assignWaitingLoans();
+
+    startHotFlusher(serverSocketFD);
+    startLogMaintainer(serverSocketFD);
+
+    if (preforkWorkers > 0) return runPreforkPool(serverSocketFD);
+    // children are reaped by the kernel, so a session child that died is gone for kill(pid, 0)
+    // and its session can be resumed
+    signal(SIGCHLD, SIG_IGN);
+    struct pollfd listener = {serverSocketFD, POLLIN, 0};
+
     while(1)
     {
+        // wake up every second even without clients so a dead helper is noticed
+        restartExitedHelpers(serverSocketFD);
+        if (poll(&listener, 1, 1000) == 0) continue;
+
         clientAddrSize = sizeof(clientAddress);
         clientSocketFD = accept(serverSocketFD, (struct sockaddr *) &clientAddress, &clientAddrSize);
 
@@ -117,6 +229,13 @@ int main()
             continue; // continue listening
         }
 
+        // sessions and queue both full: say so now instead of forking for it
+        if (admissionBusy()) {
+            write(clientSocketFD, ADMISSION_BUSY_MESSAGE, strlen(ADMISSION_BUSY_MESSAGE));
+            close(clientSocketFD);
+            continue;
+        }
+
         pid_t childPid = fork();
 
         if(childPid < 0) { 
@@ -127,6 +246,7 @@ int main()
         else if(childPid == 0)
         {
             close(serverSocketFD);// listener not needed for child
+            signal(SIGPIPE, SIG_IGN); // a vanished client shows up as a failed write, so the session gets detached
             printf("Client connected. FD: %d, Process ID: %d\n", clientSocketFD, getpid());
             clientConnectionLoop(clientSocketFD);
             printf("Client FD %d disconnected. Child process %d exiting.\n", clientSocketFD, getpid());
@@ -144,13 +264,34 @@ int main()
     return 0;
 }
 
+// fork mode: exited children are reaped by the kernel, so a helper that died is one
+// whose pid is gone. prefork mode gets the same from waitpid, see runPreforkPool
+void restartExitedHelpers(int serverSocketFD)
+{
+    if (hotFlusherPid > 0 && kill(hotFlusherPid, 0) == -1 && errno == ESRCH) {
+        printf("Server: hot account flusher (pid %d) exited, restarting it\n", hotFlusherPid);
+        hotFlusherPid = 0;
+        startHotFlusher(serverSocketFD);
+    }
+    if (logMaintainerPid > 0 && kill(logMaintainerPid, 0) == -1 && errno == ESRCH) {
+        printf("Server: log maintainer (pid %d) exited, restarting it\n", logMaintainerPid);
+        logMaintainerPid = 0;
+        startLogMaintainer(serverSocketFD);
+    }
+}
+
 // got o main menu and handle that
 void clientConnectionLoop(int clientSocketFD)
 {
     int userChoice;
 
+    configureClientSocket(clientSocketFD);
+    identifyClient(clientSocketFD);
+    if (!admitConnection(clientSocketFD)) return;
+
     while(1)
     {
+        enterClientState(CLIENT_STATE_LOGIN);
         bzero(outBuffer, sizeof(outBuffer)); // clear buffer
         strcpy(outBuffer, MAIN_PROMPT);
         writeBytes = write(clientSocketFD, outBuffer, strlen(outBuffer));
@@ -160,7 +301,7 @@ void clientConnectionLoop(int clientSocketFD)
         }
 
         bzero(inBuffer, sizeof(inBuffer));
-        readBytes = read(clientSocketFD, inBuffer, sizeof(inBuffer) - 1);
+        readBytes = readClient(clientSocketFD, inBuffer, sizeof(inBuffer) - 1);
         if(readBytes <= 0) {
              perror("Read main choice failed or client disconnected");
             break;
@@ -168,8 +309,22 @@ void clientConnectionLoop(int clientSocketFD)
         inBuffer[readBytes] = '\0'; // didn't read null so insert null
         inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
 
+        // "resume <token>" from a client that lost its connection: straight back to its menu.
+        // resumeSession admits the role against its quota
+        if (strncmp(inBuffer, "resume ", 7) == 0) {
+            switch (resumeSession(clientSocketFD, inBuffer + 7)) {
+                case SESSION_CUSTOMER: handleCustomerSession(clientSocketFD); break;
+                case SESSION_EMPLOYEE: handleEmployeeSession(clientSocketFD); break;
+                case SESSION_MANAGER: handleManagerSession(clientSocketFD); break;
+                case SESSION_ADMIN: handleAdminSession(clientSocketFD); break;
+            }
+            releaseRole();
+            continue;
+        }
+
         userChoice = atoi(inBuffer);
         printf("Client FD %d choice: %d\n", clientSocketFD, userChoice);
+        if (userChoice >= 1 && userChoice <= 4 && !admitRole(clientSocketFD, userChoice)) continue;
 
         switch (userChoice)
         {
@@ -187,6 +342,9 @@ void clientConnectionLoop(int clientSocketFD)
                 break;
             case 5:
                 terminateClientSession(clientSocketFD, 0); //special ID 0 for non-logged-in exit
+                detachSession();
+                releaseRecordLocks();
+                releaseConnection();
                 return; 
             default:
                 bzero(outBuffer, sizeof(outBuffer));
@@ -194,9 +352,13 @@ void clientConnectionLoop(int clientSocketFD)
                 write(clientSocketFD, outBuffer, strlen(outBuffer));
                 // Wait for ack
                 bzero(inBuffer, sizeof(inBuffer));
-                read(clientSocketFD, inBuffer, 3);
+                readClient(clientSocketFD, inBuffer, 3);
         }
+        releaseRole();
     }
+    detachSession(); // dropped, the session stays resumable
+    releaseRecordLocks();
+    releaseConnection();
 }
 
 // clean up semaphore and informs client before closing connection
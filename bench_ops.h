@@ -0,0 +1,336 @@
+#ifndef BENCH_OPS_H
+#define BENCH_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Micro-benchmarks of the storage primitives, one at a time, against scratch databases
+// in a fresh directory under bench_data/ that is removed afterwards. For every size (the
+// number of accounts; the log and the loan file get as many records) the database is
+// rebuilt and each case timed over --iterations operations, or BENCH_CASE_MICROS if that
+// comes first. Cases marked (any size) don't depend on it and are a baseline per size:
+//   account_lookup_scan   the shard file scan a lookup falls back to (scanAccountOffset)
+//   account_lookup_index  findAccountOffset through the shared memory index
+//   record_lock           fcntl write lock and unlock of one account record (any size)
+//   history_tail_read     the first page of viewTransactionLogs for an account
+//   log_append            one TransactionLog appended under the history lock
+//   loan_scan             the loan file scan of viewAssignedLoans for one employee
+//   loan_id               allocateLoanID, the counter requestLoan takes IDs from (any size)
+//   loan_id_locked        allocateLoanIDLocked, its locked counter file fallback (any size)
+// Accounts, log entries and loans are picked at random with a fixed seed, so runs are
+// comparable. Results go to stdout and, as JSON, to --json for tracking over time.
+// Shared memory regions get their own prefix and nothing is shipped to a replica.
+//
+// ./server --bench [--sizes n,n,...] [--iterations n] [--json path]
+// make bench
+
+#define BENCH_SIZES "100,1000,10000"
+#define BENCH_SIZES_MAX 16
+#define BENCH_ITERATIONS 2000
+#define BENCH_CASE_MICROS 1000000 // a slow case stops after this long
+#define BENCH_RESULTS "bench_results.json"
+#define BENCH_EMPLOYEES 8 // loans are assigned among employees 1..BENCH_EMPLOYEES
+#define BENCH_PATH_SIZE 512
+
+struct BenchResult {
+    const char *name;
+    int size;
+    long long ops;
+    long long nanos;
+};
+
+struct BenchCase {
+    const char *name;
+    void (*run)(int size);
+};
+
+int benchShardAccounts[ACCOUNT_SHARDS]; // records in each shard's account file
+int benchSink; // keeps results the compiler could otherwise drop
+
+int runBenchmarks(int argc, char *argv[]);
+int createBenchDatabase(int size);
+int writeBenchResults(const char *path, struct BenchResult *results, int count, int iterations);
+
+static long long benchNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int benchAccountID(int size)
+{
+    return 1 + rand() % size;
+}
+
+static void benchAccountScan(int size)
+{
+    int accountID = benchAccountID(size);
+    scanAccountOffset(accountHandle(accountID), accountID);
+}
+
+static void benchAccountIndex(int size)
+{
+    int accountID = benchAccountID(size);
+    findAccountOffset(accountHandle(accountID), accountID);
+}
+
+static void benchRecordLock(int size)
+{
+    (void)size; // one record, however many there are
+    int shard = rand() % ACCOUNT_SHARDS;
+    if (benchShardAccounts[shard] == 0) return;
+    off_t offset = (off_t)(rand() % benchShardAccounts[shard]) * sizeof(struct AccountHolder);
+    struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+    int dbFile = databaseHandle(HANDLE_ACCOUNT, shard);
+    fcntl(dbFile, F_SETLKW, &lock);
+    lock.l_type = F_UNLCK;
+    fcntl(dbFile, F_SETLK, &lock);
+}
+
+static void benchHistoryTail(int size)
+{
+    struct PageCursor cursor;
+    char page[sizeof(outBuffer)];
+    page[0] = '\0';
+    openHistoryCursor(&cursor, benchAccountID(size));
+    fillCursorPage(&cursor, page, sizeof(page) - PAGE_PROMPT_RESERVE);
+    closeCursor(&cursor);
+}
+
+static void benchLogAppend(int size)
+{
+    struct TransactionLog log;
+    time_t now = time(NULL);
+    log.accountID = benchAccountID(size);
+    bzero(log.logEntry, sizeof(log.logEntry));
+    strftime(log.logEntry, sizeof(log.logEntry), "1.00 deposited at %H:%M:%S %Y-%m-%d\n", localtime(&now));
+    int logFile = lockHistory(accountShard(log.accountID));
+    if (logFile == -1) return;
+    appendTransactionLog(logFile, &log);
+    unlockHistory(logFile);
+}
+
+// the lock free scan viewAssignedLoans does, the loan file has size records
+static void benchLoanScan(int size)
+{
+    struct LoanRecord loan;
+    int employeeID = 1 + rand() % BENCH_EMPLOYEES, found = 0;
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
+    off_t position = 0;
+    (void)size;
+    while (pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan)) {
+        position += sizeof(loan);
+        if (loan.assignedEmployeeID == employeeID && loan.loanStatus == 1) found++;
+    }
+    benchSink += found;
+}
+
+static void benchLoanID(int size)
+{
+    (void)size;
+    allocateLoanID();
+}
+
+static void benchLoanIDLocked(int size)
+{
+    (void)size;
+    allocateLoanIDLocked();
+}
+
+// history_tail_read runs before log_append grows the log
+struct BenchCase benchCases[] = {
+    {"account_lookup_scan", benchAccountScan},
+    {"account_lookup_index", benchAccountIndex},
+    {"record_lock", benchRecordLock},
+    {"history_tail_read", benchHistoryTail},
+    {"log_append", benchLogAppend},
+    {"loan_scan", benchLoanScan},
+    {"loan_id", benchLoanID},
+    {"loan_id_locked", benchLoanIDLocked},
+};
+
+// size accounts, as many log entries and loans, in the current directory. 0 on failure
+int createBenchDatabase(int size)
+{
+    struct AccountHolder account;
+    struct TransactionLog log;
+    struct LoanRecord loan;
+    struct IDGenerator idGen = {size + 1};
+    int dbFiles[ACCOUNT_SHARDS], logFiles[ACCOUNT_SHARDS], ok = 1;
+    time_t now = time(NULL);
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        dbFiles[shard] = openShardFile(ACCOUNT_DB, shard, O_WRONLY | O_CREAT | O_TRUNC);
+        logFiles[shard] = openShardFile(HISTORY_DB, shard, O_WRONLY | O_CREAT | O_TRUNC);
+        if (dbFiles[shard] == -1 || logFiles[shard] == -1) ok = 0;
+        benchShardAccounts[shard] = 0;
+    }
+    int loanFile = open(LOAN_DB, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int counterFile = open(LOAN_COUNTER_DB, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (loanFile == -1 || counterFile == -1) ok = 0;
+
+    for (int i = 1; ok && i <= size; i++) {
+        memset(&account, 0, sizeof(account));
+        account.accountID = i;
+        account.currentBalance = 1000;
+        account.isActive = 1;
+        strcpy(account.holderName, "bench");
+        strcpy(account.password, "bench");
+        int shard = accountShard(i);
+        ok = write(dbFiles[shard], &account, sizeof(account)) == sizeof(account);
+        benchShardAccounts[shard]++;
+
+        log.accountID = benchAccountID(size);
+        bzero(log.logEntry, sizeof(log.logEntry));
+        strftime(log.logEntry, sizeof(log.logEntry), "1.00 deposited at %H:%M:%S %Y-%m-%d\n", localtime(&now));
+        ok = ok && write(logFiles[accountShard(log.accountID)], &log, sizeof(log)) == sizeof(log);
+
+        loan.assignedEmployeeID = 1 + rand() % BENCH_EMPLOYEES;
+        loan.accountID = benchAccountID(size);
+        loan.loanRecordID = i;
+        loan.amount = 1000 + rand() % 100000;
+        loan.loanStatus = rand() % 4;
+        ok = ok && write(loanFile, &loan, sizeof(loan)) == sizeof(loan);
+    }
+    ok = ok && write(counterFile, &idGen, sizeof(idGen)) == sizeof(idGen);
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (dbFiles[shard] != -1) close(dbFiles[shard]);
+        if (logFiles[shard] != -1) close(logFiles[shard]);
+    }
+    if (loanFile != -1) close(loanFile);
+    if (counterFile != -1) close(counterFile);
+    if (!ok) {
+        perror("Bench: Error creating scratch database");
+        return 0;
+    }
+
+    // reopen the cached handles and rebuild the shared state from the new files
+    resetHandleCache();
+    resetAccountIndex();
+    resetReadPathRegion();
+    resetSharedRegion(LOAN_ID_REGION);
+    loanIDRegion = NULL;
+    return 1;
+}
+
+int writeBenchResults(const char *path, struct BenchResult *results, int count, int iterations)
+{
+    char started[32];
+    time_t now = time(NULL);
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Bench: Error writing results");
+        return 0;
+    }
+
+    strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(out, "{\n  \"suite\": \"storage\",\n  \"time\": \"%s\",\n  \"shards\": %d,\n  \"iterations\": %d,\n  \"results\": [\n",
+            started, ACCOUNT_SHARDS, iterations);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "    {\"case\": \"%s\", \"size\": %d, \"ops\": %lld, \"ns_per_op\": %.1f}%s\n",
+                results[i].name, results[i].size, results[i].ops,
+                results[i].ops > 0 ? (double)results[i].nanos / results[i].ops : 0.0, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+static int removeBenchFile(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st; (void)type; (void)ftw;
+    remove(path);
+    return 0;
+}
+
+int runBenchmarks(int argc, char *argv[])
+{
+    char runDir[] = STORAGE_BENCH_DIR "/run.XXXXXX";
+    char resultsPath[BENCH_PATH_SIZE], home[BENCH_PATH_SIZE];
+    const char *sizesOption = BENCH_SIZES, *resultsOption = BENCH_RESULTS;
+    int sizes[BENCH_SIZES_MAX], sizeCount = 0, iterations = BENCH_ITERATIONS;
+    int caseCount = sizeof(benchCases) / sizeof(benchCases[0]), ok = 1;
+
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--sizes") == 0) sizesOption = argv[i + 1];
+        else if (strcmp(argv[i], "--iterations") == 0) iterations = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--json") == 0) resultsOption = argv[i + 1];
+        else printf("Bench: ignoring unknown option %s\n", argv[i]);
+    }
+    for (const char *next = sizesOption; *next != '\0' && sizeCount < BENCH_SIZES_MAX; next++) {
+        int size = atoi(next);
+        if (size > 0) sizes[sizeCount++] = size;
+        next = strchr(next, ',');
+        if (next == NULL) break;
+    }
+    if (iterations <= 0) iterations = BENCH_ITERATIONS;
+    if (sizeCount == 0) {
+        printf("Bench: no database sizes given\n");
+        return EXIT_FAILURE;
+    }
+
+    // the results path is relative to where we were started, the run happens in runDir
+    if (getcwd(home, sizeof(home)) == NULL) {
+        perror("Bench: getcwd failed");
+        return EXIT_FAILURE;
+    }
+    int pathLength = resultsOption[0] == '/' ? snprintf(resultsPath, sizeof(resultsPath), "%s", resultsOption)
+                                             : snprintf(resultsPath, sizeof(resultsPath), "%s/%s", home, resultsOption);
+    if (pathLength >= (int)sizeof(resultsPath)) {
+        printf("Bench: results path too long\n");
+        return EXIT_FAILURE;
+    }
+    mkdir(STORAGE_BENCH_DIR, 0755);
+    if (mkdtemp(runDir) == NULL || chdir(runDir) == -1) {
+        perror("Bench: Error creating scratch directory");
+        return EXIT_FAILURE;
+    }
+    strcpy(shmPrefix, SHM_PREFIX "_bench");
+    replicaShipDisabled = 1;
+
+    struct BenchResult *results = malloc(sizeCount * caseCount * sizeof(struct BenchResult));
+    int resultCount = 0;
+    if (results == NULL) {
+        perror("Bench: out of memory");
+        return EXIT_FAILURE;
+    }
+    printf("%-22s %10s %10s %14s\n", "case", "size", "ops", "ns/op");
+    for (int s = 0; s < sizeCount && ok; s++) {
+        srand(sizes[s]);
+        ok = createBenchDatabase(sizes[s]);
+        for (int c = 0; c < caseCount && ok; c++) {
+            struct BenchResult *result = &results[resultCount++];
+            result->name = benchCases[c].name;
+            result->size = sizes[s];
+            result->ops = 0;
+
+            long long startedAt = benchNanos(), deadline = startedAt + BENCH_CASE_MICROS * 1000LL, now = startedAt;
+            while (result->ops < iterations && now < deadline) {
+                benchCases[c].run(sizes[s]);
+                result->ops++;
+                if (result->ops % 16 == 0 || result->ops == iterations) now = benchNanos();
+            }
+            result->nanos = benchNanos() - startedAt;
+            printf("%-22s %10d %10lld %14.1f\n", result->name, result->size, result->ops, (double)result->nanos / result->ops);
+        }
+    }
+
+    resetHandleCache();
+    if (chdir(home) == -1 || nftw(runDir, removeBenchFile, 16, FTW_DEPTH | FTW_PHYS) == -1) {
+        printf("Bench: could not remove %s\n", runDir);
+    }
+    ok = ok && writeBenchResults(resultsPath, results, resultCount, iterations);
+    if (ok) printf("Bench: results written to %s\n", resultsPath);
+    free(results);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
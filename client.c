@@ -7,35 +7,66 @@
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h> 
+#include <fcntl.h>
 
-void serverCommunicationLoop(int serverSocket);
+#define RECONNECT_ATTEMPTS 5 // one second apart, only when there is a session to resume
+
+int connectToServer(const char *serverIP, int serverPort);
+int serverCommunicationLoop(int serverSocket, int resuming);
 void getMaskedInput(char *buffer, int bufSize);
+int receiveExport(int serverSocket, const char *header);
+
+char sessionToken[64]; // from the last login, sent as "resume <token>" after a dropped connection
 
 int main(int argc, char *argv[]) 
 {
     int serverSocket;
-    int connectStatus;
-    struct sockaddr_in serverAddress;
     const char *serverIP = "127.0.0.1"; 
     int serverPort = 8080; 
 
-    // Optional: Allow specifying server IP and Port via command line
-    // if (argc > 1) {
-    //     serverIP = argv[1];
-    // }
-    // if (argc > 2) {
-    //     serverPort = atoi(argv[2]);
-    //     if (serverPort <= 0 || serverPort > 65535) {
-    //          fprintf(stderr, "Invalid port number: %s\n", argv[2]);
-    //          exit(EXIT_FAILURE);
-    //     }
-    // }
-
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    // Optional: server IP and port, e.g. ./client 127.0.0.1 8081 for the read-only replica
+    if (argc > 1) {
+        serverIP = argv[1];
+    }
+    if (argc > 2) {
+        serverPort = atoi(argv[2]);
+        if (serverPort <= 0 || serverPort > 65535) {
+             fprintf(stderr, "Invalid port number: %s\n", argv[2]);
+             exit(EXIT_FAILURE);
+        }
+    }
+
+    serverSocket = connectToServer(serverIP, serverPort);
+    if (serverSocket == -1) exit(EXIT_FAILURE);
+
+    int dropped = serverCommunicationLoop(serverSocket, 0);
+    close(serverSocket);
+
+    // lost the connection while logged in: reconnect and pick the session back up
+    int attempts = 0;
+    while (dropped && sessionToken[0] != '\0' && attempts < RECONNECT_ATTEMPTS) {
+        sleep(1);
+        attempts++;
+        printf("Reconnecting (attempt %d of %d)...\n", attempts, RECONNECT_ATTEMPTS);
+        serverSocket = connectToServer(serverIP, serverPort);
+        if (serverSocket == -1) continue;
+        attempts = 0;
+        dropped = serverCommunicationLoop(serverSocket, 1);
+        close(serverSocket);
+    }
+
+    printf("Connection closed.\n");
+    return 0; 
+}
+
+int connectToServer(const char *serverIP, int serverPort)
+{
+    struct sockaddr_in serverAddress;
+    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket == -1)
     {
         perror("Client socket creation failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
     printf("Client socket created\n");
 
@@ -44,24 +75,18 @@ int main(int argc, char *argv[])
     serverAddress.sin_port = htons(serverPort);
 
     printf("Attempting to connect to %s:%d...\n", serverIP, serverPort);
-    connectStatus = connect(serverSocket, (struct sockaddr *)&serverAddress, sizeof(serverAddress));
-    if(connectStatus == -1)
+    if(connect(serverSocket, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) == -1)
     {
         perror("Client connection to server failed");
         close(serverSocket);
-        exit(EXIT_FAILURE);
+        return -1;
     }
     printf("Connected to server\n");
-
-    serverCommunicationLoop(serverSocket);
-
-    close(serverSocket);
-    printf("Connection closed.\n");
-    return 0; 
+    return serverSocket;
 }
 
-// interacting with sever loop
-void serverCommunicationLoop(int serverSocket)
+// interacting with sever loop. returns 1 if the connection dropped, 0 if the session ended
+int serverCommunicationLoop(int serverSocket, int resuming)
 {
     char inBuffer[4096], outBuffer[4096], displayBuffer[4096];
     int readBytes, writeBytes;
@@ -79,16 +104,34 @@ void serverCommunicationLoop(int serverSocket)
              } else {
                 perror("\nRead from server failed");
              }
-            break;
+            return 1;
         }
         inBuffer[readBytes] = '\0'; 
+
+        char *tokenAt = strstr(inBuffer, "Session token: ");
+        if (tokenAt != NULL) sscanf(tokenAt + 15, "%63[0-9a-f]", sessionToken);
+        if (strstr(inBuffer, "please log in") != NULL) sessionToken[0] = '\0'; // resume refused
+
         int isPasswordPrompt = (strstr(inBuffer, "password:") != NULL || strstr(inBuffer, "Password:") != NULL);
 
         // Server signals client to exit immediately
         if(strcmp(inBuffer, "Client logging out...\n") == 0)
         {
             printf("%s", inBuffer);
-            break; // Exit loop
+            sessionToken[0] = '\0';
+            return 0;
+        }
+
+        // turned away by admission control: counts as a drop, so a session to resume is retried
+        if (strncmp(inBuffer, "Server busy", 11) == 0) {
+            printf("%s", inBuffer);
+            return 1;
+        }
+
+        // "EXPORT <name> <bytes>^": ack, then the raw bytes follow and go to ./<name>
+        if (strncmp(inBuffer, "EXPORT ", 7) == 0) {
+            if (!receiveExport(serverSocket, inBuffer)) return 1;
+            continue;
         }
 
         // Check if server sent a message ending with '^' (our signal for needing an ACK)
@@ -107,6 +150,12 @@ void serverCommunicationLoop(int serverSocket)
             fflush(stdout); // to ennsure prompt is displayed before input
             getMaskedInput(outBuffer, sizeof(outBuffer)); 
 
+        } else if (resuming && strstr(inBuffer, "===== Login As =====") != NULL) {
+            // first login menu after a reconnect: resume instead of asking
+            printf("Resuming session...\n");
+            snprintf(outBuffer, sizeof(outBuffer), "resume %s", sessionToken);
+            resuming = 0;
+
         } else {
             // Standard prompt from server, needs user input
              printf("%s", inBuffer);
@@ -115,7 +164,7 @@ void serverCommunicationLoop(int serverSocket)
              if (fgets(outBuffer, sizeof(outBuffer), stdin) == NULL) {
                  // Handle EOF or read error
                  printf("\nInput error or EOF detected. Exiting.\n");
-                 break;
+                 return 0;
              }
               // Remove trailing newline from fgets
              outBuffer[strcspn(outBuffer, "\r\n")] = 0;
@@ -126,7 +175,7 @@ void serverCommunicationLoop(int serverSocket)
         if(writeBytes < 0)
         {
             perror("Client write to server failed");
-            break;
+            return 1;
         }
         // write was not completed fully
         if (writeBytes < strlen(outBuffer)) {
@@ -135,6 +184,7 @@ void serverCommunicationLoop(int serverSocket)
 
 
     } while(readBytes > 0); // Continue loop as long as server is sending data
+    return 1;
 }
 
 // for passwords
@@ -172,4 +222,34 @@ void getMaskedInput(char *buffer, int bufSize) {
     // back to original settings
     tcsetattr(STDIN_FILENO, TCSANOW, &oldTerm);
     printf("\n");
-}
\ No newline at end of file
+}
+
+// returns 0 if the connection broke mid export
+int receiveExport(int serverSocket, const char *header)
+{
+    char name[256], data[65536];
+    long long remaining, total;
+    if (sscanf(header, "EXPORT %255s %lld", name, &remaining) != 2 || strchr(name, '/') != NULL) {
+        fprintf(stderr, "Bad export header: %s\n", header);
+        return 0;
+    }
+    total = remaining;
+
+    int outFile = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFile == -1) perror("Export: cannot create file, discarding data");
+    if (write(serverSocket, "ACK", 3) != 3) return 0;
+
+    while (remaining > 0) {
+        ssize_t got = read(serverSocket, data, remaining < (long long)sizeof(data) ? remaining : (long long)sizeof(data));
+        if (got <= 0) {
+            printf("\nServer closed the connection during export.\n");
+            if (outFile != -1) close(outFile);
+            return 0;
+        }
+        if (outFile != -1 && write(outFile, data, got) != got) perror("Export: write failed");
+        remaining -= got;
+    }
+    if (outFile != -1) close(outFile);
+    printf("Saved %lld bytes to %s\n", total, name);
+    return 1;
+}
@@ -0,0 +1,404 @@
+#ifndef CREDENTIAL_OPS_H
+#define CREDENTIAL_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+
+// Passwords are stored as salted PBKDF2-HMAC-SHA256 hashes in the existing password
+// fields, encoded as text so the record layouts stay the same:
+//   '$' + 12 byte salt (16 chars) + first 24 bytes of the hash (32 chars) = 49 chars.
+// Plaintext records from before are hashed in place at startup.
+//
+// The hashing cost is deliberate, so successful logins are remembered for a few minutes
+// in a shared memory cache: a digest of the password and the stored hash, keyed with a
+// secret that only this server run knows. A reconnecting terminal that sends the same
+// password again is checked against the digest instead of being hashed again. A wrong
+// password never matches the digest and always pays the full cost; changing a password
+// changes the stored hash, so the old digest stops matching.
+
+#define PASSWORD_HASH_ROUNDS 20000
+#define PASSWORD_SALT_BYTES 12
+#define PASSWORD_HASH_BYTES 24
+#define PASSWORD_HASH_LENGTH 49 // encoded, without the terminator
+#define LOGIN_CACHE_REGION "logincache"
+#define LOGIN_CACHE_SLOTS 4096 // one entry per (kind, id) slot, collisions just evict
+#define LOGIN_CACHE_TTL 300 // seconds after the full check
+
+#define LOGIN_CUSTOMER 0
+#define LOGIN_EMPLOYEE 1 // employees and managers
+#define LOGIN_ADMIN 2
+
+struct Sha256 {
+    unsigned int state[8];
+    unsigned long long length;
+    unsigned char block[64];
+    int used;
+};
+
+struct LoginCacheEntry {
+    int kind;
+    int id;
+    long long verifiedAt; // 0 = empty
+    unsigned char digest[32];
+};
+
+struct LoginCacheRegion {
+    int lockOwner; // pid, 0 = free
+    struct LoginCacheEntry entries[LOGIN_CACHE_SLOTS];
+};
+
+struct LoginCacheRegion *loginCacheRegion = NULL;
+unsigned char loginCacheSecret[32]; // set before the first fork, inherited by every session
+
+void sha256Init(struct Sha256 *sha);
+void sha256Update(struct Sha256 *sha, const void *data, size_t length);
+void sha256Final(struct Sha256 *sha, unsigned char *digest);
+void hmacSha256(const unsigned char *key, size_t keyLength, const unsigned char *data, size_t dataLength, unsigned char *mac);
+void derivePasswordHash(const char *password, const unsigned char *salt, unsigned char *hash);
+void encodeHashBytes(const unsigned char *bytes, int count, char *text);
+void hashPassword(const char *password, char *stored);
+int isHashedPassword(const char *stored);
+int verifyPassword(const char *password, const char *stored);
+void loginCacheDigest(int kind, int id, const char *password, const char *stored, unsigned char *digest);
+struct LoginCacheRegion *getLoginCache();
+void resetLoginCache();
+int checkCredentials(int kind, int id, const char *password, const char *stored);
+int migrateCredentials();
+void markReplicaStale(const char *reason); // replica_ops.h
+
+static const unsigned int sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(struct Sha256 *sha, const unsigned char *block)
+{
+    unsigned int w[64], s[8];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (unsigned int)block[i * 4] << 24 | (unsigned int)block[i * 4 + 1] << 16 | (unsigned int)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, sha->state, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        unsigned int t1 = s[7] + (SHA256_ROTR(s[4], 6) ^ SHA256_ROTR(s[4], 11) ^ SHA256_ROTR(s[4], 25)) +
+                          ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256K[i] + w[i];
+        unsigned int t2 = (SHA256_ROTR(s[0], 2) ^ SHA256_ROTR(s[0], 13) ^ SHA256_ROTR(s[0], 22)) +
+                          ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(unsigned int));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) sha->state[i] += s[i];
+}
+
+void sha256Init(struct Sha256 *sha)
+{
+    static const unsigned int initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->length = 0;
+    sha->used = 0;
+}
+
+void sha256Update(struct Sha256 *sha, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    sha->length += length;
+    while (length > 0) {
+        size_t take = 64 - sha->used < length ? 64 - sha->used : length;
+        memcpy(sha->block + sha->used, bytes, take);
+        sha->used += take;
+        bytes += take;
+        length -= take;
+        if (sha->used == 64) {
+            sha256Block(sha, sha->block);
+            sha->used = 0;
+        }
+    }
+}
+
+void sha256Final(struct Sha256 *sha, unsigned char *digest)
+{
+    unsigned long long bits = sha->length * 8;
+    sha->block[sha->used++] = 0x80;
+    if (sha->used > 56) {
+        memset(sha->block + sha->used, 0, 64 - sha->used);
+        sha256Block(sha, sha->block);
+        sha->used = 0;
+    }
+    memset(sha->block + sha->used, 0, 56 - sha->used);
+    for (int i = 0; i < 8; i++) sha->block[56 + i] = bits >> (56 - i * 8);
+    sha256Block(sha, sha->block);
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = sha->state[i] >> 24;
+        digest[i * 4 + 1] = sha->state[i] >> 16;
+        digest[i * 4 + 2] = sha->state[i] >> 8;
+        digest[i * 4 + 3] = sha->state[i];
+    }
+}
+
+void hmacSha256(const unsigned char *key, size_t keyLength, const unsigned char *data, size_t dataLength, unsigned char *mac)
+{
+    unsigned char keyBlock[64], pad[64], inner[32];
+    struct Sha256 sha;
+
+    memset(keyBlock, 0, sizeof(keyBlock));
+    if (keyLength > 64) {
+        sha256Init(&sha); sha256Update(&sha, key, keyLength); sha256Final(&sha, keyBlock);
+    } else {
+        memcpy(keyBlock, key, keyLength);
+    }
+
+    for (int i = 0; i < 64; i++) pad[i] = keyBlock[i] ^ 0x36;
+    sha256Init(&sha); sha256Update(&sha, pad, 64); sha256Update(&sha, data, dataLength); sha256Final(&sha, inner);
+    for (int i = 0; i < 64; i++) pad[i] = keyBlock[i] ^ 0x5c;
+    sha256Init(&sha); sha256Update(&sha, pad, 64); sha256Update(&sha, inner, 32); sha256Final(&sha, mac);
+}
+
+// pbkdf2, one block is enough for PASSWORD_HASH_BYTES. the hmac key is the same every
+// round, so its padded blocks are hashed once and the states copied
+void derivePasswordHash(const char *password, const unsigned char *salt, unsigned char *hash)
+{
+    unsigned char saltBlock[PASSWORD_SALT_BYTES + 4], keyBlock[64], pad[64], u[32], result[32];
+    struct Sha256 innerBase, outerBase, sha;
+    size_t passwordLength = strlen(password);
+
+    memset(keyBlock, 0, sizeof(keyBlock));
+    if (passwordLength > 64) {
+        sha256Init(&sha); sha256Update(&sha, password, passwordLength); sha256Final(&sha, keyBlock);
+    } else {
+        memcpy(keyBlock, password, passwordLength);
+    }
+    for (int i = 0; i < 64; i++) pad[i] = keyBlock[i] ^ 0x36;
+    sha256Init(&innerBase); sha256Update(&innerBase, pad, 64);
+    for (int i = 0; i < 64; i++) pad[i] = keyBlock[i] ^ 0x5c;
+    sha256Init(&outerBase); sha256Update(&outerBase, pad, 64);
+
+    memcpy(saltBlock, salt, PASSWORD_SALT_BYTES);
+    saltBlock[PASSWORD_SALT_BYTES] = 0; saltBlock[PASSWORD_SALT_BYTES + 1] = 0;
+    saltBlock[PASSWORD_SALT_BYTES + 2] = 0; saltBlock[PASSWORD_SALT_BYTES + 3] = 1;
+
+    for (int round = 0; round < PASSWORD_HASH_ROUNDS; round++) {
+        sha = innerBase;
+        if (round == 0) sha256Update(&sha, saltBlock, sizeof(saltBlock));
+        else sha256Update(&sha, u, sizeof(u));
+        sha256Final(&sha, u);
+        sha = outerBase;
+        sha256Update(&sha, u, sizeof(u));
+        sha256Final(&sha, u);
+        if (round == 0) memcpy(result, u, sizeof(result));
+        else for (int i = 0; i < 32; i++) result[i] ^= u[i];
+    }
+    memcpy(hash, result, PASSWORD_HASH_BYTES);
+}
+
+// 3 bytes -> 4 characters, count is a multiple of 3
+void encodeHashBytes(const unsigned char *bytes, int count, char *text)
+{
+    static const char alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    for (int i = 0; i < count; i += 3) {
+        unsigned int group = bytes[i] << 16 | bytes[i + 1] << 8 | bytes[i + 2];
+        for (int j = 0; j < 4; j++) *text++ = alphabet[(group >> (18 - j * 6)) & 63];
+    }
+    *text = '\0';
+}
+
+// stored needs room for PASSWORD_HASH_LENGTH + 1, which the 50 byte password fields have
+void hashPassword(const char *password, char *stored)
+{
+    unsigned char salt[PASSWORD_SALT_BYTES], hash[PASSWORD_HASH_BYTES];
+    if (getrandom(salt, sizeof(salt), 0) != sizeof(salt)) {
+        // no entropy source, still unique per call
+        long long fallback[2] = {(long long)time(NULL) ^ ((long long)getpid() << 32), (long long)clock()};
+        memcpy(salt, fallback, sizeof(salt));
+    }
+    derivePasswordHash(password, salt, hash);
+    stored[0] = '$';
+    encodeHashBytes(salt, sizeof(salt), stored + 1);
+    encodeHashBytes(hash, sizeof(hash), stored + 1 + PASSWORD_SALT_BYTES / 3 * 4);
+}
+
+int isHashedPassword(const char *stored)
+{
+    return stored[0] == '$' && strnlen(stored, PASSWORD_HASH_LENGTH + 1) == PASSWORD_HASH_LENGTH;
+}
+
+// the salt is recovered by decoding its characters back
+int verifyPassword(const char *password, const char *stored)
+{
+    static const char alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    unsigned char salt[PASSWORD_SALT_BYTES], hash[PASSWORD_HASH_BYTES];
+    char expected[PASSWORD_HASH_LENGTH + 1];
+
+    if (!isHashedPassword(stored)) return strcmp(stored, password) == 0; // not migrated yet
+
+    for (int i = 0; i < PASSWORD_SALT_BYTES; i += 3) {
+        unsigned int group = 0;
+        for (int j = 0; j < 4; j++) {
+            const char *at = strchr(alphabet, stored[1 + i / 3 * 4 + j]);
+            if (at == NULL || *at == '\0') return 0;
+            group = group << 6 | (unsigned int)(at - alphabet);
+        }
+        salt[i] = group >> 16; salt[i + 1] = group >> 8; salt[i + 2] = group;
+    }
+    derivePasswordHash(password, salt, hash);
+    encodeHashBytes(hash, sizeof(hash), expected);
+
+    int difference = 0; // same time whichever byte differs
+    const char *storedHash = stored + 1 + PASSWORD_SALT_BYTES / 3 * 4;
+    for (int i = 0; i < PASSWORD_HASH_BYTES / 3 * 4; i++) difference |= storedHash[i] ^ expected[i];
+    return difference == 0;
+}
+
+void loginCacheDigest(int kind, int id, const char *password, const char *stored, unsigned char *digest)
+{
+    unsigned char message[2 * sizeof(int) + 2 * 64];
+    size_t length = 0;
+    memcpy(message, &kind, sizeof(kind)); length += sizeof(kind);
+    memcpy(message + length, &id, sizeof(id)); length += sizeof(id);
+    size_t storedLength = strnlen(stored, 63), passwordLength = strnlen(password, 63);
+    memcpy(message + length, stored, storedLength + 1); length += storedLength + 1; // terminators keep the two apart
+    memcpy(message + length, password, passwordLength + 1); length += passwordLength + 1;
+    hmacSha256(loginCacheSecret, sizeof(loginCacheSecret), message, length, digest);
+}
+
+// NULL means shared memory is unavailable and every login pays the full hash
+struct LoginCacheRegion *getLoginCache()
+{
+    if (loginCacheRegion == NULL) {
+        loginCacheRegion = attachSharedRegion(LOGIN_CACHE_REGION, sizeof(struct LoginCacheRegion), NULL);
+    }
+    return loginCacheRegion;
+}
+
+// new secret as well, digests from a previous run are useless anyway
+void resetLoginCache()
+{
+    if (getrandom(loginCacheSecret, sizeof(loginCacheSecret), 0) != sizeof(loginCacheSecret)) {
+        printf("Login cache: no random source, caching disabled\n");
+        loginCacheRegion = NULL;
+        resetSharedRegion(LOGIN_CACHE_REGION);
+        return;
+    }
+    resetSharedRegion(LOGIN_CACHE_REGION);
+    loginCacheRegion = NULL;
+    getLoginCache();
+}
+
+// password against the stored field of record id, through the cache
+int checkCredentials(int kind, int id, const char *password, const char *stored)
+{
+    unsigned char digest[32];
+    struct LoginCacheRegion *cache = isHashedPassword(stored) ? getLoginCache() : NULL;
+    struct LoginCacheEntry *entry = NULL;
+    long long now = time(NULL);
+
+    if (cache != NULL) {
+        loginCacheDigest(kind, id, password, stored, digest);
+        entry = &cache->entries[((unsigned int)id * 2654435761u + kind) % LOGIN_CACHE_SLOTS];
+        lockSharedRegion(&cache->lockOwner);
+        int hit = entry->verifiedAt != 0 && entry->kind == kind && entry->id == id &&
+                  now - entry->verifiedAt < LOGIN_CACHE_TTL && memcmp(entry->digest, digest, sizeof(digest)) == 0;
+        unlockSharedRegion(&cache->lockOwner);
+        if (hit) return 1;
+    }
+
+    if (!verifyPassword(password, stored)) return 0;
+
+    if (cache != NULL) {
+        lockSharedRegion(&cache->lockOwner);
+        entry->kind = kind;
+        entry->id = id;
+        entry->verifiedAt = now;
+        memcpy(entry->digest, digest, sizeof(digest));
+        unlockSharedRegion(&cache->lockOwner);
+    }
+    return 1;
+}
+
+// first start with plaintext passwords: hash every one in place, before any session runs.
+// returns 0 on failure
+int migrateCredentials()
+{
+    struct AccountHolder account;
+    struct Employee employee;
+    char stored[64];
+    int migrated = 0;
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        int dbFile = openShardFile(ACCOUNT_DB, shard, O_RDWR);
+        if (dbFile == -1) continue;
+        for (off_t offset = 0; pread(dbFile, &account, sizeof(account), offset) == sizeof(account); offset += sizeof(account)) {
+            if (isHashedPassword(account.password)) continue;
+            account.password[sizeof(account.password) - 1] = '\0';
+            hashPassword(account.password, account.password);
+            if (pwrite(dbFile, &account, sizeof(account), offset) != sizeof(account)) {
+                perror("Credentials: Error writing account");
+                close(dbFile);
+                return 0;
+            }
+            migrated++;
+        }
+        close(dbFile);
+    }
+
+    int dbFile = open(EMPLOYEE_DB, O_RDWR);
+    if (dbFile != -1) {
+        for (off_t offset = 0; pread(dbFile, &employee, sizeof(employee), offset) == sizeof(employee); offset += sizeof(employee)) {
+            if (isHashedPassword(employee.password)) continue;
+            employee.password[sizeof(employee.password) - 1] = '\0';
+            hashPassword(employee.password, employee.password);
+            if (pwrite(dbFile, &employee, sizeof(employee), offset) != sizeof(employee)) {
+                perror("Credentials: Error writing employee");
+                close(dbFile);
+                return 0;
+            }
+            migrated++;
+        }
+        close(dbFile);
+    }
+
+    int passFile = open(ADMIN_PASS_DB, O_RDWR);
+    if (passFile != -1) {
+        bzero(stored, sizeof(stored));
+        if (read(passFile, stored, PASSWORD_HASH_LENGTH + 1) > 0 && !isHashedPassword(stored)) {
+            stored[50] = '\0'; // admin passwords were capped at 49 characters
+            hashPassword(stored, stored);
+            if (pwrite(passFile, stored, PASSWORD_HASH_LENGTH + 1, 0) != PASSWORD_HASH_LENGTH + 1 || ftruncate(passFile, PASSWORD_HASH_LENGTH + 1) == -1) {
+                perror("Credentials: Error writing admin password");
+                close(passFile);
+                return 0;
+            }
+            migrated++;
+        }
+        close(passFile);
+    }
+
+    if (migrated > 0) {
+        printf("Credentials: hashed %d plaintext passwords\n", migrated);
+        markReplicaStale("passwords rehashed in place"); // not shipped, a running replica needs a new base backup
+    }
+    return 1;
+}
+
+#endif
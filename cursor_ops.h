@@ -0,0 +1,248 @@
+#ifndef CURSOR_OPS_H
+#define CURSOR_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Server side cursors for paging through append-only files. A cursor is a file offset
+// plus a filter; each page reads on from where the last one stopped, so walking a long
+// history never builds more than one page and nothing is cut off. The end of the file is
+// fixed when the cursor is opened, records appended while paging show up next time.
+// History pages go newest first, from the active log back through the sealed segments
+// (see segment_ops.h) and the archived ones, where the blocks whose account summary
+// leaves out the account are skipped without decompressing them (see archive_ops.h).
+// Feedback cursors wrap a FeedbackQuery, and audit cursors an AuditQuery, which keep
+// their own positions (see feedback_ops.h and audit_ops.h).
+// Every cursor is closed with closeCursor once done.
+
+#define PAGE_DEFAULT_RECORDS 10
+#define PAGE_MAX_RECORDS 100
+#define PAGE_READ_BATCH 16 // records per pread
+#define PAGE_PROMPT_RESERVE 160 // room left in outBuffer for the page prompt
+#define CURSOR_AUDIT HANDLE_KINDS // not a handle: every shard's log through an AuditQuery
+
+struct PageCursor {
+    int handleKind;  // HANDLE_HISTORY, HANDLE_FEEDBACK or CURSOR_AUDIT
+    int shard;
+    int accountID;   // history filter
+    off_t position;  // next record to look at, newest first: the one before it
+    off_t limit;     // end of the file when the cursor was opened
+    struct LogSegmentSet segments; // history: the log's segments when the cursor was opened
+    int segment;     // the one being read, and its descriptor
+    int segmentFD;
+    struct SegmentArchive archive; // or the archive it is in, when there is no descriptor
+    struct TransactionLog *archived; // its last decompressed block
+    int archivedBlock;
+    int newestFirst;
+    int pageNumber;
+    struct FeedbackQuery feedback;
+    struct AuditQuery audit;
+};
+
+int sessionPageSize = PAGE_DEFAULT_RECORDS; // per session, changed from the page prompt
+
+void openHistoryCursor(struct PageCursor *cursor, int accountID);
+void openFeedbackCursor(struct PageCursor *cursor, const char *word, int accountID, time_t from, time_t to);
+void openAuditCursor(struct PageCursor *cursor, struct AuditFilter *filter);
+void closeCursor(struct PageCursor *cursor);
+int cursorHasMore(struct PageCursor *cursor);
+int fillCursorPage(struct PageCursor *cursor, char *page, size_t pageCapacity);
+void streamCursorPages(int clientSocket, struct PageCursor *cursor, const char *emptyMessage);
+
+// moves a history cursor to the end of segment index, or further back past segments that
+// can't be read. a segment archived since the set was loaded is read from the archive.
+// 0 once there is nothing older
+static int openCursorSegment(struct PageCursor *cursor, int index)
+{
+    if (cursor->segmentFD != -1) close(cursor->segmentFD);
+    closeSegmentArchive(&cursor->archive);
+    cursor->segmentFD = -1;
+    cursor->archivedBlock = -1;
+    for (; index >= 0; index--) {
+        struct LogSegment *segment = &cursor->segments.segments[index];
+        if (segment->records == 0) continue;
+        cursor->segmentFD = openLogSegment(&cursor->segments, index);
+        if (cursor->segmentFD != -1) break;
+        if (segment->state == SEGMENT_ACTIVE || !openSegmentArchive(cursor->shard, segment->seq, &cursor->archive)) continue;
+        if (cursor->archived == NULL) cursor->archived = malloc(ARCHIVE_BLOCK_RECORDS * sizeof(struct TransactionLog));
+        if (cursor->archived != NULL && cursor->archive.header.blocks > 0) break;
+        closeSegmentArchive(&cursor->archive);
+    }
+    cursor->segment = index < 0 ? 0 : index;
+    long long records = cursor->archive.blocks != NULL ? cursor->archive.header.records : cursor->segments.segments[cursor->segment].records;
+    cursor->limit = index < 0 ? 0 : records * sizeof(struct TransactionLog);
+    cursor->position = cursor->limit;
+    return index >= 0;
+}
+
+void openHistoryCursor(struct PageCursor *cursor, int accountID)
+{
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->handleKind = HANDLE_HISTORY;
+    cursor->shard = accountShard(accountID);
+    cursor->accountID = accountID;
+    cursor->newestFirst = 1;
+    cursor->segmentFD = -1;
+    cursor->archive.fd = -1;
+
+    // only whole records that have been committed, see loadLogSegments
+    if (loadLogSegments(cursor->shard, &cursor->segments)) openCursorSegment(cursor, cursor->segments.count - 1);
+}
+
+void openFeedbackCursor(struct PageCursor *cursor, const char *word, int accountID, time_t from, time_t to)
+{
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->handleKind = HANDLE_FEEDBACK;
+    cursor->newestFirst = 1;
+    openFeedbackQuery(&cursor->feedback, word, accountID, from, to);
+}
+
+// caller closes cursor->audit once done paging
+void openAuditCursor(struct PageCursor *cursor, struct AuditFilter *filter)
+{
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->handleKind = CURSOR_AUDIT;
+    openAuditQuery(&cursor->audit, filter, 0);
+}
+
+void closeCursor(struct PageCursor *cursor)
+{
+    if (cursor->handleKind == CURSOR_AUDIT) closeAuditQuery(&cursor->audit);
+    if (cursor->handleKind != HANDLE_HISTORY) return;
+    if (cursor->segmentFD != -1) close(cursor->segmentFD);
+    cursor->segmentFD = -1;
+    closeSegmentArchive(&cursor->archive);
+    free(cursor->archived);
+    cursor->archived = NULL;
+    freeLogSegments(&cursor->segments);
+}
+
+int cursorHasMore(struct PageCursor *cursor)
+{
+    if (cursor->handleKind == HANDLE_FEEDBACK) return feedbackQueryHasMore(&cursor->feedback);
+    if (cursor->handleKind == CURSOR_AUDIT) return auditQueryHasMore(&cursor->audit);
+    // fillCursorPage leaves history cursors in front of their next match, so older
+    // segments only count before the first page
+    if (cursor->newestFirst && cursor->position == 0 && cursor->segment > 0) return 1;
+    return cursor->newestFirst ? cursor->position > 0 : cursor->position < cursor->limit;
+}
+
+// walks a history cursor from its position. with peek set nothing is added: it stops in
+// front of the next matching record, or at the end when there is none
+static int scanHistoryPage(struct PageCursor *cursor, char *page, size_t pageCapacity, int peek)
+{
+    static struct TransactionLog batch[PAGE_READ_BATCH];
+    off_t recordSize = sizeof(struct TransactionLog);
+    int added = 0;
+
+    while (added < sessionPageSize && cursorHasMore(cursor)) {
+        struct TransactionLog *records = batch;
+        off_t batchStart, low = 0, high;
+        int count;
+        if (cursor->newestFirst && cursor->position == 0 && !openCursorSegment(cursor, cursor->segment - 1)) break;
+        high = cursor->limit;
+
+        if (cursor->archive.blocks != NULL) {
+            // stay inside the block of the next record, and skip it whole if the account isn't in it
+            int index = findArchiveBlock(&cursor->archive, cursor->position / recordSize - cursor->newestFirst);
+            struct ArchiveBlock *block = &cursor->archive.blocks[index];
+            low = block->firstRecord * recordSize;
+            high = (block->firstRecord + block->records) * recordSize;
+            if (!archiveBlockHasAccount(block, cursor->accountID) ||
+                (cursor->archivedBlock != index && readArchiveBlock(&cursor->archive, index, cursor->archived) == -1)) {
+                cursor->position = cursor->newestFirst ? low : high;
+                continue;
+            }
+            cursor->archivedBlock = index;
+        }
+        if (cursor->newestFirst) {
+            count = (cursor->position - low) / recordSize < PAGE_READ_BATCH ? (cursor->position - low) / recordSize : PAGE_READ_BATCH;
+            batchStart = cursor->position - count * recordSize;
+        } else {
+            count = (high - cursor->position) / recordSize < PAGE_READ_BATCH ? (high - cursor->position) / recordSize : PAGE_READ_BATCH;
+            batchStart = cursor->position;
+        }
+        if (cursor->archive.blocks != NULL) {
+            records = cursor->archived + (batchStart - low) / recordSize;
+        } else if (pread(cursor->segmentFD, batch, count * recordSize, batchStart) != count * recordSize) {
+            perror("fillCursorPage: read failed");
+            cursor->position = cursor->newestFirst ? 0 : cursor->limit; // nothing more to show
+            break;
+        }
+
+        int full = 0;
+        for (int i = 0; i < count && added < sessionPageSize; i++) {
+            int index = cursor->newestFirst ? count - 1 - i : i;
+            if (records[index].accountID == cursor->accountID) {
+                if (peek) { full = 1; break; } // left for the next page
+                const char *text = records[index].logEntry;
+                size_t length = strnlen(text, sizeof(records[index].logEntry));
+                if (strlen(page) + length + 2 > pageCapacity) { full = 1; break; } // resume here next page
+                strncat(page, text, length);
+                if (length == 0 || text[length - 1] != '\n') strcat(page, "\n");
+                added++;
+            }
+            cursor->position += cursor->newestFirst ? -recordSize : recordSize;
+        }
+        if (full) break;
+    }
+    return added;
+}
+
+// appends up to sessionPageSize matching records to page. a record that doesn't fit is
+// left for the next page instead of being truncated. returns the number of records added
+int fillCursorPage(struct PageCursor *cursor, char *page, size_t pageCapacity)
+{
+    if (cursor->handleKind == HANDLE_FEEDBACK) return fillFeedbackPage(&cursor->feedback, page, pageCapacity, sessionPageSize);
+    if (cursor->handleKind == CURSOR_AUDIT) return fillAuditPage(&cursor->audit, page, pageCapacity, sessionPageSize);
+    int added = scanHistoryPage(cursor, page, pageCapacity, 0);
+    // look ahead so cursorHasMore never promises a page with nothing on it
+    scanHistoryPage(cursor, NULL, 0, 1);
+    return added;
+}
+
+// send one page at a time, the client asks for the next one or stops
+void streamCursorPages(int clientSocket, struct PageCursor *cursor, const char *emptyMessage)
+{
+    while (1)
+    {
+        bzero(outBuffer, sizeof(outBuffer));
+        int added = fillCursorPage(cursor, outBuffer, sizeof(outBuffer) - PAGE_PROMPT_RESERVE);
+        cursor->pageNumber++;
+
+        if (!cursorHasMore(cursor)) {
+            if (added == 0) strcpy(outBuffer, cursor->pageNumber == 1 ? emptyMessage : "No more entries.\n");
+            strcat(outBuffer, "-- end --^");
+            write(clientSocket, outBuffer, strlen(outBuffer));
+            readClient(clientSocket, inBuffer, 3); // ack
+            return;
+        }
+
+        sprintf(outBuffer + strlen(outBuffer), "-- page %d, %d per page --\n[1] Next page\n[2] Change page size\n[3] Back\nChoice: ",
+                cursor->pageNumber, sessionPageSize);
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        bzero(inBuffer, sizeof(inBuffer));
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+        inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+        int choice = atoi(inBuffer);
+
+        if (choice == 2) {
+            bzero(outBuffer, sizeof(outBuffer));
+            sprintf(outBuffer, "Entries per page (1-%d): ", PAGE_MAX_RECORDS);
+            write(clientSocket, outBuffer, strlen(outBuffer));
+            bzero(inBuffer, sizeof(inBuffer));
+            if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+            int pageSize = atoi(inBuffer);
+            if (pageSize >= 1 && pageSize <= PAGE_MAX_RECORDS) sessionPageSize = pageSize;
+        } else if (choice != 1) {
+            return;
+        }
+    }
+}
+
+#endif
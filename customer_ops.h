@@ -7,6 +7,8 @@
 #include <fcntl.h>
 #include <sys/types.h> 
 
+#define CUSTOMER_LOGIN_REFUSED -1 // throttled or already logged in, the client was already told why
+
 void endUserSession(int clientSocket, int sessionID);
 int authenticateCustomer(int clientSocket, int accountID, char *password_input);
 void processDeposit(int clientSocket, int accountID);
@@ -15,12 +17,13 @@ void processWithdrawal(int clientSocket, int accountID);
 void requestLoan(int clientSocket, int accountID);
 void executeTransfer(int clientSocket, int sourceAccountID, int destAccountID, float transferAmount);
 void viewTransactionLogs(int clientSocket, int accountID);
-void submitFeedback(int clientSocket);
+void submitFeedback(int clientSocket, int accountID);
 int updateCustomerPassword(int clientSocket, int accountID);
 
 
 // ======================= Shared Session Function =======================
 void endUserSession(int clientSocket, int sessionID){
+    revokeSessionToken();
     snprintf(sessionSemName, 50, "/bms_sem_%d", sessionID);
 
     sem_t *sema = sem_open(sessionSemName, 0);
@@ -37,27 +40,17 @@ void endUserSession(int clientSocket, int sessionID){
     strcpy(outBuffer, "^"); 
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    read(clientSocket, inBuffer, 3); 
+    readClient(clientSocket, inBuffer, 3); 
 }
 
 
-// login customer
+// login customer. 1 on success, 0 for bad credentials, CUSTOMER_LOGIN_REFUSED otherwise
 int authenticateCustomer(int clientSocket, int accountID, char *password_input) {
     struct AccountHolder account;
-    int dbFile = open(ACCOUNT_DB, O_RDONLY);
+    if (!allowCustomerLogin(clientSocket, accountID)) return CUSTOMER_LOGIN_REFUSED;
+    int dbFile = accountHandle(accountID); // created empty on first use
+    if (dbFile == -1) return 0;
 
-    if (dbFile == -1) {
-        if (errno == ENOENT) {
-            dbFile = open(ACCOUNT_DB, O_WRONLY | O_CREAT, 0644);
-            if (dbFile != -1) close(dbFile); // crate if first time and close
-            printf("Created empty account database file: %s\n", ACCOUNT_DB);
-        } else {
-            perror("Error opening account DB for read");
-            return 0;
-        }
-    } else {
-        close(dbFile);
-    }
     // sem init
     sessionSemaphore = createSessionLock(accountID);
      if (sessionSemaphore == SEM_FAILED) {
@@ -72,34 +65,21 @@ int authenticateCustomer(int clientSocket, int accountID, char *password_input)
             bzero(outBuffer, sizeof(outBuffer));
             strcpy(outBuffer, "This account is already logged in elsewhere.^");
             write(clientSocket, outBuffer, strlen(outBuffer));
-            read(clientSocket, inBuffer, 3); // Ack
-        } else {
-            perror("sem_trywait failed");
+            readClient(clientSocket, inBuffer, 3); // Ack
+            sem_close(sessionSemaphore);
+            return CUSTOMER_LOGIN_REFUSED;
         }
+        perror("sem_trywait failed");
         sem_close(sessionSemaphore);
         return 0;
     }
 
-    dbFile = open(ACCOUNT_DB, O_RDONLY);
-    if (dbFile == -1) {
-         perror("Error opening account DB for login check");
-         sem_post(sessionSemaphore); // Release lock before returning error
-         sem_close(sessionSemaphore);
-         sem_unlink(sessionSemName);
-         return 0;
-    }
-
     int loggedIn = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while(read(dbFile, &account, sizeof(account)) > 0)
-    {
-        if (account.accountID == accountID && strcmp(account.password, password_input) == 0 && account.isActive == 1) {
-            printf("Customer %d logged in.\n", accountID);
-            loggedIn = 1;
-            break;
-        }
+    if (readAccountSnapshot(dbFile, accountID, &account) != -1 &&
+        account.isActive == 1 && checkCredentials(LOGIN_CUSTOMER, accountID, password_input, account.password)) {
+        printf("Customer %d logged in.\n", accountID);
+        loggedIn = 1;
     }
-    close(dbFile);
     if (!loggedIn) {
         // login failed
         sem_post(sessionSemaphore);
@@ -120,109 +100,71 @@ void processDeposit(int clientSocket, int accountID){
     time_t now = time(NULL);
 	struct tm* localTime = localtime(&now);
 
-    int dbFile = open(ACCOUNT_DB, O_RDWR);
+    // collect input first, nothing is locked while the customer types
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Enter the amount to deposit: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer) - 1) <= 0) {
+        printf("Client disconnected during deposit amount entry.\n");
+        return;
+    }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+
+    depositAmount = atof(inBuffer);
+    if(depositAmount <= 0) {
+        bzero(outBuffer, sizeof(outBuffer));
+        strcpy(outBuffer, "Invalid deposit amount.^");
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
+    int dbFile = accountHandle(accountID);
     if (dbFile == -1) {
         perror("Deposit: Error opening account DB");
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Database error.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
     // Find the account record offset *before* locking
-    int offset = -1;
-    off_t currentPos = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while (read(dbFile, &account, sizeof(account)) > 0) {
-        currentPos = lseek(dbFile, 0, SEEK_CUR) - sizeof(account); // Get start pos of record read
-        if (account.accountID == accountID) {
-            offset = currentPos;
-            break;
-        }
-    }
+    off_t offset = findAccountOffset(dbFile, accountID);
 
     if(offset == -1) {
         printf("Deposit: Error - Account %d not found.\n", accountID);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Account not found.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
-        close(dbFile);
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
     if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
         perror("Deposit: Failed to lock account record");
-        close(dbFile);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error processing deposit (lock fail).^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
-        return;
-    }
-
-    bzero(outBuffer, sizeof(outBuffer));
-    strcpy(outBuffer, "Enter the amount to deposit: ");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-
-    bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer) - 1) <= 0) {
-        printf("Client disconnected during deposit amount entry.\n");
-        lock.l_type = F_UNLCK; 
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
-        return;
-    }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-
-    depositAmount = atof(inBuffer);
-    if(depositAmount <= 0) {
-        bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "Invalid deposit amount.^");
-        write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3);
-
-        lock.l_type = F_UNLCK; 
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
-    lseek(dbFile, offset, SEEK_SET);
-    if (read(dbFile, &account, sizeof(account)) != sizeof(account)) {
+    if (pread(dbFile, &account, sizeof(account), offset) != sizeof(account)) {
          perror("Deposit: Failed to re-read record after lock");
-         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
+         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error reading account data.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
          return;
     }
+    applyHotCredits(dbFile, offset, &account); // so the new balance shown is the full one
 
     account.currentBalance += depositAmount;
 
-    // logging
-    int logFile = open(HISTORY_DB, O_WRONLY | O_APPEND | O_CREAT, 0644); 
-    if (logFile == -1) {
-        perror("Deposit: Error opening log file");
-        printf("CRITICAL: Deposit to %d occurred but logging failed!\n", accountID);
-        lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &account, sizeof(account)); 
-
-        lock.l_type = F_UNLCK; 
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
-
-        bzero(outBuffer, sizeof(outBuffer));
-        sprintf(outBuffer, "Deposit successful BUT LOGGING FAILED! New Balance: %.2f^", account.currentBalance);
-        write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); 
-        return;
-    }
-    
-    struct flock logLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()}; //lock whole file for append safety
-    fcntl(logFile, F_SETLKW, &logLock);
-
+    // log entry and record write-back go out together
     bzero(logBuffer, sizeof(logBuffer));
     sprintf(logBuffer, "%.2f deposited at %02d:%02d:%02d %d-%d-%d\n",
             depositAmount, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
@@ -232,55 +174,47 @@ void processDeposit(int clientSocket, int accountID){
     strncpy(log.logEntry, logBuffer, sizeof(log.logEntry) - 1);
     log.logEntry[sizeof(log.logEntry)-1] = '\0';
     log.accountID = account.accountID;
-    write(logFile, &log, sizeof(log));
-
-    logLock.l_type = F_UNLCK;
-    fcntl(logFile, F_SETLK, &logLock);
-    close(logFile);
-
-    // udpate account file
-    lseek(dbFile, offset, SEEK_SET);
-    write(dbFile, &account, sizeof(account));
+    int committed = commitAccountUpdate(dbFile, offset, &account, &log);
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+
+    if (committed != 1) {
+        printf("CRITICAL: Deposit to %d %s!\n", accountID, committed == 0 ? "occurred but logging failed" : "could not be written");
+        bzero(outBuffer, sizeof(outBuffer));
+        if (committed == 0) sprintf(outBuffer, "Deposit successful BUT LOGGING FAILED! New Balance: %.2f^", account.currentBalance);
+        else strcpy(outBuffer, "Error processing deposit (write fail).^");
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        readClient(clientSocket, inBuffer, 3); 
+        return;
+    }
 
     printf("Account %d deposited %.2f. New balance: %.2f\n", accountID, depositAmount, account.currentBalance);
 
     bzero(outBuffer, sizeof(outBuffer));
     sprintf(outBuffer, "Deposit successful! New Balance: %.2f^", account.currentBalance);
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); 
+    readClient(clientSocket, inBuffer, 3); 
 }
 
 void checkBalance(int clientSocket, int accountID){
     struct AccountHolder account;
-    int dbFile = open(ACCOUNT_DB, O_RDONLY);
+    int dbFile = accountHandle(accountID);
     if (dbFile == -1) {
         perror("Balance Check: Error opening account DB");
          bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error retrieving balance.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
     float balance = -1.0; 
 
-    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(dbFile, F_SETLKW, &lock);
-
-    while(read(dbFile, &account, sizeof(account)) > 0) {
-        if (account.accountID == accountID) {
-            balance = account.currentBalance;
-            break;
-        }
+    // no read lock: a writer holding the record lock never blocks a balance check
+    if (readAccountSnapshot(dbFile, accountID, &account) != -1) {
+        balance = account.currentBalance;
     }
 
-    lock.l_type = F_UNLCK;
-    fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
-
     if (balance >= 0) {
         printf("Balance check for %d: %.2f\n", accountID, balance);
         bzero(outBuffer, sizeof(outBuffer));
@@ -291,7 +225,7 @@ void checkBalance(int clientSocket, int accountID){
         strcpy(outBuffer, "Account not found.^");
     }
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); 
+    readClient(clientSocket, inBuffer, 3); 
 }
 
 //  withdraw money
@@ -304,109 +238,77 @@ void processWithdrawal(int clientSocket, int accountID){
     time_t now = time(NULL);
 	struct tm* localTime = localtime(&now);
 
-    int dbFile = open(ACCOUNT_DB, O_RDWR);
+    // collect input first, the balance check happens under the record lock below
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Enter the amount to withdraw: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Client disconnected during withdrawal amount entry.\n");
+        return;
+    }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+
+    withdrawAmount = atof(inBuffer);
+
+    int dbFile = accountHandle(accountID);
      if (dbFile == -1) {
         perror("Withdraw: Error opening account DB");
          bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Database error.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
     // Find record and get offset
-    int offset = -1;
-    off_t currentPos = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while(read(dbFile, &account, sizeof(account)) > 0) {
-        currentPos = lseek(dbFile, 0, SEEK_CUR) - sizeof(account);
-        if(account.accountID == accountID) {
-            offset = currentPos;
-            break;
-        }
-    }
+    off_t offset = findAccountOffset(dbFile, accountID);
     if(offset == -1) {
         printf("Withdraw: Error - Account %d not found.\n", accountID);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Account not found.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
-        close(dbFile);
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
     if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
         perror("Withdraw: Failed to lock record");
-        close(dbFile);
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error processing withdrawal (lock fail).^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
-        return;
-    }
-
-    bzero(outBuffer, sizeof(outBuffer));
-    strcpy(outBuffer, "Enter the amount to withdraw: ");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-
-    bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected during withdrawal amount entry.\n");
-        lock.l_type = F_UNLCK;
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-
-    withdrawAmount = atof(inBuffer);
 
-    lseek(dbFile, offset, SEEK_SET);
-     if (read(dbFile, &account, sizeof(account)) != sizeof(account)) {
+     if (pread(dbFile, &account, sizeof(account), offset) != sizeof(account)) {
          perror("Withdraw: Failed to re-read record after lock");
-         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
+         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error reading account data.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
          return;
     }
+    applyHotCredits(dbFile, offset, &account); // pending credits count towards the funds check
 
     // fund check
     if (withdrawAmount <= 0 || account.currentBalance < withdrawAmount ){
         bzero(outBuffer, sizeof(outBuffer));
         sprintf(outBuffer, "Insufficient funds or invalid amount! Balance: %.2f^", account.currentBalance);
-        write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
 
         lock.l_type = F_UNLCK;
         fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
-        return;
-    }
-
-    // process
-    account.currentBalance -= withdrawAmount;
 
-     // -logging
-    int logFile = open(HISTORY_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
-    if (logFile == -1) {
-        perror("Withdraw: Error opening log file");
-        printf("CRITICAL: Withdraw from %d occurred but logging failed!\n", accountID);
-        lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &account, sizeof(account));
-        lock.l_type = F_UNLCK;
-        fcntl(dbFile, F_SETLK, &lock);
-        close(dbFile);
-        bzero(outBuffer, sizeof(outBuffer));
-        sprintf(outBuffer, "Withdrawal successful BUT LOGGING FAILED! Balance: %.2f^", account.currentBalance);
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
-    struct flock logLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(logFile, F_SETLKW, &logLock);
+    // process
+    account.currentBalance -= withdrawAmount;
 
+     // -logging, appended together with the record write-back
     bzero(logBuffer, sizeof(logBuffer));
     sprintf(logBuffer, "%.2f withdrawn at %02d:%02d:%02d %d-%d-%d\n",
             withdrawAmount, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
@@ -416,68 +318,41 @@ void processWithdrawal(int clientSocket, int accountID){
     strncpy(log.logEntry, logBuffer, sizeof(log.logEntry) - 1);
      log.logEntry[sizeof(log.logEntry)-1] = '\0';
     log.accountID = account.accountID;
-    write(logFile, &log, sizeof(log));
-
-    logLock.l_type = F_UNLCK;
-    fcntl(logFile, F_SETLK, &logLock);
-    close(logFile);
-
-    // account update
-    lseek(dbFile, offset, SEEK_SET);
-    write(dbFile, &account, sizeof(account));
+    int committed = commitAccountUpdate(dbFile, offset, &account, &log);
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+
+    if (committed != 1) {
+        printf("CRITICAL: Withdraw from %d %s!\n", accountID, committed == 0 ? "occurred but logging failed" : "could not be written");
+        bzero(outBuffer, sizeof(outBuffer));
+        if (committed == 0) sprintf(outBuffer, "Withdrawal successful BUT LOGGING FAILED! Balance: %.2f^", account.currentBalance);
+        else strcpy(outBuffer, "Error processing withdrawal (write fail).^");
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        readClient(clientSocket, inBuffer, 3); // ack
+        return;
+    }
 
     printf("Account %d withdrew %.2f. New balance: %.2f\n", accountID, withdrawAmount, account.currentBalance);
 
     bzero(outBuffer, sizeof(outBuffer));
     sprintf(outBuffer, "Withdrawal successful! New Balance: %.2f^", account.currentBalance);
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); // ack
+    readClient(clientSocket, inBuffer, 3); // ack
 }
 
 //  apply loan
 void requestLoan(int clientSocket, int accountID){
-    struct IDGenerator idGen;
     struct LoanRecord loan;
 
-    int counterFile = open(LOAN_COUNTER_DB, O_RDWR | O_CREAT, 0644);
-    if(counterFile == -1) {
-        perror("Loan Request: Failed to open counter DB");
+    int newLoanID = allocateLoanID();
+    if(newLoanID == -1) {
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error processing loan request (counter fail).^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        return;
-     }
-
-    // lock counter file
-    struct flock idLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
-    if (fcntl(counterFile, F_SETLKW, &idLock) == -1) {
-        perror("Loan Request: Failed to lock counter DB");
-        close(counterFile);
-         bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "Error processing loan request (counter lock fail).^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    int newLoanID;
-    if(read(counterFile, &idGen, sizeof(idGen)) > 0) {
-        newLoanID = idGen.nextID;
-    } else {
-        newLoanID = 1;
-        idGen.nextID = 1;
-    }
-    idGen.nextID = newLoanID + 1; 
-    lseek(counterFile, 0, SEEK_SET);
-    write(counterFile, &idGen, sizeof(idGen));
-
-    idLock.l_type = F_UNLCK;
-    fcntl(counterFile, F_SETLK, &idLock);
-    close(counterFile);
-
     //loan amount from client
     int loanAmount;
     bzero(outBuffer, sizeof(outBuffer));
@@ -485,7 +360,7 @@ void requestLoan(int clientSocket, int accountID){
     write(clientSocket, outBuffer, strlen(outBuffer));
 
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0){
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0){
         printf("Client disconnected during loan amount entry.\n"); return;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; // Sanitize
@@ -495,16 +370,16 @@ void requestLoan(int clientSocket, int accountID){
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Invalid loan amount.^");
         write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); // ack
+        readClient(clientSocket, inBuffer, 3); // ack
         return;
     }
 
-    int loanFile = open(LOAN_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
     if(loanFile == -1) {
         perror("Loan Request: Failed to open loan DB");
          bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error processing loan request (db fail).^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
     
@@ -517,293 +392,224 @@ void requestLoan(int clientSocket, int accountID){
     loan.loanStatus = 0; // requestd
     loan.loanRecordID = newLoanID;
 
-    write(loanFile, &loan, sizeof(loan));
+    int employeeID = scheduleLoan(&loan); // stays unassigned for a manager if there are no officers
+    if (!writeLoanRecord(loanFile, -1, &loan) && employeeID != -1) loanDecided(&loan);
 
     loanDBLock.l_type = F_UNLCK;
     fcntl(loanFile, F_SETLK, &loanDBLock);
-    close(loanFile);
 
-    printf("Loan %d for amount %d from account %d requested.\n", newLoanID, loanAmount, accountID);
+    printf("Loan %d for amount %d from account %d requested, assigned to %d.\n", newLoanID, loanAmount, accountID, employeeID);
 
     bzero(outBuffer, sizeof(outBuffer));
     sprintf(outBuffer, "Loan %d for amount %d has been requested.^", newLoanID, loanAmount);
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); // ack
+    readClient(clientSocket, inBuffer, 3); // ack
 }
 
 // send money
 void executeTransfer(int clientSocket, int sourceAccountID, int destAccountID, float transferAmount) {
     char logBuffer[1024];
-    struct AccountHolder sourceAccount, destAccount, tempAccount;
+    struct AccountHolder sourceAccount, destAccount;
     struct TransactionLog log;
 
     if(sourceAccountID == destAccountID) {
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Cannot transfer to the same account.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
     if(transferAmount <= 0) {
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Invalid transfer amount.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
     time_t now = time(NULL);
 	struct tm* localTime = localtime(&now);
 
-    int dbFile = open(ACCOUNT_DB, O_RDWR);
-    if(dbFile == -1) {
-        perror("Transfer: Error opening account DB");
+    // the two accounts may live in different shard files, same shard gets the same handle
+    int srcFile = accountHandle(sourceAccountID);
+    int dstFile = accountHandle(destAccountID);
+    if(srcFile == -1 || dstFile == -1) {
          bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Database error during transfer.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    // Find offsets for both accounts robustly
-    int srcOffset = -1, dstOffset = -1;
-    off_t currentPos = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while(1) {
-        currentPos = lseek(dbFile, 0, SEEK_CUR);
-        int bytesRead = read(dbFile, &tempAccount, sizeof(tempAccount));
-        if (bytesRead <= 0) break; 
-
-        if(tempAccount.accountID == sourceAccountID) {
-            srcOffset = currentPos;
-        }
-        else if(tempAccount.accountID == destAccountID) {
-            dstOffset = currentPos;
-        }
-        if(srcOffset != -1 && dstOffset != -1) break;
-    }
+    off_t srcOffset = findAccountOffset(srcFile, sourceAccountID);
+    off_t dstOffset = findAccountOffset(dstFile, destAccountID);
 
     if(dstOffset == -1) {
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Destination account does not exist.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        close(dbFile);
-        return;
+        goto transfer_close;
     }
     if(srcOffset == -1) {
         bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Source account not found. Critical error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        close(dbFile);
-        return;
+        goto transfer_close;
     }
     
     struct flock lock1 = {F_WRLCK, SEEK_SET, 0, sizeof(struct AccountHolder), getpid()};
     struct flock lock2 = {F_WRLCK, SEEK_SET, 0, sizeof(struct AccountHolder), getpid()};
-
-    // lock to smaller offest
-    if (srcOffset < dstOffset) {
-        lock1.l_start = srcOffset;
-        lock2.l_start = dstOffset;
+    int lockFile1, lockFile2;
+
+    // a hot destination is credited through its delta, only the source record is locked.
+    // lock2 then repeats lock1, fcntl locks don't nest so taking and dropping it twice is harmless
+    int hotDest = findHotAccount(destAccountID) != NULL;
+
+    // global lock order is (shard, offset) so transfers in opposite directions can't deadlock
+    int srcShard = accountShard(sourceAccountID), dstShard = accountShard(destAccountID);
+    if (hotDest) {
+        lockFile1 = lockFile2 = srcFile; lock1.l_start = lock2.l_start = srcOffset;
+    } else if (srcShard < dstShard || (srcShard == dstShard && srcOffset < dstOffset)) {
+        lockFile1 = srcFile; lock1.l_start = srcOffset;
+        lockFile2 = dstFile; lock2.l_start = dstOffset;
     } else {
-        lock1.l_start = dstOffset;
-        lock2.l_start = srcOffset;
+        lockFile1 = dstFile; lock1.l_start = dstOffset;
+        lockFile2 = srcFile; lock2.l_start = srcOffset;
     }
 
-    if (fcntl(dbFile, F_SETLKW, &lock1) == -1) {
-        perror("Transfer: Fcntl lock1 failed"); close(dbFile); return;
+    bzero(outBuffer, sizeof(outBuffer));
+    if (fcntl(lockFile1, F_SETLKW, &lock1) == -1) {
+        perror("Transfer: Fcntl lock1 failed"); goto transfer_close;
     }
-    if (fcntl(dbFile, F_SETLKW, &lock2) == -1) {
+    if (fcntl(lockFile2, F_SETLKW, &lock2) == -1) {
         perror("Transfer: Fcntl lock2 failed");
-        lock1.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock1); close(dbFile); return;
+        lock1.l_type = F_UNLCK; fcntl(lockFile1, F_SETLK, &lock1); goto transfer_close;
     }
     
     //read 
-    lseek(dbFile, srcOffset, SEEK_SET);
-     if (read(dbFile, &sourceAccount, sizeof(sourceAccount)) != sizeof(sourceAccount)) {
+    if (pread(srcFile, &sourceAccount, sizeof(sourceAccount), srcOffset) != sizeof(sourceAccount)) {
          perror("Transfer: Failed read source after lock"); goto unlock_close;
      }
-    lseek(dbFile, dstOffset, SEEK_SET);
-     if (read(dbFile, &destAccount, sizeof(destAccount)) != sizeof(destAccount)) {
+    if (!hotDest && pread(dstFile, &destAccount, sizeof(destAccount), dstOffset) != sizeof(destAccount)) {
          perror("Transfer: Failed read dest after lock"); goto unlock_close;
      }
+    applyHotCredits(srcFile, srcOffset, &sourceAccount); // a hot source spends its pending credits too
 
     // check funds
     if (sourceAccount.currentBalance < transferAmount) {
         printf("Transfer: Insufficient funds (%.2f < %.2f).\n", sourceAccount.currentBalance, transferAmount);
-        bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Insufficient funds.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
         goto unlock_close;
     }
 
     // transfer
     sourceAccount.currentBalance -= transferAmount;
-    destAccount.currentBalance += transferAmount;
+    if (!hotDest) destAccount.currentBalance += transferAmount; // a hot record wasn't read
+
+    // logging, each side goes to its own shard's log. logs are locked one at a time so
+    // two cross shard transfers never wait on each other's log
+    int logFailed = 0;
+    for (int side = 0; side < 2; side++) {
+        int logAccountID = side == 0 ? sourceAccountID : destAccountID;
+        int otherAccountID = side == 0 ? destAccountID : sourceAccountID;
+
+        int logFile = lockHistory(accountShard(logAccountID));
+        if(logFile == -1) {
+            logFailed = 1;
+            continue;
+        }
 
-    // logging
-    int logFile = open(HISTORY_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
-    if(logFile == -1) {
-        perror("Transfer: Error opening log file");
+        bzero(logBuffer, sizeof(logBuffer));
+        sprintf(logBuffer, side == 0 ? "%.2f transferred to acc %d at %02d:%02d:%02d %d-%d-%d\n"
+                                     : "%.2f credited from acc %d at %02d:%02d:%02d %d-%d-%d\n",
+                transferAmount, otherAccountID, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
+                (localTime->tm_year)+1900, (localTime->tm_mon)+1, localTime->tm_mday);
+        bzero(log.logEntry, sizeof(log.logEntry));
+        strncpy(log.logEntry, logBuffer, sizeof(log.logEntry)-1); log.logEntry[sizeof(log.logEntry)-1]='\0';
+        log.accountID = logAccountID;
+        appendTransactionLog(logFile, &log);
+
+        unlockHistory(logFile);
+    }
+    if (logFailed) {
         printf("CRITICAL: Transfer between %d and %d occurred but logging failed!\n", sourceAccountID, destAccountID);
-        lseek(dbFile, srcOffset, SEEK_SET); write(dbFile, &sourceAccount, sizeof(sourceAccount));
-        lseek(dbFile, dstOffset, SEEK_SET); write(dbFile, &destAccount, sizeof(destAccount));
-        bzero(outBuffer, sizeof(outBuffer));
-        sprintf(outBuffer, "Transfer successful BUT LOGGING FAILED! New Balance: %.2f^", sourceAccount.currentBalance);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        goto unlock_close; 
     }
 
-    // Lock the log file
-    struct flock logLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
-    fcntl(logFile, F_SETLKW, &logLock);
-
-    // Log for source
-    bzero(logBuffer, sizeof(logBuffer));
-    sprintf(logBuffer,"%.2f transferred to acc %d at %02d:%02d:%02d %d-%d-%d\n",
-            transferAmount, destAccountID, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
-            (localTime->tm_year)+1900, (localTime->tm_mon)+1, localTime->tm_mday);
-    bzero(log.logEntry, sizeof(log.logEntry));
-    strncpy(log.logEntry, logBuffer, sizeof(log.logEntry)-1); log.logEntry[sizeof(log.logEntry)-1]='\0';
-    log.accountID = sourceAccountID;
-    write(logFile, &log, sizeof(log));
-
-    // Log for destination
-    bzero(logBuffer, sizeof(logBuffer));
-    sprintf(logBuffer,"%.2f credited from acc %d at %02d:%02d:%02d %d-%d-%d\n",
-            transferAmount, sourceAccountID, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
-            (localTime->tm_year)+1900, (localTime->tm_mon)+1, localTime->tm_mday);
-    bzero(log.logEntry, sizeof(log.logEntry));
-    strncpy(log.logEntry, logBuffer, sizeof(log.logEntry)-1); log.logEntry[sizeof(log.logEntry)-1]='\0';
-    log.accountID = destAccountID;
-    write(logFile, &log, sizeof(log));
-
-    logLock.l_type = F_UNLCK;
-    fcntl(logFile, F_SETLK, &logLock);
-    close(logFile);
-
     // up;date account
-    lseek(dbFile, srcOffset, SEEK_SET);
-    write(dbFile, &sourceAccount, sizeof(sourceAccount));
-    lseek(dbFile, dstOffset, SEEK_SET);
-    write(dbFile, &destAccount, sizeof(destAccount));
+    writeAccountRecord(srcFile, srcOffset, &sourceAccount);
+    if (hotDest) creditHotAccount(destAccountID, transferAmount);
+    else writeAccountRecord(dstFile, dstOffset, &destAccount);
 
     printf("Transfer %.2f from %d to %d successful.\n", transferAmount, sourceAccountID, destAccountID);
 
-    bzero(outBuffer, sizeof(outBuffer));
-    sprintf(outBuffer, "Transfer successful! New Balance: %.2f^", sourceAccount.currentBalance);
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+    if (logFailed) sprintf(outBuffer, "Transfer successful BUT LOGGING FAILED! New Balance: %.2f^", sourceAccount.currentBalance);
+    else sprintf(outBuffer, "Transfer successful! New Balance: %.2f^", sourceAccount.currentBalance);
 
-unlock_close: // cleanup dbfile / can be also used for closing 
+unlock_close: // release both records before answering the client
     lock1.l_type = F_UNLCK;
     lock2.l_type = F_UNLCK;
-    fcntl(dbFile, F_SETLK, &lock1);
-    fcntl(dbFile, F_SETLK, &lock2);
-    close(dbFile);
+    fcntl(lockFile2, F_SETLK, &lock2);
+    fcntl(lockFile1, F_SETLK, &lock1);
+
+transfer_close:
+    if (outBuffer[0] != '\0') {
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+    }
 }
 
-// transactions log - will show last 10 
+// transaction history, newest first, one page at a time
 void viewTransactionLogs(int clientSocket, int accountID){
-    struct TransactionLog log;
-    int maxLogs = 10;
-    int logCount = 0;
-    off_t fileSize, readPos;
-
-
-    int logFile = open(HISTORY_DB, O_RDONLY | O_CREAT, 0644); // Ensure file exists
-    if(logFile == -1) {
-        perror("View Logs: Error opening log file");
-         bzero(outBuffer, sizeof(outBuffer));
+    struct PageCursor cursor;
+    if (historyHandle(accountID) == -1) {
+        bzero(outBuffer, sizeof(outBuffer));
         strcpy(outBuffer, "Error retrieving transaction history.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()};
-    fcntl(logFile, F_SETLKW, &lock);
-
-    fileSize = lseek(logFile, 0, SEEK_END);
-    logCount = fileSize / sizeof(struct TransactionLog);
-
-    bzero(outBuffer, sizeof(outBuffer)); 
-    int foundCount = 0;
-
-    //starting position for reading backwards
-    readPos = (logCount > maxLogs) ? fileSize - (maxLogs * sizeof(struct TransactionLog)) : 0;
-    lseek(logFile, readPos, SEEK_SET);
-
-    while(foundCount < maxLogs && read(logFile, &log, sizeof(log)) == sizeof(log))
-    {
-        if(log.accountID == accountID)
-        {
-            //check to prevent buffer overflow
-            if (strlen(outBuffer) + strlen(log.logEntry) + 1 < sizeof(outBuffer)) {
-                 strcat(outBuffer, log.logEntry);
-                 foundCount++;
-            } else {
-                 // buffer full
-                 strcat(outBuffer, "... (more entries truncated)\n");
-                 break;
-            }
-        }
-    }
-
-    lock.l_type = F_UNLCK;
-    fcntl(logFile, F_SETLK, &lock);
-    close(logFile);
-
-    if(foundCount == 0) {
-        strcpy(outBuffer, "No transactions found.\n");
-    }
-
-    strcat(outBuffer, "^");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); 
+    openHistoryCursor(&cursor, accountID);
+    streamCursorPages(clientSocket, &cursor, "No transactions found.\n");
+    closeCursor(&cursor);
 }
 
 
-void submitFeedback(int clientSocket){
-    struct ClientFeedback feedback;
-    int feedbackFile = open(FEEDBACK_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
-    if(feedbackFile == -1) {
-        perror("Feedback: Error opening file");
-         bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "Error submitting feedback.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        return;
-     }
-
-    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(feedbackFile, F_SETLKW, &lock);
-
+void submitFeedback(int clientSocket, int accountID){
+    char message[FEEDBACK_COMMENT_MAX + 32];
     int choice;
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "Enter Feedback:\n1. Good\n2. Average\n3. Poor\nChoice: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
 
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <=0){
-        printf("Client disconnected during feedback.\n"); goto feedback_unlock_close;
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <=0){
+        printf("Client disconnected during feedback.\n"); return;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     choice = atoi(inBuffer);
 
-    bzero(feedback.message, sizeof(feedback.message));
-    if(choice == 1) strncpy(feedback.message, "Good", sizeof(feedback.message)-1);
-    else if(choice == 2) strncpy(feedback.message, "Average", sizeof(feedback.message)-1);
-    else if(choice == 3) strncpy(feedback.message, "Poor", sizeof(feedback.message)-1);
-    else strncpy(feedback.message, "Unknown Choice", sizeof(feedback.message)-1);
-    feedback.message[sizeof(feedback.message)-1] = '\0'; 
+    if(choice == 1) strcpy(message, "Good");
+    else if(choice == 2) strcpy(message, "Average");
+    else if(choice == 3) strcpy(message, "Poor");
+    else strcpy(message, "Unknown Choice");
+
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Comments (up to %d characters, - to skip): ", FEEDBACK_COMMENT_MAX);
+    write(clientSocket, outBuffer, strlen(outBuffer));
 
-    write(feedbackFile, &feedback, sizeof(feedback));
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <=0){
+        printf("Client disconnected during feedback.\n"); return;
+    }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    if(strcmp(inBuffer, "-") != 0 && inBuffer[0] != '\0') {
+        inBuffer[FEEDBACK_COMMENT_MAX] = '\0';
+        strcat(message, ": ");
+        strcat(message, inBuffer);
+    }
 
-feedback_unlock_close:
-    lock.l_type = F_UNLCK;
-    fcntl(feedbackFile, F_SETLK, &lock);
-    close(feedbackFile);
+    int entryNumber = appendFeedback(accountID, message, strlen(message), 0);
+    if(entryNumber != -1) indexFeedbackEntries();
 
     bzero(outBuffer, sizeof(outBuffer));
-    strcpy(outBuffer, "Thank you for your feedback!^");
+    strcpy(outBuffer, entryNumber != -1 ? "Thank you for your feedback!^" : "Error submitting feedback.^");
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); 
+    readClient(clientSocket, inBuffer, 3); 
 }
 
 // change password
@@ -811,64 +617,53 @@ int updateCustomerPassword(int clientSocket, int accountID){
     char newPassword[50];
     struct AccountHolder account;
 
-    int dbFile = open(ACCOUNT_DB, O_RDWR);
+    // read the new password before touching the record
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Enter new password: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+        printf("Client disconnected during password change entry.\n");
+        return 0;
+    }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    strncpy(newPassword, inBuffer, sizeof(newPassword) - 1);
+    newPassword[sizeof(newPassword) - 1] = '\0';
+    hashPassword(newPassword, newPassword); // before locking, it's slow on purpose
+
+    int dbFile = accountHandle(accountID);
     if(dbFile == -1) {
         perror("ChangePass: Error opening DB");
         return 0;
      }
 
-    int offset = -1;
-    off_t currentPos = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while(read(dbFile, &account, sizeof(account)) > 0) {
-        currentPos = lseek(dbFile, 0, SEEK_CUR) - sizeof(account);
-        if(account.accountID == accountID) {
-            offset = currentPos;
-            break;
-        }
-    }
+    off_t offset = findAccountOffset(dbFile, accountID);
     if(offset == -1) {
         printf("ChangePass: Account %d not found\n", accountID);
-        close(dbFile); return 0;
+        return 0;
     }
 
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
     if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
          perror("ChangePass: Failed to lock record");
-         close(dbFile); return 0;
-    }
-
-    bzero(outBuffer, sizeof(outBuffer));
-    strcpy(outBuffer, "Enter new password: ");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-
-    bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected during password change entry.\n");
-        lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
-        return 0;
+         return 0;
     }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-    strncpy(newPassword, inBuffer, sizeof(newPassword) - 1);
-    newPassword[sizeof(newPassword) - 1] = '\0';
 
     // Re-read data before writing
     lseek(dbFile, offset, SEEK_SET);
     if (read(dbFile, &account, sizeof(account)) != sizeof(account)) {
          perror("ChangePass: Failed re-read after lock");
-         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
+         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
          return 0;
     }
 
     // set pass
-    strncpy(account.password, newPassword, sizeof(account.password) - 1);
-    account.password[sizeof(account.password) - 1] = '\0';
-    lseek(dbFile, offset, SEEK_SET);
-    write(dbFile, &account, sizeof(account));
+    strcpy(account.password, newPassword);
+    writeAccountRecord(dbFile, offset, &account);
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
 
     printf("Customer %d changed password\n", accountID);
     return 1; 
@@ -881,13 +676,15 @@ void handleCustomerSession(int clientSocket){
     int authAccountID = -1, destAccountID; 
     int choice;
     char password[50]; 
+    int loginStatus;
 
 label_customer_login:
+    if (takeResumedSession(SESSION_CUSTOMER, &authAccountID)) goto customer_logged_in;
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "\nEnter account number: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
         printf("Client disconnected before login.\n"); return;
     }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
@@ -897,7 +694,7 @@ label_customer_login:
     strcpy(outBuffer,  "Enter password: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
          printf("Client disconnected before login password.\n"); return;
      }
      
@@ -905,20 +702,19 @@ label_customer_login:
     strncpy(password, inBuffer, sizeof(password) - 1); 
     password[sizeof(password)-1] = '\0';
 
-    if (authenticateCustomer(clientSocket, authAccountID, password))
+    loginStatus = authenticateCustomer(clientSocket, authAccountID, password);
+    if (loginStatus == 1)
     {
-        bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "\nLogin Successfully^");
-        write(clientSocket, outBuffer, strlen(outBuffer));
-        read(clientSocket, inBuffer, 3); 
+        sendLoginSuccess(clientSocket, SESSION_CUSTOMER, authAccountID);
 
+customer_logged_in:
         while(1)
         {
             bzero(outBuffer, sizeof(outBuffer));
             strcpy(outBuffer, CUSTOMER_PROMPT);
             write(clientSocket, outBuffer, strlen(outBuffer));
             bzero(inBuffer, sizeof(inBuffer));
-            if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+            if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
                 printf("Client %d disconnected during session.\n", authAccountID);
                 terminateClientSession(clientSocket, authAccountID); 
                 return;
@@ -926,6 +722,7 @@ label_customer_login:
             inBuffer[strcspn(inBuffer, "\r\n")] = 0;
             choice = atoi(inBuffer);
             printf("Customer %d choice: %d\n", authAccountID, choice);
+            if (choice >= 1 && choice <= 8 && !allowCustomerOperation(clientSocket, authAccountID)) continue;
 
             switch(choice)
             {
@@ -946,7 +743,7 @@ label_customer_login:
                     strcpy(outBuffer, "Enter destination account number: ");
                     write(clientSocket, outBuffer, strlen(outBuffer));
                     bzero(inBuffer, sizeof(inBuffer));
-                    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup;
+                    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup;
                     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
                     destAccountID = atoi(inBuffer);
 
@@ -955,7 +752,7 @@ label_customer_login:
                     strcpy(outBuffer, "Enter amount: ");
                     write(clientSocket, outBuffer, strlen(outBuffer));
                     bzero(inBuffer, sizeof(inBuffer));
-                     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup;
+                     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup;
                      inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
                     amount = atof(inBuffer);
 
@@ -965,11 +762,11 @@ label_customer_login:
                     if(updateCustomerPassword(clientSocket, authAccountID)) {
                         bzero(outBuffer, sizeof(outBuffer));
                         strcpy(outBuffer, "Password changed. Please log in again.^");
-                        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+                        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
                     } else {
                          bzero(outBuffer, sizeof(outBuffer));
                         strcpy(outBuffer, "Password change failed.^");
-                        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+                        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
                     }
                     endUserSession(clientSocket, authAccountID);
                     authAccountID = -1; 
@@ -978,7 +775,7 @@ label_customer_login:
                     viewTransactionLogs(clientSocket, authAccountID);
                     break;
                 case 8: 
-                    submitFeedback(clientSocket);
+                    submitFeedback(clientSocket, authAccountID);
                     break;
                 case 9: 
                     printf("%d logged out.\n", authAccountID);
@@ -987,22 +784,25 @@ label_customer_login:
                     return; 
                 case 10: // exit
                     printf("Customer: %d Exited!\n", authAccountID);
+                    revokeSessionToken();
                     terminateClientSession(clientSocket, authAccountID);
                      authAccountID = -1;
                     return; 
                 default:
                     bzero(outBuffer, sizeof(outBuffer));
                     strcpy(outBuffer, "Invalid Choice^");
-                    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+                    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
             }
         }
     }
     else 
     {
-        // login failed
-        bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "\nInvalid ID, Password, or Inactive Account^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        // login failed, a refused login has already said why
+        if (loginStatus != CUSTOMER_LOGIN_REFUSED) {
+            bzero(outBuffer, sizeof(outBuffer));
+            strcpy(outBuffer, "\nInvalid ID, Password, or Inactive Account^");
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        }
          authAccountID = -1; // reset auth 
         goto label_customer_login;
     }
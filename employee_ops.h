@@ -10,29 +10,36 @@
 #include <time.h>  
 #include <sys/types.h>
 
+// bulk loan decisions, see processLoansInBulk
+#define BULK_MAX_LOANS 1024
+#define BULK_UNDECIDED 0 // otherwise the loanStatus to set: 2 approve, 3 reject
+
+struct BulkLoan {
+    struct LoanRecord loan;
+    off_t offset;
+    int decision;
+};
+
+struct BulkLoan bulkLoans[BULK_MAX_LOANS];
+struct TransactionLog bulkLogs[BULK_MAX_LOANS];
+
 int authenticateEmployee(int clientSocket, int employeeID, char *password_input);
 void createNewCustomerAccount(int clientSocket);
 void processLoanApplication(int clientSocket, int employeeID);
+int compareBulkLoans(const void *first, const void *second);
+void commitBulkLoanGroup(int loanFile, int employeeID, struct BulkLoan *group, int count, struct tm *localTime,
+                         int *approved, int *rejected, int *skipped);
+void processLoansInBulk(int clientSocket, int employeeID);
 void viewAssignedLoans(int clientSocket, int employeeID);
+void auditTransactionLogs(int clientSocket, int staffID); //-> used by both employee and Manager
 int updateEmployeePassword(int clientSocket, int employeeID);
 void handleEmployeeSession(int clientSocket); 
 
 int authenticateEmployee(int clientSocket, int employeeID, char *password_input)
 {
     struct Employee employee;
-    int dbFile = open(EMPLOYEE_DB, O_RDONLY); 
-    if (dbFile == -1) {
-         if (errno == ENOENT) { // createe file if doesnt exists
-             dbFile = open(EMPLOYEE_DB, O_WRONLY | O_CREAT, 0644);
-             if (dbFile != -1) close(dbFile);
-             printf("Created empty employee database file: %s\n", EMPLOYEE_DB);
-         } else {
-            perror("AuthEmployee: Error opening employee DB for read");
-            return 0; 
-         }
-    } else {
-        close(dbFile); 
-    }
+    int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0); // created empty on first use
+    if (dbFile == -1) return 0;
 
     sessionSemaphore = createSessionLock(employeeID);
     if (sessionSemaphore == SEM_FAILED) {
@@ -45,31 +52,24 @@ int authenticateEmployee(int clientSocket, int employeeID, char *password_input)
         if (errno == EAGAIN) {
             printf("Employee %d is already logged in!\n", employeeID);
             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "This ID is already logged in elsewhere.^");
-            write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         } else {
             perror("AuthEmployee: sem_trywait failed");
         }
         sem_close(sessionSemaphore);
         return 0;
     }
-     dbFile = open(EMPLOYEE_DB, O_RDONLY);
-     if (dbFile == -1) {
-          perror("AuthEmployee: Error opening employee DB for login check");
-          sem_post(sessionSemaphore); sem_close(sessionSemaphore); sem_unlink(sessionSemName);
-          return 0;
-     }
-
     // check credentials
     int loggedIn = 0;
     lseek(dbFile, 0, SEEK_SET);
     while(read(dbFile, &employee, sizeof(employee)) == sizeof(employee)) 
     {
-        if (employee.employeeID == employeeID && strcmp(employee.password, password_input) == 0 && employee.roleType == 1) { // 1 = Employee
+        if (employee.employeeID == employeeID && employee.roleType == 1 && // 1 = Employee
+            checkCredentials(LOGIN_EMPLOYEE, employeeID, password_input, employee.password)) {
             loggedIn = 1;
             break;
         }
     }
-    close(dbFile);
 
     if (!loggedIn) { // failed auth
         sem_post(sessionSemaphore);
@@ -82,13 +82,13 @@ int authenticateEmployee(int clientSocket, int employeeID, char *password_input)
 }
 
 void createNewCustomerAccount(int clientSocket) {
-    struct AccountHolder account, tempAccount;
+    struct AccountHolder account;
     struct TransactionLog log;
 
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Name: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     strncpy(account.holderName, inBuffer, sizeof(account.holderName) - 1);
     account.holderName[sizeof(account.holderName)-1] = '\0';
@@ -96,92 +96,79 @@ void createNewCustomerAccount(int clientSocket) {
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Password: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-    strncpy(account.password, inBuffer, sizeof(account.password) - 1);
-    account.password[sizeof(account.password)-1] = '\0';
+    inBuffer[sizeof(account.password) - 1] = '\0';
+    hashPassword(inBuffer, account.password);
 
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Account Number: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     account.accountID = atoi(inBuffer);
 
     // duplicate check
-    int dbFile = open(ACCOUNT_DB, O_RDWR | O_CREAT, 0644);
+    int dbFile = accountHandle(account.accountID);
     if(dbFile == -1) {
         perror("CreateCust: Error opening account DB");
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
+    // ids hash to a fixed shard, so checking this shard's file is enough.
+    // unlocked here to fail early, checked again under the lock below
+    if (findAccountOffset(dbFile, account.accountID) != -1) goto createcust_duplicate;
+
+    // the last prompt: everything after it runs under the file lock without waiting on the client
+    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Opening Balance: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { printf("Client disconnected.\n"); return; }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
+    account.currentBalance = atof(inBuffer);
+    if (account.currentBalance < 0) account.currentBalance = 0; // negative balance not accepted
+
     struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
     if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
         perror("CreateCust: Failed to lock account DB");
-        close(dbFile);
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    int duplicateFound = 0;
-    lseek(dbFile, 0, SEEK_SET); 
-    while(read(dbFile, &tempAccount, sizeof(tempAccount)) == sizeof(tempAccount)) {
-        if (tempAccount.accountID == account.accountID) {
-            duplicateFound = 1;
-            break;
-        }
+    if (findAccountOffset(dbFile, account.accountID) != -1) { // created while we were asking
+        lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
+        goto createcust_duplicate;
     }
 
-    if (duplicateFound) { // duplicate account found
-        lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Account number already exists.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        return; 
-    }
-    
-    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Opening Balance: ");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-    bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-        printf("Client disconnected.\n"); goto createcust_unlock_fail;
-    }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
-    account.currentBalance = atof(inBuffer);
-    if (account.currentBalance < 0) account.currentBalance = 0; // negative balance not accepted
-
     time_t now = time(NULL);
 	struct tm* localTime = localtime(&now);
 
-    int logFile = open(HISTORY_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    int logFile = lockHistory(accountShard(account.accountID));
     if(logFile == -1) {
-        perror("CreateCust: Error opening log file");
         printf("CRITICAL: Account %d created but initial log failed!\n", account.accountID);
     } else {
-        struct flock logLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()}; 
-        fcntl(logFile, F_SETLKW, &logLock);
         bzero(log.logEntry, sizeof(log.logEntry));
         sprintf(log.logEntry, "%.2f Opening Balance at %02d:%02d:%02d %d-%d-%d\n",
                 account.currentBalance, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
                 (localTime->tm_year)+1900, (localTime->tm_mon)+1, localTime->tm_mday);
         log.logEntry[sizeof(log.logEntry)-1]='\0'; 
         log.accountID = account.accountID;
-        write(logFile, &log, sizeof(log));
+        appendTransactionLog(logFile, &log);
 
-        logLock.l_type = F_UNLCK; fcntl(logFile, F_SETLK, &logLock);
-        close(logFile);
+        unlockHistory(logFile);
     }
 
     // write to db
     account.isActive = 1; // active by default
-    lseek(dbFile, 0, SEEK_END); // write to end of file 
-    write(dbFile, &account, sizeof(account));
+    off_t newOffset = lseek(dbFile, 0, SEEK_END); // write to end of file
+    writeAccountRecord(dbFile, newOffset, &account);
+    indexAccount(account.accountID, newOffset);
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
 
     printf("Employee added customer %d\n", account.accountID);
 
@@ -191,13 +178,12 @@ void createNewCustomerAccount(int clientSocket) {
     } else {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Customer added successfully!^");
     }
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
     return;
 
-createcust_unlock_fail: // cleanup
-    lock.l_type = F_UNLCK;
-    fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+createcust_duplicate: // duplicate account found
+    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Account number already exists.^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
     return;
 }
 
@@ -212,22 +198,24 @@ void processLoanApplication(int clientSocket, int employeeID)
 	struct tm* localTime = localtime(&now);
 
     int loanID;
-    int loanFile = open(LOAN_DB, O_RDWR);
-    int accountFile = open(ACCOUNT_DB, O_RDWR); 
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
+    int accountFile = -1; // known once the loan tells us which shard
 
-    if(loanFile == -1 || accountFile == -1) {
+    if(loanFile == -1) {
         perror("ProcessLoan: Error opening DB files");
-        if(loanFile != -1) close(loanFile); if(accountFile != -1) close(accountFile);
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
     // loan id 
-    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Loan ID to process: ");
+    int queuedLoanID = nextQueuedLoan(employeeID);
+    bzero(outBuffer, sizeof(outBuffer));
+    if (queuedLoanID != -1) sprintf(outBuffer, "Next loan in your queue: %d\nEnter Loan ID to process: ", queuedLoanID);
+    else strcpy(outBuffer, "Enter Loan ID to process: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { goto loanproc_close_files; }
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { goto loanproc_done; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     loanID = atoi(inBuffer);
 
@@ -246,43 +234,62 @@ void processLoanApplication(int clientSocket, int employeeID)
 
     if(loanOffset == -1) {
         bzero(outBuffer, sizeof(outBuffer)); sprintf(outBuffer, "Loan ID %d not found.^", loanID);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        goto loanproc_close_files;
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        goto loanproc_done;
     }
 
     // check if assigned to this employee and is pending
     if(loan.assignedEmployeeID != employeeID || loan.loanStatus != 1) { // 1 = Pending
         bzero(outBuffer, sizeof(outBuffer));
         sprintf(outBuffer, "Loan ID %d is not assigned to you or is not pending.^", loanID);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        goto loanproc_close_files;
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        goto loanproc_done;
     }
 
-    struct flock loanLock = {F_WRLCK, SEEK_SET, loanOffset, sizeof(struct LoanRecord), getpid()};
-    if(fcntl(loanFile, F_SETLKW, &loanLock) == -1) {
-        perror("ProcessLoan: Loan lock failed"); goto loanproc_close_files;
-    }
-    
-    // get account 
-    int accountOffset = -1;
-    off_t currentPosAcc = 0;
-    lseek(accountFile, 0, SEEK_SET);
-    while (read(accountFile, &account, sizeof(account)) == sizeof(account))
-    {
-        currentPosAcc = lseek(accountFile, 0, SEEK_CUR) - sizeof(account);
-        if(account.accountID == loan.accountID) {
-            accountOffset = currentPosAcc;
-            break;
-        }
+    accountFile = accountHandle(loan.accountID);
+    if(accountFile == -1) {
+        perror("ProcessLoan: Error opening account DB");
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        goto loanproc_done;
     }
+
+    // get account, unlocked snapshot is enough to show the employee what they decide on
+    off_t accountOffset = readAccountSnapshot(accountFile, loan.accountID, &account);
     if(accountOffset == -1) {
         // loan exists but account doesn't.
         printf("CRITICAL ERROR: Loan %d exists but account %d not found!\n", loanID, loan.accountID);
         bzero(outBuffer, sizeof(outBuffer)); sprintf(outBuffer, "Error: Account %d for loan %d not found!^", loan.accountID, loanID);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        goto loanproc_unlock_loan;
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        goto loanproc_done;
     }
 
+    // get decision before taking any lock
+    int choice;
+    int decidedAmount = loan.amount;
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Processing Loan ID: %d\nAccount: %d (%s)\nCurrent Balance: %.2f\nLoan Amount: %d\n[1] Approve Loan\n[2] Reject Loan\nChoice: ",
+             loanID, account.accountID, account.holderName, account.currentBalance, loan.amount);
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+         printf("Client disconnected during loan decision.\n"); goto loanproc_done;
+     }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    choice = atoi(inBuffer);
+
+    if(choice != 1 && choice != 2) {
+         printf("Invalid choice (%d) for loan %d.\n", choice, loanID);
+         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid choice. No action taken.^");
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+         goto loanproc_done;
+    }
+
+    // commit: short locks, re-read and re-validate what the decision was based on
+    struct flock loanLock = {F_WRLCK, SEEK_SET, loanOffset, sizeof(struct LoanRecord), getpid()};
+    if(fcntl(loanFile, F_SETLKW, &loanLock) == -1) {
+        perror("ProcessLoan: Loan lock failed"); goto loanproc_done;
+    }
     struct flock accLock = {F_WRLCK, SEEK_SET, accountOffset, sizeof(struct AccountHolder), getpid()};
     if(fcntl(accountFile, F_SETLKW, &accLock) == -1) {
          perror("ProcessLoan: Account lock failed"); goto loanproc_unlock_loan;
@@ -299,28 +306,17 @@ void processLoanApplication(int clientSocket, int employeeID)
          perror("ProcessLoan: Loan re-read failed"); goto loanproc_unlock_both;
      }
 
-     // reverify everything after locking 
-     if(loan.assignedEmployeeID != employeeID || loan.loanStatus != 1) {
+     // reverify everything after locking
+     if(loan.assignedEmployeeID != employeeID || loan.loanStatus != 1 || loan.amount != decidedAmount) {
+        accLock.l_type = F_UNLCK; fcntl(accountFile, F_SETLK, &accLock);
+        loanLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &loanLock);
         bzero(outBuffer, sizeof(outBuffer));
         sprintf(outBuffer, "Loan ID %d status changed before processing.^", loanID);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        goto loanproc_unlock_both;
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        goto loanproc_done;
     }
 
-    // get decision
-    int choice;
-    bzero(outBuffer, sizeof(outBuffer));
-    sprintf(outBuffer, "Processing Loan ID: %d\nAccount: %d (%s)\nCurrent Balance: %.2f\nLoan Amount: %d\n[1] Approve Loan\n[2] Reject Loan\nChoice: ",
-             loanID, account.accountID, account.holderName, account.currentBalance, loan.amount);
-    write(clientSocket, outBuffer, strlen(outBuffer));
-    bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-         printf("Client disconnected during loan decision.\n"); goto loanproc_unlock_both;
-     }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
-    choice = atoi(inBuffer);
-
-    int logFile = -1; 
+    int logFile = -1;
     if(choice == 1) // Approve
     {
         if(account.isActive == 0)
@@ -335,14 +331,11 @@ void processLoanApplication(int clientSocket, int employeeID)
             loan.loanStatus = 2; // 2 = Approved
 
             //logging
-            logFile = open(HISTORY_DB, O_WRONLY | O_APPEND | O_CREAT, 0644);
+            logFile = lockHistory(accountShard(account.accountID));
             if (logFile == -1) {
-                perror("ProcessLoan (Approve): Error opening log file");
                 printf("CRITICAL: Loan %d approved for %d but logging failed!\n", loanID, account.accountID);
                  bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Loan Approved BUT LOGGING FAILED!^");
             } else {
-                struct flock logLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
-                fcntl(logFile, F_SETLKW, &logLock);
 
                 bzero(logBuffer, sizeof(logBuffer));
                 sprintf(logBuffer, "%d credited via loan %d at %02d:%02d:%02d %d-%d-%d\n",
@@ -351,102 +344,340 @@ void processLoanApplication(int clientSocket, int employeeID)
                 bzero(log.logEntry, sizeof(log.logEntry));
                 strncpy(log.logEntry, logBuffer, sizeof(log.logEntry)-1); log.logEntry[sizeof(log.logEntry)-1]='\0';
                 log.accountID = account.accountID;
-                write(logFile, &log, sizeof(log));
+                appendTransactionLog(logFile, &log);
 
-                logLock.l_type = F_UNLCK; fcntl(logFile, F_SETLK, &logLock);
-                close(logFile);
+                unlockHistory(logFile);
                  bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Loan Approved.^");
             }
 
             // update account
-            lseek(accountFile, accountOffset, SEEK_SET);
-            write(accountFile, &account, sizeof(account));
+            writeAccountRecord(accountFile, accountOffset, &account);
 
             printf("Loan %d approved for account %d\n", loanID, account.accountID);
         }
     }
-    else if (choice == 2) // Reject
+    else // Reject
     {
         loan.loanStatus = 3; // 3 = Rejected
         printf("Loan %d rejected for account %d\n", loanID, account.accountID);
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Loan Rejected.^");
     }
-    else // Invalid choice
-    {
-         printf("Invalid choice (%d) for loan %d.\n", choice, loanID);
-         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid choice. No action taken.^");
-         goto loanproc_unlock_both_ack; 
-    }
-
 
     //updated loan status
-    lseek(loanFile, loanOffset, SEEK_SET);
-    write(loanFile, &loan, sizeof(loan));
+    if (writeLoanRecord(loanFile, loanOffset, &loan)) loanDecided(&loan);
 
-loanproc_unlock_both_ack:
+    // release before talking to the client again
+    accLock.l_type = F_UNLCK; fcntl(accountFile, F_SETLK, &accLock);
+    loanLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &loanLock);
     write(clientSocket, outBuffer, strlen(outBuffer));
-    read(clientSocket, inBuffer, 3); // ack
+    readClient(clientSocket, inBuffer, 3); // ack
+    goto loanproc_done;
 
 loanproc_unlock_both:
     accLock.l_type = F_UNLCK; fcntl(accountFile, F_SETLK, &accLock);
 loanproc_unlock_loan:
     loanLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &loanLock);
-loanproc_close_files:
-    close(accountFile);
-    close(loanFile);
+loanproc_done:
+    return;
 }
 
-void viewAssignedLoans(int clientSocket, int employeeID)
+// by account, then file order, so each account is locked and written once
+int compareBulkLoans(const void *first, const void *second)
 {
-    struct LoanRecord loan;
-    int loanFile = open(LOAN_DB, O_RDONLY);
+    const struct BulkLoan *a = first, *b = second;
+    if (a->loan.accountID != b->loan.accountID) return a->loan.accountID < b->loan.accountID ? -1 : 1;
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+// one account's decided loans: loan records locked, re-read and checked, the approved
+// amounts credited with one account write and one log append, then the loan records.
+// loans that changed since they were loaded are left alone
+void commitBulkLoanGroup(int loanFile, int employeeID, struct BulkLoan *group, int count, struct tm *localTime,
+                         int *approved, int *rejected, int *skipped)
+{
+    struct flock loanLocks[BULK_MAX_LOANS];
+    struct AccountHolder account;
+    float credit = 0;
+    int approvals = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct LoanRecord current;
+        struct flock lock = {F_WRLCK, SEEK_SET, group[i].offset, sizeof(struct LoanRecord), getpid()};
+        loanLocks[i] = lock;
+        if (group[i].decision == BULK_UNDECIDED) continue;
+        if (fcntl(loanFile, F_SETLKW, &loanLocks[i]) == -1 ||
+            pread(loanFile, &current, sizeof(current), group[i].offset) != sizeof(current) ||
+            current.assignedEmployeeID != employeeID || current.loanStatus != 1 || current.amount != group[i].loan.amount) {
+            group[i].decision = BULK_UNDECIDED;
+            (*skipped)++;
+            continue;
+        }
+        if (group[i].decision == 2) { credit += current.amount; approvals++; }
+    }
+
+    int accountFile = -1;
+    off_t accountOffset = -1;
+    struct flock accLock = {F_WRLCK, SEEK_SET, 0, sizeof(struct AccountHolder), getpid()};
+    if (approvals > 0) {
+        accountFile = accountHandle(group[0].loan.accountID);
+        if (accountFile != -1) accountOffset = findAccountOffset(accountFile, group[0].loan.accountID);
+        accLock.l_start = accountOffset;
+        if (accountOffset == -1 || fcntl(accountFile, F_SETLKW, &accLock) == -1 ||
+            pread(accountFile, &account, sizeof(account), accountOffset) != sizeof(account)) {
+            printf("BulkLoans: account %d unavailable, its approvals stay pending\n", group[0].loan.accountID);
+            for (int i = 0; i < count; i++) {
+                if (group[i].decision == 2) { group[i].decision = BULK_UNDECIDED; (*skipped)++; }
+            }
+            if (accountOffset != -1) { accLock.l_type = F_UNLCK; fcntl(accountFile, F_SETLK, &accLock); }
+            accountOffset = -1;
+        } else if (account.isActive == 0) {
+            for (int i = 0; i < count; i++) {
+                if (group[i].decision == 2) group[i].decision = 3; // inactive account, rejected
+            }
+        } else {
+            int logCount = 0;
+            for (int i = 0; i < count; i++) {
+                if (group[i].decision != 2) continue;
+                struct TransactionLog *log = &bulkLogs[logCount++];
+                bzero(log, sizeof(*log));
+                log->accountID = account.accountID;
+                snprintf(log->logEntry, sizeof(log->logEntry), "%d credited via loan %d at %02d:%02d:%02d %d-%d-%d\n",
+                         group[i].loan.amount, group[i].loan.loanRecordID, localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
+                         (localTime->tm_year)+1900, (localTime->tm_mon)+1, localTime->tm_mday);
+            }
+            account.currentBalance += credit;
+
+            int logFile = lockHistory(accountShard(account.accountID));
+            if (logFile == -1 || !appendTransactionLogs(logFile, bulkLogs, logCount)) {
+                printf("CRITICAL: Bulk loans credited to %d but logging failed!\n", account.accountID);
+            }
+            writeAccountRecord(accountFile, accountOffset, &account);
+            if (logFile != -1) unlockHistory(logFile);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (group[i].decision == BULK_UNDECIDED) continue;
+        group[i].loan.loanStatus = group[i].decision;
+        if (writeLoanRecord(loanFile, group[i].offset, &group[i].loan)) loanDecided(&group[i].loan);
+        if (group[i].decision == 2) (*approved)++;
+        else (*rejected)++;
+    }
+
+    if (accountOffset != -1) { accLock.l_type = F_UNLCK; fcntl(accountFile, F_SETLK, &accLock); }
+    for (int i = 0; i < count; i++) {
+        loanLocks[i].l_type = F_UNLCK;
+        fcntl(loanFile, F_SETLK, &loanLocks[i]);
+    }
+}
+
+// every loan pending with this employee is loaded once and decided with nothing locked,
+// then everything is committed in one pass
+void processLoansInBulk(int clientSocket, int employeeID)
+{
+    struct LoanRecord batch[64];
+    int loanCount = 0;
+    off_t position = 0;
+    ssize_t got;
+
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
     if(loanFile == -1) {
-        perror("ViewLoans: Error opening file");
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error retrieving assigned loans.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(loanFile, F_SETLKW, &lock);
+    while ((got = pread(loanFile, batch, sizeof(batch), position)) >= (ssize_t)sizeof(struct LoanRecord)) {
+        int records = got / sizeof(struct LoanRecord);
+        for (int i = 0; i < records && loanCount < BULK_MAX_LOANS; i++) {
+            if (batch[i].assignedEmployeeID != employeeID || batch[i].loanStatus != 1) continue;
+            bulkLoans[loanCount].loan = batch[i];
+            bulkLoans[loanCount].offset = position + i * sizeof(struct LoanRecord);
+            bulkLoans[loanCount].decision = BULK_UNDECIDED;
+            loanCount++;
+        }
+        position += records * sizeof(struct LoanRecord);
+    }
 
-    int found = 0;
-    while(read(loanFile, &loan, sizeof(loan)) == sizeof(loan))
-    {
-        if(loan.assignedEmployeeID == employeeID && loan.loanStatus == 1) // 1 = Pending
-        {
+    if (loanCount == 0) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "No pending loans assigned to you.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
+    // the list goes out in as few messages as fit
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "%d pending loans%s:\n", loanCount, loanCount == BULK_MAX_LOANS ? " (first batch)" : "");
+    for (int i = 0; i < loanCount; i++) {
+        char line[96];
+        sprintf(line, "Loan ID: %d | Account: %d | Amount: %d\n", bulkLoans[i].loan.loanRecordID, bulkLoans[i].loan.accountID, bulkLoans[i].loan.amount);
+        if (strlen(outBuffer) + strlen(line) + 2 > sizeof(outBuffer)) {
+            strcat(outBuffer, "^");
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
             bzero(outBuffer, sizeof(outBuffer));
-            sprintf(outBuffer, "Loan ID: %d | Account: %d | Amount: %d^",
-                    loan.loanRecordID, loan.accountID, loan.amount);
-            write(clientSocket, outBuffer, strlen(outBuffer));
-            read(clientSocket, inBuffer, 3); // ack for each record sent
-            found = 1;
         }
+        strcat(outBuffer, line);
+    }
+    strcat(outBuffer, "^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+
+    int unknown = 0;
+    while (1)
+    {
+        int approving = 0, rejecting = 0;
+        for (int i = 0; i < loanCount; i++) {
+            if (bulkLoans[i].decision == 2) approving++;
+            else if (bulkLoans[i].decision == 3) rejecting++;
+        }
+        bzero(outBuffer, sizeof(outBuffer));
+        if (unknown > 0) sprintf(outBuffer, "%d loan IDs not in your list were ignored.\n", unknown);
+        sprintf(outBuffer + strlen(outBuffer), "Approve: %d | Reject: %d | Undecided: %d\n"
+                "A <loan IDs|all> approve, R <loan IDs|all> reject, C commit, Q quit without changes: ",
+                approving, rejecting, loanCount - approving - rejecting);
+        write(clientSocket, outBuffer, strlen(outBuffer));
+
+        bzero(inBuffer, sizeof(inBuffer));
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+            printf("Client disconnected during bulk loan decisions.\n"); return;
+        }
+        inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+
+        char *token = strtok(inBuffer, " ,");
+        if (token == NULL) continue;
+        char command = token[0] & ~0x20; // upper case
+        if (command == 'Q') return;
+        if (command == 'C') break;
+        if (command != 'A' && command != 'R') continue;
+
+        int decision = command == 'A' ? 2 : 3;
+        unknown = 0;
+        while ((token = strtok(NULL, " ,")) != NULL) {
+            if (strcmp(token, "all") == 0) {
+                for (int i = 0; i < loanCount; i++) {
+                    if (bulkLoans[i].decision == BULK_UNDECIDED) bulkLoans[i].decision = decision;
+                }
+                continue;
+            }
+            int loanID = atoi(token), found = 0;
+            for (int i = 0; i < loanCount; i++) {
+                if (bulkLoans[i].loan.loanRecordID == loanID) { bulkLoans[i].decision = decision; found = 1; break; }
+            }
+            if (!found) unknown++;
+        }
+    }
+
+    time_t now = time(NULL);
+    struct tm* localTime = localtime(&now);
+    int approved = 0, rejected = 0, skipped = 0;
+
+    qsort(bulkLoans, loanCount, sizeof(struct BulkLoan), compareBulkLoans);
+    for (int start = 0, end; start < loanCount; start = end) {
+        for (end = start; end < loanCount && bulkLoans[end].loan.accountID == bulkLoans[start].loan.accountID; end++);
+        commitBulkLoanGroup(loanFile, employeeID, &bulkLoans[start], end - start, localTime, &approved, &rejected, &skipped);
+    }
+
+    printf("Employee %d bulk decided loans: %d approved, %d rejected, %d skipped\n", employeeID, approved, rejected, skipped);
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Committed: %d approved, %d rejected.", approved, rejected);
+    if (skipped > 0) sprintf(outBuffer + strlen(outBuffer), " %d changed meanwhile and were left as they are.", skipped);
+    strcat(outBuffer, "^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+}
+
+void viewAssignedLoans(int clientSocket, int employeeID)
+{
+    struct LoanRecord loan;
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
+    if(loanFile == -1) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error retrieving assigned loans.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
     }
 
-    lock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &lock);
-    close(loanFile);
+    // no lock: loan records are rewritten whole in place, and one message instead of an ack per loan
+    int found = 0, shown = 0;
+    off_t position = 0;
+    bzero(outBuffer, sizeof(outBuffer));
+    while(pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan))
+    {
+        position += sizeof(loan);
+        if(loan.assignedEmployeeID != employeeID || loan.loanStatus != 1) continue; // 1 = Pending
+        found++;
+        if(strlen(outBuffer) + 128 > sizeof(outBuffer)) continue;
+        sprintf(outBuffer + strlen(outBuffer), "Loan ID: %d | Account: %d | Amount: %d\n",
+                loan.loanRecordID, loan.accountID, loan.amount);
+        shown++;
+    }
 
     if(!found) {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "No pending assigned loans found.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-    } else {
-        //final empty ack after the last record or if none were found previously
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
     }
+    if(shown < found) sprintf(outBuffer + strlen(outBuffer), "... and %d more\n", found - shown);
+    strcat(outBuffer, "^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
 }
 
+// every filter is optional; answers "-" (or 0) match everything
+void auditTransactionLogs(int clientSocket, int staffID)
+{
+    struct PageCursor cursor;
+    struct AuditFilter filter;
+    const char *prompts[6] = {"Account Number (0 for any): ", "From date YYYY-MM-DD (- for any): ",
+                              "To date YYYY-MM-DD (- for any): ", "Minimum amount (0 for any): ",
+                              "Type: deposit, withdrawal, transfer, loan, opening, accrual (- for any): ",
+                              "Text (- for any): "};
+    char answers[6][AUDIT_TEXT_MAX];
+
+    for (int i = 0; i < 6; i++) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, prompts[i]);
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        bzero(inBuffer, sizeof(inBuffer));
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+        inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+        inBuffer[sizeof(answers[i]) - 1] = '\0'; // cut to fit
+        strcpy(answers[i], inBuffer);
+    }
+
+    memset(&filter, 0, sizeof(filter));
+    filter.accountID = atoi(answers[0]);
+    filter.fromDay = parseAuditDay(answers[1]);
+    filter.toDay = parseAuditDay(answers[2]);
+    filter.minCents = (long long)(atof(answers[3]) * 100 + 0.5);
+    filter.types = parseAuditTypes(answers[4]);
+    if (strcmp(answers[5], "-") != 0) strcpy(filter.text, answers[5]);
+
+    long long started = currentMicros();
+    openAuditCursor(&cursor, &filter);
+    streamCursorPages(clientSocket, &cursor, "No matching transactions.\n");
+    printf("Staff %d audit (account %s, %s to %s, min %s, type %s, text %s): %lld matches in %lld entries, %lld us\n",
+           staffID, answers[0], answers[1], answers[2], answers[3], answers[4], answers[5],
+           cursor.audit.matched, cursor.audit.scanned, currentMicros() - started);
+    closeCursor(&cursor);
+}
 
 int updateEmployeePassword(int clientSocket, int employeeID) //-> used by both employee and Manager
 {
-    char newPassword[50];
+    char newPassword[50], hashedPassword[PASSWORD_HASH_LENGTH + 1];
     struct Employee employee;
-    int dbFile = open(EMPLOYEE_DB, O_RDWR);
-     if(dbFile == -1) {
-        perror("ChangePass: Error opening DB");
-        return 0;
+    int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0);
+     if(dbFile == -1) return 0;
+
+    // ask before locking, the record lock never waits on the client
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Enter new password: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+
+    bzero(inBuffer, sizeof(inBuffer));
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+         printf("Client disconnected during password change entry.\n");
+         return 0; 
      }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    strncpy(newPassword, inBuffer, sizeof(newPassword) - 1);
+    newPassword[sizeof(newPassword) - 1] = '\0';
+    hashPassword(newPassword, hashedPassword); // the slow part, done before the record is locked
 
     int offset = -1;
     off_t currentPos = 0;
@@ -461,47 +692,29 @@ int updateEmployeePassword(int clientSocket, int employeeID) //-> used by both e
     }
     if(offset == -1) {
         printf("Changepass: employee/Manager ID %d not found\n", employeeID);
-        close(dbFile); return 0; 
+        return 0; 
      }
 
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct Employee), getpid()};
     if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
          perror("ChangePass: Failed to lock record");
-         close(dbFile); return 0; 
-    }
-
-
-    bzero(outBuffer, sizeof(outBuffer));
-    strcpy(outBuffer, "Enter new password: ");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-
-    bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-         printf("Client disconnected during password change entry.\n");
-         lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
          return 0; 
-     }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
-    strncpy(newPassword, inBuffer, sizeof(newPassword) - 1);
-    newPassword[sizeof(newPassword) - 1] = '\0';
-
+    }
 
     lseek(dbFile, offset, SEEK_SET);
     if (read(dbFile, &employee, sizeof(employee)) != sizeof(employee)) {
         perror("ChangePass: Re-read failed");
-        lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock); close(dbFile);
+        lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
         return 0;
     }
-    
-    strncpy(employee.password, newPassword, sizeof(employee.password) - 1);
-    employee.password[sizeof(employee.password) - 1] = '\0';
+    strcpy(employee.password, hashedPassword);
 
     lseek(dbFile, offset, SEEK_SET);
-    write(dbFile, &employee, sizeof(employee));
+    if (write(dbFile, &employee, sizeof(employee)) == sizeof(employee))
+        shipRecord(REPL_FILE_EMPLOYEE, 0, offset, &employee, sizeof(employee));
 
     lock.l_type = F_UNLCK;
     fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
 
     printf("employee/Manager %d changed password\n", employeeID);
     return 1; 
@@ -513,11 +726,12 @@ void handleEmployeeSession(int clientSocket)
     char password[51];
 
 label_employee_login:
+    if (takeResumedSession(SESSION_EMPLOYEE, &authEmployeeID)) goto employee_logged_in;
     bzero(outBuffer, sizeof(outBuffer));
     strcpy(outBuffer, "\nEnter Employee ID: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     authEmployeeID = atoi(inBuffer);
 
@@ -525,17 +739,16 @@ label_employee_login:
     strcpy(outBuffer, "Enter password: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     strncpy(password, inBuffer, sizeof(password) - 1);
     password[sizeof(password)-1] = '\0';
 
     if(authenticateEmployee(clientSocket, authEmployeeID, password))
     {
-        bzero(outBuffer, sizeof(outBuffer));
-        strcpy(outBuffer, "\nLogin Successfully^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+        sendLoginSuccess(clientSocket, SESSION_EMPLOYEE, authEmployeeID);
 
+employee_logged_in:
         while(1)
         {
             bzero(outBuffer, sizeof(outBuffer));
@@ -543,7 +756,7 @@ label_employee_login:
             write(clientSocket, outBuffer, strlen(outBuffer));
 
             bzero(inBuffer, sizeof(inBuffer));
-            if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+            if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
                  printf("employee %d disconnected during session.\n", authEmployeeID);
                 terminateClientSession(clientSocket, authEmployeeID);
                 return;
@@ -563,51 +776,58 @@ label_employee_login:
                 case 3: 
                     processLoanApplication(clientSocket, authEmployeeID); 
                     break;
-                case 4: 
-                    viewAssignedLoans(clientSocket, authEmployeeID); 
+                case 4:
+                    processLoansInBulk(clientSocket, authEmployeeID);
                     break;
                 case 5: 
+                    viewAssignedLoans(clientSocket, authEmployeeID); 
+                    break;
+                case 6: 
                     bzero(outBuffer, sizeof(outBuffer));
                     strcpy(outBuffer, "Enter Account Number: ");
                     write(clientSocket, outBuffer, strlen(outBuffer));
 
                     bzero(inBuffer, sizeof(inBuffer));
-                    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup_employee;
+                    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) goto disconnect_cleanup_employee;
                      inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
                     accountChoice = atoi(inBuffer);
 
                     viewTransactionLogs(clientSocket, accountChoice); 
                     break;
-                case 6: 
+                case 7: 
                     if(updateEmployeePassword(clientSocket, authEmployeeID)) {
                         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer,"Password changed. Please log in again.^");
                     } else {
                         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer,"Password change failed.^");
                     }
-                    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+                    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
                     endUserSession(clientSocket, authEmployeeID);
                     authEmployeeID = -1;
                     goto label_employee_login;
-                case 7: 
+                case 8:
+                    auditTransactionLogs(clientSocket, authEmployeeID);
+                    break;
+                case 9: 
                     printf("Employee ID: %d Logged Out!\n", authEmployeeID);
                     endUserSession(clientSocket, authEmployeeID);
                     authEmployeeID = -1;
                     return; 
-                case 8: 
+                case 10: 
                     printf("Employee ID: %d Exited!\n", authEmployeeID);
+                    revokeSessionToken();
                     terminateClientSession(clientSocket, authEmployeeID);
                     authEmployeeID = -1;
                     return; 
                 default:
                     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid Choice^");
-                    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+                    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
             }
         }
     }
     else 
     {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "\nInvalid ID or Password^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         authEmployeeID = -1;
         goto label_employee_login;
     }
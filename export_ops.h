@@ -0,0 +1,363 @@
+#ifndef EXPORT_OPS_H
+#define EXPORT_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// Bulk exports of transaction records, sent with sendfile so the bytes go from the page
+// cache to the socket without passing through outBuffer. The client is told the name and
+// size first ("EXPORT <name> <bytes>^"), acks, then reads exactly that many raw bytes.
+// Records are sent in their on-disk TransactionLog format.
+//
+// An account statement is a per-account file of that account's records, kept under
+// statements/ and brought up to date from the shard log before each export. Its header
+// says how far into the log it has been filled (segment and offset, see segment_ops.h)
+// and how many of its bytes are valid. A day export is a byte range of each log segment
+// that can hold the day, found by binary search. That works because records are appended
+// in time order: each one is stamped at commit time, under the log lock (stampLogEntry).
+// Statements read archived segments too, only decompressing the blocks whose account
+// summary has the account (see archive_ops.h). Day exports send file ranges as they are;
+// the day's records from archived segments are decompressed into a scratch file first
+// and sent from there, in segment order with the rest.
+
+#define STATEMENT_DIR "statements"
+#define STATEMENT_PATH_SIZE 64
+#define EXPORT_SCAN_BATCH 64 // log records per pread while refreshing a statement
+#define EXPORT_DAY_RANGES 64 // initial room for segment ranges in a day export, grows as needed
+
+struct StatementHeader {
+    int scannedSeq;        // log segment being filled from
+    off_t scannedLog;      // bytes of it looked at so far
+    off_t statementBytes;  // records written after the header
+};
+
+struct ExportRange {
+    int fd;
+    off_t start, length;
+};
+
+int refreshAccountStatement(int accountID, off_t *length);
+off_t scanArchivedStatement(int statementFile, off_t appendAt, int accountID, struct LogSegment *segment, struct StatementHeader *header);
+off_t firstRecordOnOrAfter(int logFile, off_t recordCount, int dayKey);
+off_t stageArchivedDay(int stageFile, off_t at, int shard, struct LogSegment *segment, int dayKey);
+int sendExportHeader(int clientSocket, const char *name, off_t size);
+int sendFileRange(int clientSocket, int fd, off_t offset, off_t length);
+void exportAccountStatement(int clientSocket);
+void exportTransactionDay(int clientSocket);
+
+// appends the account's records committed since the last refresh. returns the statement
+// descriptor (caller closes it) and its record bytes in length, or -1
+int refreshAccountStatement(int accountID, off_t *length)
+{
+    static struct TransactionLog batch[EXPORT_SCAN_BATCH];
+    char path[STATEMENT_PATH_SIZE];
+    struct StatementHeader header;
+    struct LogSegmentSet segments;
+
+    mkdir(STATEMENT_DIR, 0755);
+    snprintf(path, sizeof(path), STATEMENT_DIR "/account_%d.dat", accountID);
+    int statementFile = open(path, O_RDWR | O_CREAT, 0644);
+    if (statementFile == -1 || !loadLogSegments(accountShard(accountID), &segments)) {
+        perror("Export: Error opening statement");
+        if (statementFile != -1) close(statementFile);
+        return -1;
+    }
+
+    // one refresher at a time per statement. records are only appended, so a sender that
+    // goes on past the unlock still sends a consistent prefix
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(statementFile, F_SETLKW, &lock);
+
+    if (pread(statementFile, &header, sizeof(header), 0) != sizeof(header)) {
+        header.scannedSeq = 0;
+        header.scannedLog = header.statementBytes = 0;
+    }
+    ftruncate(statementFile, sizeof(header) + header.statementBytes); // drop records a crashed refresh left behind
+    off_t appendAt = sizeof(header) + header.statementBytes;
+
+    for (int index = 0; index < segments.count; index++) {
+        struct LogSegment *segment = &segments.segments[index];
+        off_t end = segment->records * sizeof(struct TransactionLog);
+        if (segment->seq < header.scannedSeq) continue;
+        if (segment->seq > header.scannedSeq) {
+            header.scannedSeq = segment->seq;
+            header.scannedLog = 0;
+        }
+        int logFile = header.scannedLog < end ? openLogSegment(&segments, index) : -1;
+        while (logFile != -1 && header.scannedLog < end) {
+            off_t count = (end - header.scannedLog) / sizeof(struct TransactionLog);
+            if (count > EXPORT_SCAN_BATCH) count = EXPORT_SCAN_BATCH;
+            if (pread(logFile, batch, count * sizeof(struct TransactionLog), header.scannedLog) != (ssize_t)(count * sizeof(struct TransactionLog))) {
+                perror("Export: Error reading log");
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                if (batch[i].accountID != accountID) continue;
+                pwrite(statementFile, &batch[i], sizeof(batch[i]), appendAt);
+                appendAt += sizeof(batch[i]);
+            }
+            header.scannedLog += count * sizeof(struct TransactionLog);
+        }
+        if (logFile != -1) close(logFile);
+        else if (header.scannedLog < end && segment->state != SEGMENT_ACTIVE) {
+            appendAt = scanArchivedStatement(statementFile, appendAt, accountID, segment, &header);
+        }
+        if (header.scannedLog < end) break; // read failed, pick up here next time
+    }
+    header.statementBytes = appendAt - sizeof(header);
+    pwrite(statementFile, &header, sizeof(header), 0); // after the records it covers
+    *length = header.statementBytes;
+    freeLogSegments(&segments);
+
+    lock.l_type = F_UNLCK;
+    fcntl(statementFile, F_SETLK, &lock);
+    return statementFile;
+}
+
+// the account's records in an archived segment from header->scannedLog on, appended at
+// appendAt. moves scannedLog on past the blocks read and returns the new append offset
+off_t scanArchivedStatement(int statementFile, off_t appendAt, int accountID, struct LogSegment *segment, struct StatementHeader *header)
+{
+    struct SegmentArchive archive;
+    struct TransactionLog *logs = malloc(ARCHIVE_BLOCK_RECORDS * sizeof(struct TransactionLog));
+    if (logs == NULL || !openSegmentArchive(accountShard(accountID), segment->seq, &archive)) {
+        free(logs);
+        return appendAt;
+    }
+
+    long long from = header->scannedLog / sizeof(struct TransactionLog);
+    for (int index = from < archive.header.records ? findArchiveBlock(&archive, from) : archive.header.blocks; index < archive.header.blocks; index++) {
+        struct ArchiveBlock *block = &archive.blocks[index];
+        if (archiveBlockHasAccount(block, accountID)) {
+            int count = readArchiveBlock(&archive, index, logs);
+            if (count == -1) break;
+            for (int i = from > block->firstRecord ? from - block->firstRecord : 0; i < count; i++) {
+                if (logs[i].accountID != accountID) continue;
+                pwrite(statementFile, &logs[i], sizeof(logs[i]), appendAt);
+                appendAt += sizeof(logs[i]);
+            }
+        }
+        header->scannedLog = (block->firstRecord + block->records) * sizeof(struct TransactionLog);
+    }
+    closeSegmentArchive(&archive);
+    free(logs);
+    return appendAt;
+}
+
+off_t firstRecordOnOrAfter(int logFile, off_t recordCount, int dayKey)
+{
+    off_t low = 0, high = recordCount;
+    while (low < high) {
+        off_t middle = low + (high - low) / 2;
+        if (logRecordDay(logFile, middle) < dayKey) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// the day's records of an archived segment, appended to stageFile at at. only blocks
+// whose day range can hold the day are decompressed. returns the new end, -1 on failure
+off_t stageArchivedDay(int stageFile, off_t at, int shard, struct LogSegment *segment, int dayKey)
+{
+    struct SegmentArchive archive;
+    struct TransactionLog *logs = malloc(ARCHIVE_BLOCK_RECORDS * sizeof(struct TransactionLog));
+    if (logs == NULL || !openSegmentArchive(shard, segment->seq, &archive)) {
+        free(logs);
+        return -1;
+    }
+
+    for (int index = 0; index < archive.header.blocks && at != -1; index++) {
+        struct ArchiveBlock *block = &archive.blocks[index];
+        if (block->firstDay != 0 && block->lastDay != 0 && (block->lastDay < dayKey || block->firstDay > dayKey)) continue;
+        int count = readArchiveBlock(&archive, index, logs);
+        if (count == -1) at = -1;
+        for (int i = 0; i < count && at != -1; i++) {
+            if (logEntryDay(logs[i].logEntry, strnlen(logs[i].logEntry, sizeof(logs[i].logEntry))) != dayKey) continue;
+            if (pwrite(stageFile, &logs[i], sizeof(logs[i]), at) != sizeof(logs[i])) at = -1;
+            else at += sizeof(logs[i]);
+        }
+    }
+    closeSegmentArchive(&archive);
+    free(logs);
+    return at;
+}
+
+// 1 once the client has acked and is waiting for the bytes
+int sendExportHeader(int clientSocket, const char *name, off_t size)
+{
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "EXPORT %s %lld^", name, (long long)size);
+    if (write(clientSocket, outBuffer, strlen(outBuffer)) <= 0) return 0;
+    bzero(inBuffer, sizeof(inBuffer));
+    return readClient(clientSocket, inBuffer, 3) > 0;
+}
+
+int sendFileRange(int clientSocket, int fd, off_t offset, off_t length)
+{
+    while (length > 0) {
+        ssize_t sent = sendfile(clientSocket, fd, &offset, length);
+        if (sent <= 0) {
+            if (sent == -1 && errno == EINTR) continue;
+            perror("Export: sendfile failed");
+            return 0;
+        }
+        length -= sent;
+    }
+    return 1;
+}
+
+void exportAccountStatement(int clientSocket)
+{
+    char name[STATEMENT_PATH_SIZE];
+    off_t length = 0;
+
+    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Account Number: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+    if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    int accountID = atoi(inBuffer);
+
+    struct AccountHolder account;
+    int dbFile = accountHandle(accountID);
+    if (dbFile == -1 || readAccountSnapshot(dbFile, accountID, &account) == -1) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Account not found.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
+    int statementFile = refreshAccountStatement(accountID, &length);
+    if (statementFile == -1) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error preparing statement.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
+    snprintf(name, sizeof(name), "statement_%d.dat", accountID);
+    int sent = sendExportHeader(clientSocket, name, length) &&
+               sendFileRange(clientSocket, statementFile, sizeof(struct StatementHeader), length);
+    close(statementFile);
+    if (!sent) return;
+
+    printf("Exported %lld bytes of statement for account %d\n", (long long)length, accountID);
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Exported %lld transactions for account %d.^", (long long)(length / sizeof(struct TransactionLog)), accountID);
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+}
+
+// every shard's records for one day, shard after shard and segment after segment. a
+// segment that can't be read is left out and the client is told the export is incomplete
+void exportTransactionDay(int clientSocket)
+{
+    char name[STATEMENT_PATH_SIZE], stagePath[STATEMENT_PATH_SIZE];
+    int year, month, day, rangeCount = 0, rangeCapacity = EXPORT_DAY_RANGES, incomplete = 0;
+    struct ExportRange *ranges;
+    struct LogSegmentSet segments;
+    off_t total = 0, staged = 0;
+    int stageFile = -1; // archived records, created on first use
+
+    bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter date (YYYY-MM-DD): ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+    if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    if (sscanf(inBuffer, "%d-%d-%d", &year, &month, &day) != 3) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid date.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+    ranges = malloc(rangeCapacity * sizeof(struct ExportRange));
+    if (ranges == NULL) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error preparing export.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+    int dayKey = year * 10000 + month * 100 + day;
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (!loadLogSegments(shard, &segments)) {
+            incomplete = 1;
+            continue;
+        }
+        for (int index = 0; index < segments.count; index++) {
+            struct LogSegment *segment = &segments.segments[index];
+            if (segment->records == 0 || (segment->lastDay != 0 && segment->lastDay < dayKey) ||
+                (segment->firstDay != 0 && segment->firstDay > dayKey)) continue;
+            if (rangeCount == rangeCapacity) {
+                struct ExportRange *grown = realloc(ranges, 2 * rangeCapacity * sizeof(struct ExportRange));
+                if (grown == NULL) {
+                    incomplete = 1;
+                    break;
+                }
+                ranges = grown;
+                rangeCapacity *= 2;
+            }
+
+            struct ExportRange *range = &ranges[rangeCount];
+            if (segment->state == SEGMENT_ARCHIVED) {
+                if (stageFile == -1) {
+                    mkdir(STATEMENT_DIR, 0755);
+                    snprintf(stagePath, sizeof(stagePath), STATEMENT_DIR "/day_%d.tmp", getpid());
+                    stageFile = open(stagePath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+                    if (stageFile != -1) unlink(stagePath); // gone once the export closes it
+                }
+                off_t end = stageFile == -1 ? -1 : stageArchivedDay(stageFile, staged, shard, segment, dayKey);
+                if (end == -1) {
+                    perror("Export: Error reading archived segment");
+                    incomplete = 1;
+                    continue;
+                }
+                if (end == staged) continue;
+                range->fd = stageFile;
+                range->start = staged;
+                range->length = end - staged;
+                staged = end;
+            } else {
+                int logFile = openLogSegment(&segments, index);
+                if (logFile == -1) {
+                    perror("Export: Error opening log segment");
+                    incomplete = 1;
+                    continue;
+                }
+                off_t first = firstRecordOnOrAfter(logFile, segment->records, dayKey);
+                off_t last = firstRecordOnOrAfter(logFile, segment->records, dayKey + 1);
+                if (first == last) {
+                    close(logFile);
+                    continue;
+                }
+                range->fd = logFile;
+                range->start = first * sizeof(struct TransactionLog);
+                range->length = (last - first) * sizeof(struct TransactionLog);
+            }
+            total += range->length;
+            rangeCount++;
+        }
+        freeLogSegments(&segments);
+    }
+
+    snprintf(name, sizeof(name), "transactions_%04d-%02d-%02d.dat", year, month, day);
+    int sent = sendExportHeader(clientSocket, name, total);
+    for (int i = 0; i < rangeCount; i++) {
+        sent = sent && sendFileRange(clientSocket, ranges[i].fd, ranges[i].start, ranges[i].length);
+        if (ranges[i].fd != stageFile) close(ranges[i].fd);
+    }
+    if (stageFile != -1) close(stageFile);
+    free(ranges);
+    if (!sent) return;
+
+    printf("Exported %lld bytes of transactions for %04d-%02d-%02d%s\n", (long long)total, year, month, day,
+           incomplete ? ", incomplete" : "");
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Exported %lld transactions for %04d-%02d-%02d.%s^", (long long)(total / sizeof(struct TransactionLog)), year, month, day,
+            incomplete ? "\nIncomplete: some log segments could not be read." : "");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+}
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef FEEDBACK_OPS_H
+#define FEEDBACK_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Feedback store. Messages are variable length and packed one after another in
+// feedback_messages.dat; feedback_entries.dat has a fixed size entry per feedback with
+// the account, time and where its message is, so entries can be counted, binary searched
+// by time and read by number. Entries are appended in time order under the entries file
+// lock.
+//
+// feedback_index.dat is an inverted index over the words of each message plus one term
+// per account ("#<id>"). Terms hash into a fixed table of buckets; each bucket is a chain
+// of posting blocks, newest first, so a query reads only the blocks of one bucket and
+// stops once it walks past the start of the date range. Postings are added as feedback
+// comes in; indexedEntries says how far the index has got, so a crash just means the
+// next writer catches up. Hash collisions are filtered out by checking the message.
+
+#define FEEDBACK_INDEX_BUCKETS 65536
+#define FEEDBACK_BLOCK_POSTINGS 30
+#define FEEDBACK_WORD_MAX 32 // longer words are indexed by their first 31 characters
+#define FEEDBACK_TERMS_MAX 128 // distinct terms indexed per message
+#define FEEDBACK_COMMENT_MAX 1000
+#define PREMIGRATION_SUFFIX ".premigration" // the old feedback file is renamed to this
+
+struct FeedbackEntry {
+    long long messageOffset;
+    long long submittedAt; // 0 for feedback migrated from before times were recorded
+    int accountID;         // -1 for feedback migrated from before accounts were recorded
+    int messageLength;
+};
+
+struct FeedbackIndexHeader {
+    int indexedEntries;
+    int unused;
+    long long bucketHeads[FEEDBACK_INDEX_BUCKETS]; // newest posting block, 0 = empty
+};
+
+struct PostingBlock {
+    long long previous; // older block of the same bucket, 0 = none
+    int count;
+    int unused;
+    unsigned int terms[FEEDBACK_BLOCK_POSTINGS];
+    int entries[FEEDBACK_BLOCK_POSTINGS];
+};
+
+// matching entries newest first. with a keyword or an account the term's posting chain is
+// walked, otherwise every entry in the date range
+struct FeedbackQuery {
+    char word[FEEDBACK_WORD_MAX]; // "" = any
+    int accountID;                // 0 = any
+    int firstEntry, endEntry;     // date range as entry numbers, end exclusive
+    int indexed;
+    unsigned int term;
+    long long blockOffset;        // chain position, 0 once the chain is done
+    int slot;                     // postings below this in the block are left, -1 = not loaded
+    int lastEntry;                // skips postings repeated by a catch up after a crash
+    int nextEntry;                // scan position, entries below it are left
+    int pendingEntry;             // matched but didn't fit on the last page, -1 = none
+    struct PostingBlock block;
+};
+
+unsigned int feedbackTermHash(const char *term);
+int nextFeedbackWord(const char **text, char *word);
+int feedbackEntryCount();
+int readFeedbackEntry(int entryNumber, struct FeedbackEntry *entry, char *message, size_t capacity);
+int appendFeedback(int accountID, const char *message, int length, int undated);
+int addFeedbackPosting(int indexFile, unsigned int term, int entryNumber);
+void indexFeedbackEntries();
+int migrateFeedbackStore();
+int firstFeedbackOnOrAfter(int entryCount, time_t at);
+time_t parseFeedbackDate(const char *text, int dayAfter);
+void openFeedbackQuery(struct FeedbackQuery *query, const char *word, int accountID, time_t from, time_t to);
+int feedbackQueryHasMore(struct FeedbackQuery *query);
+int nextFeedbackMatch(struct FeedbackQuery *query);
+int fillFeedbackPage(struct FeedbackQuery *query, char *page, size_t pageCapacity, int pageSize);
+
+// fnv-1a, terms are already lower case
+unsigned int feedbackTermHash(const char *term)
+{
+    unsigned int hash = 2166136261u;
+    while (*term) {
+        hash ^= (unsigned char)*term++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// next run of letters and digits, lower cased into word. returns its length, 0 at the end
+int nextFeedbackWord(const char **text, char *word)
+{
+    const char *at = *text;
+    int length = 0;
+    while (*at && !isalnum((unsigned char)*at)) at++;
+    while (*at && isalnum((unsigned char)*at)) {
+        if (length < FEEDBACK_WORD_MAX - 1) word[length++] = tolower((unsigned char)*at);
+        at++;
+    }
+    word[length] = '\0';
+    *text = at;
+    return length;
+}
+
+int feedbackEntryCount()
+{
+    struct stat st;
+    int entriesFile = databaseHandle(HANDLE_FEEDBACK_ENTRIES, 0);
+    if (entriesFile == -1 || fstat(entriesFile, &st) == -1) return 0;
+    return st.st_size / sizeof(struct FeedbackEntry);
+}
+
+// message is cut to capacity and always terminated. returns 0 if the entry can't be read
+int readFeedbackEntry(int entryNumber, struct FeedbackEntry *entry, char *message, size_t capacity)
+{
+    int entriesFile = databaseHandle(HANDLE_FEEDBACK_ENTRIES, 0);
+    int messagesFile = databaseHandle(HANDLE_FEEDBACK, 0);
+    if (entriesFile == -1 || messagesFile == -1) return 0;
+    if (pread(entriesFile, entry, sizeof(*entry), (off_t)entryNumber * sizeof(*entry)) != sizeof(*entry)) return 0;
+
+    size_t length = entry->messageLength < (int)capacity ? (size_t)entry->messageLength : capacity - 1;
+    ssize_t got = pread(messagesFile, message, length, entry->messageOffset);
+    message[got > 0 ? got : 0] = '\0';
+    return 1;
+}
+
+// the message goes out before its entry, so a visible entry always has its message.
+// the time is taken under the lock, so entries stay in submission order for the date search.
+// undated entries (from the old store) get 0. returns the entry number, -1 on failure.
+// the caller indexes it
+int appendFeedback(int accountID, const char *message, int length, int undated)
+{
+    struct FeedbackEntry entry;
+    struct stat st;
+    int entriesFile = databaseHandle(HANDLE_FEEDBACK_ENTRIES, 0);
+    int messagesFile = databaseHandle(HANDLE_FEEDBACK, 0);
+    if (entriesFile == -1 || messagesFile == -1) return -1;
+
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(entriesFile, F_SETLKW, &lock);
+
+    int entryNumber = -1;
+    beginShipBatch(); // message and entry reach the replica together
+    if (fstat(messagesFile, &st) == 0 && write(messagesFile, message, length) == length) {
+        shipRecord(REPL_FILE_FEEDBACK_MESSAGES, 0, st.st_size, message, length);
+        entry.messageOffset = st.st_size;
+        entry.submittedAt = undated ? 0 : time(NULL);
+        entry.accountID = accountID;
+        entry.messageLength = length;
+        if (fstat(entriesFile, &st) == 0 && write(entriesFile, &entry, sizeof(entry)) == sizeof(entry)) {
+            entryNumber = st.st_size / sizeof(entry);
+            shipRecord(REPL_FILE_FEEDBACK_ENTRIES, 0, st.st_size, &entry, sizeof(entry));
+        }
+    }
+    endShipBatch();
+    if (entryNumber == -1) perror("Feedback: Error appending");
+
+    lock.l_type = F_UNLCK;
+    fcntl(entriesFile, F_SETLK, &lock);
+    return entryNumber;
+}
+
+// caller holds the index write lock
+int addFeedbackPosting(int indexFile, unsigned int term, int entryNumber)
+{
+    struct PostingBlock block;
+    struct stat st;
+    long long head = 0;
+    off_t headOffset = offsetof(struct FeedbackIndexHeader, bucketHeads) + (term % FEEDBACK_INDEX_BUCKETS) * sizeof(long long);
+
+    if (pread(indexFile, &head, sizeof(head), headOffset) != sizeof(head)) return 0;
+    if (head != 0 && pread(indexFile, &block, sizeof(block), head) == sizeof(block) && block.count < FEEDBACK_BLOCK_POSTINGS) {
+        block.terms[block.count] = term;
+        block.entries[block.count] = entryNumber;
+        block.count++;
+        return pwrite(indexFile, &block, sizeof(block), head) == sizeof(block);
+    }
+
+    // bucket empty or its newest block full: start a new one in front of it
+    if (fstat(indexFile, &st) == -1) return 0;
+    memset(&block, 0, sizeof(block));
+    block.previous = head;
+    block.terms[0] = term;
+    block.entries[0] = entryNumber;
+    block.count = 1;
+    head = st.st_size;
+    if (pwrite(indexFile, &block, sizeof(block), head) != sizeof(block)) return 0;
+    return pwrite(indexFile, &head, sizeof(head), headOffset) == sizeof(head);
+}
+
+// index every entry the index hasn't seen yet
+void indexFeedbackEntries()
+{
+    static char message[FEEDBACK_COMMENT_MAX + 64];
+    unsigned int terms[FEEDBACK_TERMS_MAX];
+    char word[FEEDBACK_WORD_MAX];
+    struct FeedbackEntry entry;
+    struct stat st;
+    int indexedEntries = 0;
+
+    int indexFile = databaseHandle(HANDLE_FEEDBACK_INDEX, 0);
+    if (indexFile == -1) return;
+
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(indexFile, F_SETLKW, &lock);
+
+    if (fstat(indexFile, &st) == 0 && st.st_size < (off_t)sizeof(struct FeedbackIndexHeader)) {
+        ftruncate(indexFile, sizeof(struct FeedbackIndexHeader)); // new index, zero filled
+    }
+    pread(indexFile, &indexedEntries, sizeof(indexedEntries), 0);
+
+    int entryCount = feedbackEntryCount();
+    for (int entryNumber = indexedEntries; entryNumber < entryCount; entryNumber++) {
+        if (!readFeedbackEntry(entryNumber, &entry, message, sizeof(message))) break;
+
+        int termCount = 0;
+        if (entry.accountID > 0) {
+            snprintf(word, sizeof(word), "#%d", entry.accountID);
+            terms[termCount++] = feedbackTermHash(word);
+        }
+        const char *text = message;
+        while (termCount < FEEDBACK_TERMS_MAX && nextFeedbackWord(&text, word) > 0) {
+            unsigned int term = feedbackTermHash(word);
+            int seen = 0;
+            for (int i = 0; i < termCount && !seen; i++) seen = terms[i] == term;
+            if (!seen) terms[termCount++] = term;
+        }
+
+        int indexed = 1;
+        for (int i = 0; i < termCount && indexed; i++) indexed = addFeedbackPosting(indexFile, terms[i], entryNumber);
+        if (!indexed) {
+            perror("Feedback: Error writing index");
+            break;
+        }
+        indexedEntries = entryNumber + 1;
+        pwrite(indexFile, &indexedEntries, sizeof(indexedEntries), 0);
+    }
+
+    lock.l_type = F_UNLCK;
+    fcntl(indexFile, F_SETLK, &lock);
+}
+
+// first start on a tree with the old fixed size feedback file: move its messages into
+// the store as undated, anonymous feedback and set the old file aside. returns 0 on failure
+int migrateFeedbackStore()
+{
+    struct ClientFeedback feedback;
+    struct stat st;
+    char movedPath[64];
+
+    if (stat(FEEDBACK_DB, &st) == -1) return 1;
+    if (stat(FEEDBACK_ENTRIES_DB, &st) == 0) {
+        printf("Feedback: both %s and %s exist, leaving the old file alone\n", FEEDBACK_DB, FEEDBACK_ENTRIES_DB);
+        return 1;
+    }
+
+    int oldFile = open(FEEDBACK_DB, O_RDONLY);
+    if (oldFile == -1) {
+        perror("Feedback: Error opening old feedback");
+        return 0;
+    }
+    int moved = 0;
+    while (read(oldFile, &feedback, sizeof(feedback)) == sizeof(feedback)) {
+        int length = strnlen(feedback.message, sizeof(feedback.message));
+        if (appendFeedback(-1, feedback.message, length, 1) == -1) {
+            close(oldFile);
+            return 0;
+        }
+        moved++;
+    }
+    close(oldFile);
+    indexFeedbackEntries();
+
+    snprintf(movedPath, sizeof(movedPath), "%s%s", FEEDBACK_DB, PREMIGRATION_SUFFIX);
+    rename(FEEDBACK_DB, movedPath);
+    printf("Feedback: moved %d entries into the indexed store\n", moved);
+    return 1;
+}
+
+int firstFeedbackOnOrAfter(int entryCount, time_t at)
+{
+    struct FeedbackEntry entry;
+    int entriesFile = databaseHandle(HANDLE_FEEDBACK_ENTRIES, 0);
+    int low = 0, high = entryCount;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (pread(entriesFile, &entry, sizeof(entry), (off_t)middle * sizeof(entry)) != sizeof(entry)) break;
+        if (entry.submittedAt < at) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// local midnight of a YYYY-MM-DD date, or of the day after it. 0 if it isn't a date
+time_t parseFeedbackDate(const char *text, int dayAfter)
+{
+    struct tm day;
+    memset(&day, 0, sizeof(day));
+    if (sscanf(text, "%d-%d-%d", &day.tm_year, &day.tm_mon, &day.tm_mday) != 3) return 0;
+    day.tm_year -= 1900;
+    day.tm_mon -= 1;
+    day.tm_mday += dayAfter;
+    day.tm_isdst = -1;
+    time_t at = mktime(&day);
+    return at == -1 ? 0 : at;
+}
+
+// from and to are 0 for an open range, to is exclusive
+void openFeedbackQuery(struct FeedbackQuery *query, const char *word, int accountID, time_t from, time_t to)
+{
+    char term[FEEDBACK_WORD_MAX];
+    memset(query, 0, sizeof(*query));
+    indexFeedbackEntries(); // catch up after a crashed writer
+
+    if (word != NULL) nextFeedbackWord(&word, query->word);
+    query->accountID = accountID;
+    int entryCount = feedbackEntryCount();
+    query->firstEntry = from ? firstFeedbackOnOrAfter(entryCount, from) : 0;
+    query->endEntry = to ? firstFeedbackOnOrAfter(entryCount, to) : entryCount;
+    query->nextEntry = query->endEntry;
+    query->lastEntry = -1;
+    query->pendingEntry = -1;
+    query->slot = -1;
+
+    if (query->word[0] == '\0' && accountID <= 0) return; // plain scan of the date range
+
+    if (query->word[0] != '\0') strcpy(term, query->word);
+    else snprintf(term, sizeof(term), "#%d", accountID);
+    query->indexed = 1;
+    query->term = feedbackTermHash(term);
+
+    int indexFile = databaseHandle(HANDLE_FEEDBACK_INDEX, 0);
+    off_t headOffset = offsetof(struct FeedbackIndexHeader, bucketHeads) + (query->term % FEEDBACK_INDEX_BUCKETS) * sizeof(long long);
+    if (indexFile == -1 || pread(indexFile, &query->blockOffset, sizeof(query->blockOffset), headOffset) != sizeof(query->blockOffset)) {
+        query->blockOffset = 0;
+    }
+}
+
+int feedbackQueryHasMore(struct FeedbackQuery *query)
+{
+    if (query->pendingEntry != -1) return 1;
+    return query->indexed ? query->blockOffset != 0 : query->nextEntry > query->firstEntry;
+}
+
+// number of the next matching entry, -1 when there are no more
+int nextFeedbackMatch(struct FeedbackQuery *query)
+{
+    static char message[FEEDBACK_COMMENT_MAX + 64];
+    char word[FEEDBACK_WORD_MAX];
+    struct FeedbackEntry entry;
+
+    if (query->pendingEntry != -1) {
+        int entryNumber = query->pendingEntry;
+        query->pendingEntry = -1;
+        return entryNumber;
+    }
+    if (!query->indexed) return query->nextEntry > query->firstEntry ? --query->nextEntry : -1;
+
+    int indexFile = databaseHandle(HANDLE_FEEDBACK_INDEX, 0);
+    while (query->blockOffset != 0) {
+        if (query->slot == -1) {
+            if (pread(indexFile, &query->block, sizeof(query->block), query->blockOffset) != sizeof(query->block)) break;
+            query->slot = query->block.count;
+        }
+        while (query->slot > 0) {
+            query->slot--;
+            int entryNumber = query->block.entries[query->slot];
+            if (query->block.terms[query->slot] != query->term || entryNumber >= query->endEntry || entryNumber == query->lastEntry) continue;
+            if (entryNumber < query->firstEntry) { query->blockOffset = 0; return -1; } // older ones are out of range too
+            query->lastEntry = entryNumber;
+
+            if (!readFeedbackEntry(entryNumber, &entry, message, sizeof(message))) continue;
+            if (query->accountID > 0 && entry.accountID != query->accountID) continue;
+            if (query->word[0] == '\0') return entryNumber;
+            const char *text = message;
+            while (nextFeedbackWord(&text, word) > 0) {
+                if (strcmp(word, query->word) == 0) return entryNumber;
+            }
+        }
+        query->blockOffset = query->block.previous;
+        query->slot = -1;
+    }
+    query->blockOffset = 0;
+    return -1;
+}
+
+// appends up to pageSize matches to page, one that doesn't fit waits for the next page
+int fillFeedbackPage(struct FeedbackQuery *query, char *page, size_t pageCapacity, int pageSize)
+{
+    static char message[FEEDBACK_COMMENT_MAX + 64];
+    char line[FEEDBACK_COMMENT_MAX + 160], when[32];
+    struct FeedbackEntry entry;
+    int added = 0;
+
+    // index writers update blocks in place
+    int indexFile = databaseHandle(HANDLE_FEEDBACK_INDEX, 0);
+    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()};
+    if (indexFile != -1) fcntl(indexFile, F_SETLKW, &lock);
+
+    while (added < pageSize) {
+        int entryNumber = nextFeedbackMatch(query);
+        if (entryNumber == -1) break;
+        if (!readFeedbackEntry(entryNumber, &entry, message, sizeof(message))) continue;
+
+        time_t submittedAt = entry.submittedAt;
+        if (submittedAt == 0) strcpy(when, "undated");
+        else strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&submittedAt));
+        if (entry.accountID > 0) snprintf(line, sizeof(line), "[%s] account %d: %s\n", when, entry.accountID, message);
+        else snprintf(line, sizeof(line), "[%s] anonymous: %s\n", when, message);
+
+        if (strlen(page) + strlen(line) + 1 > pageCapacity) {
+            query->pendingEntry = entryNumber;
+            break;
+        }
+        strcat(page, line);
+        added++;
+    }
+
+    lock.l_type = F_UNLCK;
+    if (indexFile != -1) fcntl(indexFile, F_SETLK, &lock);
+    return added;
+}
+
+#endif
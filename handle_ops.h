@@ -0,0 +1,90 @@
+#ifndef HANDLE_OPS_H
+#define HANDLE_OPS_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+// Per-process cache of database descriptors. Each file is opened once per process (per
+// session child, or per prefork worker) and handed out to every handler after that.
+// Handlers must never close a handle: closing any descriptor of a file drops all the
+// fcntl locks this process holds on it. The file position is shared by every user of a
+// handle, so readers always seek (or pread) before reading. The one exception is a
+// history handle whose log has been sealed since it was opened (see segment_ops.h): it is
+// reopened on the next call, by which time lockHistory has let go of its lock.
+
+#define HANDLE_ACCOUNT 0 // one per shard
+#define HANDLE_HISTORY 1 // one per shard, O_APPEND
+#define HANDLE_LOAN 2
+#define HANDLE_LOAN_COUNTER 3
+#define HANDLE_EMPLOYEE 4
+#define HANDLE_FEEDBACK 5 // messages, O_APPEND
+#define HANDLE_FEEDBACK_ENTRIES 6 // O_APPEND
+#define HANDLE_FEEDBACK_INDEX 7
+#define HANDLE_KINDS 8
+
+struct HandleCache {
+    pid_t ownerPid; // handles inherited across fork share file positions, reopen them
+    int fds[HANDLE_KINDS][ACCOUNT_SHARDS];
+    unsigned int historyGenerations[ACCOUNT_SHARDS]; // of each history handle when it was opened
+};
+
+struct HandleCache handleCache = {0};
+
+void resetHandleCache();
+int databaseHandle(int kind, int shard);
+int accountHandle(int accountID);
+int historyHandle(int accountID);
+unsigned int historyGeneration(int shard); // segment_ops.h
+
+// the new process holds no locks yet, so dropping the inherited descriptors is safe
+void resetHandleCache()
+{
+    for (int kind = 0; kind < HANDLE_KINDS; kind++) {
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            if (handleCache.ownerPid != 0 && handleCache.fds[kind][shard] != -1) close(handleCache.fds[kind][shard]);
+            handleCache.fds[kind][shard] = -1;
+        }
+    }
+    handleCache.ownerPid = getpid();
+}
+
+// -1 if the file can't be opened; retried on the next call
+int databaseHandle(int kind, int shard)
+{
+    if (handleCache.ownerPid != getpid()) resetHandleCache();
+
+    int *fd = &handleCache.fds[kind][shard];
+    if (kind == HANDLE_HISTORY && *fd != -1 && handleCache.historyGenerations[shard] != historyGeneration(shard)) {
+        close(*fd);
+        *fd = -1;
+    }
+    if (*fd != -1) return *fd;
+    if (kind == HANDLE_HISTORY) handleCache.historyGenerations[shard] = historyGeneration(shard); // before the open, a seal after it shows
+
+    switch (kind) {
+        case HANDLE_ACCOUNT: *fd = openShardFile(ACCOUNT_DB, shard, O_RDWR | O_CREAT); break;
+        case HANDLE_HISTORY: *fd = openShardFile(HISTORY_DB, shard, O_RDWR | O_APPEND | O_CREAT); break;
+        case HANDLE_LOAN: *fd = open(LOAN_DB, O_RDWR | O_CREAT, 0644); break;
+        case HANDLE_LOAN_COUNTER: *fd = open(LOAN_COUNTER_DB, O_RDWR | O_CREAT, 0644); break;
+        case HANDLE_EMPLOYEE: *fd = open(EMPLOYEE_DB, O_RDWR | O_CREAT, 0644); break;
+        case HANDLE_FEEDBACK: *fd = open(FEEDBACK_MESSAGES_DB, O_RDWR | O_APPEND | O_CREAT, 0644); break;
+        case HANDLE_FEEDBACK_ENTRIES: *fd = open(FEEDBACK_ENTRIES_DB, O_RDWR | O_APPEND | O_CREAT, 0644); break;
+        case HANDLE_FEEDBACK_INDEX: *fd = open(FEEDBACK_INDEX_DB, O_RDWR | O_CREAT, 0644); break;
+    }
+    if (*fd == -1) perror("databaseHandle: open failed");
+    return *fd;
+}
+
+int accountHandle(int accountID)
+{
+    return databaseHandle(HANDLE_ACCOUNT, accountShard(accountID));
+}
+
+int historyHandle(int accountID)
+{
+    return databaseHandle(HANDLE_HISTORY, accountShard(accountID));
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef HOT_OPS_H
+#define HOT_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+
+// Hot accounts. Transfers into a designated account don't take its record lock. The
+// credit goes into a per-account delta in shared memory and is logged at once as usual.
+// A flusher process applies the accumulated delta to the record every HOT_FLUSH_MS. It
+// does that under the record lock and inside the account's seqlock write, so
+// readAccountSnapshot (record plus pending delta) never counts a credit twice or misses
+// it. Anything that debits or rewrites the balance under the record lock folds the delta
+// into the record first, so funds checks see every credit. The delta lives only in
+// shared memory. A crashed server's deltas are applied at the next startup, and only a
+// reboot can lose credits: at most HOT_FLUSH_MS of them, and those are still in the log.
+//
+// ./server --hot-accounts id,id,...
+
+#define HOT_REGION "hotaccounts"
+#define HOT_ACCOUNTS_MAX 64
+#define HOT_FLUSH_MS 100
+#define HOT_FLUSH_BACKSTOP 100000 // pending credits before a crediting process flushes itself
+
+struct HotAccount {
+    int accountID;
+    long long pendingCents; // credited, not yet in the record
+    int pendingCount;
+};
+
+struct HotRegion {
+    int count;
+    struct HotAccount accounts[HOT_ACCOUNTS_MAX];
+};
+
+struct HotRegion *hotRegion = NULL;
+int hotAccountIDs[HOT_ACCOUNTS_MAX];
+int hotAccountCount = 0;
+pid_t hotFlusherPid = 0;
+
+void parseHotAccountOptions(int argc, char *argv[]);
+void initHotRegion(void *region);
+struct HotRegion *getHotRegion();
+struct HotRegion *attachServerHotAccounts();
+void resetHotAccounts();
+struct HotAccount *findHotAccount(int accountID);
+long long pendingHotCredit(int accountID);
+void creditHotAccount(int accountID, float amount);
+void applyHotCredits(int dbFile, off_t offset, struct AccountHolder *account);
+void flushHotAccount(struct HotAccount *hot);
+void startHotFlusher(int serverSocketFD);
+
+void parseHotAccountOptions(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hot-accounts") != 0 || i + 1 >= argc) continue;
+        char *list = argv[++i], *next;
+        while (*list != '\0' && hotAccountCount < HOT_ACCOUNTS_MAX) {
+            int accountID = strtol(list, &next, 10);
+            if (next == list) break;
+            if (accountID > 0) hotAccountIDs[hotAccountCount++] = accountID;
+            list = *next == ',' ? next + 1 : next;
+        }
+    }
+}
+
+void initHotRegion(void *region)
+{
+    struct HotRegion *hot = (struct HotRegion *)region;
+    hot->count = hotAccountCount;
+    for (int i = 0; i < hotAccountCount; i++) hot->accounts[i].accountID = hotAccountIDs[i];
+}
+
+// NULL means no hot accounts, or shared memory is unavailable: every transfer locks
+struct HotRegion *getHotRegion()
+{
+    if (hotRegion == NULL && hotAccountCount > 0) {
+        hotRegion = attachSharedRegion(HOT_REGION, sizeof(struct HotRegion), initHotRegion);
+    }
+    return hotRegion;
+}
+
+// for a tool run next to the server (--accrue): the running server's hot accounts,
+// whatever this process was started with. NULL if there is no region
+struct HotRegion *attachServerHotAccounts()
+{
+    if (hotRegion == NULL) hotRegion = attachSharedRegion(HOT_REGION, sizeof(struct HotRegion), NULL);
+    return hotRegion;
+}
+
+// apply whatever a previous run left pending, then start over with this run's accounts
+void resetHotAccounts()
+{
+    struct HotRegion *previous = attachSharedRegion(HOT_REGION, sizeof(struct HotRegion), NULL);
+    if (previous != NULL) {
+        for (int i = 0; i < previous->count && i < HOT_ACCOUNTS_MAX; i++) {
+            if (previous->accounts[i].pendingCents != 0) {
+                printf("Hot accounts: applying %lld cents left pending on account %d\n",
+                       previous->accounts[i].pendingCents, previous->accounts[i].accountID);
+                flushHotAccount(&previous->accounts[i]);
+            }
+        }
+    }
+
+    resetSharedRegion(HOT_REGION);
+    hotRegion = NULL;
+    if (getHotRegion() != NULL) printf("Hot accounts: %d, flushed every %d ms\n", hotAccountCount, HOT_FLUSH_MS);
+}
+
+struct HotAccount *findHotAccount(int accountID)
+{
+    struct HotRegion *hot = getHotRegion();
+    if (hot == NULL) return NULL;
+    for (int i = 0; i < hot->count; i++) {
+        if (hot->accounts[i].accountID == accountID) return &hot->accounts[i];
+    }
+    return NULL;
+}
+
+long long pendingHotCredit(int accountID)
+{
+    struct HotAccount *hot = findHotAccount(accountID);
+    return hot == NULL ? 0 : __atomic_load_n(&hot->pendingCents, __ATOMIC_SEQ_CST);
+}
+
+// the credit half of a transfer into a hot account, already logged by the caller
+void creditHotAccount(int accountID, float amount)
+{
+    struct AccountHolder account;
+    struct HotAccount *hot = findHotAccount(accountID);
+    if (hot == NULL) { // the region went away since the caller looked: credit the record under its lock
+        int dbFile = accountHandle(accountID);
+        off_t offset = dbFile == -1 ? -1 : findAccountOffset(dbFile, accountID);
+        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+        int credited = offset != -1 && fcntl(dbFile, F_SETLKW, &lock) != -1;
+        if (credited) {
+            credited = pread(dbFile, &account, sizeof(account), offset) == sizeof(account);
+            account.currentBalance += amount;
+            credited = credited && writeAccountRecord(dbFile, offset, &account);
+            lock.l_type = F_UNLCK;
+            fcntl(dbFile, F_SETLK, &lock);
+        }
+        if (!credited) printf("CRITICAL: Hot accounts: credit of %.2f to %d could not be applied\n", amount, accountID);
+        return;
+    }
+    __atomic_fetch_add(&hot->pendingCents, (long long)(amount * 100 + 0.5f), __ATOMIC_SEQ_CST);
+    if (__atomic_add_fetch(&hot->pendingCount, 1, __ATOMIC_SEQ_CST) >= HOT_FLUSH_BACKSTOP) flushHotAccount(hot);
+}
+
+// move the pending delta into the record. caller holds the record write lock and has
+// just read the record into account
+void applyHotCredits(int dbFile, off_t offset, struct AccountHolder *account)
+{
+    struct HotAccount *hot = findHotAccount(account->accountID);
+    if (hot == NULL || __atomic_load_n(&hot->pendingCents, __ATOMIC_SEQ_CST) == 0) return;
+
+    int shard = accountShard(account->accountID);
+    beginAccountWrite(shard, offset); // snapshot readers retry until the delta is in the record
+    long long cents = __atomic_exchange_n(&hot->pendingCents, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&hot->pendingCount, 0, __ATOMIC_SEQ_CST);
+    account->currentBalance += cents / 100.0;
+    if (!writeAccountRecord(dbFile, offset, account)) {
+        account->currentBalance -= cents / 100.0;
+        __atomic_fetch_add(&hot->pendingCents, cents, __ATOMIC_SEQ_CST); // try again next flush
+    }
+    endAccountWrite(shard, offset);
+}
+
+void flushHotAccount(struct HotAccount *hot)
+{
+    struct AccountHolder account;
+    int dbFile = accountHandle(hot->accountID);
+    off_t offset = dbFile == -1 ? -1 : findAccountOffset(dbFile, hot->accountID);
+    if (offset == -1) return;
+
+    struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+    if (fcntl(dbFile, F_SETLKW, &lock) == -1) {
+        perror("Hot accounts: Failed to lock record");
+        return;
+    }
+    if (pread(dbFile, &account, sizeof(account), offset) == sizeof(account)) {
+        // applyHotCredits looks the account up in this run's region, a previous run's
+        // leftovers are applied here directly
+        if (findHotAccount(hot->accountID) == hot) {
+            applyHotCredits(dbFile, offset, &account);
+        } else {
+            account.currentBalance += __atomic_exchange_n(&hot->pendingCents, 0, __ATOMIC_SEQ_CST) / 100.0;
+            writeAccountRecord(dbFile, offset, &account);
+        }
+    }
+    lock.l_type = F_UNLCK;
+    fcntl(dbFile, F_SETLK, &lock);
+}
+
+// the flusher: applies every pending delta each HOT_FLUSH_MS, exits once the server
+// that started it is gone
+void startHotFlusher(int serverSocketFD)
+{
+    struct HotRegion *hot = getHotRegion();
+    if (hot == NULL) return;
+
+    pid_t serverPid = getpid();
+    hotFlusherPid = fork();
+    if (hotFlusherPid < 0) {
+        perror("Hot accounts: flusher fork failed, credits are applied by the backstop only");
+        hotFlusherPid = 0;
+        return;
+    }
+    if (hotFlusherPid > 0) return;
+
+    close(serverSocketFD);
+    setupSignalHandlers(); // a prefork pool restarts helpers after installing its own
+    printf("Hot account flusher started. Process ID: %d\n", getpid());
+    while (getppid() == serverPid) {
+        usleep(HOT_FLUSH_MS * 1000);
+        for (int i = 0; i < hot->count; i++) {
+            if (__atomic_load_n(&hot->accounts[i].pendingCents, __ATOMIC_SEQ_CST) != 0) flushHotAccount(&hot->accounts[i]);
+        }
+    }
+    for (int i = 0; i < hot->count; i++) flushHotAccount(&hot->accounts[i]);
+    exit(EXIT_SUCCESS);
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef LOAN_ID_OPS_H
+#define LOAN_ID_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+// Loan IDs come from an atomic counter in shared memory instead of a locked
+// read-modify-write of loan_id_counter.dat per loan. The counter file holds a high-water
+// mark: every ID below it may have been handed out. IDs are reserved LOAN_ID_BLOCK at a
+// time, so the file is locked and written once per block, by whichever process crosses
+// the mark. On restart counting resumes at the mark, skipping whatever was left of the
+// last block. The file keeps the IDGenerator layout, nextID is the mark.
+
+#define LOAN_ID_REGION "loanids"
+#define LOAN_ID_BLOCK 1000
+
+struct LoanIDRegion {
+    int nextID;       // next ID to hand out
+    int reservedUpTo; // persisted mark, IDs below it are safe to hand out
+};
+
+struct LoanIDRegion *loanIDRegion = NULL;
+
+int readLoanIDMark(int counterFile);
+void initLoanIDRegion(void *region);
+struct LoanIDRegion *getLoanIDRegion();
+void resetLoanIDAllocator();
+int reserveLoanIDs(struct LoanIDRegion *loanIDs, int loanID);
+int allocateLoanIDLocked();
+int allocateLoanID();
+
+int readLoanIDMark(int counterFile)
+{
+    struct IDGenerator idGen;
+    if (pread(counterFile, &idGen, sizeof(idGen), 0) != sizeof(idGen) || idGen.nextID < 1) return 1;
+    return idGen.nextID;
+}
+
+// start at the persisted mark, or past the highest loan on disk if the file is behind
+void initLoanIDRegion(void *region)
+{
+    struct LoanIDRegion *loanIDs = (struct LoanIDRegion *)region;
+    struct LoanRecord batch[64];
+    off_t position = 0;
+    ssize_t got;
+
+    int mark = 1;
+    int counterFile = open(LOAN_COUNTER_DB, O_RDONLY);
+    if (counterFile != -1) {
+        mark = readLoanIDMark(counterFile);
+        close(counterFile);
+    }
+
+    int loanFile = open(LOAN_DB, O_RDONLY);
+    if (loanFile != -1) {
+        while ((got = pread(loanFile, batch, sizeof(batch), position)) >= (ssize_t)sizeof(struct LoanRecord)) {
+            int records = got / sizeof(struct LoanRecord);
+            for (int i = 0; i < records; i++) {
+                if (batch[i].loanRecordID >= mark) mark = batch[i].loanRecordID + 1;
+            }
+            position += records * sizeof(struct LoanRecord);
+        }
+        close(loanFile);
+    }
+
+    loanIDs->nextID = mark;
+    loanIDs->reservedUpTo = mark; // first allocation reserves a block
+}
+
+// NULL means shared memory is unavailable and IDs come from the locked counter file
+struct LoanIDRegion *getLoanIDRegion()
+{
+    if (loanIDRegion == NULL) {
+        loanIDRegion = attachSharedRegion(LOAN_ID_REGION, sizeof(struct LoanIDRegion), initLoanIDRegion);
+    }
+    return loanIDRegion;
+}
+
+void resetLoanIDAllocator()
+{
+    resetSharedRegion(LOAN_ID_REGION);
+    loanIDRegion = NULL;
+    struct LoanIDRegion *loanIDs = getLoanIDRegion();
+    if (loanIDs != NULL) printf("Loan IDs: next %d\n", loanIDs->nextID);
+}
+
+// persist a mark past loanID. callers that raced to the same block find it already
+// reserved once they get the lock. returns 0 if the mark could not be written
+int reserveLoanIDs(struct LoanIDRegion *loanIDs, int loanID)
+{
+    int counterFile = databaseHandle(HANDLE_LOAN_COUNTER, 0);
+    if (counterFile == -1) return 0;
+
+    struct flock idLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    if (fcntl(counterFile, F_SETLKW, &idLock) == -1) {
+        perror("Loan IDs: Failed to lock counter DB");
+        return 0;
+    }
+
+    int reserved = 1;
+    int mark = __atomic_load_n(&loanIDs->reservedUpTo, __ATOMIC_ACQUIRE);
+    if (loanID >= mark) {
+        struct IDGenerator idGen;
+        idGen.nextID = mark;
+        while (idGen.nextID <= loanID) idGen.nextID += LOAN_ID_BLOCK;
+        if (pwrite(counterFile, &idGen, sizeof(idGen), 0) != sizeof(idGen) || fdatasync(counterFile) == -1) {
+            perror("Loan IDs: Failed to persist high-water mark");
+            reserved = 0;
+        } else {
+            __atomic_store_n(&loanIDs->reservedUpTo, idGen.nextID, __ATOMIC_RELEASE);
+        }
+    }
+
+    idLock.l_type = F_UNLCK;
+    fcntl(counterFile, F_SETLK, &idLock);
+    return reserved;
+}
+
+// the original per-loan path, used without shared memory
+int allocateLoanIDLocked()
+{
+    struct IDGenerator idGen;
+    int counterFile = databaseHandle(HANDLE_LOAN_COUNTER, 0);
+    if (counterFile == -1) return -1;
+
+    struct flock idLock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    if (fcntl(counterFile, F_SETLKW, &idLock) == -1) {
+        perror("Loan IDs: Failed to lock counter DB");
+        return -1;
+    }
+    int loanID = readLoanIDMark(counterFile);
+    idGen.nextID = loanID + 1;
+    pwrite(counterFile, &idGen, sizeof(idGen), 0);
+
+    idLock.l_type = F_UNLCK;
+    fcntl(counterFile, F_SETLK, &idLock);
+    return loanID;
+}
+
+// a new loan ID, -1 on failure
+int allocateLoanID()
+{
+    struct LoanIDRegion *loanIDs = getLoanIDRegion();
+    if (loanIDs == NULL) return allocateLoanIDLocked();
+
+    int loanID = __atomic_fetch_add(&loanIDs->nextID, 1, __ATOMIC_SEQ_CST);
+    while (loanID >= __atomic_load_n(&loanIDs->reservedUpTo, __ATOMIC_ACQUIRE)) {
+        if (!reserveLoanIDs(loanIDs, loanID)) return -1; // this ID is skipped, never reused
+    }
+    return loanID;
+}
+
+#endif
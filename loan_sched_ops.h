@@ -0,0 +1,374 @@
+#ifndef LOAN_SCHED_OPS_H
+#define LOAN_SCHED_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+
+// Loan assignment scheduler. Every employee with roleType 1 is a loan officer with a
+// queue of the loans waiting on them; new loans from requestLoan go straight to an
+// officer picked by the active policy instead of waiting for a manager. The queues live
+// in shared memory, are rebuilt from loan_records.dat at startup and are updated under
+// the same loan record lock as every status change. Managers can still reassign a loan.
+//
+// BMS_LOAN_POLICY=least-loaded|round-robin|amount-weighted picks the policy, default is
+// least-loaded (fewest outstanding loans).
+
+#define LOAN_SCHED_REGION "loansched"
+#define LOAN_SCHED_MAX_OFFICERS 256
+#define LOAN_QUEUE_SLOTS 64 // loans beyond this count toward the load and are queued once there is room
+#define LOAN_REFILL_TRIES 3
+#define LOAN_SCHED_POLICY_ENV "BMS_LOAN_POLICY"
+
+struct LoanOfficer {
+    int employeeID;
+    int outstanding;             // pending loans assigned to this officer
+    long long outstandingAmount;
+    int queued;                  // oldest first
+    int loanIDs[LOAN_QUEUE_SLOTS];
+    unsigned int version;        // bumped on every queue change, see refillOfficerQueue
+};
+
+struct LoanSchedulerRegion {
+    int lockOwner; // pid, 0 = free
+    int policy;
+    int nextRoundRobin;
+    int officerCount;
+    struct LoanOfficer officers[LOAN_SCHED_MAX_OFFICERS];
+};
+
+// returns the officer index for the loan, -1 if there is nobody to assign it to
+typedef int (*LoanPolicy)(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan);
+
+struct LoanPolicyEntry {
+    const char *name;
+    LoanPolicy pick;
+};
+
+struct LoanSchedulerRegion *loanSchedulerRegion = NULL;
+
+int pickLeastLoaded(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan);
+int pickRoundRobin(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan);
+int pickAmountWeighted(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan);
+
+struct LoanPolicyEntry loanPolicies[] = {
+    {"least-loaded", pickLeastLoaded},
+    {"round-robin", pickRoundRobin},
+    {"amount-weighted", pickAmountWeighted},
+};
+#define LOAN_POLICY_COUNT (int)(sizeof(loanPolicies) / sizeof(loanPolicies[0]))
+
+int findLoanOfficer(struct LoanSchedulerRegion *scheduler, int employeeID);
+void queueOfficerLoan(struct LoanOfficer *officer, struct LoanRecord *loan);
+void dropOfficerLoan(struct LoanOfficer *officer, struct LoanRecord *loan);
+void refillOfficerQueue(int employeeID);
+int hasLoanOfficer(struct LoanSchedulerRegion *scheduler, int employeeID);
+void initLoanScheduler(void *region);
+struct LoanSchedulerRegion *getLoanScheduler();
+void resetLoanScheduler();
+int scheduleLoan(struct LoanRecord *loan);
+void loanDecided(struct LoanRecord *loan);
+void loanReassigned(int fromEmployeeID, struct LoanRecord *loan);
+int nextQueuedLoan(int employeeID);
+int isLoanOfficer(int employeeID);
+void setLoanOfficer(int employeeID, int isOfficer);
+void assignWaitingLoans();
+
+int pickLeastLoaded(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan)
+{
+    (void)loan;
+    int best = -1;
+    for (int i = 0; i < scheduler->officerCount; i++) {
+        if (best == -1 || scheduler->officers[i].outstanding < scheduler->officers[best].outstanding) best = i;
+    }
+    return best;
+}
+
+int pickRoundRobin(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan)
+{
+    (void)loan;
+    if (scheduler->officerCount == 0) return -1;
+    return scheduler->nextRoundRobin++ % scheduler->officerCount;
+}
+
+// least money outstanding, so one officer doesn't end up with every large loan
+int pickAmountWeighted(struct LoanSchedulerRegion *scheduler, struct LoanRecord *loan)
+{
+    (void)loan;
+    int best = -1;
+    for (int i = 0; i < scheduler->officerCount; i++) {
+        struct LoanOfficer *officer = &scheduler->officers[i];
+        if (best == -1 || officer->outstandingAmount < scheduler->officers[best].outstandingAmount ||
+            (officer->outstandingAmount == scheduler->officers[best].outstandingAmount &&
+             officer->outstanding < scheduler->officers[best].outstanding)) best = i;
+    }
+    return best;
+}
+
+int findLoanOfficer(struct LoanSchedulerRegion *scheduler, int employeeID)
+{
+    for (int i = 0; i < scheduler->officerCount; i++) {
+        if (scheduler->officers[i].employeeID == employeeID) return i;
+    }
+    return -1;
+}
+
+void queueOfficerLoan(struct LoanOfficer *officer, struct LoanRecord *loan)
+{
+    officer->version++;
+    officer->outstanding++;
+    officer->outstandingAmount += loan->amount;
+    if (officer->queued < LOAN_QUEUE_SLOTS) officer->loanIDs[officer->queued++] = loan->loanRecordID;
+}
+
+void dropOfficerLoan(struct LoanOfficer *officer, struct LoanRecord *loan)
+{
+    officer->version++;
+    if (officer->outstanding > 0) officer->outstanding--;
+    officer->outstandingAmount -= loan->amount;
+    if (officer->outstandingAmount < 0) officer->outstandingAmount = 0;
+    for (int i = 0; i < officer->queued; i++) {
+        if (officer->loanIDs[i] != loan->loanRecordID) continue;
+        memmove(&officer->loanIDs[i], &officer->loanIDs[i + 1], (officer->queued - i - 1) * sizeof(int));
+        officer->queued--;
+        break;
+    }
+}
+
+// loans past LOAN_QUEUE_SLOTS were only counted. once the queue is half empty it is rebuilt
+// from the officer's oldest pending loans in the loan file. the scan runs without the
+// region lock and is redone when the queue changed meanwhile
+void refillOfficerQueue(int employeeID)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    struct LoanRecord loan;
+    int loanIDs[LOAN_QUEUE_SLOTS];
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
+    if (scheduler == NULL || loanFile == -1) return;
+
+    for (int attempt = 0; attempt < LOAN_REFILL_TRIES; attempt++) {
+        lockSharedRegion(&scheduler->lockOwner);
+        int officer = findLoanOfficer(scheduler, employeeID);
+        struct LoanOfficer *entry = officer == -1 ? NULL : &scheduler->officers[officer];
+        if (entry == NULL || entry->outstanding <= entry->queued || entry->queued > LOAN_QUEUE_SLOTS / 2) {
+            unlockSharedRegion(&scheduler->lockOwner);
+            return;
+        }
+        unsigned int version = entry->version;
+        unlockSharedRegion(&scheduler->lockOwner);
+
+        int count = 0;
+        off_t position = 0;
+        while (count < LOAN_QUEUE_SLOTS && pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan)) {
+            position += sizeof(loan);
+            if (loan.loanStatus == 1 && loan.assignedEmployeeID == employeeID) loanIDs[count++] = loan.loanRecordID;
+        }
+
+        lockSharedRegion(&scheduler->lockOwner);
+        officer = findLoanOfficer(scheduler, employeeID);
+        entry = officer == -1 ? NULL : &scheduler->officers[officer];
+        int refilled = entry != NULL && entry->version == version;
+        if (refilled) {
+            memcpy(entry->loanIDs, loanIDs, count * sizeof(int));
+            entry->queued = count;
+            entry->version++;
+        }
+        unlockSharedRegion(&scheduler->lockOwner);
+        if (refilled) return;
+    }
+}
+
+// officers from the employee file, then every pending loan onto its officer's queue
+void initLoanScheduler(void *region)
+{
+    struct LoanSchedulerRegion *scheduler = (struct LoanSchedulerRegion *)region;
+    struct Employee employee;
+    struct LoanRecord loan;
+    off_t position = 0;
+
+    const char *policyName = getenv(LOAN_SCHED_POLICY_ENV);
+    for (int i = 0; policyName != NULL && i < LOAN_POLICY_COUNT; i++) {
+        if (strcmp(policyName, loanPolicies[i].name) == 0) scheduler->policy = i;
+    }
+
+    int employeeFile = open(EMPLOYEE_DB, O_RDONLY);
+    if (employeeFile != -1) {
+        while (pread(employeeFile, &employee, sizeof(employee), position) == sizeof(employee)) {
+            position += sizeof(employee);
+            if (employee.roleType != 1 || scheduler->officerCount == LOAN_SCHED_MAX_OFFICERS) continue;
+            scheduler->officers[scheduler->officerCount++].employeeID = employee.employeeID;
+        }
+        close(employeeFile);
+    }
+
+    int loanFile = open(LOAN_DB, O_RDONLY);
+    if (loanFile != -1) {
+        position = 0;
+        while (pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan)) {
+            position += sizeof(loan);
+            if (loan.loanStatus != 1) continue;
+            int officer = findLoanOfficer(scheduler, loan.assignedEmployeeID);
+            if (officer != -1) queueOfficerLoan(&scheduler->officers[officer], &loan);
+        }
+        close(loanFile);
+    }
+}
+
+// NULL means shared memory is unavailable; loans then wait for a manager as before
+struct LoanSchedulerRegion *getLoanScheduler()
+{
+    if (loanSchedulerRegion == NULL) {
+        loanSchedulerRegion = attachSharedRegion(LOAN_SCHED_REGION, sizeof(struct LoanSchedulerRegion), initLoanScheduler);
+    }
+    return loanSchedulerRegion;
+}
+
+void resetLoanScheduler()
+{
+    resetSharedRegion(LOAN_SCHED_REGION);
+    loanSchedulerRegion = NULL;
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    if (scheduler != NULL) {
+        printf("Loan scheduler: %d officers, policy %s\n", scheduler->officerCount, loanPolicies[scheduler->policy].name);
+    }
+}
+
+// picks an officer and marks the loan pending with them; the caller writes the record.
+// returns the employee ID, or -1 with the loan left untouched
+int scheduleLoan(struct LoanRecord *loan)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    if (scheduler == NULL) return -1;
+
+    lockSharedRegion(&scheduler->lockOwner);
+    int officer = loanPolicies[scheduler->policy].pick(scheduler, loan);
+    if (officer != -1) {
+        queueOfficerLoan(&scheduler->officers[officer], loan);
+        loan->assignedEmployeeID = scheduler->officers[officer].employeeID;
+        loan->loanStatus = 1; // 1 = Pending (assigned)
+    }
+    unlockSharedRegion(&scheduler->lockOwner);
+    return officer == -1 ? -1 : loan->assignedEmployeeID;
+}
+
+// approved or rejected by its officer
+void loanDecided(struct LoanRecord *loan)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    if (scheduler == NULL) return;
+
+    lockSharedRegion(&scheduler->lockOwner);
+    int officer = findLoanOfficer(scheduler, loan->assignedEmployeeID);
+    if (officer != -1) dropOfficerLoan(&scheduler->officers[officer], loan);
+    unlockSharedRegion(&scheduler->lockOwner);
+    refillOfficerQueue(loan->assignedEmployeeID);
+}
+
+// loan already carries its new officer; fromEmployeeID is -1 if it was unassigned
+void loanReassigned(int fromEmployeeID, struct LoanRecord *loan)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    if (scheduler == NULL) return;
+
+    lockSharedRegion(&scheduler->lockOwner);
+    int from = findLoanOfficer(scheduler, fromEmployeeID);
+    int to = findLoanOfficer(scheduler, loan->assignedEmployeeID);
+    if (from != -1) dropOfficerLoan(&scheduler->officers[from], loan);
+    if (to != -1) queueOfficerLoan(&scheduler->officers[to], loan);
+    unlockSharedRegion(&scheduler->lockOwner);
+    refillOfficerQueue(fromEmployeeID);
+}
+
+// oldest loan waiting on the officer, -1 if none are queued
+int nextQueuedLoan(int employeeID)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    int loanID = -1;
+    if (scheduler == NULL) return -1;
+
+    lockSharedRegion(&scheduler->lockOwner);
+    int officer = findLoanOfficer(scheduler, employeeID);
+    if (officer != -1 && scheduler->officers[officer].queued > 0) loanID = scheduler->officers[officer].loanIDs[0];
+    unlockSharedRegion(&scheduler->lockOwner);
+    return loanID;
+}
+
+// from the employee file, so it works without the shared region too
+int isLoanOfficer(int employeeID)
+{
+    struct Employee employee;
+    off_t position = 0;
+    int employeeFile = databaseHandle(HANDLE_EMPLOYEE, 0);
+    if (employeeFile == -1) return 0;
+    while (pread(employeeFile, &employee, sizeof(employee), position) == sizeof(employee)) {
+        if (employee.employeeID == employeeID) return employee.roleType == 1;
+        position += sizeof(employee);
+    }
+    return 0;
+}
+
+// new employee or role change. an officer removed from the pool keeps nothing: their
+// pending loans are handed to the others, and a new officer picks up loans that were
+// waiting for someone to exist
+void setLoanOfficer(int employeeID, int isOfficer)
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    if (scheduler == NULL) return;
+
+    lockSharedRegion(&scheduler->lockOwner);
+    int officer = findLoanOfficer(scheduler, employeeID);
+    if (isOfficer && officer == -1 && scheduler->officerCount < LOAN_SCHED_MAX_OFFICERS) {
+        memset(&scheduler->officers[scheduler->officerCount], 0, sizeof(struct LoanOfficer));
+        scheduler->officers[scheduler->officerCount++].employeeID = employeeID;
+    } else if (!isOfficer && officer != -1) {
+        scheduler->officers[officer] = scheduler->officers[--scheduler->officerCount];
+    }
+    unlockSharedRegion(&scheduler->lockOwner);
+    assignWaitingLoans();
+}
+
+// the scheduler's officer table, kept in step with the employee file by setLoanOfficer
+int hasLoanOfficer(struct LoanSchedulerRegion *scheduler, int employeeID)
+{
+    lockSharedRegion(&scheduler->lockOwner);
+    int officer = findLoanOfficer(scheduler, employeeID);
+    unlockSharedRegion(&scheduler->lockOwner);
+    return officer != -1;
+}
+
+// loans nobody is working on: never assigned (no officers existed yet) or left behind by
+// an officer who is no longer one. each is locked, re-read and scheduled
+void assignWaitingLoans()
+{
+    struct LoanSchedulerRegion *scheduler = getLoanScheduler();
+    struct LoanRecord loan;
+    off_t position = 0;
+    int assigned = 0;
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
+    if (scheduler == NULL || loanFile == -1) return;
+
+    while (pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan)) {
+        off_t offset = position;
+        position += sizeof(loan);
+        if (loan.loanStatus > 1) continue;
+        if (loan.loanStatus == 1 && hasLoanOfficer(scheduler, loan.assignedEmployeeID)) continue;
+
+        struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(loan), getpid()};
+        if (fcntl(loanFile, F_SETLKW, &lock) == -1) continue;
+        if (pread(loanFile, &loan, sizeof(loan), offset) == sizeof(loan) &&
+            (loan.loanStatus == 0 || (loan.loanStatus == 1 && !hasLoanOfficer(scheduler, loan.assignedEmployeeID))) &&
+            scheduleLoan(&loan) != -1) {
+            writeLoanRecord(loanFile, offset, &loan);
+            assigned++;
+        }
+        lock.l_type = F_UNLCK;
+        fcntl(loanFile, F_SETLK, &lock);
+    }
+    if (assigned > 0) printf("Loan scheduler: assigned %d waiting loans\n", assigned);
+}
+
+#endif
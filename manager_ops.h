@@ -19,19 +19,8 @@ void handleManagerSession(int clientSocket);
 int authenticateManager(int clientSocket, int managerID, char *password_input)
 {
     struct Employee manager;
-    int dbFile = open(EMPLOYEE_DB, O_RDONLY);
-    if (dbFile == -1) {
-         if (errno == ENOENT) { // create fiel is not there
-             dbFile = open(EMPLOYEE_DB, O_WRONLY | O_CREAT, 0644);
-             if (dbFile != -1) close(dbFile);
-             printf("Created empty employee database file: %s\n", EMPLOYEE_DB);
-         } else {
-            perror("AuthMgr: Error opening employee DB for read");
-            return 0; //auth failed
-         }
-    } else {
-        close(dbFile); 
-    }
+    int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0); // created empty on first use
+    if (dbFile == -1) return 0; //auth failed
 
     
     sessionSemaphore = createSessionLock(managerID);
@@ -45,7 +34,7 @@ int authenticateManager(int clientSocket, int managerID, char *password_input)
         if (errno == EAGAIN) {
             printf("Manager %d is already logged in!\n", managerID);
             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "This ID is already logged in elsewhere.^");
-            write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+            write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         } else {
             perror("AuthMgr: sem_trywait failed");
         }
@@ -54,23 +43,16 @@ int authenticateManager(int clientSocket, int managerID, char *password_input)
     }
 
     //read and check credentials
-     dbFile = open(EMPLOYEE_DB, O_RDONLY);
-     if (dbFile == -1) {
-          perror("AuthMgr: Error opening employee DB for login check");
-          sem_post(sessionSemaphore); sem_close(sessionSemaphore); sem_unlink(sessionSemName);
-          return 0;
-     }
-     
     int loggedIn = 0;
     lseek(dbFile, 0, SEEK_SET);
     while(read(dbFile, &manager, sizeof(manager)) == sizeof(manager))
     {
-        if (manager.employeeID == managerID && strcmp(manager.password, password_input) == 0 && manager.roleType == 0) { // 0 = Manager
+        if (manager.employeeID == managerID && manager.roleType == 0 && // 0 = Manager
+            checkCredentials(LOGIN_EMPLOYEE, managerID, password_input, manager.password)) {
            loggedIn = 1;
            break;
         }
     }
-    close(dbFile);
 
      if (!loggedIn) {
         // relesae lock auth failed
@@ -85,48 +67,49 @@ int authenticateManager(int clientSocket, int managerID, char *password_input)
 
 void setAccountActiveStatus(int clientSocket)
 {
-    int dbFile = open(ACCOUNT_DB, O_RDWR);
-    if(dbFile == -1) {
-        perror("SetStatus: Error opening account DB");
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        return;
-    }
-
     struct AccountHolder account;
     int accountID, choice;
 
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Account Number to modify: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(dbFile); return; }
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     accountID = atoi(inBuffer);
-    
-    int offset = -1;
-    off_t currentPos = 0;
-    lseek(dbFile, 0, SEEK_SET);
-    while(read(dbFile, &account, sizeof(account)) > 0)
-    {
-        currentPos = lseek(dbFile, 0, SEEK_CUR) - sizeof(account);
-        if(account.accountID == accountID) {
-            offset = currentPos;
-            break;
-        }
+
+    int dbFile = accountHandle(accountID);
+    if(dbFile == -1) {
+        perror("SetStatus: Error opening account DB");
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
     }
+    
+    off_t offset = readAccountSnapshot(dbFile, accountID, &account);
 
     if (offset == -1) {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid account number^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        close(dbFile);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
     
+    // show the current state from the scan, ask, then lock only to apply
+    bzero(outBuffer, sizeof(outBuffer));
+    sprintf(outBuffer, "Account %d (%s) is currently %s.\n[1] Deactivate\n[2] Activate\nChoice: ",
+            accountID, account.holderName, account.isActive ? "Active" : "Inactive");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+     if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+         printf("Client disconnected during status choice.\n"); return;
+     }
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
+    choice = atoi(inBuffer);
+
     struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
     if(fcntl(dbFile, F_SETLKW, &lock) == -1) {
-        perror("SetStatus: Lock failed"); close(dbFile);
+        perror("SetStatus: Lock failed");
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
@@ -135,17 +118,6 @@ void setAccountActiveStatus(int clientSocket)
          perror("SetStatus: Re-read failed"); goto setstatus_unlock_fail;
      }
 
-    bzero(outBuffer, sizeof(outBuffer));
-    sprintf(outBuffer, "Account %d (%s) is currently %s.\n[1] Deactivate\n[2] Activate\nChoice: ",
-            accountID, account.holderName, account.isActive ? "Active" : "Inactive");
-    write(clientSocket, outBuffer, strlen(outBuffer));
-    bzero(inBuffer, sizeof(inBuffer));
-     if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
-         printf("Client disconnected during status choice.\n"); goto setstatus_unlock_fail;
-     }
-    inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
-    choice = atoi(inBuffer);
-
     int statusChanged = 0;
     if(choice == 1 && account.isActive != 0) { // Deactivate
         account.isActive = 0;
@@ -159,8 +131,7 @@ void setAccountActiveStatus(int clientSocket)
 
     if (statusChanged) {
         //write updates
-        lseek(dbFile, offset, SEEK_SET);
-        write(dbFile, &account, sizeof(account));
+        writeAccountRecord(dbFile, offset, &account);
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Status Changed Successfully^");
     } else {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid choice or status already set.^");
@@ -168,172 +139,166 @@ void setAccountActiveStatus(int clientSocket)
 
 
     lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
+    if (statusChanged) revokeSessionsFor(SESSION_CUSTOMER, accountID); // a resume re-checks isActive, this ends it now
 
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
     return;
 
 setstatus_unlock_fail: //cleanup on disconnect
     lock.l_type = F_UNLCK; fcntl(dbFile, F_SETLK, &lock);
-    close(dbFile);
     return; 
 }
 
+// every filter is optional; answers "-" (or 0 for the account) match everything
 void reviewClientFeedback(int clientSocket)
 {
-    struct ClientFeedback feedback;
-    int feedbackFile = open(FEEDBACK_DB, O_RDONLY | O_CREAT, 0644);
-    if(feedbackFile == -1) {
-        perror("ReviewFeedback: Error opening file");
+    struct PageCursor cursor;
+    const char *prompts[4] = {"Keyword (- for any): ", "Account Number (0 for any): ",
+                              "From date YYYY-MM-DD (- for any): ", "To date YYYY-MM-DD (- for any): "};
+    char answers[4][64];
+
+    if(databaseHandle(HANDLE_FEEDBACK_ENTRIES, 0) == -1) {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error retrieving feedback.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
 
-    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(feedbackFile, F_SETLKW, &lock);
-
-    bzero(outBuffer, sizeof(outBuffer));
-    int feedbackCount = 0;
-    while(read(feedbackFile, &feedback, sizeof(feedback)) == sizeof(feedback))
-    {
-        
-        if (strlen(outBuffer) + strlen(feedback.message) + 2 < sizeof(outBuffer)) {
-            strcat(outBuffer, feedback.message);
-            strcat(outBuffer, "\n");
-            feedbackCount++;
-        } else {
-            strcat(outBuffer, "... (more feedback truncated)\n");
-            break; 
-        }
-    }
-
-    lock.l_type = F_UNLCK; fcntl(feedbackFile, F_SETLK, &lock);
-    close(feedbackFile);
-
-    if(feedbackCount == 0) {
-        strcpy(outBuffer, "No feedback found.\n");
+    for (int i = 0; i < 4; i++) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, prompts[i]);
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        bzero(inBuffer, sizeof(inBuffer));
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+        inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+        inBuffer[sizeof(answers[i]) - 1] = '\0'; // cut to fit
+        strcpy(answers[i], inBuffer);
     }
 
-    strcat(outBuffer, "^"); 
-    printf("Manager reading %d feedback entries.\n", feedbackCount);
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+    long long started = currentMicros();
+    openFeedbackCursor(&cursor, strcmp(answers[0], "-") == 0 ? NULL : answers[0], atoi(answers[1]),
+                       parseFeedbackDate(answers[2], 0), parseFeedbackDate(answers[3], 1));
+    printf("Manager searching feedback (keyword %s, account %s, %s to %s), %lld us to open\n",
+           answers[0], answers[1], answers[2], answers[3], currentMicros() - started);
+    streamCursorPages(clientSocket, &cursor, "No feedback found.\n");
+    closeCursor(&cursor);
 }
 
+// loans are assigned by the scheduler as they come in, this is the manager override:
+// assign a loan nobody has yet or move a pending one to another employee
 void assignLoanToEmployee(int clientSocket)
 {
     struct LoanRecord loan;
-    int loanFile = open(LOAN_DB, O_RDWR);
+    int loanFile = databaseHandle(HANDLE_LOAN, 0);
     if(loanFile == -1) {
-         perror("AssignLoan: Error opening loan DB");
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database error.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
          return;
     }
 
-    // -unassigned loans
-    struct flock readLock = {F_RDLCK, SEEK_SET, 0, 0, getpid()}; 
-    fcntl(loanFile, F_SETLKW, &readLock);
-
-    int unassignedFound = 0;
-    lseek(loanFile, 0, SEEK_SET);
-    while(read(loanFile, &loan, sizeof(loan)) == sizeof(loan))
+    // open loans, one message instead of an ack per loan
+    int openLoans = 0, shown = 0;
+    off_t position = 0;
+    bzero(outBuffer, sizeof(outBuffer));
+    while(pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan))
     {
-        if(loan.assignedEmployeeID == -1 && loan.loanStatus == 0)
-        {
-            bzero(outBuffer, sizeof(outBuffer));
-            sprintf(outBuffer, "-> Unassigned Loan ID: %d | Account: %d | Amount: %d^",
-                    loan.loanRecordID, loan.accountID, loan.amount);
-            write(clientSocket, outBuffer, strlen(outBuffer));
-            read(clientSocket, inBuffer, 3); // ack for each
-            unassignedFound = 1;
-        }
+        position += sizeof(loan);
+        if(loan.loanStatus > 1) continue;
+        openLoans++;
+        if(strlen(outBuffer) + 128 > sizeof(outBuffer)) continue;
+        if(loan.loanStatus == 0) sprintf(outBuffer + strlen(outBuffer), "-> Loan ID: %d | Account: %d | Amount: %d | Unassigned\n",
+                                         loan.loanRecordID, loan.accountID, loan.amount);
+        else sprintf(outBuffer + strlen(outBuffer), "-> Loan ID: %d | Account: %d | Amount: %d | Employee %d\n",
+                     loan.loanRecordID, loan.accountID, loan.amount, loan.assignedEmployeeID);
+        shown++;
     }
 
-    readLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &readLock);
-
-    if(!unassignedFound) {
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "No unassigned loans found.^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        close(loanFile);
+    if(openLoans == 0) {
+        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "No open loans found.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
+    if(shown < openLoans) sprintf(outBuffer + strlen(outBuffer), "... and %d more\n", openLoans - shown);
+    strcat(outBuffer, "^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
 
-    
     int loanID, employeeID;
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Loan ID to assign: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(loanFile); return; }
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     loanID = atoi(inBuffer);
 
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter Employee ID to assign to: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { close(loanFile); return; }
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) { return; }
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     employeeID = atoi(inBuffer);
 
+    if(!isLoanOfficer(employeeID)) {
+        bzero(outBuffer, sizeof(outBuffer)); sprintf(outBuffer, "%d is not an employee who can process loans.^", employeeID);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
     // update the loan
     int offset = -1;
-    off_t currentPos = 0;
-    lseek(loanFile, 0, SEEK_SET);
-    while (read(loanFile, &loan, sizeof(loan)) == sizeof(loan))
+    position = 0;
+    while (pread(loanFile, &loan, sizeof(loan), position) == sizeof(loan))
     {
-        currentPos = lseek(loanFile, 0, SEEK_CUR) - sizeof(loan);
         if(loan.loanRecordID == loanID) {
-            offset = currentPos;
+            offset = position;
             break;
         }
+        position += sizeof(loan);
     }
 
     if(offset == -1) {
         bzero(outBuffer, sizeof(outBuffer)); sprintf(outBuffer, "Loan ID %d not found.^", loanID);
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
-        close(loanFile);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         return;
     }
     
     struct flock writeLock = {F_WRLCK, SEEK_SET, offset, sizeof(struct LoanRecord), getpid()};
     if(fcntl(loanFile, F_SETLKW, &writeLock) == -1) {
-         perror("AssignLoan: Lock failed"); close(loanFile);
+         perror("AssignLoan: Lock failed");
          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Database lock error.^");
-         write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+         write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
          return;
     }
 
-    lseek(loanFile, offset, SEEK_SET);
-    if (read(loanFile, &loan, sizeof(loan)) != sizeof(loan)) {
+    if (pread(loanFile, &loan, sizeof(loan), offset) != sizeof(loan)) {
         perror("AssignLoan: Re-read failed"); goto assignloan_unlock_fail;
     }
 
-    if(loan.assignedEmployeeID != -1 || loan.loanStatus != 0) {
+    if(loan.loanStatus > 1) {
         bzero(outBuffer, sizeof(outBuffer));
-        sprintf(outBuffer, "Loan %d was already assigned or processed.^", loanID);
+        sprintf(outBuffer, "Loan %d was already processed.^", loanID);
+    } else if(loan.loanStatus == 1 && loan.assignedEmployeeID == employeeID) {
+        bzero(outBuffer, sizeof(outBuffer));
+        sprintf(outBuffer, "Loan %d is already assigned to employee %d.^", loanID, employeeID);
     } else {
+        int previousEmployeeID = loan.loanStatus == 1 ? loan.assignedEmployeeID : -1;
         loan.assignedEmployeeID = employeeID;
         loan.loanStatus = 1; // 1 = Pending (assigned)
 
-        lseek(loanFile, offset, SEEK_SET);
-        write(loanFile, &loan, sizeof(loan));
+        if (!writeLoanRecord(loanFile, offset, &loan)) goto assignloan_unlock_fail;
+        loanReassigned(previousEmployeeID, &loan);
 
-        printf("Manager assigned loan %d to employee %d\n", loanID, employeeID);
+        printf("Manager assigned loan %d to employee %d (was %d)\n", loanID, employeeID, previousEmployeeID);
         bzero(outBuffer, sizeof(outBuffer));
         sprintf(outBuffer, "Loan %d assigned to employee %d.^", loanID, employeeID);
     }
 
     writeLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &writeLock);
-    close(loanFile);
 
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
     return; 
 
 assignloan_unlock_fail: // cleanup
     writeLock.l_type = F_UNLCK; fcntl(loanFile, F_SETLK, &writeLock);
-    close(loanFile);
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Error during assignment.^");
-    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
     return;
 }
 
@@ -348,32 +313,33 @@ void handleManagerSession(int clientSocket)
     char password[51]; 
 
 label_manager_login:
+    if (takeResumedSession(SESSION_MANAGER, &authManagerID)) goto manager_logged_in;
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "\nEnter Manager ID: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
     inBuffer[strcspn(inBuffer, "\r\n")] = 0; 
     authManagerID = atoi(inBuffer);
 
     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Enter password: ");
     write(clientSocket, outBuffer, strlen(outBuffer));
     bzero(inBuffer, sizeof(inBuffer));
-    if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
     inBuffer[strcspn(inBuffer, "\r\n")] = 0;
     strncpy(password, inBuffer, sizeof(password) - 1); password[sizeof(password)-1] = '\0';
 
     if(authenticateManager(clientSocket, authManagerID, password))
     {
-        bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "\nLogin Successfully^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+        sendLoginSuccess(clientSocket, SESSION_MANAGER, authManagerID);
 
+manager_logged_in:
         while(1)
         {
             bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, MANAGER_PROMPT);
             write(clientSocket, outBuffer, strlen(outBuffer));
 
             bzero(inBuffer, sizeof(inBuffer));
-             if(read(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+             if(readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
                  printf("Manager %d disconnected during session.\n", authManagerID);
                  terminateClientSession(clientSocket, authManagerID);
                  return;
@@ -399,30 +365,43 @@ label_manager_login:
                     } else {
                          bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer,"Password change failed.^");
                     }
-                    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3); // ack
+                    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3); // ack
                     endUserSession(clientSocket, authManagerID);
                     authManagerID = -1;
                     goto label_manager_login; 
-                case 5: 
+                case 5:
+                    exportAccountStatement(clientSocket);
+                    break;
+                case 6:
+                    exportTransactionDay(clientSocket);
+                    break;
+                case 7:
+                    viewRateLimitStats(clientSocket);
+                    break;
+                case 8:
+                    auditTransactionLogs(clientSocket, authManagerID);
+                    break;
+                case 9: 
                     printf("Manager %d Logged Out!\n", authManagerID);
                     endUserSession(clientSocket, authManagerID); 
                     authManagerID = -1;
                     return; 
-                case 6: 
+                case 10: 
                     printf("Manager %d Exited!\n", authManagerID);
+                    revokeSessionToken();
                     terminateClientSession(clientSocket, authManagerID); 
                      authManagerID = -1;
                     return; 
                 default:
                     bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "Invalid Choice^");
-                    write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+                    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
             }
         }
     }
     else 
     {
         bzero(outBuffer, sizeof(outBuffer)); strcpy(outBuffer, "\nInvalid ID or Password^");
-        write(clientSocket, outBuffer, strlen(outBuffer)); read(clientSocket, inBuffer, 3);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
         authManagerID = -1;
         goto label_manager_login;
     }
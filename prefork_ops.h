@@ -0,0 +1,158 @@
+#ifndef PREFORK_OPS_H
+#define PREFORK_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// ./server --prefork [workers] [sessions per worker]
+// Long lived workers accept on the shared listener and run clientConnectionLoop one
+// session after another, so a connection never waits on a fork. Each worker exits after
+// sessionsPerWorker sessions and the parent respawns it, which keeps any leak or
+// fragmentation in a worker bounded. The listener is shared rather than one socket per
+// worker so a recycled worker never takes queued connections down with it. The hot account
+// flusher and the log maintainer are children of the parent too, and it restarts them
+// when they exit.
+
+#define PREFORK_WORKERS 8
+#define PREFORK_MAX_WORKERS 256
+#define PREFORK_SESSIONS_PER_WORKER 100
+#define PREFORK_RESPAWN_DELAY_S 1 // back off when workers die right after starting
+
+int preforkWorkers = 0; // 0 = fork per connection
+int preforkSessionsPerWorker = PREFORK_SESSIONS_PER_WORKER;
+volatile sig_atomic_t preforkShutdown = 0;
+
+void preforkShutdownHandler(int signum);
+pid_t spawnPreforkWorker(int serverSocketFD, int workerSlot);
+void runPreforkWorker(int serverSocketFD, int workerSlot);
+int runPreforkPool(int serverSocketFD);
+
+void preforkShutdownHandler(int signum)
+{
+    (void)signum;
+    preforkShutdown = 1;
+}
+
+pid_t spawnPreforkWorker(int serverSocketFD, int workerSlot)
+{
+    pid_t workerPid = fork();
+    if (workerPid == 0) {
+        runPreforkWorker(serverSocketFD, workerSlot);
+        exit(EXIT_SUCCESS);
+    }
+    if (workerPid < 0) perror("Prefork: fork failed");
+    return workerPid;
+}
+
+void runPreforkWorker(int serverSocketFD, int workerSlot)
+{
+    struct sockaddr_in clientAddress;
+    socklen_t clientAddrSize;
+    int sessions = 0;
+
+    setupSignalHandlers();
+    signal(SIGPIPE, SIG_IGN); // a client vanishing mid write must not take the worker down
+    printf("Worker %d started. Process ID: %d\n", workerSlot, getpid());
+
+    while (sessions < preforkSessionsPerWorker)
+    {
+        clientAddrSize = sizeof(clientAddress);
+        int clientSocketFD = accept(serverSocketFD, (struct sockaddr *)&clientAddress, &clientAddrSize);
+        if (clientSocketFD == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("Worker accept failed");
+            sleep(PREFORK_RESPAWN_DELAY_S);
+            continue;
+        }
+
+        sessions++;
+        printf("Client connected. FD: %d, Worker %d (Process ID: %d), session %d\n", clientSocketFD, workerSlot, getpid(), sessions);
+        clientConnectionLoop(clientSocketFD);
+        printf("Client FD %d disconnected from worker %d.\n", clientSocketFD, workerSlot);
+        close(clientSocketFD);
+
+        // forget the finished session's lock so the signal handler can't release it twice
+        sessionSemaphore = NULL;
+        bzero(sessionSemName, sizeof(sessionSemName));
+        sessionPageSize = PAGE_DEFAULT_RECORDS;
+    }
+    printf("Worker %d recycling after %d sessions.\n", workerSlot, sessions);
+}
+
+// supervisor: keep preforkWorkers workers alive until SIGINT/SIGTERM
+int runPreforkPool(int serverSocketFD)
+{
+    pid_t workerPids[PREFORK_MAX_WORKERS];
+    time_t startedAt[PREFORK_MAX_WORKERS];
+    int status;
+
+    if (preforkWorkers > PREFORK_MAX_WORKERS) preforkWorkers = PREFORK_MAX_WORKERS;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = preforkShutdownHandler;
+    sigaction(SIGINT, &sa, NULL); // no SA_RESTART so waitpid returns
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (int slot = 0; slot < preforkWorkers; slot++) {
+        workerPids[slot] = spawnPreforkWorker(serverSocketFD, slot);
+        startedAt[slot] = time(NULL);
+    }
+    printf("Prefork: %d workers, recycled every %d sessions\n", preforkWorkers, preforkSessionsPerWorker);
+
+    while (!preforkShutdown)
+    {
+        pid_t exitedPid = waitpid(-1, &status, 0);
+        if (exitedPid == -1) {
+            if (errno == EINTR) continue;
+            if (errno == ECHILD) sleep(PREFORK_RESPAWN_DELAY_S); // every fork failed, try again below
+        }
+
+        // waitpid(-1) reaps the helpers as well, bring them back instead of a worker
+        if (exitedPid > 0 && exitedPid == hotFlusherPid) {
+            printf("Prefork: hot account flusher (pid %d) exited, restarting it\n", exitedPid);
+            sleep(PREFORK_RESPAWN_DELAY_S);
+            hotFlusherPid = 0;
+            if (!preforkShutdown) startHotFlusher(serverSocketFD);
+            continue;
+        }
+        if (exitedPid > 0 && exitedPid == logMaintainerPid) {
+            printf("Prefork: log maintainer (pid %d) exited, restarting it\n", exitedPid);
+            sleep(PREFORK_RESPAWN_DELAY_S);
+            logMaintainerPid = 0;
+            if (!preforkShutdown) startLogMaintainer(serverSocketFD);
+            continue;
+        }
+
+        for (int slot = 0; slot < preforkWorkers && !preforkShutdown; slot++) {
+            if (workerPids[slot] != exitedPid && workerPids[slot] > 0) continue;
+
+            if (workerPids[slot] == exitedPid && !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+                printf("Prefork: worker %d (pid %d) died unexpectedly\n", slot, exitedPid);
+                if (time(NULL) - startedAt[slot] < PREFORK_RESPAWN_DELAY_S) sleep(PREFORK_RESPAWN_DELAY_S);
+            }
+            workerPids[slot] = spawnPreforkWorker(serverSocketFD, slot);
+            startedAt[slot] = time(NULL);
+        }
+    }
+
+    printf("\nPrefork: shutting down workers.\n");
+    for (int slot = 0; slot < preforkWorkers; slot++) {
+        if (workerPids[slot] > 0) kill(workerPids[slot], SIGTERM);
+    }
+    if (hotFlusherPid > 0) kill(hotFlusherPid, SIGTERM);
+    if (logMaintainerPid > 0) kill(logMaintainerPid, SIGTERM);
+    while (waitpid(-1, NULL, 0) > 0);
+    close(serverSocketFD);
+    return 0;
+}
+
+#endif
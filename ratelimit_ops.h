@@ -0,0 +1,252 @@
+#ifndef RATELIMIT_OPS_H
+#define RATELIMIT_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Per-account and per-client-IP rate limits. Token buckets live in a shared hash table
+// keyed by (bucket kind, account ID or IPv4 address). Customer logins and customer menu
+// operations spend one token from both their account's bucket and their IP's bucket
+// before any file is touched. Whatever runs out first is refused with a message, so a
+// script hammering one account stays off its record lock and session semaphore. Tokens
+// are kept in 1/60000ths so a rate per minute refills in whole units per millisecond.
+// When the table is full the oldest bucket is evicted. The usual victim is an idle bucket
+// that would be full again anyway.
+//
+// ./server [--rate-login-account n burst] [--rate-login-ip n burst]
+//          [--rate-ops-account n burst] [--rate-ops-ip n burst]    n per minute
+
+#define RATE_REGION "ratelimit"
+#define RATE_BUCKETS 8192
+#define RATE_PROBES 32
+#define RATE_UNITS 60000 // per token, one minute in ms
+
+#define RATE_LOGIN_ACCOUNT 0
+#define RATE_LOGIN_IP 1
+#define RATE_OPS_ACCOUNT 2
+#define RATE_OPS_IP 3
+#define RATE_KINDS 4
+
+struct RateBucket {
+    int kind;          // RATE_*, plus one so 0 marks a free bucket
+    unsigned int key;  // account ID or IPv4 address
+    long long units;   // tokens * RATE_UNITS
+    long long updatedMs;
+    int throttled;
+};
+
+struct RateRegion {
+    int lockOwner; // pid, 0 = free
+    long long allowed[RATE_KINDS];
+    long long throttled[RATE_KINDS];
+    struct RateBucket buckets[RATE_BUCKETS];
+};
+
+struct RateRegion *rateRegion = NULL;
+int ratePerMinute[RATE_KINDS] = {10, 60, 120, 1200};
+int rateBurst[RATE_KINDS] = {5, 20, 20, 100};
+unsigned int clientIP = 0; // this connection's peer, network order
+
+const char *rateKindNames[RATE_KINDS] = {"login-account", "login-ip", "ops-account", "ops-ip"};
+
+void parseRateLimitOptions(int argc, char *argv[]);
+struct RateRegion *getRateRegion();
+void resetRateLimits();
+void identifyClient(int clientSocket);
+int takeRateTokens(int accountKind, int accountID);
+int allowCustomerLogin(int clientSocket, int accountID);
+int allowCustomerOperation(int clientSocket, int accountID);
+void viewRateLimitStats(int clientSocket);
+
+void parseRateLimitOptions(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        for (int kind = 0; kind < RATE_KINDS; kind++) {
+            char flag[32];
+            snprintf(flag, sizeof(flag), "--rate-%s", rateKindNames[kind]);
+            if (strcmp(argv[i], flag) == 0 && i + 2 < argc) {
+                ratePerMinute[kind] = atoi(argv[++i]);
+                rateBurst[kind] = atoi(argv[++i]);
+                if (ratePerMinute[kind] <= 0) ratePerMinute[kind] = 1;
+                if (rateBurst[kind] <= 0) rateBurst[kind] = 1;
+                break;
+            }
+        }
+    }
+}
+
+// NULL means shared memory is unavailable and nothing is rate limited
+struct RateRegion *getRateRegion()
+{
+    if (rateRegion == NULL) {
+        rateRegion = attachSharedRegion(RATE_REGION, sizeof(struct RateRegion), NULL);
+    }
+    return rateRegion;
+}
+
+void resetRateLimits()
+{
+    resetSharedRegion(RATE_REGION);
+    rateRegion = NULL;
+    getRateRegion();
+}
+
+static long long rateNowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+// the bucket for (kind, key), refilled up to now. keep is never evicted for it. caller
+// holds the lock
+static struct RateBucket *findRateBucket(struct RateRegion *rates, int kind, unsigned int key, long long now, struct RateBucket *keep)
+{
+    unsigned int hash = (key * 2654435761u) ^ (kind * 40503u);
+    struct RateBucket *oldest = NULL;
+    long long capacity = (long long)rateBurst[kind] * RATE_UNITS;
+
+    for (int probe = 0; probe < RATE_PROBES; probe++) {
+        struct RateBucket *bucket = &rates->buckets[(hash + probe) % RATE_BUCKETS];
+        if (bucket->kind == kind + 1 && bucket->key == key) {
+            bucket->units += (now - bucket->updatedMs) * ratePerMinute[kind];
+            if (bucket->units > capacity) bucket->units = capacity;
+            bucket->updatedMs = now;
+            return bucket;
+        }
+        if (bucket->kind == 0) {
+            oldest = bucket;
+            break;
+        }
+        if (bucket != keep && (oldest == NULL || bucket->updatedMs < oldest->updatedMs)) oldest = bucket;
+    }
+
+    // new key, starts with a full burst
+    oldest->kind = kind + 1;
+    oldest->key = key;
+    oldest->units = capacity;
+    oldest->updatedMs = now;
+    oldest->throttled = 0;
+    return oldest;
+}
+
+// remember who is on the other end, for the per-IP buckets
+void identifyClient(int clientSocket)
+{
+    struct sockaddr_in peer;
+    socklen_t peerSize = sizeof(peer);
+    clientIP = 0;
+    if (getpeername(clientSocket, (struct sockaddr *)&peer, &peerSize) == 0 && peer.sin_family == AF_INET) {
+        clientIP = peer.sin_addr.s_addr;
+    }
+}
+
+// one token from the account's bucket and one from the IP's, or neither. the IP kind is
+// the one after the account kind
+int takeRateTokens(int accountKind, int accountID)
+{
+    struct RateRegion *rates = getRateRegion();
+    if (rates == NULL) return 1;
+
+    long long now = rateNowMs();
+    lockSharedRegion(&rates->lockOwner);
+    struct RateBucket *account = findRateBucket(rates, accountKind, accountID, now, NULL);
+    struct RateBucket *ip = findRateBucket(rates, accountKind + 1, clientIP, now, account);
+    int allowed = account->units >= RATE_UNITS && ip->units >= RATE_UNITS;
+    if (allowed) {
+        account->units -= RATE_UNITS;
+        ip->units -= RATE_UNITS;
+        rates->allowed[accountKind]++;
+        rates->allowed[accountKind + 1]++;
+    } else {
+        struct RateBucket *empty = account->units < RATE_UNITS ? account : ip;
+        int emptyKind = account->units < RATE_UNITS ? accountKind : accountKind + 1;
+        empty->throttled++;
+        rates->throttled[emptyKind]++;
+    }
+    unlockSharedRegion(&rates->lockOwner);
+    return allowed;
+}
+
+// before authenticateCustomer opens anything. 0 after telling the client to slow down
+int allowCustomerLogin(int clientSocket, int accountID)
+{
+    if (takeRateTokens(RATE_LOGIN_ACCOUNT, accountID)) return 1;
+    printf("Rate limit: login for account %d from %s throttled\n", accountID, inet_ntoa((struct in_addr){clientIP}));
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Too many login attempts, wait a minute and try again.^");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    readClient(clientSocket, inBuffer, 3); // ack
+    return 0;
+}
+
+// before a customer menu operation. 0 after telling the client to slow down
+int allowCustomerOperation(int clientSocket, int accountID)
+{
+    if (takeRateTokens(RATE_OPS_ACCOUNT, accountID)) return 1;
+    printf("Rate limit: operation on account %d throttled\n", accountID);
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Too many requests, slow down and try again shortly.^");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    readClient(clientSocket, inBuffer, 3); // ack
+    return 0;
+}
+
+// manager view: totals per bucket kind and the most throttled keys
+void viewRateLimitStats(int clientSocket)
+{
+    struct RateRegion *rates = getRateRegion();
+    struct RateBucket top[5];
+    int topCount = 0;
+    char line[128];
+
+    bzero(outBuffer, sizeof(outBuffer));
+    if (rates == NULL) {
+        strcpy(outBuffer, "Rate limiting is not active.^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return;
+    }
+
+    strcpy(outBuffer, "\n--- Rate Limits ---\n");
+    lockSharedRegion(&rates->lockOwner);
+    for (int kind = 0; kind < RATE_KINDS; kind++) {
+        snprintf(line, sizeof(line), "%-14s %5d/min burst %-4d allowed %lld throttled %lld\n", rateKindNames[kind],
+                 ratePerMinute[kind], rateBurst[kind], rates->allowed[kind], rates->throttled[kind]);
+        strcat(outBuffer, line);
+    }
+    // keep the five most throttled buckets, insertion sorted
+    for (int i = 0; i < RATE_BUCKETS; i++) {
+        struct RateBucket *bucket = &rates->buckets[i];
+        if (bucket->kind == 0 || bucket->throttled == 0) continue;
+        int at = topCount < 5 ? topCount++ : 5;
+        while (at > 0 && top[at - 1].throttled < bucket->throttled) {
+            if (at < 5) top[at] = top[at - 1];
+            at--;
+        }
+        if (at < 5) top[at] = *bucket;
+    }
+    unlockSharedRegion(&rates->lockOwner);
+
+    if (topCount > 0) strcat(outBuffer, "Most throttled:\n");
+    for (int i = 0; i < topCount; i++) {
+        int kind = top[i].kind - 1;
+        if (kind == RATE_LOGIN_IP || kind == RATE_OPS_IP) {
+            snprintf(line, sizeof(line), "  %-14s %-15s %d\n", rateKindNames[kind], inet_ntoa((struct in_addr){top[i].key}), top[i].throttled);
+        } else {
+            snprintf(line, sizeof(line), "  %-14s account %-7u %d\n", rateKindNames[kind], top[i].key, top[i].throttled);
+        }
+        strcat(outBuffer, line);
+    }
+    strcat(outBuffer, "^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef RECONCILE_OPS_H
+#define RECONCILE_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <float.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// ./server --reconcile [threads]
+// End of day check that every balance equals the sum of its account's log entries.
+// Every segment of every shard log (see segment_ops.h) is cut into record aligned
+// ranges, one per thread, and every archived segment goes whole to one thread. Each
+// thread preads its ranges in batches, parses the amount out of each entry, and adds it to
+// a hash map of its own keyed by account. The maps are merged once all threads are
+// done. Then each account record is compared with its total, plus any hot account
+// credit still pending. Balances are floats, so a difference within the float
+// rounding of the account's entries is not reported.
+// A running server is held off with a read lock on every account file for the
+// whole run. Balance changes all happen under record or file write locks, so the
+// logs and balances stay in step. Exits 1 when anything doesn't match.
+
+#define RECONCILE_THREADS_MAX 16
+#define RECONCILE_BATCH 256 // log records per pread
+#define RECONCILE_MAP_START 4096 // slots, doubles at half full
+#define RECONCILE_REPORT_MAX 50 // mismatches and unparsed entries printed
+
+// what logEntryAmount makes of an entry
+#define LOG_ENTRY_UNKNOWN 0
+#define LOG_ENTRY_DEPOSIT 1
+#define LOG_ENTRY_WITHDRAWAL 2
+#define LOG_ENTRY_TRANSFER_OUT 3
+#define LOG_ENTRY_TRANSFER_IN 4
+#define LOG_ENTRY_LOAN 5
+#define LOG_ENTRY_OPENING 6
+#define LOG_ENTRY_ACCRUAL 7
+
+struct ReconcileTotal {
+    int accountID; // 0 = free slot
+    int entries;
+    long long cents;
+};
+
+struct ReconcileMap {
+    struct ReconcileTotal *slots;
+    int capacity, used;
+};
+
+struct ReconcileRange {
+    int shard, seq;
+    int logFile; // -1 for an archived segment, read whole
+    off_t start, end;
+};
+
+struct ReconcileWorker {
+    pthread_t thread;
+    struct ReconcileRange *ranges;
+    int rangeCount;
+    struct ReconcileMap totals;
+    long long records, unparsed;
+    int failed;
+};
+
+int reconcileReported = 0; // unparsed entries printed so far, shared by the threads
+
+int logEntryAmount(struct TransactionLog *log, long long *cents);
+struct ReconcileTotal *reconcileSlot(struct ReconcileMap *map, int accountID);
+int reconcileEntries(struct ReconcileWorker *worker, struct TransactionLog *batch, int count);
+void *reconcileLogRange(void *arg);
+int lockAccountFiles(int dbFiles[], int lockType);
+int runReconciliation(int threadCount);
+
+// signed amount of a log entry in cents. returns the entry's LOG_ENTRY_* type,
+// LOG_ENTRY_UNKNOWN with 0 cents if it isn't understood
+int logEntryAmount(struct TransactionLog *log, long long *cents)
+{
+    char *text = log->logEntry;
+    double amount, fee;
+    int loanAmount, consumed = 0, type;
+
+    *cents = 0;
+    text[sizeof(log->logEntry) - 1] = '\0';
+    if (sscanf(text, "Accrual %*d: interest %lf, fee %lf", &amount, &fee) == 2) {
+        amount -= fee;
+        type = LOG_ENTRY_ACCRUAL;
+    } else if (sscanf(text, "%d credited via loan%n", &loanAmount, &consumed) == 1 && consumed > 0) {
+        amount = loanAmount;
+        type = LOG_ENTRY_LOAN;
+    } else if (sscanf(text, "%lf %n", &amount, &consumed) == 1 && consumed > 0) {
+        text += consumed;
+        if (strncmp(text, "deposited", 9) == 0) type = LOG_ENTRY_DEPOSIT;
+        else if (strncmp(text, "withdrawn", 9) == 0) type = LOG_ENTRY_WITHDRAWAL;
+        else if (strncmp(text, "transferred to acc", 18) == 0) type = LOG_ENTRY_TRANSFER_OUT;
+        else if (strncmp(text, "credited from acc", 17) == 0) type = LOG_ENTRY_TRANSFER_IN;
+        else if (strncmp(text, "Opening Balance", 15) == 0) type = LOG_ENTRY_OPENING;
+        else return LOG_ENTRY_UNKNOWN;
+        if (type == LOG_ENTRY_WITHDRAWAL || type == LOG_ENTRY_TRANSFER_OUT) amount = -amount;
+    } else {
+        return LOG_ENTRY_UNKNOWN;
+    }
+    *cents = (long long)(amount * 100 + (amount < 0 ? -0.5 : 0.5));
+    return type;
+}
+
+// the account's total, added if missing. NULL only when the map can't grow
+struct ReconcileTotal *reconcileSlot(struct ReconcileMap *map, int accountID)
+{
+    if (map->used * 2 >= map->capacity) {
+        int capacity = map->capacity ? map->capacity * 2 : RECONCILE_MAP_START;
+        struct ReconcileTotal *slots = calloc(capacity, sizeof(*slots));
+        if (slots == NULL) return NULL;
+        for (int i = 0; i < map->capacity; i++) {
+            if (map->slots[i].accountID == 0) continue;
+            unsigned int at = (unsigned int)map->slots[i].accountID * 2654435761u & (capacity - 1);
+            while (slots[at].accountID != 0) at = (at + 1) & (capacity - 1);
+            slots[at] = map->slots[i];
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->capacity = capacity;
+    }
+
+    unsigned int at = (unsigned int)accountID * 2654435761u & (map->capacity - 1);
+    while (map->slots[at].accountID != 0 && map->slots[at].accountID != accountID) at = (at + 1) & (map->capacity - 1);
+    if (map->slots[at].accountID == 0) {
+        map->slots[at].accountID = accountID;
+        map->used++;
+    }
+    return &map->slots[at];
+}
+
+// adds a batch of entries to the worker's totals. 0 when the map can't grow
+int reconcileEntries(struct ReconcileWorker *worker, struct TransactionLog *batch, int count)
+{
+    long long cents;
+    for (int i = 0; i < count; i++) {
+        worker->records++;
+        if (!logEntryAmount(&batch[i], &cents)) {
+            worker->unparsed++;
+            if (__atomic_fetch_add(&reconcileReported, 1, __ATOMIC_RELAXED) < RECONCILE_REPORT_MAX) {
+                printf("Reconcile: can't read entry of account %d: %.60s", batch[i].accountID, batch[i].logEntry);
+                if (strchr(batch[i].logEntry, '\n') == NULL) printf("\n");
+            }
+            continue;
+        }
+        struct ReconcileTotal *total = reconcileSlot(&worker->totals, batch[i].accountID);
+        if (total == NULL) return 0;
+        total->cents += cents;
+        total->entries++;
+    }
+    return 1;
+}
+
+void *reconcileLogRange(void *arg)
+{
+    struct ReconcileWorker *worker = (struct ReconcileWorker *)arg;
+    struct TransactionLog *batch = malloc(RECONCILE_BATCH * sizeof(struct TransactionLog));
+    if (batch == NULL) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    for (int r = 0; r < worker->rangeCount && !worker->failed; r++) {
+        struct ReconcileRange *range = &worker->ranges[r];
+        if (range->logFile == -1) {
+            struct SegmentArchive archive;
+            int count;
+            if (!openSegmentArchive(range->shard, range->seq, &archive)) {
+                printf("Reconcile: archived segment %d of shard %d unreadable\n", range->seq, range->shard);
+                worker->failed = 1;
+                break;
+            }
+            while ((count = readSegmentArchive(&archive, batch, RECONCILE_BATCH)) > 0) {
+                if (!reconcileEntries(worker, batch, count)) break;
+            }
+            if (count != 0) worker->failed = 1;
+            closeSegmentArchive(&archive);
+            continue;
+        }
+        for (off_t at = range->start; at < range->end; at += RECONCILE_BATCH * sizeof(struct TransactionLog)) {
+            off_t count = (range->end - at) / sizeof(struct TransactionLog);
+            if (count > RECONCILE_BATCH) count = RECONCILE_BATCH;
+            if (pread(range->logFile, batch, count * sizeof(struct TransactionLog), at) != (ssize_t)(count * sizeof(struct TransactionLog))) {
+                perror("Reconcile: log read failed");
+                worker->failed = 1;
+                break;
+            }
+            if (!reconcileEntries(worker, batch, count)) {
+                worker->failed = 1;
+                break;
+            }
+        }
+    }
+    free(batch);
+    return NULL;
+}
+
+// lockType on every shard's account file, in shard order. a session that holds a record
+// lock in one shard and waits on another can deadlock us: then start over
+int lockAccountFiles(int dbFiles[], int lockType)
+{
+    struct flock lock = {lockType, SEEK_SET, 0, 0, getpid()};
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (dbFiles[shard] == -1) continue;
+        if (fcntl(dbFiles[shard], F_SETLKW, &lock) == -1) {
+            if (errno != EDEADLK) return 0;
+            struct flock unlock = {F_UNLCK, SEEK_SET, 0, 0, getpid()};
+            for (int locked = 0; locked < shard; locked++) {
+                if (dbFiles[locked] != -1) fcntl(dbFiles[locked], F_SETLK, &unlock);
+            }
+            usleep(1000);
+            shard = -1;
+        }
+    }
+    return 1;
+}
+
+int runReconciliation(int threadCount)
+{
+    struct ReconcileWorker *workers;
+    struct ReconcileMap merged = {NULL, 0, 0};
+    int dbFiles[ACCOUNT_SHARDS], *logFiles = NULL, logFileCount = 0, archivedCount = 0;
+    struct LogSegmentSet segments[ACCOUNT_SHARDS];
+    struct timespec started, finished;
+    struct AccountHolder account;
+    long long records = 0, unparsed = 0, accounts = 0, mismatches = 0;
+    int failed = 0;
+
+    if (threadCount <= 0) threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount <= 0) threadCount = 1;
+    if (threadCount > RECONCILE_THREADS_MAX) threadCount = RECONCILE_THREADS_MAX;
+    workers = calloc(threadCount, sizeof(*workers));
+    if (workers == NULL) {
+        perror("Reconcile: setup failed");
+        return EXIT_FAILURE;
+    }
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) dbFiles[shard] = openShardFile(ACCOUNT_DB, shard, O_RDONLY);
+    if (!lockAccountFiles(dbFiles, F_RDLCK)) {
+        perror("Reconcile: Failed to lock account files");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    int segmentCount = 0;
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (!loadLogSegments(shard, &segments[shard])) {
+            printf("Reconcile: log segments of shard %d unreadable\n", shard);
+            return EXIT_FAILURE;
+        }
+        segmentCount += segments[shard].count;
+    }
+    logFiles = malloc(segmentCount * sizeof(int));
+    for (int t = 0; t < threadCount; t++) workers[t].ranges = malloc(segmentCount * sizeof(struct ReconcileRange));
+    for (int t = 0; t < threadCount; t++) {
+        if (workers[t].ranges == NULL || logFiles == NULL) {
+            perror("Reconcile: setup failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // cut every plain segment into threadCount ranges, worker t gets range t of each.
+    // archived segments are handed out whole, round robin
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        for (int index = 0; index < segments[shard].count; index++) {
+            struct LogSegment *segment = &segments[shard].segments[index];
+            if (segment->records == 0) continue;
+            int logFile = openLogSegment(&segments[shard], index);
+            if (logFile == -1) {
+                struct ReconcileWorker *worker = &workers[archivedCount++ % threadCount];
+                struct ReconcileRange range = {shard, segment->seq, -1, 0, 0};
+                worker->ranges[worker->rangeCount++] = range;
+                continue;
+            }
+            logFiles[logFileCount++] = logFile;
+            for (int t = 0; t < threadCount; t++) {
+                struct ReconcileWorker *worker = &workers[t];
+                off_t first = segment->records * t / threadCount, last = segment->records * (t + 1) / threadCount;
+                if (first == last) continue;
+                struct ReconcileRange range = {shard, segment->seq, logFile, first * (off_t)sizeof(struct TransactionLog),
+                                               last * (off_t)sizeof(struct TransactionLog)};
+                worker->ranges[worker->rangeCount++] = range;
+            }
+        }
+    }
+
+    for (int t = 0; t < threadCount; t++) {
+        if (pthread_create(&workers[t].thread, NULL, reconcileLogRange, &workers[t]) != 0) {
+            perror("Reconcile: thread start failed, scanning in this thread");
+            reconcileLogRange(&workers[t]);
+            workers[t].thread = 0;
+        }
+    }
+    for (int t = 0; t < threadCount; t++) {
+        if (workers[t].thread != 0) pthread_join(workers[t].thread, NULL);
+        records += workers[t].records;
+        unparsed += workers[t].unparsed;
+        failed |= workers[t].failed;
+        for (int i = 0; i < workers[t].totals.capacity && !failed; i++) {
+            struct ReconcileTotal *total = &workers[t].totals.slots[i];
+            if (total->accountID == 0) continue;
+            struct ReconcileTotal *into = reconcileSlot(&merged, total->accountID);
+            if (into == NULL) {
+                failed = 1;
+                break;
+            }
+            into->cents += total->cents;
+            into->entries += total->entries;
+        }
+        free(workers[t].totals.slots);
+        free(workers[t].ranges);
+    }
+    if (failed) {
+        printf("Reconcile: log scan failed, nothing compared\n");
+        return EXIT_FAILURE;
+    }
+
+    // balances against the totals. a matched total is marked by negating its entry count
+    struct HotRegion *hot = attachSharedRegion(HOT_REGION, sizeof(struct HotRegion), NULL);
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        for (off_t at = 0; dbFiles[shard] != -1 && pread(dbFiles[shard], &account, sizeof(account), at) == sizeof(account); at += sizeof(account)) {
+            struct ReconcileTotal *total = reconcileSlot(&merged, account.accountID);
+            if (total == NULL) return EXIT_FAILURE;
+            double balance = account.currentBalance;
+            for (int i = 0; hot != NULL && i < hot->count && i < HOT_ACCOUNTS_MAX; i++) {
+                if (hot->accounts[i].accountID == account.accountID) balance += hot->accounts[i].pendingCents / 100.0;
+            }
+            // every logged change rounded the balance to a float once, by half a ulp at most
+            double logged = total->cents / 100.0;
+            double tolerance = 0.005 + (total->entries + 1) * (balance < 0 ? -balance : balance) * FLT_EPSILON / 2;
+            if (balance - logged > tolerance || logged - balance > tolerance) {
+                if (mismatches++ < RECONCILE_REPORT_MAX) {
+                    printf("Reconcile: account %d balance %.2f, log says %.2f over %d entries (off by %.2f)\n",
+                           account.accountID, balance, logged, total->entries, balance - logged);
+                }
+            }
+            total->entries = -total->entries - 1;
+            accounts++;
+        }
+    }
+    // entries of accounts that have no record
+    for (int i = 0; i < merged.capacity; i++) {
+        struct ReconcileTotal *total = &merged.slots[i];
+        if (total->accountID == 0 || total->entries < 0) continue;
+        if (mismatches++ < RECONCILE_REPORT_MAX) {
+            printf("Reconcile: %d log entries for account %d, which has no record (net %.2f)\n",
+                   total->entries, total->accountID, total->cents / 100.0);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    lockAccountFiles(dbFiles, F_UNLCK);
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("Reconcile: %lld log entries (%d archived segments), %lld accounts, %d threads, %.2f s\n",
+           records, archivedCount, accounts, threadCount, seconds);
+    printf("Reconcile: %lld mismatches, %lld entries not understood\n", mismatches, unparsed);
+
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (dbFiles[shard] != -1) close(dbFiles[shard]);
+        freeLogSegments(&segments[shard]);
+    }
+    for (int i = 0; i < logFileCount; i++) close(logFiles[i]);
+    free(logFiles);
+    free(merged.slots);
+    free(workers);
+    return mismatches == 0 && unparsed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef RECORD_OPS_H
+#define RECORD_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Record write helpers shared by all ops headers, plus the lock free read path.
+// Writers still serialize on fcntl record locks; readers never take one. Each account
+// record position maps to a version slot in shared memory, writers bump it around the
+// write and readers retry if it moved while they were copying the record. A writer
+// killed mid-write leaves its slot looking busy for good, so a reader that keeps
+// failing gives up after a bounded number of tries and reads under F_RDLCK; the dead
+// writer's record lock is gone with it.
+
+#define READ_PATH_REGION "readpath"
+#define SEQLOCK_SLOTS 65536 // slots are hashed by record position, a collision only costs a retry
+#define SEQLOCK_SPIN_LIMIT 64 // retries before a reader yields the CPU
+#define SEQLOCK_READ_ATTEMPTS 4096 // then the reader takes the record read lock instead
+
+struct RecordVersion {
+    unsigned int writers; // writes in flight on this slot
+    unsigned int version; // bumped at the start and end of every write
+};
+
+struct ReadPathRegion {
+    long long historyCommittedSize[ACCOUNT_SHARDS]; // bytes of each shard's active log made of complete records
+    unsigned int historyGeneration[ACCOUNT_SHARDS]; // odd while the shard's log is being sealed, see segment_ops.h
+    struct RecordVersion accountVersions[SEQLOCK_SLOTS];
+};
+
+struct ReadPathRegion *readPathRegion = NULL;
+
+void initReadPathRegion(void *region);
+struct ReadPathRegion *getReadPathRegion();
+void resetReadPathRegion();
+struct RecordVersion *accountVersionSlot(struct ReadPathRegion *readPath, int shard, off_t offset);
+void beginAccountWrite(int shard, off_t offset);
+void endAccountWrite(int shard, off_t offset);
+int writeAccountRecord(int dbFile, off_t offset, struct AccountHolder *account);
+off_t readAccountSnapshot(int dbFile, int accountID, struct AccountHolder *account);
+void publishHistoryCommitted(int shard, off_t endOffset);
+off_t committedHistorySize(int logFile, int shard);
+void stampLogEntry(struct TransactionLog *log, time_t now);
+int appendTransactionLog(int logFile, struct TransactionLog *log);
+int appendTransactionLogs(int logFile, struct TransactionLog *logs, int count);
+int writeLoanRecord(int loanFile, off_t offset, struct LoanRecord *loan);
+int commitAccountUpdate(int dbFile, off_t offset, struct AccountHolder *account, struct TransactionLog *log);
+long long pendingHotCredit(int accountID); // hot_ops.h
+int lockHistory(int shard); // segment_ops.h
+void unlockHistory(int logFile);
+
+void initReadPathRegion(void *region)
+{
+    struct ReadPathRegion *readPath = (struct ReadPathRegion *)region;
+    struct stat st;
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        int logFile = openShardFile(HISTORY_DB, shard, O_RDONLY);
+        if (logFile != -1 && fstat(logFile, &st) == 0) {
+            readPath->historyCommittedSize[shard] = (st.st_size / sizeof(struct TransactionLog)) * sizeof(struct TransactionLog);
+        }
+        if (logFile != -1) close(logFile);
+    }
+}
+
+// NULL means shared memory is unavailable and callers fall back to read locks
+struct ReadPathRegion *getReadPathRegion()
+{
+    if (readPathRegion == NULL) {
+        readPathRegion = attachSharedRegion(READ_PATH_REGION, sizeof(struct ReadPathRegion), initReadPathRegion);
+    }
+    return readPathRegion;
+}
+
+// rebuild the region from the files; children forked afterwards inherit the mapping
+void resetReadPathRegion()
+{
+    resetSharedRegion(READ_PATH_REGION);
+    readPathRegion = NULL;
+    getReadPathRegion();
+}
+
+struct RecordVersion *accountVersionSlot(struct ReadPathRegion *readPath, int shard, off_t offset)
+{
+    return &readPath->accountVersions[(offset / sizeof(struct AccountHolder) * ACCOUNT_SHARDS + shard) % SEQLOCK_SLOTS];
+}
+
+void beginAccountWrite(int shard, off_t offset)
+{
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return;
+    struct RecordVersion *slot = accountVersionSlot(readPath, shard, offset);
+    __atomic_fetch_add(&slot->writers, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&slot->version, 1, __ATOMIC_SEQ_CST);
+}
+
+void endAccountWrite(int shard, off_t offset)
+{
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return;
+    struct RecordVersion *slot = accountVersionSlot(readPath, shard, offset);
+    __atomic_fetch_add(&slot->version, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&slot->writers, 1, __ATOMIC_SEQ_CST);
+}
+
+// caller holds the record write lock; dbFile is the account's shard file
+int writeAccountRecord(int dbFile, off_t offset, struct AccountHolder *account)
+{
+    int shard = accountShard(account->accountID);
+    beginAccountWrite(shard, offset);
+    lseek(dbFile, offset, SEEK_SET);
+    int written = write(dbFile, account, sizeof(*account));
+    endAccountWrite(shard, offset);
+
+    if (written != sizeof(*account)) {
+        perror("writeAccountRecord: write failed");
+        return 0;
+    }
+    shipRecord(REPL_FILE_ACCOUNT, shard, offset, account, sizeof(*account));
+    return 1;
+}
+
+// the slow path of readAccountSnapshot: no shared memory, or a slot that stays busy
+static off_t readAccountLocked(int dbFile, int accountID, off_t offset, struct AccountHolder *account)
+{
+    struct flock lock = {F_RDLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+    fcntl(dbFile, F_SETLKW, &lock);
+    pread(dbFile, account, sizeof(*account), offset);
+    account->currentBalance += pendingHotCredit(accountID) / 100.0;
+    lock.l_type = F_UNLCK;
+    fcntl(dbFile, F_SETLK, &lock);
+    return offset;
+}
+
+// consistent copy of an account without locking. account IDs never change once written,
+// so the unlocked lookup of the position is safe; only the copy itself is validated.
+// a hot account's balance includes the credits not yet applied to its record.
+// returns the record offset, or -1 if not found
+off_t readAccountSnapshot(int dbFile, int accountID, struct AccountHolder *account)
+{
+    off_t offset = findAccountOffset(dbFile, accountID);
+    if (offset == -1) return -1;
+
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return readAccountLocked(dbFile, accountID, offset, account);
+
+    struct RecordVersion *slot = accountVersionSlot(readPath, accountShard(accountID), offset);
+    for (int attempts = 1; attempts <= SEQLOCK_READ_ATTEMPTS; attempts++) {
+        unsigned int versionBefore = __atomic_load_n(&slot->version, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&slot->writers, __ATOMIC_SEQ_CST) == 0 &&
+            pread(dbFile, account, sizeof(*account), offset) == sizeof(*account)) {
+            long long pending = pendingHotCredit(accountID); // inside the window, a flush moves it into the record
+            if (__atomic_load_n(&slot->writers, __ATOMIC_SEQ_CST) == 0 &&
+                __atomic_load_n(&slot->version, __ATOMIC_SEQ_CST) == versionBefore) {
+                account->currentBalance += pending / 100.0;
+                return offset;
+            }
+        }
+        if (attempts % SEQLOCK_SPIN_LIMIT == 0) sched_yield();
+    }
+    return readAccountLocked(dbFile, accountID, offset, account); // busy for too long, maybe a dead writer
+}
+
+void publishHistoryCommitted(int shard, off_t endOffset)
+{
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return;
+    long long committed = __atomic_load_n(&readPath->historyCommittedSize[shard], __ATOMIC_SEQ_CST);
+    while (endOffset > committed &&
+           !__atomic_compare_exchange_n(&readPath->historyCommittedSize[shard], &committed, (long long)endOffset, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+
+// how much of the log a lock free reader may look at: everything up to the last
+// fully written record
+off_t committedHistorySize(int logFile, int shard)
+{
+    off_t fileSize = lseek(logFile, 0, SEEK_END);
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return (fileSize / sizeof(struct TransactionLog)) * sizeof(struct TransactionLog);
+
+    off_t committed = __atomic_load_n(&readPath->historyCommittedSize[shard], __ATOMIC_SEQ_CST);
+    return committed < fileSize ? committed : fileSize;
+}
+
+// every entry ends in " at hh:mm:ss y-m-d". handlers fill it in before they prompt the
+// client, so it is rewritten with the commit time under the log lock: the log is then in
+// time order, which the day lookups of export_ops.h and audit_ops.h rely on
+void stampLogEntry(struct TransactionLog *log, time_t now)
+{
+    struct tm *localTime = localtime(&now);
+    char *at = NULL, *next = log->logEntry;
+    log->logEntry[sizeof(log->logEntry) - 1] = '\0';
+    while ((next = strstr(next, " at ")) != NULL) at = next++;
+    if (at == NULL) return;
+    snprintf(at, sizeof(log->logEntry) - (at - log->logEntry), " at %02d:%02d:%02d %d-%d-%d\n",
+             localTime->tm_hour, localTime->tm_min, localTime->tm_sec,
+             localTime->tm_year + 1900, localTime->tm_mon + 1, localTime->tm_mday);
+}
+
+// caller holds the whole file log lock; logFile is the account's shard log opened O_APPEND
+int appendTransactionLog(int logFile, struct TransactionLog *log)
+{
+    return appendTransactionLogs(logFile, log, 1);
+}
+
+// several records of one shard in a single write, same locking as appendTransactionLog
+int appendTransactionLogs(int logFile, struct TransactionLog *logs, int count)
+{
+    int shard = accountShard(logs[0].accountID);
+    ssize_t length = count * sizeof(*logs);
+    time_t now = time(NULL);
+    for (int i = 0; i < count; i++) stampLogEntry(&logs[i], now);
+    if (write(logFile, logs, length) != length) {
+        perror("appendTransactionLog: write failed");
+        return 0;
+    }
+    off_t endOffset = lseek(logFile, 0, SEEK_CUR);
+    shipRecord(REPL_FILE_HISTORY, shard, endOffset - length, logs, length);
+    publishHistoryCommitted(shard, endOffset);
+    return 1;
+}
+
+// offset -1 appends, caller holds the lock that serializes appends
+int writeLoanRecord(int loanFile, off_t offset, struct LoanRecord *loan)
+{
+    lseek(loanFile, offset == -1 ? 0 : offset, offset == -1 ? SEEK_END : SEEK_SET);
+    if (write(loanFile, loan, sizeof(*loan)) != sizeof(*loan)) {
+        perror("writeLoanRecord: write failed");
+        return 0;
+    }
+    if (offset == -1) offset = lseek(loanFile, 0, SEEK_CUR) - sizeof(*loan);
+    shipRecord(REPL_FILE_LOAN, 0, offset, loan, sizeof(*loan));
+    return 1;
+}
+
+// log append + account write-back for a balance change. caller holds the record write lock,
+// the shard's log lock is taken here and held until both writes are done.
+// returns 1 when both are written, 0 when only the record made it, -1 if the record failed
+int commitAccountUpdate(int dbFile, off_t offset, struct AccountHolder *account, struct TransactionLog *log)
+{
+    int shard = accountShard(account->accountID);
+    int logSlot = storageSlot(HISTORY_DB, shard);
+    int logFile = lockHistory(shard);
+    if (logFile == -1) {
+        perror("commitAccountUpdate: log unavailable");
+        return writeAccountRecord(dbFile, offset, account) ? 0 : -1;
+    }
+
+    stampLogEntry(log, time(NULL));
+    off_t logOffset = lseek(logFile, 0, SEEK_END);
+
+    struct StorageWrite writes[2] = {
+        {logSlot, log, sizeof(*log), logOffset},
+        {storageSlot(ACCOUNT_DB, shard), account, sizeof(*account), offset},
+    };
+    beginShipBatch(); // log entry and record reach the replica in one datagram
+    beginAccountWrite(shard, offset);
+    int done = submitLinkedWrites(writes, 2);
+    endAccountWrite(shard, offset);
+
+    int logged, recordWritten;
+    if (done == -1) { // posix path
+        logged = appendTransactionLog(logFile, log);
+        recordWritten = writeAccountRecord(dbFile, offset, account);
+    } else {
+        if (done >= 1) {
+            logged = 1;
+            shipRecord(REPL_FILE_HISTORY, shard, logOffset, log, sizeof(*log));
+            publishHistoryCommitted(shard, logOffset + sizeof(*log));
+        } else { // the log write failed and took the record with it: both go through posix
+            if (ftruncate(logFile, logOffset) == -1) perror("commitAccountUpdate: dropping a short log write failed");
+            logged = appendTransactionLog(logFile, log);
+        }
+        if (done == 2) shipRecord(REPL_FILE_ACCOUNT, shard, offset, account, sizeof(*account));
+        recordWritten = done == 2 || writeAccountRecord(dbFile, offset, account); // the link got cut, retry the record alone
+    }
+    endShipBatch();
+
+    unlockHistory(logFile);
+
+    if (!recordWritten) return -1;
+    return logged ? 1 : 0;
+}
+
+#endif
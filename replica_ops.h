@@ -0,0 +1,596 @@
+#ifndef REPLICA_OPS_H
+#define REPLICA_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define REPLICA_SOCKET_PATH "/tmp/bms_replica.sock" // primary ships records here
+#define REPLICA_DIR "replica_data" // replica's own copy of the .dat files
+#define REPLICA_PORT 8081 // read-only sessions
+#define REPLICA_STALE_PATH "/tmp/bms_replica.stale" // exists once a record was dropped since the base backup
+#define REPL_MAX_PAYLOAD 65536
+#define REPL_SEND_WAIT_MS 100 // how long a commit waits for room at a lagging replica before dropping
+
+// file types carried in a shipped record
+#define REPL_FILE_ACCOUNT 1
+#define REPL_FILE_LOAN 2
+#define REPL_FILE_HISTORY 3
+#define REPL_FILE_EMPLOYEE 4
+#define REPL_FILE_FEEDBACK_MESSAGES 5
+#define REPL_FILE_FEEDBACK_ENTRIES 6
+#define REPL_FILE_ADMIN_PASS 7 // the whole file, the replica cuts it to the payload
+#define REPL_FILE_TYPES 8
+#define REPL_OP_ROTATE_HISTORY 98 // control message, offset = the seq the primary sealed
+#define REPL_OP_PROMOTE 99 // control message, no payload
+
+// one record = header + payload. a datagram carries one or more records back to back
+struct ReplicationHeader {
+    int fileType;
+    int shard; // account and history records only, 0 otherwise
+    int length; // payload bytes
+    long long offset; // where the payload goes in the target file
+    long long shippedAt; // primary clock, microseconds
+};
+
+// shared between the replica apply loop and its read-only sessions
+struct ReplicationStatus {
+    long long appliedCount;
+    long long lastShippedAt;
+    long long lastAppliedAt;
+    long long lagMicros;
+};
+
+int replicaShipSocket = -1;
+int replicaShipConnected = 0;
+int replicaStale = 0; // this process found the marker, nothing is shipped until it is gone
+long long replicaDroppedCount = 0;
+char replicaBatch[sizeof(struct ReplicationHeader) + REPL_MAX_PAYLOAD]; // records not sent yet
+int replicaBatchBytes = 0;
+int replicaBatchDepth = 0;
+int replicaShipDisabled = 0; // benchmarks write scratch files that must not reach a replica
+struct ReplicationStatus *replicaStatus = NULL;
+
+int runPrimaryServer();
+void checkBalance(int clientSocket, int accountID); // customer_ops.h
+void viewTransactionLogs(int clientSocket, int accountID);
+void resetReadPathRegion(); // record_ops.h
+off_t readAccountSnapshot(int dbFile, int accountID, struct AccountHolder *account);
+void beginAccountWrite(int shard, off_t offset);
+void endAccountWrite(int shard, off_t offset);
+void publishHistoryCommitted(int shard, off_t endOffset);
+long long currentMicros();
+void markReplicaStale(const char *reason);
+void flushShipBatch();
+void beginShipBatch();
+void endShipBatch();
+void shipRecord(int fileType, int shard, off_t offset, const void *data, int length);
+int copyDatabaseFile(const char *fileName, const char *destDir);
+int copyLogSegments(int shard, const char *destDir); // segment_ops.h
+int applyLogRotation(int shard, int seq, int *logFile);
+int applyReplicationRecord(struct ReplicationHeader *header, char *payload, int fileDescriptors[][ACCOUNT_SHARDS]);
+int applyReplicationFrame(char *frame, int frameLen, int fileDescriptors[][ACCOUNT_SHARDS]);
+void rebuildLoanCounter();
+void indexFeedbackEntries(); // feedback_ops.h
+void handleReadOnlySession(int clientSocket);
+int sendPromoteCommand();
+int runReplicaServer();
+
+long long currentMicros()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// ======================= Primary side =======================
+
+// a dropped record leaves a hole only a new base backup can fill, so the replica refuses
+// promotion while this marker exists. it is removed when the replica takes its base backup.
+// the first drop of an outage creates it, later ones are only counted
+void markReplicaStale(const char *reason)
+{
+    char line[128];
+    replicaDroppedCount++;
+    replicaStale = 1;
+    int staleFile = open(REPLICA_STALE_PATH, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (staleFile == -1) {
+        if (errno != EEXIST) perror("Replication: Failed to mark replica stale");
+        return;
+    }
+    int len = snprintf(line, sizeof(line), "%lld dropped: %s\n", currentMicros(), reason);
+    write(staleFile, line, len);
+    close(staleFile);
+    printf("Replication: record dropped (%s), replica marked stale until its next base backup\n", reason);
+}
+
+// 0 when no replica is listening
+static int connectReplica()
+{
+    struct sockaddr_un replicaAddress;
+    if (replicaShipConnected) return 1;
+    if (replicaShipSocket == -1) {
+        replicaShipSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (replicaShipSocket == -1) {
+            perror("Replication: socket failed");
+            return 0;
+        }
+    }
+
+    // connected, so poll can tell when the replica's queue has room again
+    memset(&replicaAddress, 0, sizeof(replicaAddress));
+    replicaAddress.sun_family = AF_UNIX;
+    strncpy(replicaAddress.sun_path, REPLICA_SOCKET_PATH, sizeof(replicaAddress.sun_path) - 1);
+    if (connect(replicaShipSocket, (struct sockaddr *)&replicaAddress, sizeof(replicaAddress)) == -1) {
+        if (errno != ENOENT && errno != ECONNREFUSED) perror("Replication: connect failed");
+        return 0;
+    }
+    replicaShipConnected = 1;
+    return 1;
+}
+
+// sends the records gathered so far as one datagram. callers hold the record and history
+// locks, so a lagging replica is waited on for REPL_SEND_WAIT_MS at most
+void flushShipBatch()
+{
+    int frameLength = replicaBatchBytes;
+    replicaBatchBytes = 0;
+    if (frameLength == 0) return;
+    if (replicaStale) {
+        if (access(REPLICA_STALE_PATH, F_OK) == 0) { // still waiting for a new base backup
+            replicaDroppedCount++;
+            return;
+        }
+        replicaStale = 0;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!connectReplica()) return; // no replica running
+        if (send(replicaShipSocket, replicaBatch, frameLength, MSG_DONTWAIT) == frameLength) return;
+        if (errno == EAGAIN) {
+            struct pollfd room = {replicaShipSocket, POLLOUT, 0};
+            if (poll(&room, 1, REPL_SEND_WAIT_MS) == 1 &&
+                send(replicaShipSocket, replicaBatch, frameLength, MSG_DONTWAIT) == frameLength) return;
+            break;
+        }
+        if (errno != ECONNREFUSED) break;
+        replicaShipConnected = 0; // the replica restarted, its new socket has the same path
+    }
+    markReplicaStale(errno == EAGAIN ? "replica queue full" : strerror(errno));
+}
+
+// records shipped until the matching endShipBatch go out together. the batch has to end
+// before the locks that order its records are released
+void beginShipBatch()
+{
+    replicaBatchDepth++;
+}
+
+void endShipBatch()
+{
+    if (--replicaBatchDepth == 0) flushShipBatch();
+}
+
+// called right after a committed write; offset is the byte offset the data was written at.
+// data longer than REPL_MAX_PAYLOAD goes out as consecutive records
+void shipRecord(int fileType, int shard, off_t offset, const void *data, int length)
+{
+    struct ReplicationHeader header;
+    const char *payload = data;
+
+    if (replicaShipDisabled || length < 0) return;
+    do {
+        int piece = length < REPL_MAX_PAYLOAD ? length : REPL_MAX_PAYLOAD;
+        if (replicaBatchBytes + (int)sizeof(header) + piece > (int)sizeof(replicaBatch)) flushShipBatch();
+
+        header.fileType = fileType;
+        header.shard = shard;
+        header.length = piece;
+        header.offset = offset;
+        header.shippedAt = currentMicros();
+        memcpy(replicaBatch + replicaBatchBytes, &header, sizeof(header));
+        if (piece > 0) memcpy(replicaBatch + replicaBatchBytes + sizeof(header), payload, piece);
+        replicaBatchBytes += sizeof(header) + piece;
+
+        payload += piece;
+        offset += piece;
+        length -= piece;
+    } while (length > 0);
+    if (replicaBatchDepth == 0) flushShipBatch();
+}
+
+// ======================= Replica side =======================
+
+// base backup: copy a database file under a read lock so we never copy a half written record
+int copyDatabaseFile(const char *fileName, const char *destDir)
+{
+    char destPath[256], copyBuffer[8192];
+    int bytesRead;
+
+    snprintf(destPath, sizeof(destPath), "%s/%s", destDir, fileName);
+    int srcFile = open(fileName, O_RDONLY);
+    if (srcFile == -1) {
+        if (errno == ENOENT) return 1; // nothing to copy yet
+        perror("Replica: Error opening source file");
+        return 0;
+    }
+    int destFile = open(destPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (destFile == -1) {
+        perror("Replica: Error opening destination file");
+        close(srcFile);
+        return 0;
+    }
+
+    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(srcFile, F_SETLKW, &lock);
+    while ((bytesRead = read(srcFile, copyBuffer, sizeof(copyBuffer))) > 0) {
+        write(destFile, copyBuffer, bytesRead);
+    }
+    lock.l_type = F_UNLCK;
+    fcntl(srcFile, F_SETLK, &lock);
+
+    close(srcFile);
+    close(destFile);
+    return 1;
+}
+
+// writes are positional so a record applied twice (base backup + stream) is harmless
+int applyReplicationRecord(struct ReplicationHeader *header, char *payload, int fileDescriptors[][ACCOUNT_SHARDS])
+{
+    if ((header->fileType < REPL_FILE_ACCOUNT || header->fileType >= REPL_FILE_TYPES) && header->fileType != REPL_OP_ROTATE_HISTORY) return 0;
+    if (header->shard < 0 || header->shard >= ACCOUNT_SHARDS) {
+        printf("Replica: Record for shard %d ignored, primary runs with more shards\n", header->shard);
+        return 0;
+    }
+    // records after it go to the new active log, in the order they were shipped
+    if (header->fileType == REPL_OP_ROTATE_HISTORY) {
+        if (applyLogRotation(header->shard, header->offset, &fileDescriptors[REPL_FILE_HISTORY][header->shard])) return 1;
+        printf("Replica: Failed to seal segment %lld of shard %d\n", header->offset, header->shard);
+        return 0;
+    }
+
+    // keep the replica's own lock free readers consistent too
+    int fd = fileDescriptors[header->fileType][header->shard];
+    if (fd == -1) return 0;
+    if (header->fileType == REPL_FILE_ACCOUNT) beginAccountWrite(header->shard, header->offset);
+    int written = pwrite(fd, payload, header->length, header->offset);
+    if (header->fileType == REPL_FILE_ACCOUNT) endAccountWrite(header->shard, header->offset);
+    if (written != header->length) {
+        perror("Replica: Apply failed");
+        return 0;
+    }
+    if (header->fileType == REPL_FILE_HISTORY) publishHistoryCommitted(header->shard, header->offset + header->length);
+    if (header->fileType == REPL_FILE_ADMIN_PASS) ftruncate(fd, header->offset + header->length);
+
+    long long now = currentMicros();
+    replicaStatus->appliedCount++;
+    replicaStatus->lastShippedAt = header->shippedAt;
+    replicaStatus->lastAppliedAt = now;
+    replicaStatus->lagMicros = now - header->shippedAt;
+    return 1;
+}
+
+// every record of one datagram, in order. returns how many were applied
+int applyReplicationFrame(char *frame, int frameLen, int fileDescriptors[][ACCOUNT_SHARDS])
+{
+    struct ReplicationHeader header;
+    int applied = 0;
+
+    while (frameLen >= (int)sizeof(header)) {
+        memcpy(&header, frame, sizeof(header));
+        if (header.length < 0 || header.length > frameLen - (int)sizeof(header)) {
+            printf("Replica: Truncated record ignored (type %d)\n", header.fileType);
+            break;
+        }
+        applied += applyReplicationRecord(&header, frame + sizeof(header), fileDescriptors);
+        frame += sizeof(header) + header.length;
+        frameLen -= sizeof(header) + header.length;
+    }
+    return applied;
+}
+
+// loan ids are not shipped, so derive the next one from the replicated loans on promotion
+void rebuildLoanCounter()
+{
+    struct LoanRecord loan;
+    struct IDGenerator idGen;
+    idGen.nextID = 1;
+
+    int loanFile = open(LOAN_DB, O_RDONLY);
+    if (loanFile != -1) {
+        while (read(loanFile, &loan, sizeof(loan)) == sizeof(loan)) {
+            if (loan.loanRecordID >= idGen.nextID) idGen.nextID = loan.loanRecordID + 1;
+        }
+        close(loanFile);
+    }
+
+    int counterFile = open(LOAN_COUNTER_DB, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (counterFile == -1) {
+        perror("Promote: Failed to write loan counter");
+        return;
+    }
+    write(counterFile, &idGen, sizeof(idGen));
+    close(counterFile);
+    printf("Promote: next loan ID set to %d\n", idGen.nextID);
+}
+
+// read-only menu served by the replica, no session semaphore since nothing is written
+void handleReadOnlySession(int clientSocket)
+{
+    struct AccountHolder account;
+    int accountID, choice, loggedIn = 0;
+    char password[50];
+
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "\nEnter account number: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+    if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    accountID = atoi(inBuffer);
+
+    bzero(outBuffer, sizeof(outBuffer));
+    strcpy(outBuffer, "Enter password: ");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    bzero(inBuffer, sizeof(inBuffer));
+    if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) return;
+    inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+    strncpy(password, inBuffer, sizeof(password) - 1);
+    password[sizeof(password)-1] = '\0';
+
+    int dbFile = accountHandle(accountID);
+    if (dbFile != -1 && readAccountSnapshot(dbFile, accountID, &account) != -1 &&
+        account.isActive == 1 && checkCredentials(LOGIN_CUSTOMER, accountID, password, account.password)) {
+        loggedIn = 1;
+    }
+
+    if (!loggedIn) {
+        bzero(outBuffer, sizeof(outBuffer));
+        strcpy(outBuffer, "\nInvalid ID, Password, or Inactive Account^");
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        terminateClientSession(clientSocket, 0);
+        return;
+    }
+
+    while (1)
+    {
+        bzero(outBuffer, sizeof(outBuffer));
+        strcpy(outBuffer, REPLICA_PROMPT);
+        write(clientSocket, outBuffer, strlen(outBuffer));
+        bzero(inBuffer, sizeof(inBuffer));
+        if (readClient(clientSocket, inBuffer, sizeof(inBuffer)-1) <= 0) {
+            printf("Read-only client %d disconnected.\n", accountID);
+            return;
+        }
+        inBuffer[strcspn(inBuffer, "\r\n")] = 0;
+        choice = atoi(inBuffer);
+
+        switch (choice)
+        {
+            case 1:
+                checkBalance(clientSocket, accountID);
+                break;
+            case 2:
+                viewTransactionLogs(clientSocket, accountID);
+                break;
+            case 3:
+                bzero(outBuffer, sizeof(outBuffer));
+                if (access(REPLICA_STALE_PATH, F_OK) == 0) {
+                    strcpy(outBuffer, "Replica is stale: records were dropped since the base backup.\nRestart it with --replica to take a new one.^");
+                } else if (replicaStatus->appliedCount == 0) {
+                    strcpy(outBuffer, "No records received from primary yet.^");
+                } else {
+                    sprintf(outBuffer, "Records applied: %lld\nApply lag: %.3f ms\nLast record applied %.1f s ago^",
+                            replicaStatus->appliedCount, replicaStatus->lagMicros / 1000.0,
+                            (currentMicros() - replicaStatus->lastAppliedAt) / 1000000.0);
+                }
+                write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+                break;
+            case 4:
+                terminateClientSession(clientSocket, 0);
+                return;
+            default:
+                bzero(outBuffer, sizeof(outBuffer));
+                strcpy(outBuffer, "Invalid Choice^");
+                write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        }
+    }
+}
+
+// ./server --promote : tell the running replica to take over as primary
+int sendPromoteCommand()
+{
+    struct ReplicationHeader header = {REPL_OP_PROMOTE, 0, 0, 0, 0};
+    header.shippedAt = currentMicros();
+    struct sockaddr_un replicaAddress;
+
+    if (access(REPLICA_STALE_PATH, F_OK) == 0) {
+        printf("Promote: Replica is stale (see %s), restart it with --replica for a new base backup first.\n", REPLICA_STALE_PATH);
+        return EXIT_FAILURE;
+    }
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        perror("Promote: socket failed");
+        return EXIT_FAILURE;
+    }
+    memset(&replicaAddress, 0, sizeof(replicaAddress));
+    replicaAddress.sun_family = AF_UNIX;
+    strncpy(replicaAddress.sun_path, REPLICA_SOCKET_PATH, sizeof(replicaAddress.sun_path) - 1);
+
+    if (sendto(sock, &header, sizeof(header), 0, (struct sockaddr *)&replicaAddress, sizeof(replicaAddress)) == -1) {
+        perror("Promote: No replica reachable");
+        close(sock);
+        return EXIT_FAILURE;
+    }
+    close(sock);
+    printf("Promote command sent to replica.\n");
+    return EXIT_SUCCESS;
+}
+
+// ./server --replica : base backup of the primary's files, then apply shipped records
+// and serve read-only sessions until promoted
+int runReplicaServer()
+{
+    struct sockaddr_un shipAddress;
+    struct sockaddr_in serverAddress, clientAddress;
+    socklen_t clientAddrSize;
+    static char frame[sizeof(struct ReplicationHeader) + REPL_MAX_PAYLOAD];
+    int fileDescriptors[REPL_FILE_TYPES][ACCOUNT_SHARDS];
+    char shardFile[SHARD_PATH_SIZE], shardDir[SHARD_PATH_SIZE + 16];
+
+    // bind before the base backup so nothing shipped during the copy is lost
+    int shipSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (shipSocket == -1) {
+        perror("Replica: socket failed");
+        return EXIT_FAILURE;
+    }
+    unlink(REPLICA_SOCKET_PATH);
+    memset(&shipAddress, 0, sizeof(shipAddress));
+    shipAddress.sun_family = AF_UNIX;
+    strncpy(shipAddress.sun_path, REPLICA_SOCKET_PATH, sizeof(shipAddress.sun_path) - 1);
+    if (bind(shipSocket, (struct sockaddr *)&shipAddress, sizeof(shipAddress)) == -1) {
+        perror("Replica: bind of shipping socket failed");
+        close(shipSocket);
+        return EXIT_FAILURE;
+    }
+    chmod(REPLICA_SOCKET_PATH, 0666);
+
+    // anything dropped from here on is caught by the stale marker, earlier drops by the backup
+    unlink(REPLICA_STALE_PATH);
+    mkdir(REPLICA_DIR, 0755);
+    int backupOK = copyDatabaseFile(LOAN_DB, REPLICA_DIR) && copyDatabaseFile(EMPLOYEE_DB, REPLICA_DIR) &&
+                   copyDatabaseFile(FEEDBACK_MESSAGES_DB, REPLICA_DIR) && copyDatabaseFile(FEEDBACK_ENTRIES_DB, REPLICA_DIR) &&
+                   copyDatabaseFile(FEEDBACK_INDEX_DB, REPLICA_DIR) && copyDatabaseFile(ADMIN_PASS_DB, REPLICA_DIR);
+    for (int shard = 0; backupOK && shard < ACCOUNT_SHARDS; shard++) {
+        if (ACCOUNT_SHARDS > 1) {
+            snprintf(shardDir, sizeof(shardDir), "%s/" SHARD_DIR_FORMAT, REPLICA_DIR, shard);
+            mkdir(shardDir, 0755);
+        }
+        shardPath(ACCOUNT_DB, shard, shardFile);
+        backupOK = copyDatabaseFile(shardFile, REPLICA_DIR);
+        backupOK = backupOK && copyLogSegments(shard, REPLICA_DIR);
+    }
+    if (!backupOK) {
+        printf("Replica: Base backup failed\n");
+        close(shipSocket);
+        unlink(REPLICA_SOCKET_PATH);
+        return EXIT_FAILURE;
+    }
+    if (chdir(REPLICA_DIR) == -1) {
+        perror("Replica: chdir failed");
+        return EXIT_FAILURE;
+    }
+    printf("Replica: Base backup copied into %s\n", REPLICA_DIR);
+
+    // separate shared memory namespace so a replica on the same host never touches the primary's
+    strcpy(shmPrefix, SHM_PREFIX "_replica");
+    resetAccountIndex();
+    resetReadPathRegion();
+    resetLoginCache();
+
+    for (int fileType = 0; fileType < REPL_FILE_TYPES; fileType++) {
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) fileDescriptors[fileType][shard] = -1;
+    }
+    fileDescriptors[REPL_FILE_LOAN][0] = open(LOAN_DB, O_RDWR | O_CREAT, 0644);
+    fileDescriptors[REPL_FILE_EMPLOYEE][0] = open(EMPLOYEE_DB, O_RDWR | O_CREAT, 0644);
+    fileDescriptors[REPL_FILE_FEEDBACK_MESSAGES][0] = open(FEEDBACK_MESSAGES_DB, O_RDWR | O_CREAT, 0644);
+    fileDescriptors[REPL_FILE_FEEDBACK_ENTRIES][0] = open(FEEDBACK_ENTRIES_DB, O_RDWR | O_CREAT, 0644);
+    fileDescriptors[REPL_FILE_ADMIN_PASS][0] = open(ADMIN_PASS_DB, O_RDWR | O_CREAT, 0644);
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        fileDescriptors[REPL_FILE_ACCOUNT][shard] = openShardFile(ACCOUNT_DB, shard, O_RDWR | O_CREAT);
+        fileDescriptors[REPL_FILE_HISTORY][shard] = openShardFile(HISTORY_DB, shard, O_RDWR | O_CREAT);
+    }
+
+    // anonymous shared mapping so forked read-only sessions see the live lag
+    replicaStatus = mmap(NULL, sizeof(struct ReplicationStatus), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (replicaStatus == MAP_FAILED) {
+        perror("Replica: mmap failed");
+        return EXIT_FAILURE;
+    }
+    memset(replicaStatus, 0, sizeof(struct ReplicationStatus));
+
+    int serverSocketFD = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(serverSocketFD, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(REPLICA_PORT);
+    if (bind(serverSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) == -1 ||
+        listen(serverSocketFD, 10) == -1) {
+        perror("Replica: read-only listener failed");
+        close(serverSocketFD);
+        return EXIT_FAILURE;
+    }
+    printf("Replica: Read-only sessions on port %d, applying records from %s\n", REPLICA_PORT, REPLICA_SOCKET_PATH);
+
+    setupSignalHandlers();
+    struct pollfd pollSet[2] = {{shipSocket, POLLIN, 0}, {serverSocketFD, POLLIN, 0}};
+    int promoted = 0;
+
+    while (!promoted)
+    {
+        while (waitpid(-1, NULL, WNOHANG) > 0); // reap finished read-only sessions
+
+        if (poll(pollSet, 2, 1000) <= 0) continue;
+
+        if (pollSet[0].revents & POLLIN) {
+            // drain everything queued before checking the listener again
+            int frameLen;
+            while ((frameLen = recv(shipSocket, frame, sizeof(frame), MSG_DONTWAIT)) > 0) {
+                struct ReplicationHeader *header = (struct ReplicationHeader *)frame;
+                if (frameLen >= (int)sizeof(struct ReplicationHeader) && header->fileType == REPL_OP_PROMOTE) {
+                    if (access(REPLICA_STALE_PATH, F_OK) == 0) {
+                        printf("Replica: Promotion refused, records were dropped since the base backup. Restart with --replica.\n");
+                        continue;
+                    }
+                    promoted = 1;
+                    break;
+                }
+                applyReplicationFrame(frame, frameLen, fileDescriptors);
+            }
+        }
+
+        if (!promoted && (pollSet[1].revents & POLLIN)) {
+            clientAddrSize = sizeof(clientAddress);
+            int clientSocketFD = accept(serverSocketFD, (struct sockaddr *)&clientAddress, &clientAddrSize);
+            if (clientSocketFD == -1) continue;
+
+            pid_t childPid = fork();
+            if (childPid == 0) {
+                close(serverSocketFD);
+                close(shipSocket);
+                printf("Read-only client connected. FD: %d, Process ID: %d\n", clientSocketFD, getpid());
+                handleReadOnlySession(clientSocketFD);
+                close(clientSocketFD);
+                exit(EXIT_SUCCESS);
+            }
+            close(clientSocketFD);
+        }
+    }
+
+    printf("Replica: Promotion requested after %lld applied records, taking over as primary.\n", replicaStatus->appliedCount);
+    close(serverSocketFD);
+    close(shipSocket);
+    unlink(REPLICA_SOCKET_PATH);
+    for (int fileType = 0; fileType < REPL_FILE_TYPES; fileType++) {
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            if (fileDescriptors[fileType][shard] != -1) close(fileDescriptors[fileType][shard]);
+        }
+    }
+    rebuildLoanCounter();
+    indexFeedbackEntries(); // the index isn't shipped, catch it up from the shipped entries
+
+    return runPrimaryServer();
+}
+
+#endif
@@ -0,0 +1,547 @@
+#ifndef SEGMENT_OPS_H
+#define SEGMENT_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Time segmented transaction logs. HISTORY_DB is only the active segment of its shard.
+// A maintainer process seals it once it holds an earlier day than today or has grown
+// past --log-segment-mb: the file is renamed to transaction_logs.<seq>.dat and a fresh
+// one takes its place. Each shard keeps a manifest of its sealed segments, oldest first,
+// with their record count and first and last day. Sealing happens under the log's
+// write lock, with the shard's history generation odd, so writers that were waiting
+// on the lock notice it and reopen the new file (lockHistory), and readers retry a
+// snapshot that straddled it (loadLogSegments). Sealed segments whose last day is
+// more than --log-retain-days old are archived: compressed a block of records at a time
+// into transaction_logs.<seq>.arc (see archive_ops.h), and the .dat removed. Nothing is
+// ever deleted, the logs are the record of every balance. History pages, audits,
+// statements and the reconciliation run read sealed and archived segments too.
+// The replica seals its own copy when the primary ships the rotation.
+//
+// ./server [mode] --log-segment-mb n --log-retain-days n
+
+#define SEGMENT_MANIFEST_DB "log_manifest.dat"
+#define SEGMENT_FILE_FORMAT "transaction_logs.%06d.dat"
+#define SEGMENT_ARCHIVE_FORMAT "transaction_logs.%06d.arc"
+#define SEGMENT_MANIFEST_MAGIC 0x4d534d42 // "BMSM"
+#define SEGMENT_SIZE_MB 64    // 0 = daily only
+#define SEGMENT_RETAIN_DAYS 7 // sealed segments stay uncompressed this long
+#define SEGMENT_CHECK_SECONDS 5
+#define SEGMENT_SCAN_BATCH 64 // records per pread when a sealed log's days are read
+
+#define SEGMENT_ACTIVE 0
+#define SEGMENT_SEALED 1
+#define SEGMENT_ARCHIVED 2
+
+struct SegmentManifestHeader {
+    int magic;
+    int activeSeq; // seq the active segment gets when it is sealed
+};
+
+// manifest entries follow the header, oldest first
+struct LogSegment {
+    int seq;
+    int state;
+    int firstDay, lastDay; // yyyymmdd, 0 for the active segment
+    long long records;
+};
+
+// a consistent view of one shard's log: the manifest's segments then the active one
+struct LogSegmentSet {
+    int shard;
+    int count;
+    struct LogSegment *segments;
+    int activeFD; // opened in the same generation as the manifest was read
+};
+
+long long segmentMaxBytes = (long long)SEGMENT_SIZE_MB * 1024 * 1024;
+int segmentRetainDays = SEGMENT_RETAIN_DAYS;
+pid_t logMaintainerPid = 0;
+
+void parseSegmentOptions(int argc, char *argv[]);
+unsigned int historyGeneration(int shard);
+int lockHistory(int shard);
+void unlockHistory(int logFile);
+int logRecordDay(int logFile, off_t recordNumber);
+void logDayRange(int logFile, off_t records, int *firstDay, int *lastDay);
+int dayKeyDaysAgo(int days);
+int readSegmentManifest(int shard, int manifestFile, struct SegmentManifestHeader *header, struct LogSegment **segments, int *count);
+int activeLogSeq(int shard);
+int loadLogSegments(int shard, struct LogSegmentSet *set);
+void freeLogSegments(struct LogSegmentSet *set);
+int openLogSegment(struct LogSegmentSet *set, int index);
+int sealActiveSegment(int shard, int logFile);
+int rotateLogSegment(int shard);
+int archiveLogSegment(int shard, struct LogSegment *segment);
+int archiveExpiredSegments(int shard);
+int applyLogRotation(int shard, int seq, int *logFile);
+int copyLogSegments(int shard, const char *destDir);
+void recoverLogSegments();
+void startLogMaintainer(int serverSocketFD);
+int writeSegmentArchive(int shard, struct LogSegment *segment, const char *path); // archive_ops.h
+int logEntryDay(const char *text, size_t length); // audit_ops.h
+
+void parseSegmentOptions(int argc, char *argv[])
+{
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--log-segment-mb") == 0) segmentMaxBytes = atoll(argv[i + 1]) * 1024 * 1024;
+        else if (strcmp(argv[i], "--log-retain-days") == 0) segmentRetainDays = atoi(argv[i + 1]);
+    }
+    if (segmentMaxBytes < 0) segmentMaxBytes = 0;
+    if (segmentRetainDays < 0) segmentRetainDays = SEGMENT_RETAIN_DAYS;
+}
+
+// bumped to odd when a seal starts and to even when it is done. 0 without shared
+// memory, and then nothing is ever sealed
+unsigned int historyGeneration(int shard)
+{
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    if (readPath == NULL) return 0;
+    return __atomic_load_n(&readPath->historyGeneration[shard], __ATOMIC_SEQ_CST);
+}
+
+// the shard's active log, write locked. a seal that went through while we waited for the
+// lock leaves us holding the old file: let go and lock the new one. -1 if it can't be opened
+int lockHistory(int shard)
+{
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    while (1) {
+        int logFile = databaseHandle(HANDLE_HISTORY, shard);
+        if (logFile == -1) return -1;
+        fcntl(logFile, F_SETLKW, &lock);
+        if (handleCache.historyGenerations[shard] == historyGeneration(shard)) return logFile;
+        lock.l_type = F_UNLCK;
+        fcntl(logFile, F_SETLK, &lock);
+        lock.l_type = F_WRLCK;
+    }
+}
+
+void unlockHistory(int logFile)
+{
+    struct flock lock = {F_UNLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(logFile, F_SETLK, &lock);
+}
+
+// yyyymmdd from the "... at hh:mm:ss y-m-d" tail every log entry ends with, 0 if unreadable
+int logRecordDay(int logFile, off_t recordNumber)
+{
+    struct TransactionLog log;
+    int hour, minute, second, year, month, day;
+    if (pread(logFile, &log, sizeof(log), recordNumber * sizeof(log)) != sizeof(log)) return 0;
+    log.logEntry[sizeof(log.logEntry) - 1] = '\0';
+
+    char *at = NULL, *next = log.logEntry;
+    while ((next = strstr(next, " at ")) != NULL) at = next++;
+    if (at == NULL || sscanf(at, " at %d:%d:%d %d-%d-%d", &hour, &minute, &second, &year, &month, &day) != 6) return 0;
+    return year * 10000 + month * 100 + day;
+}
+
+// earliest and latest day of a log, 0 for both if none is readable. every record is read:
+// entries written before they were stamped at commit time can be out of order
+void logDayRange(int logFile, off_t records, int *firstDay, int *lastDay)
+{
+    static struct TransactionLog batch[SEGMENT_SCAN_BATCH];
+    *firstDay = *lastDay = 0;
+    for (off_t record = 0; record < records; record += SEGMENT_SCAN_BATCH) {
+        ssize_t got = pread(logFile, batch, sizeof(batch), record * sizeof(struct TransactionLog));
+        if (got <= 0) break;
+        for (int i = 0; i < got / (ssize_t)sizeof(struct TransactionLog) && record + i < records; i++) {
+            int day = logEntryDay(batch[i].logEntry, strnlen(batch[i].logEntry, sizeof(batch[i].logEntry)));
+            if (day != 0 && (*firstDay == 0 || day < *firstDay)) *firstDay = day;
+            if (day > *lastDay) *lastDay = day;
+        }
+    }
+}
+
+int dayKeyDaysAgo(int days)
+{
+    time_t then = time(NULL) - (time_t)days * 86400;
+    struct tm *localTime = localtime(&then);
+    return (localTime->tm_year + 1900) * 10000 + (localTime->tm_mon + 1) * 100 + localTime->tm_mday;
+}
+
+static void segmentFilePath(int shard, int seq, const char *format, char *path)
+{
+    char name[SHARD_NAME_SIZE];
+    snprintf(name, sizeof(name), format, seq);
+    shardPath(name, shard, path);
+}
+
+// segments is malloc'd, caller frees. a shard that never sealed anything has no manifest
+// yet. manifestFile -1 opens the shard's own; a caller holding the manifest lock passes
+// its descriptor, since closing another one would drop the lock
+int readSegmentManifest(int shard, int manifestFile, struct SegmentManifestHeader *header, struct LogSegment **segments, int *count)
+{
+    struct stat st;
+    int ok = 0, opened = manifestFile == -1;
+    header->magic = SEGMENT_MANIFEST_MAGIC;
+    header->activeSeq = 1;
+    *segments = NULL;
+    *count = 0;
+
+    if (opened) manifestFile = openShardFile(SEGMENT_MANIFEST_DB, shard, O_RDONLY);
+    if (manifestFile == -1) return errno == ENOENT;
+    if (fstat(manifestFile, &st) == 0 && st.st_size == 0) {
+        ok = 1; // created by a seal that is writing its first entry
+    } else if (fstat(manifestFile, &st) == 0 && pread(manifestFile, header, sizeof(*header), 0) == sizeof(*header) &&
+               header->magic == SEGMENT_MANIFEST_MAGIC) {
+        *count = (st.st_size - sizeof(*header)) / sizeof(struct LogSegment);
+        *segments = malloc((*count + 1) * sizeof(struct LogSegment)); // room for the active one
+        ok = *segments != NULL &&
+             pread(manifestFile, *segments, *count * sizeof(struct LogSegment), sizeof(*header)) == (ssize_t)(*count * sizeof(struct LogSegment));
+    }
+    if (!ok) {
+        printf("Segments: manifest of shard %d unreadable\n", shard);
+        free(*segments);
+        *segments = NULL;
+        *count = 0;
+    }
+    if (opened) close(manifestFile);
+    return ok;
+}
+
+int activeLogSeq(int shard)
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments;
+    int count;
+    readSegmentManifest(shard, -1, &header, &segments, &count);
+    free(segments);
+    return header.activeSeq;
+}
+
+// manifest and active log as of one generation, so a seal in between never shows a
+// segment twice or not at all. 0 if the manifest can't be read
+int loadLogSegments(int shard, struct LogSegmentSet *set)
+{
+    struct SegmentManifestHeader header;
+    memset(set, 0, sizeof(*set));
+    set->shard = shard;
+
+    while (1) {
+        unsigned int generation = historyGeneration(shard);
+        if (generation & 1) {
+            usleep(1000);
+            continue;
+        }
+        if (!readSegmentManifest(shard, -1, &header, &set->segments, &set->count)) return 0;
+        if (set->segments == NULL) set->segments = malloc(sizeof(struct LogSegment));
+        set->activeFD = openShardFile(HISTORY_DB, shard, O_RDONLY);
+        off_t size = set->activeFD == -1 ? 0 : committedHistorySize(set->activeFD, shard);
+        if (historyGeneration(shard) == generation && set->segments != NULL) {
+            struct LogSegment *active = &set->segments[set->count++];
+            memset(active, 0, sizeof(*active));
+            active->seq = header.activeSeq;
+            active->state = SEGMENT_ACTIVE;
+            active->records = size / sizeof(struct TransactionLog);
+            return 1;
+        }
+        if (set->activeFD != -1) close(set->activeFD);
+        free(set->segments);
+        if (historyGeneration(shard) == generation) return 0; // out of memory
+    }
+}
+
+void freeLogSegments(struct LogSegmentSet *set)
+{
+    if (set->activeFD > 0) close(set->activeFD);
+    free(set->segments);
+    memset(set, 0, sizeof(*set));
+}
+
+// descriptor of a plain segment of the set, caller closes it. only read past records
+// instead of the file size: a sealed file may end in a torn record. -1 for an archived
+// segment, including one archived since the set was loaded
+int openLogSegment(struct LogSegmentSet *set, int index)
+{
+    char path[SHARD_PATH_SIZE];
+    struct LogSegment *segment = &set->segments[index];
+    if (segment->state == SEGMENT_ACTIVE) return set->activeFD == -1 ? -1 : dup(set->activeFD);
+    if (segment->state == SEGMENT_ARCHIVED) return -1;
+    segmentFilePath(set->shard, segment->seq, SEGMENT_FILE_FORMAT, path);
+    return open(path, O_RDONLY);
+}
+
+// seals the shard's active log into the next segment. caller holds its write lock, or is
+// the only writer (replica). the caller's descriptor then belongs to the sealed file.
+// returns the sealed seq, 0 if there was nothing to seal or it failed
+int sealActiveSegment(int shard, int logFile)
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments, segment;
+    char activePath[SHARD_PATH_SIZE], sealedPath[SHARD_PATH_SIZE];
+    int count;
+
+    struct ReadPathRegion *readPath = getReadPathRegion();
+    off_t size = lseek(logFile, 0, SEEK_END);
+    if (readPath == NULL || size < (off_t)sizeof(struct TransactionLog)) return 0;
+
+    int manifestFile = openShardFile(SEGMENT_MANIFEST_DB, shard, O_RDWR | O_CREAT);
+    if (manifestFile == -1) {
+        perror("Segments: Error opening manifest");
+        return 0;
+    }
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(manifestFile, F_SETLKW, &lock);
+    if (!readSegmentManifest(shard, manifestFile, &header, &segments, &count)) {
+        close(manifestFile); // drops the lock
+        return 0;
+    }
+    free(segments);
+
+    memset(&segment, 0, sizeof(segment));
+    segment.seq = header.activeSeq;
+    segment.state = SEGMENT_SEALED;
+    segment.records = size / sizeof(struct TransactionLog);
+    logDayRange(logFile, segment.records, &segment.firstDay, &segment.lastDay);
+    fdatasync(logFile);
+
+    shardPath(HISTORY_DB, shard, activePath);
+    segmentFilePath(shard, segment.seq, SEGMENT_FILE_FORMAT, sealedPath);
+    __atomic_fetch_add(&readPath->historyGeneration[shard], 1, __ATOMIC_SEQ_CST);
+    int sealed = rename(activePath, sealedPath) == 0;
+    if (!sealed) {
+        perror("Segments: Error sealing log");
+    } else {
+        // a crash between the rename and the manifest is finished by recoverLogSegments
+        off_t entryOffset = sizeof(header) + (off_t)count * sizeof(segment);
+        header.magic = SEGMENT_MANIFEST_MAGIC;
+        header.activeSeq = segment.seq + 1;
+        if (pwrite(manifestFile, &segment, sizeof(segment), entryOffset) != sizeof(segment) ||
+            fdatasync(manifestFile) == -1 || pwrite(manifestFile, &header, sizeof(header), 0) != sizeof(header) ||
+            fdatasync(manifestFile) == -1) {
+            perror("Segments: Error writing manifest");
+        }
+        int freshLog = openShardFile(HISTORY_DB, shard, O_RDWR | O_CREAT);
+        if (freshLog != -1) close(freshLog);
+        __atomic_store_n(&readPath->historyCommittedSize[shard], 0, __ATOMIC_SEQ_CST);
+    }
+    __atomic_fetch_add(&readPath->historyGeneration[shard], 1, __ATOMIC_SEQ_CST);
+
+    lock.l_type = F_UNLCK;
+    fcntl(manifestFile, F_SETLK, &lock);
+    close(manifestFile);
+    return sealed ? segment.seq : 0;
+}
+
+// seal once the active log holds an earlier day than today or has outgrown the size limit
+int rotateLogSegment(int shard)
+{
+    int logFile = lockHistory(shard);
+    if (logFile == -1) return 0;
+
+    int sealed = 0;
+    off_t size = lseek(logFile, 0, SEEK_END);
+    int firstDay = logRecordDay(logFile, 0);
+    if (size >= (off_t)sizeof(struct TransactionLog) &&
+        ((segmentMaxBytes > 0 && size >= segmentMaxBytes) || (firstDay != 0 && firstDay < dayKeyDaysAgo(0)))) {
+        sealed = sealActiveSegment(shard, logFile);
+        if (sealed) {
+            shipRecord(REPL_OP_ROTATE_HISTORY, shard, sealed, NULL, 0);
+            printf("Segments: shard %d log sealed as segment %d (%lld bytes)\n", shard, sealed, (long long)size);
+        }
+    }
+    unlockHistory(logFile);
+    return sealed;
+}
+
+static int setSegmentState(int shard, int seq, int state)
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments;
+    int count, done = 0;
+
+    int manifestFile = openShardFile(SEGMENT_MANIFEST_DB, shard, O_RDWR);
+    if (manifestFile == -1) return 0;
+    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, getpid()};
+    fcntl(manifestFile, F_SETLKW, &lock);
+    if (readSegmentManifest(shard, manifestFile, &header, &segments, &count)) {
+        for (int i = 0; i < count; i++) {
+            if (segments[i].seq != seq) continue;
+            segments[i].state = state;
+            off_t entryOffset = sizeof(header) + (off_t)i * sizeof(segments[i]);
+            done = pwrite(manifestFile, &segments[i], sizeof(segments[i]), entryOffset) == sizeof(segments[i]) &&
+                   fdatasync(manifestFile) == 0;
+        }
+        free(segments);
+    }
+    lock.l_type = F_UNLCK;
+    fcntl(manifestFile, F_SETLK, &lock);
+    close(manifestFile);
+    return done;
+}
+
+// rewrite a sealed segment as a compressed archive, then drop the .dat. 1 once archived
+int archiveLogSegment(int shard, struct LogSegment *segment)
+{
+    char sealedPath[SHARD_PATH_SIZE], archivePath[SHARD_PATH_SIZE], tempPath[SHARD_PATH_SIZE + 8];
+
+    segmentFilePath(shard, segment->seq, SEGMENT_FILE_FORMAT, sealedPath);
+    segmentFilePath(shard, segment->seq, SEGMENT_ARCHIVE_FORMAT, archivePath);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", archivePath);
+
+    // the archive is complete before the manifest says so, and the manifest before the
+    // .dat goes. a reader that still has the .dat open keeps reading it
+    if (!writeSegmentArchive(shard, segment, tempPath) || rename(tempPath, archivePath) == -1 ||
+        !setSegmentState(shard, segment->seq, SEGMENT_ARCHIVED)) {
+        perror("Segments: Error archiving segment");
+        unlink(tempPath);
+        return 0;
+    }
+    unlink(sealedPath);
+    segment->state = SEGMENT_ARCHIVED;
+    return 1;
+}
+
+// the retention policy: sealed segments with nothing newer than --log-retain-days are archived
+int archiveExpiredSegments(int shard)
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments;
+    int count, archived = 0;
+    int oldestKept = dayKeyDaysAgo(segmentRetainDays);
+
+    if (!readSegmentManifest(shard, -1, &header, &segments, &count)) return 0;
+    for (int i = 0; i < count; i++) {
+        if (segments[i].state != SEGMENT_SEALED || segments[i].lastDay >= oldestKept) continue;
+        if (!archiveLogSegment(shard, &segments[i])) break;
+        printf("Segments: shard %d segment %d archived (%lld records up to %d)\n",
+               shard, segments[i].seq, segments[i].records, segments[i].lastDay);
+        archived++;
+    }
+    free(segments);
+    return archived;
+}
+
+// replica side of a shipped rotation. a base backup taken after the primary sealed
+// already has the segment, then there is nothing to do
+int applyLogRotation(int shard, int seq, int *logFile)
+{
+    if (activeLogSeq(shard) != seq) return 1;
+    if (sealActiveSegment(shard, *logFile) != seq) return 0;
+    close(*logFile);
+    *logFile = openShardFile(HISTORY_DB, shard, O_RDWR | O_CREAT);
+    return *logFile != -1;
+}
+
+// base backup of one shard's log: manifest, segments, then the active log. a read lock on
+// the active log holds off a seal until the copy is done
+int copyLogSegments(int shard, const char *destDir)
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments;
+    char path[SHARD_PATH_SIZE];
+    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, getpid()};
+    int count, activeFD;
+
+    while (1) {
+        activeFD = openShardFile(HISTORY_DB, shard, O_RDONLY);
+        if (activeFD == -1) break;
+        unsigned int generation = historyGeneration(shard);
+        fcntl(activeFD, F_SETLKW, &lock);
+        if (!(generation & 1) && historyGeneration(shard) == generation) break;
+        close(activeFD);
+        usleep(1000);
+    }
+
+    int ok = readSegmentManifest(shard, -1, &header, &segments, &count);
+    if (ok) {
+        shardPath(SEGMENT_MANIFEST_DB, shard, path);
+        ok = copyDatabaseFile(path, destDir);
+    }
+    for (int i = 0; ok && i < count; i++) {
+        // either file, an archive run may be under way
+        segmentFilePath(shard, segments[i].seq, SEGMENT_FILE_FORMAT, path);
+        ok = copyDatabaseFile(path, destDir);
+        segmentFilePath(shard, segments[i].seq, SEGMENT_ARCHIVE_FORMAT, path);
+        ok = ok && copyDatabaseFile(path, destDir);
+    }
+    free(segments);
+    shardPath(HISTORY_DB, shard, path);
+    ok = ok && copyDatabaseFile(path, destDir);
+    if (activeFD != -1) close(activeFD); // copyDatabaseFile's close already dropped the lock
+    return ok;
+}
+
+// finish what a crash cut short: a seal renamed but not in the manifest, an archive not
+// in the manifest or whose .dat is still there
+void recoverLogSegments()
+{
+    struct SegmentManifestHeader header;
+    struct LogSegment *segments;
+    char path[SHARD_PATH_SIZE];
+    int count;
+
+    if (getReadPathRegion() == NULL) return;
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        if (!readSegmentManifest(shard, -1, &header, &segments, &count)) continue;
+        for (int i = 0; i < count; i++) {
+            segmentFilePath(shard, segments[i].seq, SEGMENT_ARCHIVE_FORMAT, path);
+            if (segments[i].state == SEGMENT_SEALED) {
+                strcat(path, ".tmp");
+                unlink(path);
+            } else {
+                segmentFilePath(shard, segments[i].seq, SEGMENT_FILE_FORMAT, path);
+                if (unlink(path) == 0) printf("Segments: removed archived segment %d of shard %d\n", segments[i].seq, shard);
+            }
+        }
+        free(segments);
+
+        segmentFilePath(shard, header.activeSeq, SEGMENT_FILE_FORMAT, path);
+        int sealedFile = open(path, O_RDWR);
+        if (sealedFile == -1) continue;
+        // seal the renamed file again under its own name, the manifest entry is what was missing
+        char activePath[SHARD_PATH_SIZE];
+        shardPath(HISTORY_DB, shard, activePath);
+        int activeFile = openShardFile(HISTORY_DB, shard, O_RDONLY);
+        off_t activeSize = activeFile == -1 ? 0 : lseek(activeFile, 0, SEEK_END);
+        if (activeFile != -1) close(activeFile);
+        if (activeSize == 0 && rename(path, activePath) == 0 && sealActiveSegment(shard, sealedFile) == header.activeSeq) {
+            printf("Segments: finished sealing segment %d of shard %d\n", header.activeSeq, shard);
+        } else {
+            printf("Segments: %s is not in the manifest and the active log is not empty, left alone\n", path);
+        }
+        close(sealedFile);
+    }
+}
+
+// the maintainer: seals and archives every SEGMENT_CHECK_SECONDS, exits once the server
+// that started it is gone
+void startLogMaintainer(int serverSocketFD)
+{
+    if (getReadPathRegion() == NULL) {
+        printf("Segments: no shared memory, transaction logs are not rotated\n");
+        return;
+    }
+
+    pid_t serverPid = getpid();
+    logMaintainerPid = fork();
+    if (logMaintainerPid < 0) {
+        perror("Segments: maintainer fork failed, transaction logs are not rotated");
+        logMaintainerPid = 0;
+        return;
+    }
+    if (logMaintainerPid > 0) return;
+
+    close(serverSocketFD);
+    setupSignalHandlers(); // a prefork pool restarts helpers after installing its own
+    printf("Log maintainer started. Process ID: %d\n", getpid());
+    while (getppid() == serverPid) {
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            rotateLogSegment(shard);
+            archiveExpiredSegments(shard);
+        }
+        sleep(SEGMENT_CHECK_SECONDS);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+#endif
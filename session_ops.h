@@ -0,0 +1,300 @@
+#ifndef SESSION_OPS_H
+#define SESSION_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/random.h>
+
+// Resumable sessions. A successful login gets a token, which the client keeps. If the
+// connection drops, the client reconnects and sends "resume <token>" at the login menu
+// and lands back in its menu without logging in again. Sessions live in a shared table;
+// the token starts with its slot number, so a resume is one slot lookup. The rest of
+// the token is a random secret. Logout, exit and password changes revoke the token. A
+// dropped connection only detaches it, and it can be resumed until it expires. A resume
+// goes through the same gates as a login. It takes the session semaphore, so a user who
+// logged in again elsewhere in the meantime can't be resumed twice. It counts against
+// the role quota (admission_ops.h). It re-reads the account or employee record, so a
+// deactivated customer or an employee whose role changed has to log in again;
+// deactivation and role changes revoke every token of that ID anyway.
+
+#define SESSION_REGION "sessions"
+#define SESSION_SLOTS 4096
+#define SESSION_SECRET_BYTES 14
+#define SESSION_TOKEN_LENGTH (4 + SESSION_SECRET_BYTES * 2) // hex slot, hex secret
+#define SESSION_TTL 1800 // seconds, renewed on every resume
+
+#define SESSION_CUSTOMER 1
+#define SESSION_EMPLOYEE 2
+#define SESSION_MANAGER 3
+#define SESSION_ADMIN 4
+
+struct SessionEntry {
+    int kind;             // 0 = free
+    int id;
+    long long expiresAt;
+    int ownerPid;         // process serving it, 0 = detached
+    unsigned char secret[SESSION_SECRET_BYTES];
+};
+
+struct SessionRegion {
+    int lockOwner; // pid, 0 = free
+    int nextSlot;
+    struct SessionEntry entries[SESSION_SLOTS];
+};
+
+struct SessionRegion *sessionRegion = NULL;
+char sessionToken[SESSION_TOKEN_LENGTH + 1]; // this connection's token, "" = none
+int resumedKind = 0, resumedID = 0; // handed from resumeSession to the role's handler
+
+struct SessionRegion *getSessionTable();
+void resetSessionTable();
+int issueSessionToken(int kind, int id);
+struct SessionEntry *currentSessionEntry(struct SessionRegion *sessions);
+void revokeSessionToken();
+void revokeSessionsFor(int kind, int id);
+void detachSession();
+int resumeSession(int clientSocket, const char *token);
+int takeResumedSession(int kind, int *id);
+void sendLoginSuccess(int clientSocket, int kind, int id);
+off_t readAccountSnapshot(int dbFile, int accountID, struct AccountHolder *account); // record_ops.h
+int admitRole(int clientSocket, int role); // admission_ops.h
+
+// NULL means shared memory is unavailable and sessions can't be resumed
+struct SessionRegion *getSessionTable()
+{
+    if (sessionRegion == NULL) {
+        sessionRegion = attachSharedRegion(SESSION_REGION, sizeof(struct SessionRegion), NULL);
+    }
+    return sessionRegion;
+}
+
+void resetSessionTable()
+{
+    resetSharedRegion(SESSION_REGION);
+    sessionRegion = NULL;
+    getSessionTable();
+}
+
+// a slot is reusable once it is free or expired and nobody is serving it
+static int sessionSlotFree(struct SessionEntry *entry, long long now)
+{
+    if (entry->kind == 0) return 1;
+    if (entry->expiresAt > now) return 0;
+    return entry->ownerPid == 0 || (kill(entry->ownerPid, 0) == -1 && errno == ESRCH);
+}
+
+// fills sessionToken, returns 0 if the table is unavailable or full
+int issueSessionToken(int kind, int id)
+{
+    unsigned char secret[SESSION_SECRET_BYTES];
+    struct SessionRegion *sessions = getSessionTable();
+    long long now = time(NULL);
+    sessionToken[0] = '\0';
+    if (sessions == NULL || getrandom(secret, sizeof(secret), 0) != sizeof(secret)) return 0;
+
+    lockSharedRegion(&sessions->lockOwner);
+    int slot = -1;
+    for (int probe = 0; probe < SESSION_SLOTS && slot == -1; probe++) {
+        int candidate = (sessions->nextSlot + probe) % SESSION_SLOTS;
+        if (sessionSlotFree(&sessions->entries[candidate], now)) slot = candidate;
+    }
+    if (slot != -1) {
+        struct SessionEntry *entry = &sessions->entries[slot];
+        entry->kind = kind;
+        entry->id = id;
+        entry->expiresAt = now + SESSION_TTL;
+        entry->ownerPid = getpid();
+        memcpy(entry->secret, secret, sizeof(secret));
+        sessions->nextSlot = (slot + 1) % SESSION_SLOTS;
+    }
+    unlockSharedRegion(&sessions->lockOwner);
+    if (slot == -1) {
+        printf("Sessions: table full, no resume token issued\n");
+        return 0;
+    }
+
+    sprintf(sessionToken, "%04x", slot);
+    for (int i = 0; i < SESSION_SECRET_BYTES; i++) sprintf(sessionToken + 4 + i * 2, "%02x", secret[i]);
+    return 1;
+}
+
+// the entry for sessionToken if it is still the one we were given, caller holds the lock
+struct SessionEntry *currentSessionEntry(struct SessionRegion *sessions)
+{
+    unsigned char secret[SESSION_SECRET_BYTES];
+    unsigned int slot, byte;
+    if (sessionToken[0] == '\0' || sscanf(sessionToken, "%4x", &slot) != 1 || slot >= SESSION_SLOTS) return NULL;
+    for (int i = 0; i < SESSION_SECRET_BYTES; i++) {
+        if (sscanf(sessionToken + 4 + i * 2, "%2x", &byte) != 1) return NULL;
+        secret[i] = byte;
+    }
+
+    struct SessionEntry *entry = &sessions->entries[slot];
+    int difference = 0; // same time whichever byte differs
+    for (int i = 0; i < SESSION_SECRET_BYTES; i++) difference |= entry->secret[i] ^ secret[i];
+    return entry->kind != 0 && difference == 0 ? entry : NULL;
+}
+
+// logout, exit or password change: the token is dead
+void revokeSessionToken()
+{
+    struct SessionRegion *sessions = getSessionTable();
+    if (sessions != NULL && sessionToken[0] != '\0') {
+        lockSharedRegion(&sessions->lockOwner);
+        struct SessionEntry *entry = currentSessionEntry(sessions);
+        if (entry != NULL) memset(entry, 0, sizeof(*entry));
+        unlockSharedRegion(&sessions->lockOwner);
+    }
+    sessionToken[0] = '\0';
+}
+
+// deactivation or role change: every token of that ID is dead, wherever it is
+void revokeSessionsFor(int kind, int id)
+{
+    struct SessionRegion *sessions = getSessionTable();
+    if (sessions == NULL) return;
+    lockSharedRegion(&sessions->lockOwner);
+    for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+        struct SessionEntry *entry = &sessions->entries[slot];
+        if (entry->kind == kind && entry->id == id) memset(entry, 0, sizeof(*entry));
+    }
+    unlockSharedRegion(&sessions->lockOwner);
+}
+
+// the checks a login makes past the password: the account is still active, the
+// employee still has the role the session was opened with. admins have no record
+static int sessionStillAllowed(int kind, int id)
+{
+    if (kind == SESSION_CUSTOMER) {
+        struct AccountHolder account;
+        int dbFile = accountHandle(id);
+        return dbFile != -1 && readAccountSnapshot(dbFile, id, &account) != -1 && account.isActive == 1;
+    }
+    if (kind == SESSION_EMPLOYEE || kind == SESSION_MANAGER) {
+        struct Employee employee;
+        int dbFile = databaseHandle(HANDLE_EMPLOYEE, 0);
+        if (dbFile == -1) return 0;
+        lseek(dbFile, 0, SEEK_SET);
+        while (read(dbFile, &employee, sizeof(employee)) == sizeof(employee)) {
+            if (employee.employeeID == id) return employee.roleType == (kind == SESSION_MANAGER ? 0 : 1);
+        }
+        return 0;
+    }
+    return kind == SESSION_ADMIN;
+}
+
+// connection gone: leave the session for a resume
+void detachSession()
+{
+    struct SessionRegion *sessions = getSessionTable();
+    if (sessions != NULL && sessionToken[0] != '\0') {
+        lockSharedRegion(&sessions->lockOwner);
+        struct SessionEntry *entry = currentSessionEntry(sessions);
+        if (entry != NULL && entry->ownerPid == getpid()) entry->ownerPid = 0;
+        unlockSharedRegion(&sessions->lockOwner);
+    }
+    sessionToken[0] = '\0';
+}
+
+// "resume <token>" from the login menu. returns the session kind for the caller to
+// dispatch on, 0 after telling the client why not
+int resumeSession(int clientSocket, const char *token)
+{
+    const char *failure = NULL;
+    struct SessionRegion *sessions = getSessionTable();
+    long long now = time(NULL);
+    int kind = 0, id = 0;
+
+    snprintf(sessionToken, sizeof(sessionToken), "%s", token);
+    sessionToken[strcspn(sessionToken, " \r\n")] = '\0';
+    if (sessions == NULL) {
+        failure = "Sessions can't be resumed right now, please log in.^";
+    } else {
+        lockSharedRegion(&sessions->lockOwner);
+        struct SessionEntry *entry = currentSessionEntry(sessions);
+        if (entry == NULL || entry->expiresAt <= now) {
+            failure = "Session expired or invalid, please log in.^";
+        } else if (entry->ownerPid != 0 && entry->ownerPid != getpid() && !(kill(entry->ownerPid, 0) == -1 && errno == ESRCH)) {
+            failure = "Session is active on another connection.^";
+        } else {
+            entry->ownerPid = getpid();
+            entry->expiresAt = now + SESSION_TTL;
+            kind = entry->kind;
+            id = entry->id;
+        }
+        unlockSharedRegion(&sessions->lockOwner);
+    }
+
+    // outside the table lock, the record reads can wait on file locks
+    if (failure == NULL && !sessionStillAllowed(kind, id)) {
+        failure = "Session is no longer valid, please log in.^";
+        revokeSessionToken();
+    }
+
+    // the role quota counts a resumed session like a login. session kinds are the login
+    // menu's role numbers. admitRole has told the client if not, the token stays resumable
+    if (failure == NULL && !admitRole(clientSocket, kind)) {
+        detachSession();
+        return 0;
+    }
+
+    // the same single login rule as authenticate*, admins have none
+    if (failure == NULL && kind != SESSION_ADMIN) {
+        sessionSemaphore = createSessionLock(id);
+        if (sessionSemaphore == SEM_FAILED) {
+            failure = "Session could not be resumed, please log in.^";
+        } else if (sem_trywait(sessionSemaphore) == -1) {
+            sem_close(sessionSemaphore);
+            failure = "This ID is already logged in elsewhere.^";
+        } else {
+            setupSignalHandlers();
+        }
+        if (failure != NULL) detachSession();
+    }
+
+    bzero(outBuffer, sizeof(outBuffer));
+    if (failure != NULL) {
+        sessionToken[0] = '\0';
+        strcpy(outBuffer, failure);
+        write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+        return 0;
+    }
+
+    printf("Session of %d (kind %d) resumed by process %d\n", id, kind, getpid());
+    enterClientState(CLIENT_STATE_SESSION);
+    resumedKind = kind;
+    resumedID = id;
+    strcpy(outBuffer, "\nSession resumed^");
+    write(clientSocket, outBuffer, strlen(outBuffer)); readClient(clientSocket, inBuffer, 3);
+    return kind;
+}
+
+// called at the top of a role's login; 1 with id set if it is picking up a resumed session
+int takeResumedSession(int kind, int *id)
+{
+    if (resumedKind != kind) return 0;
+    *id = resumedID;
+    resumedKind = resumedID = 0;
+    return 1;
+}
+
+// replaces the plain "Login Successfully" so the client learns its token
+void sendLoginSuccess(int clientSocket, int kind, int id)
+{
+    enterClientState(CLIENT_STATE_SESSION);
+    bzero(outBuffer, sizeof(outBuffer));
+    if (issueSessionToken(kind, id)) sprintf(outBuffer, "\nLogin Successfully\nSession token: %s^", sessionToken);
+    else strcpy(outBuffer, "\nLogin Successfully^");
+    write(clientSocket, outBuffer, strlen(outBuffer));
+    readClient(clientSocket, inBuffer, 3); // ack
+}
+
+#endif
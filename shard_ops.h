@@ -0,0 +1,251 @@
+#ifndef SHARD_OPS_H
+#define SHARD_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Account storage split across ACCOUNT_SHARDS files by hash of the account ID. Each shard
+// has its own account file and transaction log under shard_<n>/, so record locks, file
+// sizes and appends only contend within a shard and a shard directory can be a mount
+// point on its own disk. With one shard the original flat files are used as is.
+// Records never move once written, so a shared memory index maps account ID -> offset
+// instead of scanning the file on every lookup.
+
+#ifndef ACCOUNT_SHARDS
+#define ACCOUNT_SHARDS 1 // build with -DACCOUNT_SHARDS=N to split storage
+#endif
+#define SHARD_DIR_FORMAT "shard_%d"
+#define SHARD_NAME_SIZE 64 // a file name inside a shard directory
+#define SHARD_PATH_SIZE (SHARD_NAME_SIZE + 32) // room for "shard_N/" in front of the name
+#define ACCOUNT_INDEX_REGION "acctindex"
+#define ACCOUNT_INDEX_SLOTS 16384 // per shard, open addressing
+#define PRESHARD_SUFFIX ".presharding" // flat files are renamed to this after migration
+
+struct AccountIndexRegion {
+    // (accountID << 32) | (record number + 1), 0 = empty slot
+    unsigned long long entries[ACCOUNT_SHARDS][ACCOUNT_INDEX_SLOTS];
+};
+
+struct AccountIndexRegion *accountIndexRegion = NULL;
+
+int accountShard(int accountID);
+void shardPath(const char *fileName, int shard, char *path);
+int openShardFile(const char *fileName, int shard, int flags);
+void indexAccount(int accountID, off_t offset);
+off_t findAccountOffset(int dbFile, int accountID);
+off_t scanAccountOffset(int dbFile, int accountID);
+void initAccountIndex(void *region);
+struct AccountIndexRegion *getAccountIndex();
+void resetAccountIndex();
+int migrateToShards();
+
+int accountShard(int accountID)
+{
+    if (ACCOUNT_SHARDS == 1) return 0;
+    return (unsigned int)accountID * 2654435761u % ACCOUNT_SHARDS; // spreads sequential ids
+}
+
+void shardPath(const char *fileName, int shard, char *path)
+{
+    if (ACCOUNT_SHARDS == 1) snprintf(path, SHARD_PATH_SIZE, "%s", fileName);
+    else snprintf(path, SHARD_PATH_SIZE, SHARD_DIR_FORMAT "/%s", shard, fileName);
+}
+
+// mode 0644 when O_CREAT is passed, shard directory created on demand
+int openShardFile(const char *fileName, int shard, int flags)
+{
+    char path[SHARD_PATH_SIZE];
+    if (ACCOUNT_SHARDS > 1 && (flags & O_CREAT)) {
+        char dir[SHARD_PATH_SIZE];
+        snprintf(dir, sizeof(dir), SHARD_DIR_FORMAT, shard);
+        mkdir(dir, 0755);
+    }
+    shardPath(fileName, shard, path);
+    return open(path, flags, 0644);
+}
+
+static unsigned int accountIndexSlot(int accountID)
+{
+    return ((unsigned int)accountID * 2246822519u) % ACCOUNT_INDEX_SLOTS;
+}
+
+// entries are only ever added, a full table just means lookups fall back to scanning
+void indexAccount(int accountID, off_t offset)
+{
+    struct AccountIndexRegion *index = getAccountIndex();
+    if (index == NULL) return;
+
+    unsigned long long *entries = index->entries[accountShard(accountID)];
+    unsigned long long entry = ((unsigned long long)(unsigned int)accountID << 32) |
+                               (unsigned long long)(offset / sizeof(struct AccountHolder) + 1);
+    unsigned int slot = accountIndexSlot(accountID);
+
+    for (int probe = 0; probe < ACCOUNT_INDEX_SLOTS; probe++) {
+        unsigned long long *current = &entries[(slot + probe) % ACCOUNT_INDEX_SLOTS];
+        unsigned long long expected = 0;
+        if (__atomic_compare_exchange_n(current, &expected, entry, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return;
+        if ((int)(expected >> 32) == accountID) return; // already indexed
+    }
+}
+
+// offset of the account's record in dbFile (the account's shard file), or -1
+off_t findAccountOffset(int dbFile, int accountID)
+{
+    struct AccountIndexRegion *index = getAccountIndex();
+    if (index != NULL) {
+        unsigned long long *entries = index->entries[accountShard(accountID)];
+        unsigned int slot = accountIndexSlot(accountID);
+        for (int probe = 0; probe < ACCOUNT_INDEX_SLOTS; probe++) {
+            unsigned long long entry = __atomic_load_n(&entries[(slot + probe) % ACCOUNT_INDEX_SLOTS], __ATOMIC_SEQ_CST);
+            if (entry == 0) break;
+            if ((int)(entry >> 32) == accountID)
+                return (off_t)((entry & 0xffffffffULL) - 1) * sizeof(struct AccountHolder);
+        }
+    }
+
+    // not indexed yet (written by another node, or the table is full): scan and remember
+    off_t offset = scanAccountOffset(dbFile, accountID);
+    if (offset != -1) indexAccount(accountID, offset);
+    return offset;
+}
+
+// the lookup without the index: the shard file front to back
+off_t scanAccountOffset(int dbFile, int accountID)
+{
+    struct AccountHolder account;
+    off_t currentPos = 0;
+    while (pread(dbFile, &account, sizeof(account), currentPos) == sizeof(account)) {
+        if (account.accountID == accountID) return currentPos;
+        currentPos += sizeof(account);
+    }
+    return -1;
+}
+
+void initAccountIndex(void *region)
+{
+    struct AccountHolder account;
+    accountIndexRegion = (struct AccountIndexRegion *)region; // indexAccount below needs it
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+        int dbFile = openShardFile(ACCOUNT_DB, shard, O_RDONLY);
+        if (dbFile == -1) continue;
+        off_t currentPos = 0;
+        while (pread(dbFile, &account, sizeof(account), currentPos) == sizeof(account)) {
+            indexAccount(account.accountID, currentPos);
+            currentPos += sizeof(account);
+        }
+        close(dbFile);
+    }
+}
+
+// NULL means shared memory is unavailable and lookups scan the shard file
+struct AccountIndexRegion *getAccountIndex()
+{
+    if (accountIndexRegion == NULL) {
+        accountIndexRegion = attachSharedRegion(ACCOUNT_INDEX_REGION, sizeof(struct AccountIndexRegion), initAccountIndex);
+    }
+    return accountIndexRegion;
+}
+
+void resetAccountIndex()
+{
+    resetSharedRegion(ACCOUNT_INDEX_REGION);
+    accountIndexRegion = NULL;
+    getAccountIndex();
+}
+
+// first start with ACCOUNT_SHARDS > 1 on an unsharded tree: split the flat account file
+// and log into temp files next to the shards, rename them into place with the account
+// file of shard 0 last, then move the flat files aside. that file is the completion
+// marker, until it exists the flat files stay in use and the split starts over.
+// returns 0 on failure
+int migrateToShards()
+{
+    struct AccountHolder account;
+    struct TransactionLog log;
+    char path[SHARD_PATH_SIZE], tempPath[SHARD_PATH_SIZE], movedPath[SHARD_PATH_SIZE + 16];
+    char tempName[SHARD_NAME_SIZE];
+    int shardFiles[ACCOUNT_SHARDS];
+    struct stat st;
+
+    const char *fileNames[2] = {HISTORY_DB, ACCOUNT_DB}; // account last, see above
+    int recordSizes[2] = {sizeof(log), sizeof(account)};
+    void *records[2] = {&log, &account};
+
+    if (ACCOUNT_SHARDS == 1 || stat(ACCOUNT_DB, &st) == -1) return 1;
+    shardPath(ACCOUNT_DB, 0, path);
+    if (stat(path, &st) == 0) {
+        printf("Sharding: %s exists, the split finished before, moving the flat files aside\n", path);
+        goto shards_move_flat;
+    }
+
+    for (int file = 0; file < 2; file++) {
+        int flatFile = open(fileNames[file], O_RDONLY);
+        if (flatFile == -1) continue;
+
+        snprintf(tempName, sizeof(tempName), "%s.tmp", fileNames[file]);
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            shardFiles[shard] = openShardFile(tempName, shard, O_WRONLY | O_CREAT | O_TRUNC);
+            if (shardFiles[shard] == -1) {
+                perror("Sharding: Error creating shard file");
+                while (shard-- > 0) close(shardFiles[shard]);
+                close(flatFile);
+                return 0;
+            }
+        }
+
+        // both record types start with the account id
+        int moved = 0, ok = 1;
+        ssize_t got;
+        while ((got = read(flatFile, records[file], recordSizes[file])) == recordSizes[file]) {
+            if (write(shardFiles[accountShard(*(int *)records[file])], records[file], recordSizes[file]) != recordSizes[file]) {
+                perror("Sharding: Error writing shard file");
+                ok = 0;
+                break;
+            }
+            moved++;
+        }
+        if (got == -1) {
+            perror("Sharding: Error reading flat file");
+            ok = 0;
+        }
+
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            if (fsync(shardFiles[shard]) == -1) {
+                perror("Sharding: Error syncing shard file");
+                ok = 0;
+            }
+            close(shardFiles[shard]);
+        }
+        close(flatFile);
+        if (!ok) return 0; // the temp files are truncated on the next try
+
+        // shard 0 of the account file goes last and finishes the migration
+        for (int shard = ACCOUNT_SHARDS - 1; shard >= 0; shard--) {
+            shardPath(tempName, shard, tempPath);
+            shardPath(fileNames[file], shard, path);
+            if (rename(tempPath, path) == -1) {
+                perror("Sharding: Error renaming shard file");
+                return 0;
+            }
+        }
+        printf("Sharding: moved %d records of %s into %d shards\n", moved, fileNames[file], ACCOUNT_SHARDS);
+    }
+
+shards_move_flat:
+    for (int file = 0; file < 2; file++) {
+        snprintf(movedPath, sizeof(movedPath), "%s%s", fileNames[file], PRESHARD_SUFFIX);
+        if (rename(fileNames[file], movedPath) == -1 && errno != ENOENT) {
+            perror("Sharding: Error moving the flat file aside");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef SHM_OPS_H
+#define SHM_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define SHM_PREFIX "/bms" // namespace for every shared region, replica swaps it out
+#define SHM_HEADER_SIZE 64 // keeps the region payload cache line aligned
+#define SHM_READY_WAIT_US 2000000 // give up on a region whose creator died mid-init
+
+char shmPrefix[32] = SHM_PREFIX;
+
+struct SharedRegionHeader {
+    int ready; // set once the creator has finished initRegion
+};
+
+void *attachSharedRegion(const char *name, size_t size, void (*initRegion)(void *));
+void resetSharedRegion(const char *name);
+void lockSharedRegion(int *lockOwner);
+void unlockSharedRegion(int *lockOwner);
+
+// map a named shared memory region, creating it on first use.
+// only the creating process runs initRegion; everyone else waits for it to finish
+void *attachSharedRegion(const char *name, size_t size, void (*initRegion)(void *))
+{
+    char fullName[64];
+    size_t totalSize = SHM_HEADER_SIZE + size;
+    int created = 1, waited = 0;
+    struct stat st;
+
+    snprintf(fullName, sizeof(fullName), "%s_%s", shmPrefix, name);
+    int shmFile = shm_open(fullName, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (shmFile == -1 && errno == EEXIST) {
+        created = 0;
+        shmFile = shm_open(fullName, O_RDWR, 0666);
+    }
+    if (shmFile == -1) {
+        perror("attachSharedRegion: shm_open failed");
+        return NULL;
+    }
+
+    if (created) {
+        if (ftruncate(shmFile, totalSize) == -1) { // zero filled
+            perror("attachSharedRegion: ftruncate failed");
+            close(shmFile);
+            shm_unlink(fullName);
+            return NULL;
+        }
+    } else {
+        // creator may not have sized it yet
+        while (fstat(shmFile, &st) == 0 && (size_t)st.st_size < totalSize && waited < SHM_READY_WAIT_US) {
+            usleep(100); waited += 100;
+        }
+        if (waited >= SHM_READY_WAIT_US) {
+            printf("attachSharedRegion: %s never initialized\n", fullName);
+            close(shmFile);
+            return NULL;
+        }
+    }
+
+    char *base = mmap(NULL, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmFile, 0);
+    close(shmFile);
+    if (base == MAP_FAILED) {
+        perror("attachSharedRegion: mmap failed");
+        return NULL;
+    }
+
+    struct SharedRegionHeader *header = (struct SharedRegionHeader *)base;
+    if (created) {
+        if (initRegion) initRegion(base + SHM_HEADER_SIZE);
+        __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+    } else {
+        while (!__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) && waited < SHM_READY_WAIT_US) {
+            usleep(100); waited += 100;
+        }
+        if (waited >= SHM_READY_WAIT_US) {
+            printf("attachSharedRegion: %s never initialized\n", fullName);
+            munmap(base, totalSize);
+            return NULL;
+        }
+    }
+    return base + SHM_HEADER_SIZE;
+}
+
+// drop a region left behind by a previous server run so it gets rebuilt from the files
+void resetSharedRegion(const char *name)
+{
+    char fullName[64];
+    snprintf(fullName, sizeof(fullName), "%s_%s", shmPrefix, name);
+    shm_unlink(fullName);
+}
+
+// spinlock on a pid word inside a shared region, 0 = free. held for a few loads and stores
+// only, and a holder that died without unlocking is detected and replaced
+void lockSharedRegion(int *lockOwner)
+{
+    int self = getpid();
+    while (1) {
+        int owner = 0;
+        if (__atomic_compare_exchange_n(lockOwner, &owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+        if (kill(owner, 0) == -1 && errno == ESRCH &&
+            __atomic_compare_exchange_n(lockOwner, &owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+        sched_yield();
+    }
+}
+
+void unlockSharedRegion(int *lockOwner)
+{
+    __atomic_store_n(lockOwner, 0, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef TIMEOUT_OPS_H
+#define TIMEOUT_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Client read timeouts and dead peer detection. Every read from a client goes through
+// readClient, which waits only as long as the connection's state allows: a little
+// while at the login menu, longer once logged in, and a short time when the read happens
+// while a record lock is held. A read that times out shuts the socket down, and every
+// later read on the connection reports a disconnect at once. The handlers then unwind
+// through their existing disconnect paths. Those release the record locks and the
+// /bms_sem_<id> login lock, and releaseRecordLocks catches anything left once the
+// connection is done. TCP keepalive on accepted sockets turns a peer that vanished
+// without a FIN into a read error instead of a wait for the full timeout.
+//
+// ./server [--login-timeout s] [--idle-timeout s] [--lock-timeout s] [--keepalive idle interval count]
+
+#define CLIENT_STATE_LOGIN 0   // login menu and credentials
+#define CLIENT_STATE_SESSION 1 // logged in
+#define CLIENT_STATE_LOCKED 2  // input read while a record lock is held
+
+#define CLIENT_LOGIN_TIMEOUT 60 // seconds
+#define CLIENT_SESSION_TIMEOUT 600
+#define CLIENT_LOCKED_TIMEOUT 20
+#define KEEPALIVE_IDLE 60 // seconds before the first probe
+#define KEEPALIVE_INTERVAL 10
+#define KEEPALIVE_COUNT 3 // unanswered probes before the peer is dead
+
+int clientTimeouts[3] = {CLIENT_LOGIN_TIMEOUT, CLIENT_SESSION_TIMEOUT, CLIENT_LOCKED_TIMEOUT};
+int keepaliveIdle = KEEPALIVE_IDLE, keepaliveInterval = KEEPALIVE_INTERVAL, keepaliveCount = KEEPALIVE_COUNT;
+int clientState = CLIENT_STATE_LOGIN;
+int appliedTimeout = -1; // what the socket is set to now
+int clientTimedOut = 0;  // sticky for the rest of the connection
+
+const char *clientStateNames[3] = {"at login", "idle in session", "holding a record lock"};
+
+void parseTimeoutOptions(int argc, char *argv[]);
+void configureClientSocket(int clientSocket);
+void enterClientState(int state);
+ssize_t readClient(int clientSocket, void *buffer, size_t length);
+ssize_t readClientLocked(int clientSocket, void *buffer, size_t length);
+void releaseRecordLocks();
+
+void parseTimeoutOptions(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--login-timeout") == 0 && i + 1 < argc) clientTimeouts[CLIENT_STATE_LOGIN] = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc) clientTimeouts[CLIENT_STATE_SESSION] = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lock-timeout") == 0 && i + 1 < argc) clientTimeouts[CLIENT_STATE_LOCKED] = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--keepalive") == 0 && i + 3 < argc) {
+            keepaliveIdle = atoi(argv[++i]);
+            keepaliveInterval = atoi(argv[++i]);
+            keepaliveCount = atoi(argv[++i]);
+        }
+    }
+
+    if (clientTimeouts[CLIENT_STATE_LOGIN] <= 0) clientTimeouts[CLIENT_STATE_LOGIN] = CLIENT_LOGIN_TIMEOUT;
+    if (clientTimeouts[CLIENT_STATE_SESSION] <= 0) clientTimeouts[CLIENT_STATE_SESSION] = CLIENT_SESSION_TIMEOUT;
+    if (clientTimeouts[CLIENT_STATE_LOCKED] <= 0) clientTimeouts[CLIENT_STATE_LOCKED] = CLIENT_LOCKED_TIMEOUT;
+    if (keepaliveIdle <= 0) keepaliveIdle = KEEPALIVE_IDLE;
+    if (keepaliveInterval <= 0) keepaliveInterval = KEEPALIVE_INTERVAL;
+    if (keepaliveCount <= 0) keepaliveCount = KEEPALIVE_COUNT;
+}
+
+// a freshly accepted connection: keepalive on, and no timeout state left from the last
+// connection a prefork worker served
+void configureClientSocket(int clientSocket)
+{
+    int on = 1;
+    if (setsockopt(clientSocket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == -1 ||
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPIDLE, &keepaliveIdle, sizeof(keepaliveIdle)) == -1 ||
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPINTVL, &keepaliveInterval, sizeof(keepaliveInterval)) == -1 ||
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPCNT, &keepaliveCount, sizeof(keepaliveCount)) == -1) {
+        perror("configureClientSocket: keepalive setup failed");
+    }
+    clientState = CLIENT_STATE_LOGIN;
+    appliedTimeout = -1;
+    clientTimedOut = 0;
+}
+
+void enterClientState(int state)
+{
+    clientState = state;
+}
+
+static void applyClientTimeout(int clientSocket, int seconds)
+{
+    if (seconds == appliedTimeout) return;
+    struct timeval timeout = {seconds, 0};
+    // a client that stops reading stalls our writes the same way
+    if (setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        setsockopt(clientSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1) {
+        perror("applyClientTimeout: setsockopt failed");
+        return;
+    }
+    appliedTimeout = seconds;
+}
+
+// read() for client sockets. a timeout reads as a disconnect, now and for the rest of
+// the connection
+ssize_t readClient(int clientSocket, void *buffer, size_t length)
+{
+    if (clientTimedOut) return 0;
+    applyClientTimeout(clientSocket, clientTimeouts[clientState]);
+
+    ssize_t got = read(clientSocket, buffer, length);
+    if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        printf("Client FD %d timed out after %d s %s, closing the connection\n", clientSocket,
+               clientTimeouts[clientState], clientStateNames[clientState]);
+        clientTimedOut = 1;
+        shutdown(clientSocket, SHUT_RDWR);
+        return 0;
+    }
+    return got;
+}
+
+// for input read between taking a record lock and releasing it
+ssize_t readClientLocked(int clientSocket, void *buffer, size_t length)
+{
+    int previous = clientState;
+    clientState = CLIENT_STATE_LOCKED;
+    ssize_t got = readClient(clientSocket, buffer, length);
+    clientState = previous;
+    return got;
+}
+
+// connection over: drop any record lock a handler left behind on its way out. only
+// matters to prefork workers, a session child's locks go when it exits
+void releaseRecordLocks()
+{
+    struct flock unlock = {F_UNLCK, SEEK_SET, 0, 0, getpid()};
+    if (handleCache.ownerPid != getpid()) return;
+    for (int kind = 0; kind < HANDLE_KINDS; kind++) {
+        for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) {
+            if (handleCache.fds[kind][shard] != -1) fcntl(handleCache.fds[kind][shard], F_SETLK, &unlock);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef URING_OPS_H
+#define URING_OPS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+// io_uring storage backend. The account and history handles of every shard are
+// registered with a per-process ring, and a commit (log append + account write-back) goes
+// to the kernel as one linked submission instead of a chain of lseek/write calls. Raw
+// syscalls, no liburing. Anything the ring can't do falls back to the POSIX path:
+// kernels without io_uring, seccomp filters that block it, or a ring setup failure.
+// Sealing a log (segment_ops.h) swaps the history handle, the files are registered
+// again when that happens.
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#define STORAGE_POSIX 0
+#define STORAGE_URING 1
+#define URING_ENTRIES 8 // a commit never has more than a couple of writes in flight
+#define STORAGE_FILE_KINDS 2 // ACCOUNT_DB, HISTORY_DB
+#define STORAGE_BENCH_DIR "bench_data"
+#define STORAGE_BENCH_ITERATIONS 20000
+
+struct StorageWrite {
+    int storageSlot; // from storageSlot()
+    const void *data;
+    int length;
+    off_t offset;
+};
+
+#ifdef HAVE_IO_URING
+struct UringQueue {
+    int ringFD;
+    pid_t ownerPid; // a ring inherited across fork belongs to the parent
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    int filesRegistered;
+    unsigned int historyGenerations[ACCOUNT_SHARDS]; // of the history files registered
+};
+struct UringQueue uringQueue = {-1};
+#endif
+
+int storageBackend = -1; // -1 = not probed yet
+
+int storageSlot(const char *fileName, int shard);
+int storageFile(int slot);
+int setupUringQueue();
+int registerStorageFiles();
+int uringAvailable();
+int probeStorageBackend();
+int submitLinkedWrites(struct StorageWrite *writes, int count);
+int commitAccountUpdate(int dbFile, off_t offset, struct AccountHolder *account, struct TransactionLog *log); // record_ops.h
+int runStorageBenchmark(int iterations);
+
+int storageSlot(const char *fileName, int shard)
+{
+    return (strcmp(fileName, HISTORY_DB) == 0 ? ACCOUNT_SHARDS : 0) + shard;
+}
+
+// cached handle behind a registered file slot
+int storageFile(int slot)
+{
+    return databaseHandle(slot < ACCOUNT_SHARDS ? HANDLE_ACCOUNT : HANDLE_HISTORY, slot % ACCOUNT_SHARDS);
+}
+
+#ifdef HAVE_IO_URING
+int setupUringQueue()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int ringFD = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ringFD == -1) return 0;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) { // pre 5.4 kernels, not worth the extra mapping
+        close(ringFD);
+        return 0;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ringSize = sqSize > cqSize ? sqSize : cqSize;
+    char *ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        close(ringFD);
+        return 0;
+    }
+    struct io_uring_sqe *sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(ring, ringSize);
+        close(ringFD);
+        return 0;
+    }
+
+    uringQueue.ringFD = ringFD;
+    uringQueue.ownerPid = getpid();
+    uringQueue.sqHead = (unsigned *)(ring + params.sq_off.head);
+    uringQueue.sqTail = (unsigned *)(ring + params.sq_off.tail);
+    uringQueue.sqMask = (unsigned *)(ring + params.sq_off.ring_mask);
+    uringQueue.sqArray = (unsigned *)(ring + params.sq_off.array);
+    uringQueue.cqHead = (unsigned *)(ring + params.cq_off.head);
+    uringQueue.cqTail = (unsigned *)(ring + params.cq_off.tail);
+    uringQueue.cqMask = (unsigned *)(ring + params.cq_off.ring_mask);
+    uringQueue.cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    uringQueue.sqes = sqes;
+
+    uringQueue.filesRegistered = 0;
+    registerStorageFiles();
+    return 1;
+}
+
+// register whatever shard files exist; -1 entries stay sparse and fall back to POSIX
+int registerStorageFiles()
+{
+    int registeredFiles[STORAGE_FILE_KINDS * ACCOUNT_SHARDS];
+    if (uringQueue.filesRegistered) syscall(__NR_io_uring_register, uringQueue.ringFD, IORING_UNREGISTER_FILES, NULL, 0);
+    for (int shard = 0; shard < ACCOUNT_SHARDS; shard++) uringQueue.historyGenerations[shard] = historyGeneration(shard);
+    for (int slot = 0; slot < STORAGE_FILE_KINDS * ACCOUNT_SHARDS; slot++) registeredFiles[slot] = storageFile(slot);
+    uringQueue.filesRegistered = syscall(__NR_io_uring_register, uringQueue.ringFD, IORING_REGISTER_FILES,
+                                         registeredFiles, STORAGE_FILE_KINDS * ACCOUNT_SHARDS) == 0;
+    return uringQueue.filesRegistered;
+}
+#else
+int setupUringQueue() { return 0; }
+int registerStorageFiles() { return 0; }
+#endif
+
+int uringAvailable()
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int probeFD = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (probeFD == -1) return 0;
+
+    // the ring existing doesn't mean it can write: ask for the opcode table.
+    // kernels before 5.6 have neither the probe nor IORING_OP_WRITE
+    struct {
+        struct io_uring_probe probe;
+        struct io_uring_probe_op ops[256];
+    } opcodes;
+    memset(&opcodes, 0, sizeof(opcodes));
+    int probed = syscall(__NR_io_uring_register, probeFD, IORING_REGISTER_PROBE, &opcodes, 256) == 0;
+    close(probeFD);
+    if (!probed || opcodes.probe.last_op < IORING_OP_WRITE) return 0;
+    return (params.features & IORING_FEAT_SINGLE_MMAP) != 0 &&
+           (opcodes.ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) != 0;
+#else
+    return 0;
+#endif
+}
+
+// decided once in the server process; workers and forked sessions build their own ring lazily.
+// opt in with BMS_IO_BACKEND=io_uring: for single record writes on buffered files the ring
+// only pays off where --bench-io says so
+int probeStorageBackend()
+{
+    const char *requested = getenv("BMS_IO_BACKEND");
+    storageBackend = STORAGE_POSIX;
+    if (requested != NULL && strcmp(requested, "io_uring") == 0) {
+        if (uringAvailable()) storageBackend = STORAGE_URING;
+        else printf("Storage backend: io_uring requested but unavailable\n");
+    }
+    printf("Storage backend: %s\n", storageBackend == STORAGE_URING ? "io_uring" : "posix");
+    return storageBackend;
+}
+
+// writes run in order as one linked chain; a failure cancels everything after it.
+// returns how many writes completed in full, or -1 if the ring can't take them and
+// the caller should use the POSIX path for all of them
+int submitLinkedWrites(struct StorageWrite *writes, int count)
+{
+#ifdef HAVE_IO_URING
+    if (storageBackend == -1) probeStorageBackend();
+    if (storageBackend != STORAGE_URING || count > URING_ENTRIES) return -1;
+    if (uringQueue.ownerPid != getpid()) {
+        if (uringQueue.ringFD != -1) close(uringQueue.ringFD); // parent's ring, leave its mappings alone
+        uringQueue.ringFD = -1;
+        if (!setupUringQueue()) {
+            storageBackend = STORAGE_POSIX;
+            return -1;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        int shard = writes[i].storageSlot % ACCOUNT_SHARDS;
+        if (writes[i].storageSlot >= ACCOUNT_SHARDS && uringQueue.historyGenerations[shard] != historyGeneration(shard)) {
+            registerStorageFiles(); // a sealed log is still registered
+            break;
+        }
+    }
+    if (!uringQueue.filesRegistered) return -1;
+    for (int i = 0; i < count; i++) {
+        if (storageFile(writes[i].storageSlot) == -1) return -1;
+    }
+
+    unsigned tail = *uringQueue.sqTail;
+    for (int i = 0; i < count; i++) {
+        unsigned index = (tail + i) & *uringQueue.sqMask;
+        struct io_uring_sqe *sqe = &uringQueue.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = writes[i].storageSlot; // index into the registered files
+        sqe->flags = IOSQE_FIXED_FILE | (i < count - 1 ? IOSQE_IO_LINK : 0);
+        sqe->addr = (unsigned long)writes[i].data;
+        sqe->len = writes[i].length;
+        sqe->off = writes[i].offset;
+        sqe->user_data = i;
+        uringQueue.sqArray[index] = index;
+    }
+    __atomic_store_n(uringQueue.sqTail, tail + count, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, uringQueue.ringFD, count, count, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (submitted == -1 && errno == EINTR);
+    if (submitted != count) {
+        perror("submitLinkedWrites: io_uring_enter failed");
+        storageBackend = STORAGE_POSIX; // don't trust the ring state any more
+        return -1;
+    }
+
+    // completions of a linked chain can arrive in any order, collect all of them
+    int completed[URING_ENTRIES] = {0}, reaped = 0;
+    while (reaped < count) {
+        unsigned head = *uringQueue.cqHead;
+        unsigned cqTail = __atomic_load_n(uringQueue.cqTail, __ATOMIC_ACQUIRE);
+        if (head == cqTail) {
+            syscall(__NR_io_uring_enter, uringQueue.ringFD, 0, count - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+            continue;
+        }
+        for (; head != cqTail; head++, reaped++) {
+            struct io_uring_cqe *cqe = &uringQueue.cqes[head & *uringQueue.cqMask];
+            if (cqe->user_data < (unsigned)count) completed[cqe->user_data] = cqe->res == writes[cqe->user_data].length;
+        }
+        __atomic_store_n(uringQueue.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    int done = 0;
+    while (done < count && completed[done]) done++;
+    return done;
+#else
+    (void)writes; (void)count;
+    return -1;
+#endif
+}
+
+// ./server --bench-io [iterations] : the deposit commit path (record lock, read, log append,
+// write-back) on a scratch account, once per backend
+int runStorageBenchmark(int iterations)
+{
+    struct AccountHolder account;
+    struct TransactionLog log;
+    long long elapsed[2] = {0, 0};
+
+    if (iterations <= 0) iterations = STORAGE_BENCH_ITERATIONS;
+    mkdir(STORAGE_BENCH_DIR, 0755);
+    if (chdir(STORAGE_BENCH_DIR) == -1) {
+        perror("Bench: chdir failed");
+        return EXIT_FAILURE;
+    }
+    strcpy(shmPrefix, SHM_PREFIX "_bench");
+    replicaShipDisabled = 1;
+
+    for (int backend = STORAGE_POSIX; backend <= STORAGE_URING; backend++)
+    {
+        // fresh files for each run so both start from the same size
+        memset(&account, 0, sizeof(account));
+        account.accountID = 1;
+        account.isActive = 1;
+        strcpy(account.holderName, "bench");
+        int dbFile = openShardFile(ACCOUNT_DB, accountShard(account.accountID), O_WRONLY | O_CREAT | O_TRUNC);
+        int logFile = openShardFile(HISTORY_DB, accountShard(account.accountID), O_WRONLY | O_CREAT | O_TRUNC);
+        if (dbFile == -1 || logFile == -1) {
+            perror("Bench: Error creating scratch files");
+            return EXIT_FAILURE;
+        }
+        write(dbFile, &account, sizeof(account));
+        close(dbFile);
+        close(logFile);
+        resetHandleCache(); // reopen the cached handles on the new files
+        resetAccountIndex();
+        resetReadPathRegion();
+        dbFile = accountHandle(account.accountID);
+
+#ifdef HAVE_IO_URING
+        if (uringQueue.ringFD != -1) close(uringQueue.ringFD);
+        uringQueue.ringFD = -1;
+        uringQueue.ownerPid = 0;
+#endif
+        if (backend == STORAGE_URING && !uringAvailable()) {
+            printf("Bench: io_uring unavailable, skipping\n");
+            break;
+        }
+        storageBackend = backend;
+
+        long long startedAt = currentMicros();
+        for (int i = 0; i < iterations; i++) {
+            off_t offset = findAccountOffset(dbFile, account.accountID);
+            struct flock lock = {F_WRLCK, SEEK_SET, offset, sizeof(struct AccountHolder), getpid()};
+            fcntl(dbFile, F_SETLKW, &lock);
+            pread(dbFile, &account, sizeof(account), offset);
+            account.currentBalance += 1;
+            bzero(log.logEntry, sizeof(log.logEntry));
+            sprintf(log.logEntry, "1.00 deposited by benchmark iteration %d\n", i);
+            log.accountID = account.accountID;
+            commitAccountUpdate(dbFile, offset, &account, &log);
+            lock.l_type = F_UNLCK;
+            fcntl(dbFile, F_SETLK, &lock);
+        }
+        elapsed[backend] = currentMicros() - startedAt;
+
+        printf("%-8s %d commits in %.1f ms, %.2f us/commit\n", backend == STORAGE_URING ? "io_uring" : "posix",
+               iterations, elapsed[backend] / 1000.0, (double)elapsed[backend] / iterations);
+    }
+    if (elapsed[STORAGE_URING] > 0) {
+        printf("io_uring / posix time: %.2f\n", (double)elapsed[STORAGE_URING] / elapsed[STORAGE_POSIX]);
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif